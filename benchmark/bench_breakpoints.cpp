@@ -0,0 +1,124 @@
+/**
+ * @file bench_breakpoints.cpp
+ * @brief Measures breakpoint checking cost against the number of breakpoints set
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+
+#include "vm/rvss/rvss_vm.h"
+#include "assembler/assembler.h"
+#include "config.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace {
+
+/// Discards everything written to it, so engine logging costs formatting time but no I/O.
+class NullBuffer : public std::streambuf {
+ protected:
+  int overflow(int c) override { return c; }
+};
+
+constexpr uint64_t kPadding = 10016;      ///< nops appended to the program to carry the breakpoints
+constexpr uint64_t kLookupRounds = 2000;  ///< passes over every text address in the lookup measurement
+
+/// Breakpoints on the last count padding slots, which the loop never reaches.
+void SetBreakpoints(VmBase &vm, uint64_t count) {
+  for (uint64_t i = 0; i < count; ++i) {
+    vm.AddBreakpoint(vm.program_size_ - 4 * (i + 1), false);
+  }
+}
+
+/// Nanoseconds per CheckBreakpoint, and per lookup with the linear scan it replaced.
+void MeasureLookup(const VmBase &vm, double &bitmap_ns, double &scan_ns) {
+  uint64_t hits = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t round = 0; round < kLookupRounds; ++round) {
+    for (uint64_t address = 0; address < vm.program_size_; address += 4) {
+      hits += vm.CheckBreakpoint(address);
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  uint64_t lookups = kLookupRounds * (vm.program_size_ / 4);
+  bitmap_ns = std::chrono::duration<double, std::nano>(end - start).count() / static_cast<double>(lookups);
+
+  // The scan is much slower with many breakpoints, so it gets fewer rounds.
+  const std::vector<uint64_t> &list = vm.breakpoints_;
+  uint64_t scan_rounds = std::max<uint64_t>(1, kLookupRounds / (1 + list.size() / 10));
+  start = std::chrono::steady_clock::now();
+  for (uint64_t round = 0; round < scan_rounds; ++round) {
+    for (uint64_t address = 0; address < vm.program_size_; address += 4) {
+      hits += std::find(list.begin(), list.end(), address) != list.end();
+    }
+  }
+  end = std::chrono::steady_clock::now();
+  lookups = scan_rounds * (vm.program_size_ / 4);
+  scan_ns = std::chrono::duration<double, std::nano>(end - start).count() / static_cast<double>(lookups);
+
+  if (hits == 0 && !list.empty()) {
+    std::cerr << "breakpoints were not found" << std::endl;
+  }
+}
+
+void RunWithBreakpoints(uint64_t count, const AssembledProgram &program) {
+  RVSSVM vm;
+  NullBuffer null_buffer;
+  std::streambuf *original = std::cout.rdbuf(&null_buffer);
+  vm.LoadProgram(program);
+  SetBreakpoints(vm, count);
+
+  // StepN checks breakpoints in front of every instruction and only dumps once.
+  auto start = std::chrono::steady_clock::now();
+  vm.StepN(UINT64_MAX);
+  auto end = std::chrono::steady_clock::now();
+  std::cout.rdbuf(original);
+  std::cout.flags(std::ios::fmtflags{});
+
+  double bitmap_ns = 0;
+  double scan_ns = 0;
+  MeasureLookup(vm, bitmap_ns, scan_ns);
+
+  double seconds = std::chrono::duration<double>(end - start).count();
+  double mips = static_cast<double>(vm.instructions_retired_) / seconds / 1e6;
+  std::cout << std::right << std::setw(12) << count
+            << std::setw(14) << vm.instructions_retired_
+            << std::setw(12) << std::fixed << std::setprecision(3) << seconds
+            << std::setw(10) << std::setprecision(2) << mips
+            << std::setw(14) << std::setprecision(2) << bitmap_ns
+            << std::setw(14) << std::setprecision(2) << scan_ns << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::string program_path = std::string(BENCHMARK_PROGRAMS_DIR) + "/engine_loop.s";
+  if (argc > 1) {
+    program_path = argv[1];
+  }
+
+  setupVmStateDirectory();
+  vm_config::config.setStepUndoGranularity(vm_config::StepUndoGranularity::BATCH);
+
+  AssembledProgram program = assemble(program_path);
+  for (uint64_t i = 0; i < kPadding; ++i) {
+    program.text_buffer.push_back(0x00000013); // addi x0, x0, 0
+  }
+
+  std::cout << std::right << std::setw(12) << "breakpoints"
+            << std::setw(14) << "instructions"
+            << std::setw(12) << "seconds"
+            << std::setw(10) << "MIPS"
+            << std::setw(14) << "ns/check"
+            << std::setw(14) << "ns/scan" << std::endl;
+  for (uint64_t count : {0, 10, 10000}) {
+    RunWithBreakpoints(count, program);
+  }
+  return 0;
+}
@@ -0,0 +1,161 @@
+/**
+ * @file bench_cache.cpp
+ * @brief Measures simulated accesses per second through a 32 KB 8-way L1 data cache, and
+ * the cost and scan resistance of each replacement policy in a 2 MB 16-way last-level cache
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+
+#include "vm/cache/cache.h"
+#include "vm/main_memory.h"
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr uint64_t kAccesses = 1 << 24; ///< simulated accesses per measurement
+constexpr uint64_t kBase = 0x10000000;  ///< where the data section starts
+
+/// Addresses of kAccesses doubleword accesses.
+struct Pattern {
+  std::string name;
+  std::vector<uint64_t> addresses;
+};
+
+/// A fixed-seed xorshift, so every run sees the same addresses.
+uint64_t NextRandom(uint64_t &state) {
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+Pattern Sequential(uint64_t footprint) {
+  Pattern pattern{"sequential " + std::to_string(footprint / 1024) + " KB", {}};
+  pattern.addresses.reserve(kAccesses);
+  for (uint64_t i = 0; i < kAccesses; ++i) {
+    pattern.addresses.push_back(kBase + (i * 8) % footprint);
+  }
+  return pattern;
+}
+
+Pattern Random(uint64_t footprint) {
+  Pattern pattern{"random " + std::to_string(footprint / 1024) + " KB", {}};
+  pattern.addresses.reserve(kAccesses);
+  uint64_t state = 0x9E3779B97F4A7C15;
+  for (uint64_t i = 0; i < kAccesses; ++i) {
+    pattern.addresses.push_back(kBase + (NextRandom(state) % footprint & ~uint64_t{7}));
+  }
+  return pattern;
+}
+
+/// A 1 MB working set read twice between passes of a 4 MB scan, a line at a time.
+Pattern WorkingSetWithScan() {
+  Pattern pattern{"1 MB reuse + scan", {}};
+  pattern.addresses.reserve(kAccesses);
+  uint64_t scan = 0;
+  while (pattern.addresses.size() + 2 * (1 << 14) + (1 << 16) <= kAccesses) {
+    for (int pass = 0; pass < 2; ++pass) {
+      for (uint64_t line = 0; line < (1 << 14); ++line) {
+        pattern.addresses.push_back(kBase + line * 64);
+      }
+    }
+    for (uint64_t line = 0; line < (1 << 16); ++line, ++scan) {
+      pattern.addresses.push_back(kBase + (1 << 20) + (scan % (1 << 18)) * 64);
+    }
+  }
+  return pattern;
+}
+
+/// Reads pattern through a fresh 2 MB 16-way timing-only cache under policy.
+void MeasurePolicy(const Pattern &pattern, cache::ReplacementPolicy policy) {
+  Memory memory;
+  cache::CacheConfig config = cache::CacheConfig::FromSizes(2 * 1024 * 1024, 64, 16);
+  config.replacement_policy = policy;
+  config.timing_only = true;
+  cache::Cache cache(config, memory);
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t address : pattern.addresses) {
+    cache.Read(address, 8);
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  double seconds = std::chrono::duration<double>(end - start).count();
+  double rate = static_cast<double>(pattern.addresses.size()) / seconds / 1e6;
+  std::cout << std::left << std::setw(20) << pattern.name
+            << std::setw(8) << cache::ToString(policy)
+            << std::right << std::setw(12) << std::fixed << std::setprecision(3) << seconds
+            << std::setw(14) << std::setprecision(2) << rate
+            << std::setw(12) << std::setprecision(2) << 100.0 * cache.GetStats().HitRate()
+            << std::setw(14) << cache.GetStats().replacement_misses << std::endl;
+}
+
+/// Runs pattern through a fresh cache, every fourth access a store.
+void Measure(const Pattern &pattern, bool timing_only) {
+  Memory memory;
+  cache::CacheConfig config = cache::CacheConfig::FromSizes(32 * 1024, 64, 8);
+  config.write_miss_policy = cache::WriteMissPolicy::WriteAllocate;
+  config.timing_only = timing_only;
+  cache::Cache cache(config, memory);
+
+  uint64_t checksum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < pattern.addresses.size(); ++i) {
+    if (i % 4 == 3) {
+      cache.Write(pattern.addresses[i], i, 8);
+    } else {
+      checksum += cache.Read(pattern.addresses[i], 8);
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  double seconds = std::chrono::duration<double>(end - start).count();
+  double rate = static_cast<double>(pattern.addresses.size()) / seconds / 1e6;
+  std::cout << std::left << std::setw(20) << pattern.name
+            << std::setw(8) << (timing_only ? "timing" : "data")
+            << std::right << std::setw(12) << std::fixed << std::setprecision(3) << seconds
+            << std::setw(14) << std::setprecision(2) << rate
+            << std::setw(12) << std::setprecision(2) << 100.0 * cache.GetStats().HitRate()
+            << std::setw(12) << cache.GetStats().writebacks << std::endl;
+  if (checksum == 1) {
+    std::cerr << "unexpected checksum" << std::endl;
+  }
+}
+
+} // namespace
+
+int main() {
+  const std::vector<Pattern> patterns = {
+      Sequential(16 * 1024), Sequential(1024 * 1024), Random(16 * 1024), Random(256 * 1024)};
+
+  std::cout << std::left << std::setw(20) << "pattern"
+            << std::setw(8) << "mode"
+            << std::right << std::setw(12) << "seconds"
+            << std::setw(14) << "Maccesses/s"
+            << std::setw(12) << "hit rate %"
+            << std::setw(12) << "writebacks" << std::endl;
+  for (const Pattern &pattern : patterns) {
+    Measure(pattern, false);
+    Measure(pattern, true);
+  }
+
+  std::cout << std::endl << std::left << std::setw(20) << "pattern"
+            << std::setw(8) << "policy"
+            << std::right << std::setw(12) << "seconds"
+            << std::setw(14) << "Maccesses/s"
+            << std::setw(12) << "hit rate %"
+            << std::setw(14) << "repl. misses" << std::endl;
+  const Pattern reuse = WorkingSetWithScan();
+  using cache::ReplacementPolicy;
+  for (ReplacementPolicy policy : {ReplacementPolicy::LRU, ReplacementPolicy::PLRU, ReplacementPolicy::LIP,
+                                   ReplacementPolicy::BIP, ReplacementPolicy::SRRIP, ReplacementPolicy::BRRIP,
+                                   ReplacementPolicy::DRRIP}) {
+    MeasurePolicy(reuse, policy);
+  }
+  return 0;
+}
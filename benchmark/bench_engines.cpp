@@ -0,0 +1,74 @@
+/**
+ * @file bench_engines.cpp
+ * @brief Compares guest throughput of the single-stage execution engines
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+
+#include "vm/rvss/rvss_vm.h"
+#include "vm/rvss/rvss_threaded_vm.h"
+#include "assembler/assembler.h"
+#include "config.h"
+#include "utils.h"
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <streambuf>
+#include <string>
+
+namespace {
+
+/// Discards everything written to it, so engine logging costs formatting time but no I/O.
+class NullBuffer : public std::streambuf {
+ protected:
+  int overflow(int c) override { return c; }
+};
+
+template <typename Vm>
+void RunEngine(const std::string &name, const AssembledProgram &program) {
+  Vm vm;
+  vm.LoadProgram(program);
+
+  NullBuffer null_buffer;
+  std::streambuf *original = std::cout.rdbuf(&null_buffer);
+  auto start = std::chrono::steady_clock::now();
+  vm.Run();
+  auto end = std::chrono::steady_clock::now();
+  std::cout.rdbuf(original);
+  std::cout.flags(std::ios::fmtflags{}); // engines may leave std::hex behind
+
+  double seconds = std::chrono::duration<double>(end - start).count();
+  double mips = static_cast<double>(vm.instructions_retired_) / seconds / 1e6;
+  std::cout << std::left << std::setw(28) << name
+            << std::right << std::setw(14) << vm.instructions_retired_
+            << std::setw(12) << std::fixed << std::setprecision(3) << seconds
+            << std::setw(12) << std::setprecision(2) << mips
+            << "   a0=0x" << std::hex << vm.registers_.ReadGpr(10) << std::dec << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::string program_path = std::string(BENCHMARK_PROGRAMS_DIR) + "/engine_loop.s";
+  if (argc > 1) {
+    program_path = argv[1];
+  }
+
+  setupVmStateDirectory();
+  vm_config::config.setInstructionExecutionLimit(UINT64_MAX);
+
+  AssembledProgram program = assemble(program_path);
+
+  std::cout << std::left << std::setw(28) << "engine"
+            << std::right << std::setw(14) << "instructions"
+            << std::setw(12) << "seconds"
+            << std::setw(12) << "MIPS" << std::endl;
+  RunEngine<RVSSVM>("single_stage", program);
+  vm_config::config.setJitEnabled(false);
+  RunEngine<RVSSThreadedVM>("single_stage_threaded", program);
+  vm_config::config.setJitEnabled(true);
+  RunEngine<RVSSThreadedVM>("single_stage_threaded+jit", program);
+  return 0;
+}
@@ -0,0 +1,164 @@
+/**
+ * @file bench_memory.cpp
+ * @brief Measures guest loads and stores per second against the sparse, hash-mapped memory
+ * and the flat, mmap-backed one, for sequential and random doubleword accesses, and the
+ * coherent accessors of every width with and without an L1 data cache in front
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+
+#include "config.h"
+#include "vm/main_memory.h"
+#include "vm/memory_controller.h"
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr uint64_t kAccesses = 1 << 24;     ///< simulated accesses per measurement
+constexpr uint64_t kBase = 0x10000000;      ///< where the data section starts
+constexpr uint64_t kMemorySize = 1ULL << 32; ///< small enough for the flat backing
+
+/// Addresses of kAccesses doubleword accesses.
+struct Pattern {
+  std::string name;
+  std::vector<uint64_t> addresses;
+};
+
+/// A fixed-seed xorshift, so every run sees the same addresses.
+uint64_t NextRandom(uint64_t &state) {
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+Pattern Sequential(uint64_t footprint) {
+  Pattern pattern{"sequential " + std::to_string(footprint / 1024) + " KB", {}};
+  pattern.addresses.reserve(kAccesses);
+  for (uint64_t i = 0; i < kAccesses; ++i) {
+    pattern.addresses.push_back(kBase + (i * 8) % footprint);
+  }
+  return pattern;
+}
+
+Pattern Random(uint64_t footprint) {
+  Pattern pattern{"random " + std::to_string(footprint / 1024) + " KB", {}};
+  pattern.addresses.reserve(kAccesses);
+  uint64_t state = 0x9E3779B97F4A7C15;
+  for (uint64_t i = 0; i < kAccesses; ++i) {
+    pattern.addresses.push_back(kBase + (NextRandom(state) % footprint & ~uint64_t{7}));
+  }
+  return pattern;
+}
+
+/// Runs pattern against a fresh memory with backing, every fourth access a store.
+void Measure(const Pattern &pattern, vm_config::MemoryBacking backing, bool huge_pages) {
+  vm_config::config.setMemoryBacking(backing);
+  vm_config::config.setMemoryHugePages(huge_pages);
+  Memory memory;
+
+  uint64_t checksum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < pattern.addresses.size(); ++i) {
+    if (i % 4 == 3) {
+      memory.TryWrite<uint64_t>(pattern.addresses[i], i);
+    } else {
+      uint64_t value = 0;
+      memory.TryRead<uint64_t>(pattern.addresses[i], value);
+      checksum += value;
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  const char *name = backing == vm_config::MemoryBacking::SPARSE ? "sparse" : huge_pages ? "flat+thp" : "flat";
+  double seconds = std::chrono::duration<double>(end - start).count();
+  double rate = static_cast<double>(pattern.addresses.size()) / seconds / 1e6;
+  std::cout << std::left << std::setw(20) << pattern.name
+            << std::setw(10) << name
+            << std::right << std::setw(12) << std::fixed << std::setprecision(3) << seconds
+            << std::setw(14) << std::setprecision(2) << rate << std::endl;
+  if (checksum == 1) {
+    std::cerr << "unexpected checksum" << std::endl;
+  }
+}
+
+/// Reads and writes a 64 KB window at every T-aligned address through memory, alternately.
+template <typename T, typename Target>
+void MeasureWidth(Target &target, const std::string &name) {
+  constexpr uint64_t kWindow = 64 * 1024;
+  uint64_t checksum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < kAccesses; ++i) {
+    const uint64_t address = kBase + (i * sizeof(T)) % kWindow;
+    if (i % 2) {
+      target.template WriteValue<T>(address, static_cast<T>(i));
+    } else {
+      checksum += target.template ReadValue<T>(address);
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  double seconds = std::chrono::duration<double>(end - start).count();
+  double rate = static_cast<double>(kAccesses) / seconds / 1e6;
+  std::cout << std::left << std::setw(20) << name
+            << std::setw(10) << std::to_string(8 * sizeof(T)) + "-bit"
+            << std::right << std::setw(12) << std::fixed << std::setprecision(3) << seconds
+            << std::setw(14) << std::setprecision(2) << rate << std::endl;
+  if (checksum == 1) {
+    std::cerr << "unexpected checksum" << std::endl;
+  }
+}
+
+template <typename Target>
+void MeasureWidths(Target &target, const std::string &name) {
+  MeasureWidth<uint8_t>(target, name);
+  MeasureWidth<uint16_t>(target, name);
+  MeasureWidth<uint32_t>(target, name);
+  MeasureWidth<uint64_t>(target, name);
+}
+
+} // namespace
+
+int main() {
+  vm_config::config.setMemorySize(kMemorySize);
+  const std::vector<Pattern> patterns = {
+      Sequential(64 * 1024), Sequential(64 * 1024 * 1024), Random(64 * 1024), Random(64 * 1024 * 1024)};
+
+  std::cout << std::left << std::setw(20) << "pattern"
+            << std::setw(10) << "backing"
+            << std::right << std::setw(12) << "seconds"
+            << std::setw(14) << "Maccesses/s" << std::endl;
+  for (const Pattern &pattern : patterns) {
+    Measure(pattern, vm_config::MemoryBacking::SPARSE, false);
+    Measure(pattern, vm_config::MemoryBacking::FLAT, false);
+    Measure(pattern, vm_config::MemoryBacking::FLAT, true);
+  }
+
+  std::cout << std::endl << std::left << std::setw(20) << "accessor"
+            << std::setw(10) << "width"
+            << std::right << std::setw(12) << "seconds"
+            << std::setw(14) << "Maccesses/s" << std::endl;
+  for (auto backing : {vm_config::MemoryBacking::SPARSE, vm_config::MemoryBacking::FLAT}) {
+    vm_config::config.setMemoryBacking(backing);
+    Memory memory;
+    MeasureWidths(memory, backing == vm_config::MemoryBacking::SPARSE ? "memory sparse" : "memory flat");
+  }
+  vm_config::config.setMemoryBacking(vm_config::MemoryBacking::SPARSE);
+  {
+    MemoryController controller;
+    controller.ConfigureCache();
+    MeasureWidths(controller, "controller");
+  }
+  vm_config::config.modifyConfig("Cache", "cache_enabled", "true");
+  {
+    MemoryController controller;
+    controller.ConfigureCache();
+    MeasureWidths(controller, "controller + L1D");
+  }
+  return 0;
+}
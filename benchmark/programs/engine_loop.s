@@ -0,0 +1,24 @@
+# Integer workload used by the execution engine benchmarks:
+# a strided read-modify-write over a 2 KiB buffer mixed with ALU work,
+# a multiply and a data-dependent branch.
+
+.text
+    li t0, 0                # i
+    lui t1, 0x80            # iteration count (0x80000)
+    lui t2, 0x20            # buffer base
+    li a0, 0
+loop:
+    andi t3, t0, 255
+    slli t3, t3, 3
+    add t4, t2, t3
+    ld t5, 0(t4)
+    add t5, t5, t0
+    sd t5, 0(t4)
+    mul t6, t0, t5
+    xor a0, a0, t6
+    andi t3, t0, 3
+    bne t3, zero, skip
+    addi a1, a1, 1
+skip:
+    addi t0, t0, 1
+    blt t0, t1, loop
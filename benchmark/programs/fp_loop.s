@@ -0,0 +1,30 @@
+# Floating-point workload for the engine benchmarks: a single-precision
+# multiply-accumulate over a small buffer plus a double-precision recurrence,
+# all in the dynamic rounding mode, with loads, stores and conversions in between.
+
+.text
+    li t0, 0                # i
+    lui t1, 0x40            # iteration count (0x40000)
+    lui t2, 0x20            # buffer base
+    li t3, 3
+    fcvt.s.w f1, t3         # 3.0f
+    fcvt.d.w f2, t3         # 3.0
+    li t3, 7
+    fcvt.s.w f3, t3         # 7.0f
+    fdiv.s f4, f1, f3       # 3/7
+    fcvt.d.s f5, f4
+loop:
+    andi t3, t0, 63
+    slli t3, t3, 2
+    add t4, t2, t3
+    flw f6, 0(t4)
+    fmul.s f7, f6, f4
+    fadd.s f7, f7, f1
+    fsw f7, 0(t4)
+    fmul.d f8, f5, f2
+    fdiv.d f5, f8, f2
+    fadd.d f9, f9, f5
+    fcvt.w.s a1, f7
+    add a0, a0, a1
+    addi t0, t0, 1
+    blt t0, t1, loop
@@ -22,6 +22,7 @@ enum class CommandType {
   UNDO,
   REDO,
   RESET,
+  CHECKPOINT,
   MODIFY_REGISTER,
   GET_REGISTER,
   MODIFY_MEMORY,
@@ -278,12 +278,12 @@ inline constexpr std::array<InstructionEncoding, static_cast<size_t>(Instruction
 
   
   InstructionEncoding(Instruction::kaddi,       0b0010011, -1, 0b000, -1, -1, -1), // addi
-  InstructionEncoding(Instruction::kslli,       0b0010011, -1, 0b001, -1, -1, 0b0000000), // kslli
+  InstructionEncoding(Instruction::kslli,       0b0010011, -1, 0b001, -1, 0b000000, -1), // kslli, RV64 shamt takes bit 25
   InstructionEncoding(Instruction::kslti,       0b0010011, -1, 0b010, -1, -1, -1), // kslti
   InstructionEncoding(Instruction::ksltiu,      0b0010011, -1, 0b011, -1, -1, -1), // ksltiu
   InstructionEncoding(Instruction::kxori,       0b0010011, -1, 0b100, -1, -1, -1), // kxori
-  InstructionEncoding(Instruction::ksrli,       0b0010011, -1, 0b101, -1, -1, 0b0000000), // ksrli
-  InstructionEncoding(Instruction::ksrai,       0b0010011, -1, 0b101, -1, -1, 0b0100000), // ksrai
+  InstructionEncoding(Instruction::ksrli,       0b0010011, -1, 0b101, -1, 0b000000, -1), // ksrli
+  InstructionEncoding(Instruction::ksrai,       0b0010011, -1, 0b101, -1, 0b010000, -1), // ksrai
   InstructionEncoding(Instruction::kori,        0b0010011, -1, 0b110, -1, -1, -1), // kori
   InstructionEncoding(Instruction::kandi,       0b0010011, -1, 0b111, -1, -1, -1), // kandi
 
@@ -359,7 +359,7 @@ inline constexpr std::array<InstructionEncoding, static_cast<size_t>(Instruction
   InstructionEncoding(Instruction::kflw,        0b0000111, -1, 0b010, -1, -1, -1), // kflw
   InstructionEncoding(Instruction::kfsw,        0b0100111, -1, 0b010, -1, -1, -1), // kfsw
   InstructionEncoding(Instruction::kfld,        0b0000111, -1, 0b011, -1, -1, -1), // kfld
-  InstructionEncoding(Instruction::kfsw,        0b0100111, -1, 0b011, -1, -1, -1), // kfsd
+  InstructionEncoding(Instruction::kfsd,        0b0100111, -1, 0b011, -1, -1, -1), // kfsd
 
 
   InstructionEncoding(Instruction::kfadd_s,     0b1010011, -1, -1, -1, -1, 0b0000000), // kfadd_s
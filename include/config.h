@@ -7,6 +7,9 @@
 #define CONFIG_H
 
 #include "globals.h"
+#include "vm/cache/cache_config.h"
+#include <algorithm>
+#include <cctype>
 #include <string>
 #include <iostream>
 #include <stdexcept>
@@ -21,20 +24,208 @@
 namespace vm_config {
 enum class VmTypes {
   SINGLE_STAGE,
+  SINGLE_STAGE_THREADED,
   MULTI_STAGE
 };
 
+/// How much undo history a multi-instruction step records.
+enum class StepUndoGranularity {
+  INSTRUCTION, ///< One undo entry per instruction, as if stepped one by one.
+  BATCH        ///< One coalesced undo entry for the whole step.
+};
+
+enum class BranchPredictorType {
+  NONE,
+  ALWAYS_NOT_TAKEN,
+  ALWAYS_TAKEN,
+  BTFN,
+  BIMODAL,
+  GSHARE,
+  TOURNAMENT,
+  TAGE
+};
+
+/// How main memory holds guest bytes.
+enum class MemoryBacking {
+  SPARSE, ///< Blocks allocated on first write, found through a hash map
+  FLAT    ///< One mmap reservation of memory_size bytes, paged in on first touch
+};
+
+/// The largest memory_size the flat backing reserves address space for.
+constexpr uint64_t kMaxFlatMemorySize = uint64_t{1} << 40;
+
+/// The smallest jit_code_cache_size, one page.
+constexpr uint64_t kMinJitCodeCacheSize = 4096;
+
+/// The longest branch_prediction_history_length, TAGE keeps this many history bits around.
+constexpr uint64_t kMaxBranchPredictorHistoryLength = 1024;
+
+/// The largest branch_prediction_table_size, every predictor table is allocated up front.
+constexpr uint64_t kMaxBranchPredictorTableSize = uint64_t{1} << 24;
+
+/// One cache as config.ini describes it.
+struct CacheSettings {
+  bool enabled = false;
+  uint64_t size = 32 * 1024; // bytes
+  uint64_t block_size = 64;  // bytes
+  uint64_t associativity = 8;
+  cache::ReplacementPolicy replacement_policy = cache::ReplacementPolicy::LRU;
+  cache::WriteHitPolicy write_hit_policy = cache::WriteHitPolicy::WriteBack;
+  cache::WriteMissPolicy write_miss_policy = cache::WriteMissPolicy::WriteAllocate;
+  uint64_t miss_penalty = 10; // cycles the core waits on each demand miss: the latency of the next level
+  cache::InclusionPolicy inclusion_policy = cache::InclusionPolicy::NINE; // L2 and L3 only
+  cache::PrefetcherConfig prefetcher{}; // none by default
+
+  /// Throws std::invalid_argument if the sizes do not describe a cache.
+  cache::CacheConfig toCacheConfig(cache::CacheType type) const {
+    cache::CacheConfig config = cache::CacheConfig::FromSizes(size, block_size, associativity);
+    config.cache_type = type;
+    config.replacement_policy = replacement_policy;
+    config.write_hit_policy = write_hit_policy;
+    config.write_miss_policy = write_miss_policy;
+    config.miss_penalty = miss_penalty;
+    config.inclusion_policy = inclusion_policy;
+    config.prefetcher = prefetcher;
+    return config;
+  }
+
+  /// Applies one cache_* key; an invalid value or resulting geometry throws and changes nothing.
+  void modify(const std::string &key, const std::string &value) {
+    CacheSettings updated = *this;
+    if (key == "cache_enabled") {
+      if (value == "true") {
+        updated.enabled = true;
+      } else if (value == "false") {
+        updated.enabled = false;
+      } else {
+        throw std::invalid_argument("Unknown value: " + value);
+      }
+    } else if (key == "cache_size") {
+      updated.size = std::stoull(value);
+    } else if (key == "cache_block_size") {
+      updated.block_size = std::stoull(value);
+    } else if (key == "cache_associativity") {
+      updated.associativity = std::stoull(value);
+    } else if (key == "cache_miss_penalty") {
+      updated.miss_penalty = std::stoull(value);
+    } else if (key == "cache_inclusion_policy") {
+      if (value == "nine") {
+        updated.inclusion_policy = cache::InclusionPolicy::NINE;
+      } else if (value == "inclusive") {
+        updated.inclusion_policy = cache::InclusionPolicy::Inclusive;
+      } else if (value == "exclusive") {
+        updated.inclusion_policy = cache::InclusionPolicy::Exclusive;
+      } else {
+        throw std::invalid_argument("Unknown value: " + value);
+      }
+    } else if (key == "cache_replacement_policy") {
+      if (value == "LRU") {
+        updated.replacement_policy = cache::ReplacementPolicy::LRU;
+      } else if (value == "FIFO") {
+        updated.replacement_policy = cache::ReplacementPolicy::FIFO;
+      } else if (value == "Random") {
+        updated.replacement_policy = cache::ReplacementPolicy::Random;
+      } else if (value == "PLRU") {
+        updated.replacement_policy = cache::ReplacementPolicy::PLRU;
+      } else if (value == "LIP") {
+        updated.replacement_policy = cache::ReplacementPolicy::LIP;
+      } else if (value == "BIP") {
+        updated.replacement_policy = cache::ReplacementPolicy::BIP;
+      } else if (value == "SRRIP") {
+        updated.replacement_policy = cache::ReplacementPolicy::SRRIP;
+      } else if (value == "BRRIP") {
+        updated.replacement_policy = cache::ReplacementPolicy::BRRIP;
+      } else if (value == "DRRIP") {
+        updated.replacement_policy = cache::ReplacementPolicy::DRRIP;
+      } else {
+        throw std::invalid_argument("Unknown value: " + value);
+      }
+    } else if (key == "cache_prefetcher") {
+      if (value == "none") {
+        updated.prefetcher.type = cache::PrefetcherType::None;
+      } else if (value == "next_line") {
+        updated.prefetcher.type = cache::PrefetcherType::NextLine;
+      } else if (value == "stride") {
+        updated.prefetcher.type = cache::PrefetcherType::Stride;
+      } else if (value == "stream") {
+        updated.prefetcher.type = cache::PrefetcherType::Stream;
+      } else {
+        throw std::invalid_argument("Unknown value: " + value);
+      }
+    } else if (key == "cache_prefetch_degree") {
+      updated.prefetcher.degree = parsePrefetchCount(value);
+    } else if (key == "cache_prefetch_distance") {
+      updated.prefetcher.distance = parsePrefetchCount(value);
+    } else if (key == "cache_prefetch_table_size") {
+      updated.prefetcher.table_size = parsePrefetchCount(value);
+    } else if (key == "cache_write_hit_policy") {
+      if (value == "write_back") {
+        updated.write_hit_policy = cache::WriteHitPolicy::WriteBack;
+      } else if (value == "write_through") {
+        updated.write_hit_policy = cache::WriteHitPolicy::WriteThrough;
+      } else {
+        throw std::invalid_argument("Unknown value: " + value);
+      }
+    } else if (key == "cache_write_miss_policy") {
+      if (value == "write_allocate") {
+        updated.write_miss_policy = cache::WriteMissPolicy::WriteAllocate;
+      } else if (value == "no_write_allocate") {
+        updated.write_miss_policy = cache::WriteMissPolicy::NoWriteAllocate;
+      } else {
+        throw std::invalid_argument("Unknown value: " + value);
+      }
+    } else {
+      throw std::invalid_argument("Unknown key: " + key);
+    }
+    (void)updated.toCacheConfig(cache::CacheType::Data);
+    *this = updated;
+  }
+
+ private:
+  /// Prefetch degrees, distances and table sizes run from 1 to 64.
+  static unsigned parsePrefetchCount(const std::string &value) {
+    const unsigned long long count = std::stoull(value);
+    if (count < 1 || count > 64) {
+      throw std::invalid_argument("Prefetch degree, distance and table size must be between 1 and 64");
+    }
+    return static_cast<unsigned>(count);
+  }
+};
+
 struct VmConfig {
   VmTypes vm_type = VmTypes::SINGLE_STAGE;
   uint64_t run_step_delay = 300;
+  StepUndoGranularity step_undo_granularity = StepUndoGranularity::INSTRUCTION;
   uint64_t memory_size = 0xffffffffffffffff; // 64-bit address space
   uint64_t memory_block_size = 1024; // 1 KB blocks
+  MemoryBacking memory_backing = MemoryBacking::SPARSE;
+  bool memory_huge_pages = false; // flat backing: ask for transparent huge pages
   uint64_t data_section_start = 0x10000000; // Default start address for data section
   uint64_t text_section_start = 0x0; // Default start address for text section
   uint64_t bss_section_start = 0x11000000; // Default start address for BSS section
 
   uint64_t instruction_execution_limit = 100;
 
+  bool hazard_detection = true; // multi_stage: stall on data hazards the forwarding paths cannot cover
+  bool forwarding = true;       // multi_stage: forward EX/MEM and MEM/WB results into EX
+
+  BranchPredictorType branch_predictor_type = BranchPredictorType::ALWAYS_NOT_TAKEN;
+  uint64_t branch_predictor_table_size = 4096; // entries per table, rounded down to a power of two
+  uint64_t branch_predictor_history_length = 0; // global history bits, 0 for the predictor's default
+  bool branch_predictor_single_stage = false; // also run the predictor alongside the single-stage VM
+
+  CacheSettings data_cache; // [Cache]: the L1 data cache in front of main memory
+  CacheSettings instruction_cache; // [InstructionCache]: the L1 instruction cache on the fetch path
+  CacheSettings l2_cache{.size = 256 * 1024, .associativity = 16, .miss_penalty = 40}; // [L2Cache]: unified, below both L1s
+  CacheSettings l3_cache{.size = 2 * 1024 * 1024, .associativity = 16, .miss_penalty = 100}; // [L3Cache]: unified, below L2
+  bool cache_timing_only = false; // [Cache]: every level tracks tags only and memory keeps the data
+  uint64_t cache_mshrs = 0; // [Cache]: L1D misses outstanding at once, 0 for a blocking L1D
+  uint64_t cache_write_buffer_entries = 0; // [Cache]: L1D write buffer, 0 for a free, unbounded one
+
+  bool jit_enabled = true;
+  uint64_t jit_hot_threshold = 50; // block entries before the threaded engine translates a block
+  uint64_t jit_code_cache_size = 16 * 1024 * 1024; // bytes of translated code before the cache is flushed
+
   bool m_extension_enabled = true;
   bool f_extension_enabled = true;
   bool d_extension_enabled = true;
@@ -53,6 +244,12 @@ struct VmConfig {
   uint64_t getRunStepDelay() const {
     return run_step_delay;
   }
+  void setStepUndoGranularity(StepUndoGranularity granularity) {
+    step_undo_granularity = granularity;
+  }
+  StepUndoGranularity getStepUndoGranularity() const {
+    return step_undo_granularity;
+  }
   void setMemorySize(uint64_t size) {
     memory_size = size;
   }
@@ -65,6 +262,18 @@ struct VmConfig {
   uint64_t getMemoryBlockSize() const {
     return memory_block_size;
   }
+  void setMemoryBacking(MemoryBacking backing) {
+    memory_backing = backing;
+  }
+  MemoryBacking getMemoryBacking() const {
+    return memory_backing;
+  }
+  void setMemoryHugePages(bool enabled) {
+    memory_huge_pages = enabled;
+  }
+  bool getMemoryHugePages() const {
+    return memory_huge_pages;
+  }
   void setDataSectionStart(uint64_t start) {
     data_section_start = start;
   }
@@ -96,6 +305,153 @@ struct VmConfig {
     return instruction_execution_limit;
   }
 
+  void setHazardDetection(bool enabled) {
+    hazard_detection = enabled;
+  }
+
+  bool getHazardDetection() const {
+    return hazard_detection;
+  }
+
+  void setForwarding(bool enabled) {
+    forwarding = enabled;
+  }
+
+  bool getForwarding() const {
+    return forwarding;
+  }
+
+  void setBranchPredictorType(BranchPredictorType type) {
+    branch_predictor_type = type;
+  }
+
+  BranchPredictorType getBranchPredictorType() const {
+    return branch_predictor_type;
+  }
+
+  void setBranchPredictorTableSize(uint64_t size) {
+    branch_predictor_table_size = size;
+  }
+
+  uint64_t getBranchPredictorTableSize() const {
+    return branch_predictor_table_size;
+  }
+
+  void setBranchPredictorHistoryLength(uint64_t length) {
+    branch_predictor_history_length = length;
+  }
+
+  uint64_t getBranchPredictorHistoryLength() const {
+    return branch_predictor_history_length;
+  }
+
+  void setBranchPredictorSingleStage(bool enabled) {
+    branch_predictor_single_stage = enabled;
+  }
+
+  bool getBranchPredictorSingleStage() const {
+    return branch_predictor_single_stage;
+  }
+
+  void setDataCache(const CacheSettings &settings) {
+    data_cache = settings;
+  }
+
+  const CacheSettings &getDataCache() const {
+    return data_cache;
+  }
+
+  void setInstructionCache(const CacheSettings &settings) {
+    instruction_cache = settings;
+  }
+
+  const CacheSettings &getInstructionCache() const {
+    return instruction_cache;
+  }
+
+  void setL2Cache(const CacheSettings &settings) {
+    l2_cache = settings;
+  }
+
+  const CacheSettings &getL2Cache() const {
+    return l2_cache;
+  }
+
+  void setL3Cache(const CacheSettings &settings) {
+    l3_cache = settings;
+  }
+
+  const CacheSettings &getL3Cache() const {
+    return l3_cache;
+  }
+
+  void setCacheTimingOnly(bool timing_only) {
+    cache_timing_only = timing_only;
+  }
+
+  bool getCacheTimingOnly() const {
+    return cache_timing_only;
+  }
+
+  void setCacheMshrs(uint64_t mshrs) {
+    cache_mshrs = mshrs;
+  }
+
+  uint64_t getCacheMshrs() const {
+    return cache_mshrs;
+  }
+
+  void setCacheWriteBufferEntries(uint64_t entries) {
+    cache_write_buffer_entries = entries;
+  }
+
+  uint64_t getCacheWriteBufferEntries() const {
+    return cache_write_buffer_entries;
+  }
+
+  /// Whether every enabled cache has lines at least as large as each enabled cache above it.
+  bool cacheLineSizesNest() const {
+    uint64_t upper = 0;
+    for (const CacheSettings *level : {&instruction_cache, &data_cache}) {
+      if (level->enabled) {
+        upper = std::max(upper, level->block_size);
+      }
+    }
+    for (const CacheSettings *level : {&l2_cache, &l3_cache}) {
+      if (level->enabled) {
+        if (level->block_size < upper) {
+          return false;
+        }
+        upper = level->block_size;
+      }
+    }
+    return true;
+  }
+
+  void setJitEnabled(bool enabled) {
+    jit_enabled = enabled;
+  }
+
+  bool getJitEnabled() const {
+    return jit_enabled;
+  }
+
+  void setJitHotThreshold(uint64_t threshold) {
+    jit_hot_threshold = threshold;
+  }
+
+  uint64_t getJitHotThreshold() const {
+    return jit_hot_threshold;
+  }
+
+  void setJitCodeCacheSize(uint64_t size) {
+    jit_code_cache_size = size;
+  }
+
+  uint64_t getJitCodeCacheSize() const {
+    return jit_code_cache_size;
+  }
+
   void setMExtensionEnabled(bool enabled) {
     m_extension_enabled = enabled;
   }
@@ -125,6 +481,8 @@ struct VmConfig {
       if (key == "processor_type") {
         if (value == "single_stage") {
           setVmType(VmTypes::SINGLE_STAGE);
+        } else if (value == "single_stage_threaded") {
+          setVmType(VmTypes::SINGLE_STAGE_THREADED);
         } else if (value == "multi_stage") {
           setVmType(VmTypes::MULTI_STAGE);
         } else {
@@ -132,8 +490,48 @@ struct VmConfig {
         }
       } else if (key == "run_step_delay") {
         setRunStepDelay(std::stoull(value));
+      } else if (key == "step_undo_granularity") {
+        if (value == "instruction") {
+          setStepUndoGranularity(StepUndoGranularity::INSTRUCTION);
+        } else if (value == "batch") {
+          setStepUndoGranularity(StepUndoGranularity::BATCH);
+        } else {
+          throw std::invalid_argument("Unknown value: " + value);
+        }
       } else if (key == "instruction_execution_limit") {
         setInstructionExecutionLimit(std::stoull(value));
+      } else if (key == "hazard_detection") {
+        if (value == "true") {
+          setHazardDetection(true);
+        } else if (value == "false") {
+          setHazardDetection(false);
+        } else {
+          throw std::invalid_argument("Unknown value: " + value);
+        }
+      } else if (key == "forwarding") {
+        if (value == "true") {
+          setForwarding(true);
+        } else if (value == "false") {
+          setForwarding(false);
+        } else {
+          throw std::invalid_argument("Unknown value: " + value);
+        }
+      } else if (key == "jit_enabled") {
+        if (value == "true") {
+          setJitEnabled(true);
+        } else if (value == "false") {
+          setJitEnabled(false);
+        } else {
+          throw std::invalid_argument("Unknown value: " + value);
+        }
+      } else if (key == "jit_hot_threshold") {
+        setJitHotThreshold(std::stoull(value));
+      } else if (key == "jit_code_cache_size") {
+        uint64_t size = std::stoull(value);
+        if (size < kMinJitCodeCacheSize) {
+          throw std::invalid_argument("JIT code cache must hold at least " + std::to_string(kMinJitCodeCacheSize) + " bytes");
+        }
+        setJitCodeCacheSize(size);
       }
       
       else {
@@ -141,9 +539,33 @@ struct VmConfig {
       }
     } else if (section == "Memory") {
       if (key == "memory_size") {
-        setMemorySize(std::stoull(value));
+        uint64_t size = parseMemorySize(value);
+        if (memory_backing == MemoryBacking::FLAT && size > kMaxFlatMemorySize) {
+          throw std::invalid_argument("Flat memory holds at most " + std::to_string(kMaxFlatMemorySize) + " bytes");
+        }
+        setMemorySize(size);
       } else if (key == "memory_block_size") {
         setMemoryBlockSize(std::stoull(value));
+      } else if (key == "memory_backing") {
+        if (value == "sparse") {
+          setMemoryBacking(MemoryBacking::SPARSE);
+        } else if (value == "flat") {
+          if (memory_size > kMaxFlatMemorySize) {
+            throw std::invalid_argument("Flat memory holds at most " + std::to_string(kMaxFlatMemorySize)
+                                        + " bytes; lower memory_size first");
+          }
+          setMemoryBacking(MemoryBacking::FLAT);
+        } else {
+          throw std::invalid_argument("Unknown value: " + value);
+        }
+      } else if (key == "memory_huge_pages") {
+        if (value == "true") {
+          setMemoryHugePages(true);
+        } else if (value == "false") {
+          setMemoryHugePages(false);
+        } else {
+          throw std::invalid_argument("Unknown value: " + value);
+        }
       } else if (key == "data_section_start") {
         setDataSectionStart(std::stoull(value, nullptr, 16));
       } else if (key == "text_section_start") {
@@ -159,6 +581,91 @@ struct VmConfig {
       }
     } 
 
+    else if (section == "Cache" && key == "cache_timing_only") {
+      if (value == "true") {
+        setCacheTimingOnly(true);
+      } else if (value == "false") {
+        setCacheTimingOnly(false);
+      } else {
+        throw std::invalid_argument("Unknown value: " + value);
+      }
+    }
+
+    else if (section == "Cache" && (key == "cache_mshrs" || key == "cache_write_buffer_entries")) {
+      const uint64_t count = std::stoull(value);
+      if (count > 64) {
+        throw std::invalid_argument("MSHRs and write buffer entries cannot exceed 64");
+      }
+      if (key == "cache_mshrs") {
+        setCacheMshrs(count);
+      } else {
+        setCacheWriteBufferEntries(count);
+      }
+    }
+
+    else if (section == "Cache" || section == "InstructionCache" || section == "L2Cache" || section == "L3Cache") {
+      CacheSettings &settings = section == "Cache" ? data_cache
+                              : section == "InstructionCache" ? instruction_cache
+                              : section == "L2Cache" ? l2_cache : l3_cache;
+      const CacheSettings previous = settings;
+      settings.modify(key, value);
+      if (!cacheLineSizesNest()) {
+        settings = previous;
+        throw std::invalid_argument("A cache's block size cannot be smaller than that of a cache above it");
+      }
+    }
+
+    else if (section == "BranchPrediction") {
+      if (key == "branch_prediction_type") {
+        if (value == "none") {
+          setBranchPredictorType(BranchPredictorType::NONE);
+        } else if (value == "always_not_taken") {
+          setBranchPredictorType(BranchPredictorType::ALWAYS_NOT_TAKEN);
+        } else if (value == "always_taken") {
+          setBranchPredictorType(BranchPredictorType::ALWAYS_TAKEN);
+        } else if (value == "btfn") {
+          setBranchPredictorType(BranchPredictorType::BTFN);
+        } else if (value == "bimodal") {
+          setBranchPredictorType(BranchPredictorType::BIMODAL);
+        } else if (value == "gshare") {
+          setBranchPredictorType(BranchPredictorType::GSHARE);
+        } else if (value == "tournament") {
+          setBranchPredictorType(BranchPredictorType::TOURNAMENT);
+        } else if (value == "tage") {
+          setBranchPredictorType(BranchPredictorType::TAGE);
+        } else {
+          throw std::invalid_argument("Unknown value: " + value);
+        }
+      } else if (key == "branch_prediction_table_size") {
+        uint64_t size = std::stoull(value);
+        if (size == 0) {
+          throw std::invalid_argument("Table size must be positive: " + value);
+        }
+        if (size > kMaxBranchPredictorTableSize) {
+          throw std::invalid_argument("Table size must be at most "
+                                      + std::to_string(kMaxBranchPredictorTableSize) + ": " + value);
+        }
+        setBranchPredictorTableSize(size);
+      } else if (key == "branch_prediction_history_length") {
+        uint64_t length = std::stoull(value);
+        if (length > kMaxBranchPredictorHistoryLength) {
+          throw std::invalid_argument("History length must be at most "
+                                      + std::to_string(kMaxBranchPredictorHistoryLength) + ": " + value);
+        }
+        setBranchPredictorHistoryLength(length);
+      } else if (key == "branch_prediction_single_stage") {
+        if (value == "true") {
+          setBranchPredictorSingleStage(true);
+        } else if (value == "false") {
+          setBranchPredictorSingleStage(false);
+        } else {
+          throw std::invalid_argument("Unknown value: " + value);
+        }
+      } else {
+        throw std::invalid_argument("Unknown key: " + key);
+      }
+    }
+
     else if (section == "Assembler") {
       if (key == "m_extension_enabled") {
         if (value == "true") {
@@ -191,7 +698,17 @@ struct VmConfig {
     }
   }
 
-
+ private:
+  /// Hex with a 0x prefix, as config.ini writes it, and decimal otherwise; a leading zero is not octal.
+  static uint64_t parseMemorySize(const std::string &value) {
+    const bool hex = value.size() > 2 && value[0] == '0' && (value[1] == 'x' || value[1] == 'X');
+    const std::string digits = hex ? value.substr(2) : value;
+    const auto is_digit = [hex](unsigned char c) { return hex ? std::isxdigit(c) != 0 : std::isdigit(c) != 0; };
+    if (digits.empty() || !std::all_of(digits.begin(), digits.end(), is_digit)) {
+      throw std::invalid_argument("Invalid memory size: " + value);
+    }
+    return std::stoull(digits, nullptr, hex ? 16 : 10);
+  }
 };
 
 extern VmConfig config;
@@ -207,6 +207,29 @@ inline std::ostream& operator<<(std::ostream& os, const AluOp& op) {
     }
     return os;
 }
+/**
+ * @brief Whether the result of a floating-point op depends on the rounding mode.
+ *
+ * Moves, sign injection, min/max, compares, classification and the address arithmetic
+ * of FP loads and stores never round, so they leave the host rounding mode alone.
+ */
+constexpr bool UsesRoundingMode(AluOp op) {
+    switch (op) {
+        case AluOp::kFmadd_s: case AluOp::kFmsub_s: case AluOp::kFnmadd_s: case AluOp::kFnmsub_s:
+        case AluOp::FADD_S: case AluOp::FSUB_S: case AluOp::FMUL_S: case AluOp::FDIV_S: case AluOp::FSQRT_S:
+        case AluOp::FCVT_W_S: case AluOp::FCVT_WU_S: case AluOp::FCVT_L_S: case AluOp::FCVT_LU_S:
+        case AluOp::FCVT_S_W: case AluOp::FCVT_S_WU: case AluOp::FCVT_S_L: case AluOp::FCVT_S_LU:
+        case AluOp::FMADD_D: case AluOp::FMSUB_D: case AluOp::FNMADD_D: case AluOp::FNMSUB_D:
+        case AluOp::FADD_D: case AluOp::FSUB_D: case AluOp::FMUL_D: case AluOp::FDIV_D: case AluOp::FSQRT_D:
+        case AluOp::FCVT_W_D: case AluOp::FCVT_WU_D: case AluOp::FCVT_L_D: case AluOp::FCVT_LU_D:
+        case AluOp::FCVT_D_W: case AluOp::FCVT_D_WU: case AluOp::FCVT_D_L: case AluOp::FCVT_D_LU:
+        case AluOp::FCVT_S_D:
+            return true;
+        default:
+            return false;
+    }
+}
+
 /**
  * @brief The alu class is responsible for performing arithmetic and logic operations.
  */
@@ -232,10 +255,29 @@ public:
 
     // TODO: check all the floating point operations
 
+    /**
+     * @brief Executes a single-precision operation in a private host environment.
+     *
+     * Sets the host rounding mode for rm, clears and reads back the host flags and
+     * restores the original mode, all around this one operation.
+     * @return A pair (result, fflags raised by the operation).
+     */
     [[nodiscard]] static std::pair<uint64_t, uint8_t> fpexecute(AluOp op, uint64_t ina, uint64_t inb, uint64_t inc, uint8_t rm) ;
 
     [[nodiscard]] static std::pair<uint64_t, bool> dfpexecute(AluOp op, uint64_t ina, uint64_t inb, uint64_t inc, uint8_t rm) ;
 
+    /**
+     * @brief Executes a single-precision operation in whatever host environment is current.
+     *
+     * Rounds in the current host rounding mode and leaves host-raised flags in the host
+     * status word, see FpEnvironment.
+     * @return A pair (result, fflags raised in software rather than by the host).
+     */
+    [[nodiscard]] static std::pair<uint64_t, uint8_t> fpcompute(AluOp op, uint64_t ina, uint64_t inb, uint64_t inc) ;
+
+    /// Double-precision counterpart of fpcompute().
+    [[nodiscard]] static std::pair<uint64_t, uint8_t> dfpcompute(AluOp op, uint64_t ina, uint64_t inb, uint64_t inc) ;
+
     void setFlags(bool carry, bool zero, bool negative, bool overflow);
 
 };
@@ -0,0 +1,184 @@
+/**
+ * @file branch_predictor.h
+ * @brief Direction predictors for conditional branches
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+#ifndef BRANCH_PREDICTOR_H
+#define BRANCH_PREDICTOR_H
+
+#include "../config.h"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Predicts the direction of conditional branches.
+ *
+ * Predict() and Update() are independent lookups: an implementation keeps no
+ * state between the two, so the pipeline may predict several branches before
+ * the oldest one resolves. Global history is updated with resolved outcomes only.
+ */
+class BranchPredictor {
+ public:
+  virtual ~BranchPredictor() = default;
+
+  /// Direction guess for the branch at pc, whose taken target is target.
+  virtual bool Predict(uint64_t pc, uint64_t target) = 0;
+  /// Trains on the resolved direction of the branch at pc.
+  virtual void Update(uint64_t pc, uint64_t target, bool taken) = 0;
+  /// Forgets everything learnt.
+  virtual void Reset() = 0;
+  /// Name as written in config.ini.
+  [[nodiscard]] virtual std::string_view Name() const = 0;
+};
+
+/// Always predicts the same direction.
+class StaticBranchPredictor : public BranchPredictor {
+ public:
+  explicit StaticBranchPredictor(bool taken) : taken_(taken) {}
+
+  bool Predict(uint64_t pc, uint64_t target) override;
+  void Update(uint64_t pc, uint64_t target, bool taken) override;
+  void Reset() override {}
+  [[nodiscard]] std::string_view Name() const override;
+
+ private:
+  bool taken_;
+};
+
+/// Backward taken, forward not taken.
+class BtfnBranchPredictor : public BranchPredictor {
+ public:
+  bool Predict(uint64_t pc, uint64_t target) override;
+  void Update(uint64_t pc, uint64_t target, bool taken) override;
+  void Reset() override {}
+  [[nodiscard]] std::string_view Name() const override;
+};
+
+/// Saturating 2-bit counters indexed by PC.
+class BimodalBranchPredictor : public BranchPredictor {
+ public:
+  /// table_size is rounded down to a power of two.
+  explicit BimodalBranchPredictor(uint64_t table_size);
+
+  bool Predict(uint64_t pc, uint64_t target) override;
+  void Update(uint64_t pc, uint64_t target, bool taken) override;
+  void Reset() override;
+  [[nodiscard]] std::string_view Name() const override;
+
+ private:
+  std::vector<uint8_t> counters_;
+  uint64_t mask_;
+};
+
+/// 2-bit counters indexed by PC xor global history.
+class GshareBranchPredictor : public BranchPredictor {
+ public:
+  GshareBranchPredictor(uint64_t table_size, uint64_t history_length);
+
+  bool Predict(uint64_t pc, uint64_t target) override;
+  void Update(uint64_t pc, uint64_t target, bool taken) override;
+  void Reset() override;
+  [[nodiscard]] std::string_view Name() const override;
+
+ private:
+  [[nodiscard]] uint64_t Index(uint64_t pc) const;
+
+  std::vector<uint8_t> counters_;
+  uint64_t mask_;
+  uint64_t history_mask_;
+  uint64_t history_ = 0;
+};
+
+/// Bimodal and gshare, with per-PC 2-bit counters choosing between them.
+class TournamentBranchPredictor : public BranchPredictor {
+ public:
+  TournamentBranchPredictor(uint64_t table_size, uint64_t history_length);
+
+  bool Predict(uint64_t pc, uint64_t target) override;
+  void Update(uint64_t pc, uint64_t target, bool taken) override;
+  void Reset() override;
+  [[nodiscard]] std::string_view Name() const override;
+
+ private:
+  BimodalBranchPredictor bimodal_;
+  GshareBranchPredictor gshare_;
+  std::vector<uint8_t> choosers_; ///< 0-1 trust bimodal, 2-3 trust gshare.
+  uint64_t mask_;
+};
+
+/**
+ * @brief TAGE: a bimodal base and tagged tables indexed with geometrically longer histories.
+ *
+ * The longest history whose tag matches provides the prediction. Mispredictions
+ * allocate an entry in a longer table, and useful counters protect entries that
+ * were right where the next shorter match was wrong.
+ */
+class TageBranchPredictor : public BranchPredictor {
+ public:
+  /// table_size is the size of the base table and of each tagged table.
+  TageBranchPredictor(uint64_t table_size, uint64_t history_length);
+
+  bool Predict(uint64_t pc, uint64_t target) override;
+  void Update(uint64_t pc, uint64_t target, bool taken) override;
+  void Reset() override;
+  [[nodiscard]] std::string_view Name() const override;
+
+  static constexpr size_t kTables = 4;
+
+ private:
+  static constexpr unsigned kTagBits = 9;
+  static constexpr uint64_t kUsefulResetPeriod = uint64_t{1} << 18;
+
+  struct Entry {
+    int8_t counter = 0; ///< 3-bit signed, taken when >= 0.
+    uint16_t tag = 0xFFFF; ///< Never equal to a kTagBits-wide tag, so empty entries miss.
+    uint8_t useful = 0; ///< 2 bits.
+  };
+
+  /// History of length length folded down to width bits, updated one outcome at a time.
+  struct FoldedHistory {
+    uint64_t value = 0;
+    unsigned length = 0;
+    unsigned width = 0;
+
+    void Push(bool newest, bool oldest);
+  };
+
+  /// Tagged-table lookup shared by Predict() and Update().
+  struct Lookup {
+    int provider = -1; ///< Table with the longest matching tag, -1 for the base.
+    int alternate = -1;
+    std::array<uint64_t, kTables> index{};
+    std::array<uint16_t, kTables> tag{};
+    bool provider_prediction = false;
+    bool alternate_prediction = false;
+    bool prediction = false;
+  };
+
+  Lookup Find(uint64_t pc);
+  void PushHistory(bool taken);
+
+  BimodalBranchPredictor base_;
+  std::array<std::vector<Entry>, kTables> tables_;
+  std::array<FoldedHistory, kTables> index_history_;
+  std::array<FoldedHistory, kTables> tag_history_;
+  std::array<FoldedHistory, kTables> tag_history_short_;
+  std::array<unsigned, kTables> history_lengths_{};
+  std::vector<uint8_t> history_; ///< Circular, newest outcome at history_head_.
+  size_t history_head_ = 0;
+  uint64_t mask_;
+  unsigned index_bits_;
+  int8_t use_alternate_ = 0; ///< 4-bit signed: trust the alternate over a newly allocated provider when >= 0.
+  uint64_t updates_ = 0;
+};
+
+/// The predictor config.ini selects, nullptr for none.
+std::unique_ptr<BranchPredictor> MakeBranchPredictor(vm_config::BranchPredictorType type,
+                                                     uint64_t table_size,
+                                                     uint64_t history_length);
+
+#endif // BRANCH_PREDICTOR_H
@@ -6,85 +6,298 @@
 #ifndef CACHE_H
 #define CACHE_H
 
+#include "cache_config.h"
+#include "mshr.h"
+#include "prefetcher.h"
+
+#include <algorithm>
+#include <array>
 #include <cstdint>
+#include <memory>
+#include <ostream>
+#include <random>
+#include <span>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
+class Memory;
+
 namespace cache {
 
-enum class ReplacementPolicy {
-  LRU,    ///< Least Recently Used
-  FIFO,   ///< First In First Out
-  Random  ///< Random replacement
-};
+struct CacheStats {
+  unsigned long accesses = 0; ///< Total number of accesses to the cache
+  unsigned long hits = 0;     ///< Total number of hits in the cache
+  unsigned long misses = 0;   ///< Total number of misses in the cache
+  unsigned long reads = 0;        ///< Accesses made by loads
+  unsigned long writes = 0;       ///< Accesses made by stores
+  unsigned long read_misses = 0;  ///< Loads that missed
+  unsigned long write_misses = 0; ///< Stores that missed
+  unsigned long evictions = 0;    ///< Valid lines replaced to make room for a fill
+  unsigned long writebacks = 0;   ///< Dirty lines written back to memory
+  unsigned long penalty_cycles = 0; ///< Demand misses * miss_penalty
+  unsigned long back_invalidations = 0; ///< Lines invalidated here by inclusive evictions below
+  unsigned long replacement_misses = 0; ///< Misses on a line this cache evicted to make room for another
+  unsigned long prefetches = 0;        ///< Lines this level's prefetcher filled
+  unsigned long prefetch_useful = 0;   ///< Prefetched lines whose first demand access found them arrived
+  unsigned long prefetch_late = 0;     ///< Prefetched lines whose first demand access had to wait for them
+  unsigned long prefetch_useless = 0;  ///< Prefetched lines evicted or invalidated before any demand access
+  unsigned long prefetch_accesses = 0; ///< Lookups for prefetches from the levels above, not counted in accesses
+  unsigned long prefetch_misses = 0;   ///< Of those, the ones that missed here
+  unsigned long mshr_merges = 0;       ///< Demand accesses to a line still on the way, merged into its MSHR
+  unsigned long mshr_stall_cycles = 0; ///< Cycles misses waited for a free MSHR
+  unsigned long write_buffer_coalesced = 0;    ///< Writes merged into an entry already in the write buffer
+  unsigned long write_buffer_stall_cycles = 0; ///< Cycles writes waited for a free write-buffer entry
 
-enum class CacheType {
-  Instruction, ///< Cache for instructions
-  Data         ///< Cache for data
+  [[nodiscard]] double HitRate() const {
+    return accesses ? static_cast<double>(hits) / static_cast<double>(accesses) : 0.0;
+  }
 };
 
-enum class CacheLineState {
-  Valid,       ///< Cache line is valid
-  Invalid,     ///< Cache line is invalid
-  Dirty        ///< Cache line has been modified
-};
+/**
+ * @brief A set-associative cache in front of the next level: another Cache or main memory.
+ *
+ * Guest loads and stores go through Read() and Write(), which count statistics and
+ * fill, evict and write back lines. Under write-back the cache holds the only
+ * up-to-date copy of a dirty line, so everything else that touches memory uses
+ * PeekByte() and PokeByte(), which see and update the cached copies all the way
+ * down without counting or allocating. An access that straddles two lines counts
+ * as an access to each of them.
+ *
+ * Levels are chained with SetNextLevel(); the lower level's inclusion policy decides
+ * how lines move between the two. A lower level's lines are at least as large as
+ * those of the levels above it, so an upper line always sits inside one lower line.
+ *
+ * The tag store is a structure of arrays: each set's tags sit next to each other and
+ * are compared against the looked-up tag several ways at a time, with the valid and
+ * dirty bits of a set packed into one mask each. In timing-only mode the cache keeps
+ * no line data at all: memory stays the source of truth, loads and stores go straight
+ * to it, and only hits, misses, evictions and writebacks are simulated. Every level
+ * of a hierarchy has to agree on the mode.
+ *
+ * LRU, FIFO, LIP and BIP keep a timestamp per line; PLRU and the RRIP policies keep
+ * only bit-packed per-set state. The cache remembers the lines it evicted to make room
+ * until they come back, so that a miss on one counts as caused by a replacement choice
+ * rather than as a first touch or an invalidation.
+ *
+ * A level with a prefetcher shows it every demand access and fills the lines it asks
+ * for. Such a fill arrives after the latency of the levels it came through, counted
+ * from the cycle SetAccessContext() last gave; a demand access that finds the line
+ * still on its way is charged the remaining cycles.
+ *
+ * With MSHRs the cache is non-blocking: a miss only claims an MSHR, and the core keeps
+ * going until something needs the data, which LastLatency() says when. Demand accesses
+ * to a line still on its way merge into its MSHR, and a miss that finds them all busy
+ * stalls the core, as does a write that finds the write buffer full; LastStall() says
+ * for how long. Both stalls count as penalty cycles too, so a blocking engine pays them.
+ */
+class Cache {
+ public:
+  Cache(const CacheConfig &config, Memory &memory);
 
-enum class WriteHitPolicy {
-  WriteThrough, ///< Write through policy
-  WriteBack     ///< Write back policy
-};
+  /// Reads size bytes (at most 8) at address, little-endian. The caller has bounds-checked the access.
+  uint64_t Read(uint64_t address, unsigned size);
+  /// Writes the low size bytes of value at address. The caller has bounds-checked the access.
+  void Write(uint64_t address, uint64_t value, unsigned size);
 
-enum class WriteMissPolicy {
-  NoWriteAllocate, ///< Do not allocate on write miss
-  WriteAllocate    ///< Allocate on write miss
-};
+  /// The byte as the guest would load it, without touching statistics or replacement state.
+  uint8_t PeekByte(uint64_t address) const;
+  /// Stores a byte in the cached copies down to memory, without touching statistics.
+  void PokeByte(uint64_t address, uint8_t value);
+  /// PeekByte() for size bytes (at most 8), little-endian, with one lookup per level unless they straddle two lines.
+  uint64_t Peek(uint64_t address, unsigned size) const;
+  /// PokeByte() for the low size bytes of value, with one lookup per level unless they straddle two lines.
+  void Poke(uint64_t address, uint64_t value, unsigned size);
+  /// PeekByte() for every byte of bytes, a line at a time. The caller has bounds-checked the range.
+  void PeekBlock(uint64_t address, std::span<uint8_t> bytes) const;
+  /// PokeByte() for every byte of bytes, a line at a time. The caller has bounds-checked the range.
+  void PokeBlock(uint64_t address, std::span<const uint8_t> bytes);
 
-struct CacheConfig {
-  unsigned long lines = 0;  ///< Number of lines in the cache
-  unsigned long associativity = 0; ///< Associativity of the cache
-  unsigned long words_per_line = 0; ///< Number of words per line in the cache
-  ReplacementPolicy replacement_policy = ReplacementPolicy::LRU; ///< Replacement policy for the cache
-  CacheType cache_type = CacheType::Data; ///< Type of cache (instruction or data)
-  WriteHitPolicy write_hit_policy = WriteHitPolicy::WriteBack; ///< Write hit policy
-  WriteMissPolicy write_miss_policy = WriteMissPolicy::NoWriteAllocate; ///< Write miss policy
-  unsigned long size = 0;   ///< Size of the cache in bytes
-};
+  /// The instruction behind the next accesses and the cycle it makes them in, for prefetching.
+  void SetAccessContext(uint64_t pc, uint64_t cycle) {
+    pc_ = pc;
+    now_ = cycle;
+  }
 
-struct CacheLine {
-  CacheLineState state = CacheLineState::Invalid; ///< State of the cache line
-  unsigned long tag = 0;    ///< Tag for the cache line
-  std::vector<uint8_t> data; ///< Data stored in the cache line
-  
-};
+  /// Cycles past a hit until the data of the last Read() or Write() arrived, stalls included.
+  [[nodiscard]] uint64_t LastLatency() const { return access_latency_; }
+  /// Cycles the last Read() or Write() stalled the core for an MSHR or a write-buffer entry.
+  [[nodiscard]] uint64_t LastStall() const { return access_stall_; }
+  /// Cycles spent with n MSHRs busy, for each n; empty for a blocking cache.
+  [[nodiscard]] std::vector<uint64_t> MshrOccupancy() const {
+    return mshrs_ ? mshrs_->Occupancy() : std::vector<uint64_t>();
+  }
 
-struct CacheStats {
-  unsigned long accesses; ///< Total number of accesses to the cache
-  unsigned long hits;     ///< Total number of hits in the cache
-  unsigned long misses;   ///< Total number of misses in the cache
+  /// Misses below this cache go to next instead of memory. next must outlive this cache.
+  void SetNextLevel(Cache *next);
 
+  /// Copies every dirty line to memory; the lines stay dirty, so statistics are unaffected.
+  void SyncToMemory() const;
+  /// Invalidates every line and clears the statistics; dirty data is dropped.
+  void Reset();
 
-};
+  [[nodiscard]] const CacheStats &GetStats() const { return stats; }
+  [[nodiscard]] const CacheConfig &GetConfig() const { return config; }
+  [[nodiscard]] CacheType GetType() const { return type; }
+  [[nodiscard]] uint64_t LineSize() const { return line_size_; }
+  [[nodiscard]] bool TimingOnly() const { return data_.empty(); }
 
-struct CacheSet {
-  unsigned long associativity; ///< Associativity of the cache set
-  std::vector<CacheLine> lines; ///< Lines in the cache set
+  /// Writes configuration and statistics as a JSON object.
+  void DumpStats(std::ostream &out) const;
 
-  CacheSet(unsigned long assoc)
-    : associativity(assoc), lines(assoc) {}
-};
+ private:
+  static constexpr unsigned kBimodalPeriod = 32; ///< BIP and BRRIP treat one fill in this many as reused
+  static constexpr unsigned kRrpvMax = 3;        ///< Two-bit re-reference predictions; kRrpvMax is "distant"
+  static constexpr unsigned kPselMax = 1023;     ///< Ten-bit DRRIP policy selector
+  static constexpr uint64_t kLeaderSets = 32;    ///< DRRIP leader sets per policy
+  static constexpr uint64_t kVictimPageLines = 4096;
+
+  /// Who an access is for, which decides what it is counted as and charged.
+  enum class Access {
+    Demand,     ///< A load, store or fetch: the core waits, so misses charge their penalty
+    Background, ///< A writeback from above, or a fill it sets off
+    Prefetch    ///< A prefetch fill from this level or one above
+  };
+
+  [[nodiscard]] uint64_t LineAddress(uint64_t address) const { return address & ~(line_size_ - 1); }
+  [[nodiscard]] uint64_t SetIndex(uint64_t address) const { return (address / line_size_) & (sets_ - 1); }
+  [[nodiscard]] uint64_t Tag(uint64_t address) const { return address / line_size_ / sets_; }
+  [[nodiscard]] bool IsExclusive() const {
+    return !upper_levels_.empty() && config.inclusion_policy == InclusionPolicy::Exclusive;
+  }
+
+  // A line is addressed by its set and its way within the set.
+  [[nodiscard]] size_t Slot(uint64_t set, unsigned way) const { return set * ways_ + way; }
+  [[nodiscard]] bool IsDirty(uint64_t set, unsigned way) const { return dirty_[set] >> way & 1; }
+  void Invalidate(uint64_t set, unsigned way) {
+    valid_[set] &= ~(uint64_t{1} << way);
+    dirty_[set] &= ~(uint64_t{1} << way);
+    if (!prefetched_.empty()) {
+      DropPrefetched(set, way);
+    }
+  }
+  /// The line's bytes, nullptr in timing-only mode.
+  [[nodiscard]] uint8_t *LineData(uint64_t set, unsigned way) {
+    return data_.empty() ? nullptr : data_.data() + Slot(set, way) * line_size_;
+  }
+  [[nodiscard]] const uint8_t *LineData(uint64_t set, unsigned way) const {
+    return data_.empty() ? nullptr : data_.data() + Slot(set, way) * line_size_;
+  }
+  [[nodiscard]] uint64_t LineAddressOf(uint64_t set, unsigned way) const {
+    return (tags_[Slot(set, way)] * sets_ + set) * line_size_;
+  }
+  [[nodiscard]] uint64_t AllWays() const { return ways_ == 64 ? ~uint64_t{0} : (uint64_t{1} << ways_) - 1; }
+
+  /// The way of set SetIndex(address) holding address, -1 on a miss.
+  [[nodiscard]] int Find(uint64_t address) const;
+  /**
+   * @brief Evicts a victim if needed and claims its way for the line holding address.
+   * @param fill Whether to load the line from below; false when the caller overwrites all of it.
+   * @param access Who the fill is for, which decides what the levels below count and charge.
+   */
+  unsigned Allocate(uint64_t address, bool fill, Access access);
+  unsigned ChooseVictim(uint64_t set);
+  /// Sets the replacement state of a line just filled into way.
+  void Insert(uint64_t set, unsigned way);
+  /// Whether this fill is the one in kBimodalPeriod that BIP and BRRIP treat as reused.
+  bool BimodalFill() { return ++bimodal_fills_ % kBimodalPeriod == 0; }
+  enum class Leader { None, SRRIP, BRRIP };
+  /// DRRIP leaders are spread evenly: one of each kind per group of sets_ / kLeaderSets sets.
+  [[nodiscard]] Leader LeaderOf(uint64_t set) const {
+    const uint64_t position = set % std::max<uint64_t>(2, sets_ / kLeaderSets);
+    return position == 0 ? Leader::SRRIP : position == 1 ? Leader::BRRIP : Leader::None;
+  }
+  /// The policy set follows: SRRIP or BRRIP under DRRIP, the configured one otherwise.
+  [[nodiscard]] ReplacementPolicy SetPolicy(uint64_t set) const;
+  void SetRrpv(uint64_t set, unsigned way, unsigned rrpv);
+  /// Counts a miss on address as replacement-induced if this cache evicted its line.
+  void CheckVictims(uint64_t address);
+  /// Sends a line leaving this cache down: dirty data is written back, and an exclusive level below takes clean lines too.
+  void Evict(uint64_t set, unsigned way);
+  void Touch(uint64_t set, unsigned way);
+  /**
+   * @brief Settles a hit from above on a line: the first use of a prefetched line is useful or late.
+   * @return Whether the access would have missed without the prefetch.
+   */
+  bool UsePrefetched(uint64_t set, unsigned way, Access access);
+  /// Counts a prefetched line leaving unused.
+  void DropPrefetched(uint64_t set, unsigned way);
+  /// Shows the prefetcher a demand access and fills the lines it asks for.
+  void Prefetch(uint64_t address, bool miss);
+  /// Claims an MSHR for the demand miss that just filled way, stalling until one is free.
+  void IssueMiss(uint64_t set, unsigned way);
+  /// A demand hit on a line still on its way waits for it, merged into the line's MSHR.
+  void AwaitFill(uint64_t set, unsigned way);
+  /// Queues a write to the next level in the write buffer, stalling until an entry is free.
+  void BufferWrite(uint64_t address);
+  /// Starts a Read() or Write(): clears LastStall() and returns the cycle it issues in.
+  uint64_t BeginAccess();
+  /// Holds the core for cycles: counted as a penalty, and later accesses issue that much later.
+  void Stall(uint64_t cycles);
+  /// The level below's share of the latency of the access that just went through it.
+  [[nodiscard]] uint64_t BelowLatency() const { return config.miss_penalty + (next_level_ ? next_level_->latency_ : 0); }
+
+  // The level below, whichever it is. bytes is nullptr in timing-only mode.
+  void ReadBelow(uint64_t address, uint8_t *bytes, uint64_t size, Access access);
+  void WriteBelow(uint64_t address, const uint8_t *bytes, uint64_t size);
+  void PeekBelow(uint64_t address, uint8_t *bytes, uint64_t size) const;
+
+  // What the level above calls; each access stays within one line here.
+  void ReadWithinLine(uint64_t address, uint8_t *bytes, uint64_t size, Access access);
+  void WriteWithinLine(uint64_t address, const uint8_t *bytes, uint64_t size, Access access);
+  /// Takes a line evicted above, exclusive levels only. Clean data is re-read from below rather than trusted.
+  void InsertVictim(uint64_t address, const uint8_t *bytes, uint64_t size, bool dirty);
+  /**
+   * @brief Invalidates every line in [address, address + size) here and above, for an inclusive eviction below.
+   * @return Whether any invalidated line was dirty; its data has been merged into bytes.
+   */
+  bool BackInvalidate(uint64_t address, uint8_t *bytes, uint64_t size);
+
+  void WriteLineToMemory(uint64_t set, unsigned way) const;
 
-class Cache {
-  bool enabled; ///< Flag to indicate if the cache is enabled
   CacheType type; ///< Type of cache (instruction or data)
   CacheConfig config; ///< Configuration of the cache
   CacheStats stats; ///< Statistics for the cache
 
-
+  Memory &memory_;
+  Cache *next_level_ = nullptr; ///< nullptr when memory_ is next
+  std::vector<Cache *> upper_levels_; ///< Caches whose next level is this one
+  uint64_t line_size_;
+  uint64_t sets_;  ///< A power of two
+  unsigned ways_;
+  std::vector<uint64_t> tags_;   ///< sets_ * ways_ tags, the ways of a set contiguous for the vector compare
+  std::vector<uint64_t> valid_;  ///< One mask per set, bit w for way w
+  std::vector<uint64_t> dirty_;  ///< One mask per set, a subset of valid_
+  std::vector<uint64_t> stamps_; ///< Per line: the access count at the last promotion for LRU, LIP and BIP, at the fill for FIFO
+  std::vector<uint64_t> plru_;   ///< PLRU: one tree per set, bit n set when node n points the victim to its right subtree
+  std::vector<uint64_t> rrpv_;   ///< RRIP: two masks per set, the low and high bits of each way's re-reference prediction
+  /// A bit per line of memory, in pages of kVictimPageLines lines: set while the line is evicted and has not missed since.
+  std::unordered_map<uint64_t, std::array<uint64_t, kVictimPageLines / 64>> victims_;
+  unsigned psel_ = kPselMax / 2; ///< DRRIP policy selector, high when the SRRIP leader sets miss more
+  unsigned bimodal_fills_ = 0;
+  std::unique_ptr<Prefetcher> prefetcher_; ///< nullptr without one
+  std::vector<uint64_t> prefetched_; ///< One mask per set: lines a prefetch filled that no demand access has used
+  std::vector<uint64_t> ready_at_;   ///< Per line: the cycle its fill arrives; empty without a prefetcher or MSHRs
+  std::vector<uint64_t> prefetch_requests_; ///< Scratch for the prefetcher's requests
+  uint64_t pc_ = 0;  ///< See SetAccessContext()
+  uint64_t now_ = 0;
+  uint64_t latency_ = 0; ///< Cycles the last access here took beyond a hit, the levels below included
+  std::unique_ptr<MshrFile> mshrs_;         ///< nullptr for a blocking cache
+  std::unique_ptr<WriteBuffer> write_buffer_; ///< nullptr for a free one
+  uint64_t access_latency_ = 0; ///< See LastLatency()
+  uint64_t access_stall_ = 0;   ///< See LastStall()
+  std::vector<uint8_t> data_;    ///< sets_ * ways_ lines of line_size_ bytes; empty in timing-only mode
+  uint64_t clock_ = 0; ///< Accesses so far, the timestamp for LRU and FIFO.
+  std::mt19937 random_; ///< Fixed seed so runs with Random replacement are repeatable.
 };
 
-
+std::string_view ToString(ReplacementPolicy policy);
+std::string_view ToString(WriteHitPolicy policy);
+std::string_view ToString(WriteMissPolicy policy);
+std::string_view ToString(InclusionPolicy policy);
 
 } // namespace cache
 
 
 
-#endif // CACHE_H
\ No newline at end of file
+#endif // CACHE_H
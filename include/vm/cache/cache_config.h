@@ -0,0 +1,88 @@
+/**
+ * @file cache_config.h
+ * @brief The settings a cache level is built from, apart from the cache itself so config.h can hold them
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+#ifndef CACHE_CONFIG_H
+#define CACHE_CONFIG_H
+
+namespace cache {
+
+enum class PrefetcherType {
+  None,     ///< No prefetching
+  NextLine, ///< The next degree lines after every miss
+  Stride,   ///< A PC-indexed table of strides between the addresses each load or store touches
+  Stream    ///< Streams of misses to consecutive lines, followed in either direction
+};
+
+struct PrefetcherConfig {
+  PrefetcherType type = PrefetcherType::None;
+  unsigned degree = 1;      ///< Lines requested per trigger
+  unsigned distance = 1;    ///< How far ahead the first request is: lines, or strides for Stride
+  unsigned table_size = 64; ///< Stride table entries, or streams tracked at once
+};
+
+enum class ReplacementPolicy {
+  LRU,    ///< Least Recently Used
+  FIFO,   ///< First In First Out
+  Random, ///< Random replacement
+  PLRU,   ///< Tree pseudo-LRU: associativity - 1 bits per set
+  LIP,    ///< LRU insertion: fills go in at the LRU position and only a hit promotes them
+  BIP,    ///< Bimodal insertion: LIP, except that every 32nd fill goes in at the MRU position
+  SRRIP,  ///< Static re-reference interval prediction: two bits per line, fills predicted long
+  BRRIP,  ///< Bimodal RRIP: fills predicted distant, except every 32nd predicted long
+  DRRIP   ///< Dynamic RRIP: leader sets duel SRRIP against BRRIP and the other sets follow the winner
+};
+
+enum class CacheType {
+  Instruction, ///< Cache for instructions
+  Data         ///< Cache for data
+};
+
+enum class WriteHitPolicy {
+  WriteThrough, ///< Write through policy
+  WriteBack     ///< Write back policy
+};
+
+enum class WriteMissPolicy {
+  NoWriteAllocate, ///< Do not allocate on write miss
+  WriteAllocate    ///< Allocate on write miss
+};
+
+/// How a cache below L1 relates to the contents of the caches above it.
+enum class InclusionPolicy {
+  NINE,      ///< Non-inclusive non-exclusive: fills allocate here too, evictions here leave the levels above alone
+  Inclusive, ///< Holds everything the levels above hold: an eviction here invalidates their copies
+  Exclusive  ///< Holds only victims of the levels above: a hit moves the line up, evictions above move it down
+};
+
+struct CacheConfig {
+  unsigned long lines = 0;  ///< Number of lines in the cache
+  unsigned long associativity = 0; ///< Associativity of the cache
+  unsigned long words_per_line = 0; ///< Number of words per line in the cache
+  ReplacementPolicy replacement_policy = ReplacementPolicy::LRU; ///< Replacement policy for the cache
+  CacheType cache_type = CacheType::Data; ///< Type of cache (instruction or data)
+  WriteHitPolicy write_hit_policy = WriteHitPolicy::WriteBack; ///< Write hit policy
+  WriteMissPolicy write_miss_policy = WriteMissPolicy::NoWriteAllocate; ///< Write miss policy
+  unsigned long size = 0;   ///< Size of the cache in bytes
+  unsigned long miss_penalty = 0; ///< Cycles the core waits on each demand miss: the latency of the next level
+  InclusionPolicy inclusion_policy = InclusionPolicy::NINE; ///< Relation to the levels above, ignored at L1
+  bool timing_only = false; ///< Track tags only and leave the data in memory; see Cache
+  PrefetcherConfig prefetcher; ///< What this level fetches ahead of its demand accesses
+  unsigned mshrs = 0; ///< Primary misses outstanding at once; 0 for a blocking cache
+  unsigned write_buffer_entries = 0; ///< Writes to the next level queued at once; 0 for a free, unbounded buffer
+
+  /// Ways per set are tracked in 64-bit masks.
+  static constexpr unsigned long kMaxAssociativity = 64;
+
+  /**
+   * @brief Geometry for a cache of size bytes with line_size-byte lines.
+   * @throws std::invalid_argument unless the sizes are powers of two, size holds at least one set
+   * and associativity is at most kMaxAssociativity.
+   */
+  static CacheConfig FromSizes(unsigned long size, unsigned long line_size, unsigned long associativity);
+};
+
+} // namespace cache
+
+#endif // CACHE_CONFIG_H
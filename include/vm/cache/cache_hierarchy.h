@@ -0,0 +1,91 @@
+/**
+ * @file cache_hierarchy.h
+ * @brief L1 instruction and data caches over a unified L2 and L3
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+#ifndef CACHE_HIERARCHY_H
+#define CACHE_HIERARCHY_H
+
+#include "cache.h"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+
+class Memory;
+
+namespace cache {
+
+/**
+ * @brief L1I and L1D over an optional unified L2 and L3, then main memory.
+ *
+ * Any level may be left out; the ones present are chained in order, and each L2 or
+ * L3 follows its own inclusion policy towards the levels right above it. Fetches
+ * enter at L1I and loads and stores at L1D, so L2 and L3 only see what misses an
+ * enabled L1. Every demand miss charges its level's miss penalty, so the total
+ * over the levels is the time the core spent waiting on memory.
+ */
+class CacheHierarchy {
+ public:
+  enum Level { kL1I, kL1D, kL2, kL3, kLevels };
+
+  explicit CacheHierarchy(Memory &memory) : memory_(memory) {}
+
+  /**
+   * @brief Rebuilds the levels with cold lines and zeroed statistics; nullptr leaves a level out.
+   * @throws std::invalid_argument if a level's lines are smaller than those of a level above it,
+   * or if the levels disagree on timing-only mode.
+   */
+  void Configure(const CacheConfig *l1i, const CacheConfig *l1d, const CacheConfig *l2, const CacheConfig *l3);
+
+  /// The cache at level, nullptr when it is left out.
+  [[nodiscard]] const Cache *Get(Level level) const { return levels_[level].get(); }
+  /// Where fetches enter: L1I, nullptr when fetches go straight to memory.
+  [[nodiscard]] Cache *InstructionPath() const { return instruction_path_; }
+  /// Where loads and stores enter: L1D, nullptr when they go straight to memory.
+  [[nodiscard]] Cache *DataPath() const { return data_path_; }
+  [[nodiscard]] bool Empty() const { return !instruction_path_ && !data_path_; }
+
+  /// Miss penalty cycles charged by every level since Configure() or Reset().
+  [[nodiscard]] uint64_t PenaltyCycles() const {
+    uint64_t cycles = 0;
+    for (const auto &level : levels_) {
+      if (level) {
+        cycles += level->GetStats().penalty_cycles;
+      }
+    }
+    return cycles;
+  }
+
+  /// Tells every level which instruction makes the next accesses, and in which cycle.
+  void SetAccessContext(uint64_t pc, uint64_t cycle) {
+    for (const auto &level : levels_) {
+      if (level) {
+        level->SetAccessContext(pc, cycle);
+      }
+    }
+  }
+
+  /// Average cycles per L1 access: one for the hit plus the penalties paid below.
+  [[nodiscard]] double Amat() const;
+
+  /// Copies dirty lines to memory, lowest level first so the newest copy lands last.
+  void SyncToMemory() const;
+  void Reset();
+
+  /// Writes every level, the AMAT and each level's misses per thousand instructions as a JSON object.
+  void DumpStats(std::ostream &out, uint64_t instructions) const;
+
+  [[nodiscard]] static const char *Name(Level level);
+
+ private:
+  Memory &memory_;
+  std::array<std::unique_ptr<Cache>, kLevels> levels_;
+  Cache *instruction_path_ = nullptr;
+  Cache *data_path_ = nullptr;
+};
+
+} // namespace cache
+
+#endif // CACHE_HIERARCHY_H
@@ -0,0 +1,81 @@
+/**
+ * @file mshr.h
+ * @brief Miss-status holding registers and the coalescing write buffer of a non-blocking cache
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+#ifndef MSHR_H
+#define MSHR_H
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace cache {
+
+/**
+ * @brief The registers that track a cache's primary misses while their lines are on the way.
+ *
+ * Each register is busy from the cycle its miss issues until the line arrives. A miss
+ * that finds every register busy waits for the first to free up. Secondary misses, to
+ * a line already on the way, merge into its register; the cache spots those itself.
+ */
+class MshrFile {
+ public:
+  /// count is at least 1.
+  explicit MshrFile(unsigned count);
+
+  /**
+   * @brief Claims a register for a miss issued at cycle now whose line takes latency cycles to arrive.
+   * @return The cycles the miss waited for a free register first.
+   */
+  uint64_t Allocate(uint64_t now, uint64_t latency);
+  /// Frees the registers whose lines have arrived by cycle now, and brings Occupancy() up to it.
+  void Advance(uint64_t now);
+  void Reset();
+
+  [[nodiscard]] unsigned Count() const { return count_; }
+  /// Entry n: cycles spent with n registers busy, up to the latest Advance() or Allocate().
+  [[nodiscard]] const std::vector<uint64_t> &Occupancy() const { return occupancy_; }
+
+ private:
+  unsigned count_;
+  std::vector<uint64_t> busy_until_; ///< The arrival cycle of each busy register's line
+  std::vector<uint64_t> occupancy_;  ///< count_ + 1 entries
+  uint64_t accounted_until_ = 0;     ///< Occupancy() covers the cycles before this one
+};
+
+/**
+ * @brief A FIFO of line writes from a cache to the level below, draining one entry at a time.
+ *
+ * A write to a line already queued merges into its entry. Each entry takes the next
+ * level's latency to drain; a write that finds the buffer full waits for the oldest
+ * entry to leave.
+ */
+class WriteBuffer {
+ public:
+  /// entries is at least 1.
+  WriteBuffer(unsigned entries, uint64_t line_size);
+
+  /**
+   * @brief Queues a write to the line holding address at cycle now.
+   * @param drain_cycles How long the entry takes to drain once it is the oldest.
+   * @param coalesced Set when the write merged into an entry already queued.
+   * @return The cycles the write waited for a free entry.
+   */
+  uint64_t Insert(uint64_t address, uint64_t now, uint64_t drain_cycles, bool &coalesced);
+  void Reset() { entries_.clear(); }
+
+ private:
+  struct Entry {
+    uint64_t line;
+    uint64_t drained_at; ///< The cycle the entry leaves the buffer
+  };
+
+  unsigned capacity_;
+  uint64_t line_size_;
+  std::deque<Entry> entries_; ///< Oldest first
+};
+
+} // namespace cache
+
+#endif // MSHR_H
@@ -0,0 +1,122 @@
+/**
+ * @file prefetcher.h
+ * @brief Hardware prefetchers that a cache level consults on demand accesses
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include "cache_config.h"
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace cache {
+
+/**
+ * @brief Watches the demand accesses to one cache level and picks lines to fetch ahead of them.
+ *
+ * The cache drops requests for lines it already holds and fills the rest as prefetch
+ * traffic, which the levels below count apart from demand accesses.
+ */
+class Prefetcher {
+ public:
+  virtual ~Prefetcher() = default;
+
+  /**
+   * @brief Observes a demand access and appends the addresses of lines worth fetching to requests.
+   * @param pc The instruction making the access, 0 when unknown.
+   * @param miss Whether the access missed, or was the first use of a prefetched line and would have.
+   */
+  virtual void Observe(uint64_t pc, uint64_t address, bool miss, std::vector<uint64_t> &requests) = 0;
+  /// Forgets everything learnt.
+  virtual void Reset() = 0;
+  /// Name as written in config.ini.
+  [[nodiscard]] virtual std::string_view Name() const = 0;
+};
+
+/// On every miss, the degree lines starting distance lines past the missing one.
+class NextLinePrefetcher : public Prefetcher {
+ public:
+  NextLinePrefetcher(const PrefetcherConfig &config, uint64_t line_size);
+
+  void Observe(uint64_t pc, uint64_t address, bool miss, std::vector<uint64_t> &requests) override;
+  void Reset() override {}
+  [[nodiscard]] std::string_view Name() const override;
+
+ private:
+  PrefetcherConfig config_;
+  uint64_t line_size_;
+};
+
+/**
+ * @brief A reference prediction table: per PC, the last address and the stride to it.
+ *
+ * A stride seen twice in a row makes the entry confident; a confident entry requests
+ * degree strides starting distance strides past every access, hit or miss.
+ */
+class StridePrefetcher : public Prefetcher {
+ public:
+  /// config.table_size is rounded down to a power of two.
+  StridePrefetcher(const PrefetcherConfig &config, uint64_t line_size);
+
+  void Observe(uint64_t pc, uint64_t address, bool miss, std::vector<uint64_t> &requests) override;
+  void Reset() override;
+  [[nodiscard]] std::string_view Name() const override;
+
+ private:
+  struct Entry {
+    uint64_t pc = 0;
+    uint64_t last_address = 0;
+    int64_t stride = 0;
+    uint8_t confidence = 0; ///< 2 bits, confident from 1
+    bool valid = false;
+  };
+
+  PrefetcherConfig config_;
+  uint64_t line_size_;
+  std::vector<Entry> table_;
+  uint64_t mask_;
+};
+
+/**
+ * @brief Tracks table_size streams of misses to neighbouring lines.
+ *
+ * A miss next to a stream's last line sets its direction; from then on, a miss
+ * within the lines already requested ahead of the stream advances it and requests
+ * degree more lines, distance lines ahead. Other misses start a new stream in place
+ * of the least recently advanced one. Prefetched lines go into the cache itself
+ * rather than into separate stream buffers.
+ */
+class StreamPrefetcher : public Prefetcher {
+ public:
+  StreamPrefetcher(const PrefetcherConfig &config, uint64_t line_size);
+
+  void Observe(uint64_t pc, uint64_t address, bool miss, std::vector<uint64_t> &requests) override;
+  void Reset() override;
+  [[nodiscard]] std::string_view Name() const override;
+
+ private:
+  struct Stream {
+    uint64_t last_line = 0;
+    int direction = 0; ///< +1 or -1 once two misses agree, 0 before
+    uint64_t last_use = 0;
+    bool valid = false;
+  };
+
+  PrefetcherConfig config_;
+  uint64_t line_size_;
+  std::vector<Stream> streams_;
+  uint64_t clock_ = 0;
+};
+
+/// The prefetcher config selects, nullptr for none.
+std::unique_ptr<Prefetcher> MakePrefetcher(const PrefetcherConfig &config, uint64_t line_size);
+
+std::string_view ToString(PrefetcherType type);
+
+} // namespace cache
+
+#endif // PREFETCHER_H
@@ -0,0 +1,117 @@
+/**
+ * @file checkpoint.h
+ * @brief The binary checkpoint format that `checkpoint save` writes and `checkpoint load` reads back
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+namespace checkpoint {
+
+inline constexpr char kMagic[8] = {'R', 'V', 'S', 'S', 'C', 'K', 'P', 'T'};
+/// Bumped whenever Header or the layout after it changes; other versions are rejected.
+inline constexpr uint32_t kVersion = 1;
+/**
+ * Alignment of the start of the block data. Only the first block lands on a page boundary:
+ * loading copies every block into guest memory with a bounded WriteBlock, nothing is mapped into it.
+ */
+inline constexpr uint64_t kBlockDataAlignment = 4096;
+
+/// A CSR that was not zero.
+struct CsrEntry {
+  uint64_t index;
+  uint64_t value;
+};
+
+/**
+ * @brief Starts the file. Everything else is found through its offsets, from the start of
+ * the file; integers are little-endian, like the memory image.
+ *
+ * The layout is Header, csr_count CsrEntry, padding, block_count blocks of block_size
+ * bytes, and the block_count addresses of those blocks, ascending. Blocks of zeros are left out.
+ */
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size; ///< sizeof(Header)
+
+  uint64_t program_counter;
+  uint64_t program_size; ///< Bytes of text at address 0
+  uint64_t memory_size;  ///< memory_size of the VM that saved it; blocks beyond it are cut short
+  uint64_t block_size;
+  uint64_t block_count;
+  uint64_t block_data_offset;
+  uint64_t block_table_offset;
+  uint64_t csr_count;
+  uint64_t csr_offset;
+
+  uint64_t instructions_retired;
+  uint64_t cycles;
+  uint64_t stall_cycles;
+  uint64_t branch_predictions;
+  uint64_t branch_mispredictions;
+  uint64_t fused_pairs;
+
+  uint64_t gpr[32];
+  uint64_t fpr[32];
+  uint8_t bigmul_a[512];
+  uint8_t bigmul_b[512];
+  uint8_t bigmul_result[1024];
+};
+static_assert(std::is_trivially_copyable_v<Header> && std::is_standard_layout_v<Header>,
+              "Header is read straight out of the mapped file");
+
+/**
+ * @brief Writes a checkpoint file block by block, then the block table and the header.
+ */
+class Writer {
+ public:
+  /// Throws std::runtime_error if the file cannot be created.
+  Writer(const std::filesystem::path &path, const Header &header, std::span<const CsrEntry> csrs);
+
+  /// Adds the block at address unless it is all zeros; bytes is at most header.block_size long.
+  void AddBlock(uint64_t address, std::span<const uint8_t> bytes);
+  /// Throws std::runtime_error if anything failed to write.
+  void Finish();
+
+ private:
+  std::filesystem::path path_;
+  std::ofstream file_;
+  Header header_;
+  std::vector<uint64_t> addresses_;
+};
+
+/**
+ * @brief A checkpoint file mapped read-only, its header and offsets checked against its size.
+ */
+class MappedFile {
+ public:
+  /// Throws std::runtime_error if the file cannot be mapped or is not a checkpoint of kVersion.
+  explicit MappedFile(const std::filesystem::path &path);
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  [[nodiscard]] const Header &GetHeader() const {
+    return *reinterpret_cast<const Header *>(data_);
+  }
+  [[nodiscard]] std::span<const CsrEntry> Csrs() const;
+  [[nodiscard]] std::span<const uint64_t> BlockAddresses() const;
+  /// The index-th block, block_size bytes.
+  [[nodiscard]] std::span<const uint8_t> Block(uint64_t index) const;
+
+ private:
+  const uint8_t *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+} // namespace checkpoint
+
+#endif // CHECKPOINT_H
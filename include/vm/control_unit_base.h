@@ -9,6 +9,22 @@
 #include "registers.h"
 #include "alu.h"
 
+#include <cstdint>
+
+/**
+ * @brief Snapshot of the control signals generated for a single instruction.
+ */
+struct ControlSignals {
+  bool reg_write = false;
+  bool branch = false;
+  bool alu_src = false;
+  bool mem_read = false;
+  bool mem_write = false;
+  bool mem_to_reg = false;
+  bool bigmul_busy = false;
+  uint8_t alu_op = 0;
+};
+
 /**
  * @brief The ControlUnit class is the base class for the control unit of the CPU.
  */
@@ -38,6 +54,9 @@ class ControlUnit {
   [[nodiscard]] uint8_t GetAluOp() const;
   [[nodiscard]] bool GetBranch() const;
 
+  [[nodiscard]] ControlSignals GetControlSignals() const;
+  void LoadControlSignals(const ControlSignals &signals);
+
  protected:
   bool reg_write_ = false;
   bool branch_ = false;
@@ -0,0 +1,65 @@
+/**
+ * @file decoded_instruction.h
+ * @brief Predecoded instruction representation used by the VM fetch path
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+#ifndef DECODED_INSTRUCTION_H
+#define DECODED_INSTRUCTION_H
+
+#include "control_unit_base.h"
+#include "alu.h"
+
+#include <cstdint>
+
+/**
+ * @brief Execution path an instruction is dispatched to once decoded.
+ */
+enum class ExecutionUnit : uint8_t {
+  kInteger, ///< Base integer / M extension, handled by the main ALU path.
+  kFloat,   ///< RV64F arithmetic, loads and stores.
+  kDouble,  ///< RV64D arithmetic, loads and stores.
+  kCsr,     ///< Zicsr instructions.
+  kSyscall, ///< ecall.
+  kLdbm,    ///< Custom bigmul operand load.
+  kBigmul,  ///< Custom bigmul execute and writeback.
+};
+
+/**
+ * @brief Instruction pair that starts at this entry and can run as one superinstruction.
+ *
+ * These are the idioms the assembler's pseudo-instruction expansion and common
+ * loop code produce. The second instruction always reads the first one's rd.
+ */
+enum class FusedPair : uint8_t {
+  kNone,
+  kLuiAddi,    ///< lui rd, hi; addi rd2, rd, lo (li)
+  kAuipcAddi,  ///< auipc rd, hi; addi rd2, rd, lo (la)
+  kAuipcLoad,  ///< auipc rd, hi; l{b,h,w,d,bu,hu,wu} rd2, lo(rd)
+  kAuipcJalr,  ///< auipc rd, hi; jalr rd2, lo(rd) (call)
+  kSetBranch,  ///< slt/sltu/slti/sltiu rd, ...; beq/bne on rd against x0
+  kAddiBranch, ///< addi rd, rd, imm; b<cond> comparing rd (loop counter)
+};
+
+/**
+ * @brief An instruction with all of its fields, immediate, ALU operation and
+ * control signals resolved up front, so the execution loop does not have to
+ * re-decode the raw word on every visit.
+ */
+struct DecodedInstruction {
+  uint32_t instruction = 0;
+  int32_t imm = 0;
+  uint8_t opcode = 0;
+  uint8_t funct3 = 0;
+  uint8_t funct7 = 0;
+  uint8_t rd = 0;
+  uint8_t rs1 = 0;
+  uint8_t rs2 = 0;
+  uint8_t rs3 = 0;
+  ExecutionUnit unit = ExecutionUnit::kInteger;
+  alu::AluOp alu_op = alu::AluOp::kNone;
+  ControlSignals signals;
+  FusedPair fusion = FusedPair::kNone; ///< Pair formed with the instruction at the next address.
+  bool valid = false;
+};
+
+#endif // DECODED_INSTRUCTION_H
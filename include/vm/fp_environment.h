@@ -0,0 +1,65 @@
+/**
+ * @file fp_environment.h
+ * @brief Host floating-point environment shared by the guest F and D instructions
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+#ifndef FP_ENVIRONMENT_H
+#define FP_ENVIRONMENT_H
+
+#include <cfenv>
+#include <cstdint>
+
+namespace alu {
+
+/**
+ * @brief Keeps the host rounding mode and exception flags on behalf of the guest.
+ *
+ * The host is only reprogrammed when an instruction asks for a different rounding
+ * mode than the previous one, so a run of same-rm instructions costs one
+ * fesetround. Exception flags accrue in the host's sticky status word and are read
+ * back only when TakeFlags() or Leave() is called, instead of around every instruction.
+ *
+ * Between Enter() and Leave() the host environment belongs to the guest; host code
+ * doing its own floating-point work in between (printing, statistics) should Leave()
+ * first so it neither sees the guest rounding mode nor leaks flags into fflags.
+ */
+class FpEnvironment {
+ public:
+  /// Claims the host environment: remembers the host rounding mode and clears the host flags.
+  void Enter();
+  /// Restores the host rounding mode and returns the flags accrued since the last TakeFlags().
+  uint8_t Leave();
+
+  /// Makes the host round like RISC-V rounding mode rm; rm must already be resolved from frm.
+  void SetRoundingMode(uint8_t rm) {
+    if (rm != guest_rm_) {
+      ApplyRoundingMode(rm);
+    }
+  }
+
+  /// Records flags an operation raised in software instead of through host arithmetic.
+  void Raise(uint8_t flags) {
+    raised_ |= flags;
+  }
+
+  /// Flags accrued since the last call, in fflags layout; both host and software flags are cleared.
+  uint8_t TakeFlags();
+
+  /// Host rounding mode for RISC-V rm. RMM and the reserved encodings have no host mode and round to nearest-even.
+  static int HostRoundingMode(uint8_t rm);
+  /// fflags bits for a host fetestexcept() result.
+  static uint8_t FlagsFromHost(int raised);
+
+ private:
+  static constexpr uint8_t kNoRoundingMode = 0xFF;
+
+  void ApplyRoundingMode(uint8_t rm);
+
+  uint8_t guest_rm_ = kNoRoundingMode; ///< Guest mode the host is programmed for, kNoRoundingMode if untouched.
+  int host_rm_ = FE_TONEAREST;         ///< Host mode to restore on Leave().
+  uint8_t raised_ = 0;                 ///< Software-raised flags not yet taken.
+};
+
+} // namespace alu
+
+#endif // FP_ENVIRONMENT_H
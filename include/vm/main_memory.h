@@ -9,6 +9,8 @@
 
 #include "config.h"
 
+#include <array>
+#include <span>
 #include <vector>
 #include <unordered_map>
 #include <cstdint>
@@ -36,8 +38,47 @@ struct MemoryBlock {
 class Memory {
  private:
   std::unordered_map<uint64_t, MemoryBlock> blocks_; ///< A map storing memory blocks, indexed by block index.
+  /// The blocks TakeSnapshot() captured. While the snapshot is live, blocks_ only holds the
+  /// blocks written since, each copied from here on its first write.
+  std::unordered_map<uint64_t, MemoryBlock> snapshot_blocks_;
+  int snapshot_fd_ = -1; ///< For the flat backing: a memfd holding the snapshot, -1 for none.
+  bool has_snapshot_ = false; ///< Whether TakeSnapshot() has captured an image since the last Configure().
+  bool snapshot_live_ = false; ///< Whether memory reads through to the snapshot, as it does until Reset().
   unsigned int block_size_; ///< The size of each memory block in bytes.
   uint64_t memory_size_ = vm_config::config.getMemorySize(); ///< The total memory size in bytes.
+  /// One entry of the block TLB: a block index and where its bytes live, nullptr for a block never written.
+  struct BlockTlbEntry {
+    uint64_t block_index = UINT64_MAX; ///< UINT64_MAX for an empty entry; no address reaches that block.
+    uint8_t *data = nullptr;
+    bool writable = false; ///< False for a block still shared with the snapshot.
+  };
+  static constexpr size_t kBlockTlbEntries = 64; ///< A power of two, indexed by the low bits of the block index.
+  /// Direct-mapped cache of recent block lookups, consulted before blocks_. The maps never move a
+  /// block's bytes, so entries only go stale when Reset() drops the blocks or a write creates one.
+  mutable std::array<BlockTlbEntry, kBlockTlbEntries> block_tlb_{};
+  uint8_t *flat_ = nullptr; ///< All of memory for the flat backing, nullptr for the sparse one.
+  size_t flat_size_ = 0; ///< Bytes reserved at flat_.
+  bool huge_pages_ = false; ///< Whether flat_ was advised to use transparent huge pages.
+
+  /**
+   * @brief Applies the [Memory] size and backing settings, leaving every byte zero.
+   *
+   * The flat backing reserves memory_size bytes without committing them; the kernel
+   * supplies zero pages as they are first touched.
+   */
+  void Configure();
+
+  /// Releases the flat reservation, if any.
+  void UnmapFlat();
+
+  /**
+   * @brief Maps flat_size_ bytes at flat_, replacing the old mapping, or anywhere if flat_ is nullptr.
+   * @param fd -1 for zero pages, otherwise a file to map copy-on-write.
+   */
+  void MapFlat(int fd);
+
+  /// Forgets the snapshot, if any.
+  void DropSnapshot();
 
   /**
    * @brief Gets the block index for a given memory address.
@@ -53,6 +94,25 @@ class Memory {
    */
   uint64_t GetBlockOffset(uint64_t address) const;
 
+  /**
+   * @brief Finds the bytes of a block through the block TLB, falling back to blocks_.
+   * @param block_index The index of the block to find.
+   * @return The block's first byte, or nullptr if it has never been written.
+   */
+  const uint8_t *FindBlock(uint64_t block_index) const;
+
+  /**
+   * @brief Finds the bytes of a block through the block TLB, creating the block if needed.
+   * @param block_index The index of the block to find or create.
+   * @return The block's first byte.
+   */
+  uint8_t *GetOrCreateBlock(uint64_t block_index);
+
+  /// Empties the block TLB.
+  void FlushBlockTlb() const {
+    block_tlb_.fill(BlockTlbEntry{});
+  }
+
   /**
    * @brief Checks if a memory block is present at the specified index.
    * @param block_index The index of the block to check.
@@ -66,17 +126,37 @@ class Memory {
    */
   void EnsureBlockExists(uint64_t block_index);
 
+  /**
+   * @brief Reads a byte the caller has already bounds-checked.
+   * @param address The memory address to read from.
+   * @return The byte value at the given address.
+   */
+  uint8_t ReadByteUnchecked(uint64_t address) const;
+
+  /**
+   * @brief Writes a byte the caller has already bounds-checked.
+   * @param address The memory address to write to.
+   * @param value The byte value to write.
+   */
+  void WriteByteUnchecked(uint64_t address, uint8_t value);
+
   /**
    * @brief Generic function to read data of type T from the memory.
+   *
+   * The caller has bounds-checked the access. An access inside one block is a single block lookup and
+   * one copy; the flat backing needs no lookup. Only an access straddling two blocks goes byte by byte.
    * @tparam T The type of data to read.
    * @param address The memory address to read from.
    * @return The value read from the specified memory address.
    */
   template<typename T>
-  T ReadGeneric(uint64_t address);
+  T ReadGeneric(uint64_t address) const;
 
   /**
    * @brief Generic function to write data of type T to the memory.
+   *
+   * The caller has bounds-checked the access. An access inside one block is a single block lookup and
+   * one copy; the flat backing needs no lookup. Only an access straddling two blocks goes byte by byte.
    * @tparam T The type of data to write.
    * @param address The memory address to write to.
    * @param value The value to write to the specified memory address.
@@ -86,20 +166,134 @@ class Memory {
 
  public:
   /**
-   * @brief Constructs a Memory object.
+   * @brief Constructs a Memory object with the backing the [Memory] settings choose.
    */
-  Memory() {
-    block_size_ = vm_config::config.getMemoryBlockSize();
-  }
+  Memory();
   /**
    * @brief Destroys the Memory object.
    */
-  ~Memory() = default;
+  ~Memory();
+
+  // flat_ is owned.
+  Memory(const Memory &) = delete;
+  Memory &operator=(const Memory &) = delete;
 
-  void Reset() {
-    blocks_.clear();
+  /**
+   * @brief Zeroes memory, picking up any change to the [Memory] size and backing settings.
+   *
+   * The snapshot survives unless the settings changed.
+   */
+  void Reset();
+
+  /**
+   * @brief Captures the current contents, for RestoreSnapshot() to return to.
+   *
+   * The sparse backing moves the written blocks into the snapshot and shares them until
+   * they are next written. The flat backing copies the pages in use into an in-memory
+   * file and maps it back copy-on-write.
+   */
+  void TakeSnapshot();
+
+  /**
+   * @brief Returns memory to the last snapshot in time independent of its size: only the blocks
+   * or pages written since are dropped, and only those written afterwards get copied again.
+   * @return False, with memory unchanged, if there is no snapshot.
+   */
+  bool RestoreSnapshot();
+
+  bool HasSnapshot() const {
+    return has_snapshot_;
   }
 
+  /**
+   * @brief Checks whether an access of size bytes at address lies inside memory.
+   * @param address The first byte of the access.
+   * @param size The width of the access in bytes.
+   * @return True if every byte of the access is addressable.
+   */
+  bool InBounds(uint64_t address, uint64_t size) const {
+    return size <= memory_size_ && address <= memory_size_ - size;
+  }
+
+  /**
+   * @brief Reads an unsigned integer of type T for a guest load, without throwing.
+   * @param address The memory address to read from.
+   * @param value Receives the value; left untouched when the access is out of range.
+   * @return False if the access falls outside memory.
+   */
+  template<typename T>
+  bool TryRead(uint64_t address, T &value);
+
+  /**
+   * @brief Writes an unsigned integer of type T for a guest store, without throwing.
+   * @param address The memory address to write to.
+   * @param value The value to write.
+   * @return False, with memory unchanged, if the access falls outside memory.
+   */
+  template<typename T>
+  bool TryWrite(uint64_t address, T value);
+
+  /**
+   * @brief Reads an unsigned integer of type T, the way every ReadX() does.
+   * @param address The memory address to read from.
+   * @return The value at the given address.
+   * @throws std::out_of_range if the access falls outside memory.
+   */
+  template<typename T>
+  T ReadValue(uint64_t address);
+
+  /**
+   * @brief Writes an unsigned integer of type T, the way every WriteX() does.
+   * @param address The memory address to write to.
+   * @param value The value to write.
+   * @throws std::out_of_range, with memory unchanged, if the access falls outside memory.
+   */
+  template<typename T>
+  void WriteValue(uint64_t address, T value);
+
+  /// The total memory size in bytes.
+  uint64_t Size() const {
+    return memory_size_;
+  }
+
+  uint64_t BlockSize() const {
+    return block_size_;
+  }
+
+  /**
+   * @brief The start of every BlockSize() block that may hold a non-zero byte, ascending.
+   *
+   * The flat backing reports the blocks on pages the OS has in memory, which can include
+   * blocks of zeros.
+   */
+  std::vector<uint64_t> UsedBlocks() const;
+
+  /**
+   * @brief Copies bytes.size() bytes starting at address into bytes, a block at a time.
+   * @param address The first byte to read.
+   * @param bytes Receives the bytes.
+   * @throws std::out_of_range, with bytes untouched, if any of them falls outside memory.
+   */
+  void ReadBlock(uint64_t address, std::span<uint8_t> bytes);
+
+  /**
+   * @brief Copies bytes into memory starting at address, a block at a time.
+   * @param address The first byte to write.
+   * @param bytes The bytes to write.
+   * @throws std::out_of_range, with memory unchanged, if any of them falls outside memory.
+   */
+  void WriteBlock(uint64_t address, std::span<const uint8_t> bytes);
+
+  /**
+   * @brief Finds the first byte equal to value among the max bytes from address, like memchr.
+   * @param address The first byte to search.
+   * @param value The byte to look for.
+   * @param max How many bytes to search at most.
+   * @return The offset of the byte from address, or max if none of them matched.
+   * @throws std::out_of_range if the search runs off the end of memory first.
+   */
+  uint64_t FindByte(uint64_t address, uint8_t value, uint64_t max);
+
   /**
    * @brief Reads a single byte from the given memory address.
    * @param address The memory address to read from.
@@ -9,8 +9,15 @@
 
 #include "../config.h"
 #include "main_memory.h"
+#include "cache/cache_hierarchy.h"
 
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <filesystem>
 #include <iostream>
+#include <memory>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -21,49 +28,239 @@
 class MemoryController {
 private:
     Memory memory_; ///< The main memory object.
+    /// L1I, L1D, L2 and L3 as [InstructionCache], [Cache], [L2Cache] and [L3Cache] enable them. The
+    /// instruction cache models fetch timing only: its lines never see stores, which is harmless
+    /// because the instruction bits come from the predecoded text.
+    cache::CacheHierarchy caches_{memory_};
+
 public:
     MemoryController() = default;
+    // The caches keep a reference to memory_.
+    MemoryController(const MemoryController &) = delete;
+    MemoryController &operator=(const MemoryController &) = delete;
 
     void Reset() {
         memory_.Reset();
+        caches_.Reset();
+    }
+
+    /// Snapshots memory with dirty cached lines written back, for RestoreMemorySnapshot().
+    void TakeMemorySnapshot() {
+        SyncCache();
+        memory_.TakeSnapshot();
+    }
+
+    [[nodiscard]] uint64_t MemorySize() const {
+        return memory_.Size();
+    }
+
+    [[nodiscard]] uint64_t MemoryBlockSize() const {
+        return memory_.BlockSize();
+    }
+
+    /// Memory::UsedBlocks() with dirty cached lines written back first.
+    [[nodiscard]] std::vector<uint64_t> UsedBlocks() const {
+        SyncCache();
+        return memory_.UsedBlocks();
+    }
+
+    /// Returns memory to the last snapshot with cold caches; false if there is none.
+    bool RestoreMemorySnapshot() {
+        if (!memory_.RestoreSnapshot()) {
+            return false;
+        }
+        caches_.Reset();
+        return true;
+    }
+
+    /// Rebuilds the cache hierarchy from the cache settings with cold lines and zeroed statistics.
+    void ConfigureCache();
+
+    [[nodiscard]] const cache::CacheHierarchy &GetCaches() const {
+        return caches_;
+    }
+
+    [[nodiscard]] const cache::Cache *GetDataCache() const {
+        return caches_.Get(cache::CacheHierarchy::kL1D);
+    }
+
+    [[nodiscard]] const cache::Cache *GetInstructionCache() const {
+        return caches_.Get(cache::CacheHierarchy::kL1I);
+    }
+
+    [[nodiscard]] bool HasCaches() const {
+        return !caches_.Empty();
+    }
+
+    /// The instruction about to fetch and access memory and its cycle, for the prefetchers.
+    void SetAccessContext(uint64_t pc, uint64_t cycle) {
+        if (HasCaches()) {
+            caches_.SetAccessContext(pc, cycle);
+        }
+    }
+
+    /// Runs the fetch of the word at address through the instruction side of the hierarchy, if any.
+    void AccessInstructionCache(uint64_t address) {
+        if (cache::Cache *first = caches_.InstructionPath(); first && memory_.InBounds(address, 4)) {
+            first->Read(address, 4);
+        }
+    }
+
+    /// Whether L1D has MSHRs, so that a pipeline can keep going past its misses.
+    [[nodiscard]] bool NonBlockingData() const {
+        const cache::Cache *data = caches_.DataPath();
+        return data && data->GetConfig().mshrs;
+    }
+
+    /// Cycles past a hit until the data of the last load or store through L1D arrived, stalls included.
+    [[nodiscard]] uint64_t LastDataLatency() const {
+        return caches_.DataPath()->LastLatency();
     }
 
-    void PrintCacheStatus() const {
+    /// Cycles the last load or store through L1D stalled the core for an MSHR or a write-buffer entry.
+    [[nodiscard]] uint64_t LastDataStall() const {
+        return caches_.DataPath()->LastStall();
+    }
+
+    /// Miss penalty cycles every level has charged since the caches were configured. Engines add
+    /// the growth across a step to cycle_s_, as if the whole core waited out each miss.
+    [[nodiscard]] uint64_t MissPenaltyCycles() const {
+        return caches_.PenaltyCycles();
+    }
+
+    void PrintCacheStatus(uint64_t instructions) const;
+    /// Writes the configuration and statistics of every cache level to filename as JSON.
+    void DumpCache(const std::filesystem::path &filename, uint64_t instructions) const;
+
+    // Coherent views for everything but guest loads and stores: they see dirty cached data
+    // and keep cached copies current, without counting as cache accesses. Each resolves its
+    // block, or its line in every level, once.
+
+    template <typename T>
+    [[nodiscard]] T ReadValue(uint64_t address) {
+        if (caches_.DataPath()) {
+            return static_cast<T>(caches_.DataPath()->Peek(address, sizeof(T)));
+        }
+        return memory_.ReadValue<T>(address);
+    }
+
+    template <typename T>
+    void WriteValue(uint64_t address, T value) {
+        if (caches_.DataPath()) {
+            caches_.DataPath()->Poke(address, value, sizeof(T));
+            return;
+        }
+        memory_.WriteValue<T>(address, value);
     }
 
     void WriteByte(uint64_t address, uint8_t value) {
-      memory_.WriteByte(address, value);
+        WriteValue(address, value);
     }
 
     void WriteHalfWord(uint64_t address, uint16_t value) {
-      memory_.WriteHalfWord(address, value);
+        WriteValue(address, value);
     }
 
     void WriteWord(uint64_t address, uint32_t value) {
-      memory_.WriteWord(address, value);
+        WriteValue(address, value);
     }
 
     void WriteDoubleWord(uint64_t address, uint64_t value) {
-      memory_.WriteDoubleWord(address, value);
+        WriteValue(address, value);
     }
 
     [[nodiscard]] uint8_t ReadByte(uint64_t address) {
-        return memory_.ReadByte(address);
+        return ReadValue<uint8_t>(address);
     }
 
     [[nodiscard]] uint16_t ReadHalfWord(uint64_t address) {
-        return memory_.ReadHalfWord(address);
+        return ReadValue<uint16_t>(address);
     }
 
     [[nodiscard]] uint32_t ReadWord(uint64_t address) {
-        return memory_.ReadWord(address);
+        return ReadValue<uint32_t>(address);
     }
 
     [[nodiscard]] uint64_t ReadDoubleWord(uint64_t address) {
-        return memory_.ReadDoubleWord(address);
+        return ReadValue<uint64_t>(address);
     }
 
-    // Functions to read memory directly with cache bypass
+    /// Copies bytes.size() bytes at address into bytes; throws std::out_of_range if any falls outside memory.
+    void ReadBlock(uint64_t address, std::span<uint8_t> bytes) {
+        if (!caches_.DataPath()) {
+            memory_.ReadBlock(address, bytes);
+            return;
+        }
+        if (!memory_.InBounds(address, bytes.size())) {
+            throw std::out_of_range("Memory address out of range: " + std::to_string(address));
+        }
+        caches_.DataPath()->PeekBlock(address, bytes);
+    }
+
+    /// Copies bytes to address; throws std::out_of_range, changing nothing, if any falls outside memory.
+    void WriteBlock(uint64_t address, std::span<const uint8_t> bytes) {
+        if (!caches_.DataPath()) {
+            memory_.WriteBlock(address, bytes);
+            return;
+        }
+        if (!memory_.InBounds(address, bytes.size())) {
+            throw std::out_of_range("Memory address out of range: " + std::to_string(address));
+        }
+        caches_.DataPath()->PokeBlock(address, bytes);
+    }
+
+    /// The offset from address of the first of the max bytes there equal to value, or max; see Memory::FindByte().
+    [[nodiscard]] uint64_t FindByte(uint64_t address, uint8_t value, uint64_t max) {
+        if (!caches_.DataPath()) {
+            return memory_.FindByte(address, value, max);
+        }
+        std::array<uint8_t, 256> chunk;
+        for (uint64_t done = 0; done < max;) {
+            const uint64_t at = address + done;
+            if (at >= memory_.Size()) {
+                throw std::out_of_range("Memory address out of range: " + std::to_string(at));
+            }
+            const auto size = static_cast<size_t>(std::min<uint64_t>({chunk.size(), max - done, memory_.Size() - at}));
+            caches_.DataPath()->PeekBlock(at, std::span(chunk).first(size));
+            if (const void *found = std::memchr(chunk.data(), value, size)) {
+                return done + static_cast<uint64_t>(static_cast<const uint8_t *>(found) - chunk.data());
+            }
+            done += size;
+        }
+        return max;
+    }
+
+    // Guest loads and stores: one bounds check, a fault is reported instead of thrown
+
+    [[nodiscard]] bool InBounds(uint64_t address, uint64_t size) const {
+        return memory_.InBounds(address, size);
+    }
+
+    template <typename T>
+    [[nodiscard]] bool TryRead(uint64_t address, T &value) {
+        if (!caches_.DataPath()) {
+            return memory_.TryRead(address, value);
+        }
+        if (!memory_.InBounds(address, sizeof(T))) {
+            return false;
+        }
+        value = static_cast<T>(caches_.DataPath()->Read(address, sizeof(T)));
+        return true;
+    }
+
+    template <typename T>
+    [[nodiscard]] bool TryWrite(uint64_t address, T value) {
+        if (!caches_.DataPath()) {
+            return memory_.TryWrite(address, value);
+        }
+        if (!memory_.InBounds(address, sizeof(T))) {
+            return false;
+        }
+        caches_.DataPath()->Write(address, value, sizeof(T));
+        return true;
+    }
+
+    // Functions to read memory directly with cache bypass: dirty cached data is not seen
 
     [[nodiscard]] uint8_t ReadByte_d(uint64_t address) {
         return memory_.ReadByte(address);
@@ -82,17 +279,25 @@ public:
     }
 
     void PrintMemory(const uint64_t address, unsigned int rows) {
+      SyncCache();
       memory_.PrintMemory(address, rows);
     }
 
     void DumpMemory(std::vector<std::string> args) {
+      SyncCache();
       memory_.DumpMemory(args);
     }
 
     void GetMemoryPoint(std::string address) {
+      SyncCache();
       return memory_.GetMemoryPoint(address);
     }
 
+    /// Brings memory up to date with dirty cached lines, for code that reads memory_ wholesale.
+    void SyncCache() const {
+      caches_.SyncToMemory();
+    }
+
 };
 
 #endif // MEMORY_CONTROLLER_H
@@ -18,15 +18,15 @@
  * @brief Represents a register file containing integer, floating-point, and vector registers.
  */
 class RegisterFile {
- private:
+ public:
   static constexpr size_t NUM_GPR = 32; ///< Number of General-Purpose Registers (GPR).
   static constexpr size_t NUM_FPR = 32; ///< Number of Floating-Point Registers (FPR).
+  static constexpr size_t NUM_CSR = 4096; ///< Number of Control and Status Registers (CSR).
 
+ private:
   std::array<uint64_t, NUM_GPR> gpr_ = {}; ///< Array for storing GPR values.
   std::array<uint64_t, NUM_FPR> fpr_ = {}; ///< Array for storing FPR values.
 
-  static constexpr size_t NUM_CSR = 4096; ///< Number of Control and Status Registers (CSR).
-
   std::array<uint64_t, NUM_CSR> csr_ = {}; ///< Array for storing CSR values.
 
  public:
@@ -59,6 +59,13 @@ class RegisterFile {
    */
   void WriteGpr(size_t reg, uint64_t value);
 
+  /**
+   * @brief Direct access to the GPR storage for execution engines that index it without bounds checks.
+   * @note x0 is stored like any other register; callers must never write index 0.
+   * @return Pointer to the first of the 32 GPR slots.
+   */
+  [[nodiscard]] uint64_t *GprData() { return gpr_.data(); }
+
   /**
    * @brief Reads the value of a Floating-Point Register (FPR).
    * @param reg The index of the FPR to read.
@@ -0,0 +1,48 @@
+/**
+ * @file rv5s_control_unit.h
+ * @brief RV5S Control Unit
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+#ifndef RV5S_CONTROL_UNIT_H
+#define RV5S_CONTROL_UNIT_H
+
+#include "../control_unit_base.h"
+#include "../decoded_instruction.h"
+
+#include <cstdint>
+
+/**
+ * @brief Register file an operand is read from or a result is written to.
+ */
+enum class RegisterFileKind : uint8_t {
+  kNone,
+  kGpr,
+  kFpr,
+};
+
+/**
+ * @brief Registers an instruction actually reads and writes, as the hazard and
+ * forwarding units see them.
+ *
+ * Only real operands are listed, so unused encoding fields (the rs2 field of a
+ * unary FP op, the uimm of csrr*i) never cause a stall. A destination of x0 is
+ * kNone because the write is discarded.
+ */
+struct RegisterUse {
+  RegisterFileKind rs1 = RegisterFileKind::kNone;
+  RegisterFileKind rs2 = RegisterFileKind::kNone;
+  RegisterFileKind rs3 = RegisterFileKind::kNone;
+  RegisterFileKind rd = RegisterFileKind::kNone;
+};
+
+class RV5SControlUnit : public ControlUnit {
+ public:
+  void SetControlSignals(uint32_t instruction) override;
+
+  alu::AluOp GetAluSignal(uint32_t instruction, bool ALUOp) override;
+
+  /// Operands and destination of decoded. Writebacks RVSSVM skips (W-ops, fmadd) have no destination here either.
+  static RegisterUse GetRegisterUse(const DecodedInstruction &decoded);
+};
+
+#endif // RV5S_CONTROL_UNIT_H
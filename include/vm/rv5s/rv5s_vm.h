@@ -0,0 +1,186 @@
+/**
+ * @file rv5s_vm.h
+ * @brief RV5S VM definition
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+#ifndef RV5S_VM_H
+#define RV5S_VM_H
+
+#include "vm/vm_base.h"
+
+#include "rv5s_control_unit.h"
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <stack>
+#include <vector>
+
+/// IF/ID: the instruction fetched in IF.
+struct IfIdRegister {
+  bool valid = false; ///< False for a bubble.
+  uint64_t pc = 0;
+  DecodedInstruction decoded;
+  bool predicted_taken = false; ///< Direction fetch followed for a conditional branch.
+};
+
+/// ID/EX: operands as read from the register files in ID, before forwarding.
+struct IdExRegister {
+  bool valid = false;
+  uint64_t pc = 0;
+  DecodedInstruction decoded;
+  RegisterUse use;
+  bool predicted_taken = false;
+  uint64_t rs1_value = 0;
+  uint64_t rs2_value = 0;
+  uint64_t rs3_value = 0;
+};
+
+/// EX/MEM: the EX result, which is the effective address for memory instructions.
+struct ExMemRegister {
+  bool valid = false;
+  uint64_t pc = 0;
+  DecodedInstruction decoded;
+  RegisterUse use;
+  uint64_t result = 0;
+  uint64_t store_value = 0; ///< rs2 after forwarding: store data, or the second ldbm operand address.
+};
+
+/// MEM/WB: the value rd receives.
+struct MemWbRegister {
+  bool valid = false;
+  uint64_t pc = 0;
+  DecodedInstruction decoded;
+  RegisterUse use;
+  uint64_t result = 0;
+};
+
+struct PipelineRegisters {
+  IfIdRegister if_id;
+  IdExRegister id_ex;
+  ExMemRegister ex_mem;
+  MemWbRegister mem_wb;
+};
+
+/// Non-blocking L1D: the cycle by whose end each register's outstanding load delivers it.
+struct LoadScoreboard {
+  std::array<uint64_t, 32> gpr{};
+  std::array<uint64_t, 32> fpr{};
+};
+
+/// Pipeline latches, fetch PC and counters at a cycle boundary.
+struct PipelineSnapshot {
+  PipelineRegisters latches;
+  LoadScoreboard scoreboard;
+  uint64_t program_counter = 0;
+  uint64_t cycles = 0;
+  uint64_t instructions_retired = 0;
+  uint64_t stall_cycles = 0;
+  uint64_t branch_predictions = 0;
+  uint64_t branch_mispredictions = 0;
+  TrapRecord trap;
+};
+
+/// Everything one clock cycle changed, so Undo and Redo move the pipeline by a cycle.
+struct CycleDelta {
+  PipelineSnapshot before;
+  PipelineSnapshot after;
+  std::vector<RegisterChange> register_changes;
+  std::vector<MemoryChange> memory_changes;
+};
+
+/**
+ * @brief Five-stage IF/ID/EX/MEM/WB pipeline.
+ *
+ * Each call to Cycle() advances every stage by one clock. Stages read the
+ * latches as they were at the start of the cycle and fill the next ones, with
+ * WB evaluated first so ID reads registers written in the same cycle.
+ *
+ * - Forwarding (Execution.forwarding) feeds EX/MEM and MEM/WB results into EX.
+ * - Hazard detection (Execution.hazard_detection) stalls ID on load-use, or on
+ *   any RAW dependency still in EX or MEM when forwarding is off. Without it,
+ *   dependent instructions see stale values, as unprotected hardware would.
+ * - Fetch follows branch_predictor_ for conditional branches; with
+ *   branch_prediction_type none it falls through. Branches resolve in EX,
+ *   where a wrong guess flushes IF/ID and ID/EX and counts as a misprediction.
+ *   Jumps have no target prediction and always flush the same two slots.
+ *   Undo rewinds the counters but not what the predictor has learnt.
+ * - ecall waits in ID until the pipeline ahead of it has drained.
+ * - Cache misses freeze the whole pipeline for their penalty, unless L1D has
+ *   MSHRs (Cache.cache_mshrs). Then a load miss only marks its destination
+ *   register as pending in the scoreboard, hazard detection holds the first
+ *   instruction that reads it in ID until the data arrives, and only MSHR or
+ *   write-buffer stalls freeze the pipeline. Fetch misses still freeze it.
+ *
+ * Architectural results match RVSSVM, including which writebacks it performs.
+ * Step() advances one cycle.
+ */
+class RV5SVM : public VmBase {
+ public:
+  RV5SControlUnit control_unit_;
+
+  PipelineRegisters latches_;
+  LoadScoreboard scoreboard_;
+
+  std::stack<CycleDelta> undo_stack_;
+  std::stack<CycleDelta> redo_stack_;
+  CycleDelta current_cycle_;
+
+  DecodedInstruction DecodeInstruction(uint32_t instruction) override;
+  void LoadProgram(const AssembledProgram &program) override;
+  /// The configured predictor, regardless of the single-stage predictor-only switch.
+  std::unique_ptr<BranchPredictor> CreateBranchPredictor() const override;
+
+  /// Advances the pipeline by one clock cycle.
+  template <bool RecordHistory> void Cycle();
+  /// True when no stage holds an instruction.
+  bool PipelineEmpty() const;
+  bool AtInstructionBoundary() const override {
+    return PipelineEmpty();
+  }
+
+  RV5SVM();
+  ~RV5SVM() override;
+
+  void Run() override;
+  void DebugRun() override;
+  void Step() override;
+  void StepN(uint64_t count) override;
+  void Undo() override;
+  void Redo() override;
+  void Reset() override;
+
+  void DumpEngineState(std::ostream &file) const override;
+
+ private:
+  template <bool RecordHistory> void WriteBackStage(const MemWbRegister &in);
+  /// False if the access faulted; the trap has been raised. stall is set to the cycles a non-blocking L1D stalled.
+  template <bool RecordHistory> bool MemoryStage(const ExMemRegister &in, MemWbRegister &out, uint64_t &stall);
+  /// Sets redirect and target when a branch is taken or a jump executes.
+  template <bool RecordHistory> void ExecuteStage(const IdExRegister &in, ExMemRegister &out,
+                                                  bool &redirect, uint64_t &target);
+  /// False if the hazard unit stalled the instruction in ID.
+  bool DecodeStage(const IfIdRegister &in, IdExRegister &out);
+  void FetchStage(IfIdRegister &out);
+
+  /// Value of a source operand after the forwarding unit.
+  uint64_t Forward(RegisterFileKind kind, uint8_t reg, uint64_t value) const;
+  /// True if ID must hold the instruction this cycle.
+  bool DetectHazard(const DecodedInstruction &decoded, const RegisterUse &use) const;
+  /// True if a source register still waits on a load that missed a non-blocking L1D.
+  bool AwaitsLoad(const DecodedInstruction &decoded, const RegisterUse &use) const;
+  bool LoadMemory(uint8_t funct3, uint64_t address, uint64_t &value);
+  template <bool RecordHistory> bool StoreMemory(uint64_t address, uint64_t value, size_t width);
+  template <bool RecordHistory> void ExecuteCsr(const DecodedInstruction &decoded, uint64_t rs1_value,
+                                                ExMemRegister &out);
+  template <bool RecordHistory> void HandleSyscall();
+
+  void RecordRegister(unsigned int reg_type, unsigned int reg_index, uint64_t old_value, uint64_t new_value);
+  PipelineSnapshot Snapshot() const;
+  void Restore(const PipelineSnapshot &snapshot);
+  void UpdateStatistics();
+  /// Drives Cycle() until the program ends, a stop, the instruction limit or (Debug) a breakpoint.
+  template <bool Debug> void RunLoop();
+};
+
+#endif // RV5S_VM_H
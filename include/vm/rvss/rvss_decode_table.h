@@ -0,0 +1,345 @@
+/**
+ * @file rvss_decode_table.h
+ * @brief Compile-time generated decode table for the RVSS control unit
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+#ifndef RVSS_DECODE_TABLE_H
+#define RVSS_DECODE_TABLE_H
+
+#include "../control_unit_base.h"
+#include "../alu.h"
+#include "common/instructions.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace rvss_decode {
+
+using instruction_set::Instruction;
+
+/**
+ * @brief ALU operation of each instruction the VM executes.
+ *
+ * Together with instruction_set::compiletime_instruction_encoding_array this is
+ * the whole decoder: adding an instruction means adding its encoding there and
+ * its ALU operation here. Instructions without an entry decode to kNone.
+ */
+struct AluOpSpec {
+  Instruction instr;
+  alu::AluOp alu_op;
+};
+
+inline constexpr AluOpSpec kAluOpSpecs[] = {
+  {Instruction::kadd, alu::AluOp::kAdd},       {Instruction::ksub, alu::AluOp::kSub},
+  {Instruction::ksll, alu::AluOp::kSll},       {Instruction::kslt, alu::AluOp::kSlt},
+  {Instruction::ksltu, alu::AluOp::kSltu},     {Instruction::kxor, alu::AluOp::kXor},
+  {Instruction::ksrl, alu::AluOp::kSrl},       {Instruction::ksra, alu::AluOp::kSra},
+  {Instruction::kor, alu::AluOp::kOr},         {Instruction::kand, alu::AluOp::kAnd},
+
+  {Instruction::kmul, alu::AluOp::kMul},       {Instruction::kmulh, alu::AluOp::kMulh},
+  {Instruction::kmulhsu, alu::AluOp::kMulhsu}, {Instruction::kmulhu, alu::AluOp::kMulhu},
+  {Instruction::kdiv, alu::AluOp::kDiv},       {Instruction::kdivu, alu::AluOp::kDivu},
+  {Instruction::krem, alu::AluOp::kRem},       {Instruction::kremu, alu::AluOp::kRemu},
+
+  {Instruction::kaddw, alu::AluOp::kAddw},     {Instruction::ksubw, alu::AluOp::kSubw},
+  {Instruction::ksllw, alu::AluOp::kSllw},     {Instruction::ksrlw, alu::AluOp::kSrlw},
+  {Instruction::ksraw, alu::AluOp::kSraw},
+  {Instruction::kmulw, alu::AluOp::kMulw},     {Instruction::kdivw, alu::AluOp::kDivw},
+  {Instruction::kdivuw, alu::AluOp::kDivuw},   {Instruction::kremw, alu::AluOp::kRemw},
+  {Instruction::kremuw, alu::AluOp::kRemuw},
+
+  {Instruction::kaddi, alu::AluOp::kAdd},      {Instruction::kslli, alu::AluOp::kSll},
+  {Instruction::kslti, alu::AluOp::kSlt},      {Instruction::ksltiu, alu::AluOp::kSltu},
+  {Instruction::kxori, alu::AluOp::kXor},      {Instruction::ksrli, alu::AluOp::kSrl},
+  {Instruction::ksrai, alu::AluOp::kSra},      {Instruction::kori, alu::AluOp::kOr},
+  {Instruction::kandi, alu::AluOp::kAnd},
+
+  {Instruction::kaddiw, alu::AluOp::kAddw},    {Instruction::kslliw, alu::AluOp::kSllw},
+  {Instruction::ksrliw, alu::AluOp::kSrlw},    {Instruction::ksraiw, alu::AluOp::kSraw},
+
+  {Instruction::klb, alu::AluOp::kAdd},        {Instruction::klh, alu::AluOp::kAdd},
+  {Instruction::klw, alu::AluOp::kAdd},        {Instruction::kld, alu::AluOp::kAdd},
+  {Instruction::klbu, alu::AluOp::kAdd},       {Instruction::klhu, alu::AluOp::kAdd},
+  {Instruction::klwu, alu::AluOp::kAdd},
+  {Instruction::ksb, alu::AluOp::kAdd},        {Instruction::ksh, alu::AluOp::kAdd},
+  {Instruction::ksw, alu::AluOp::kAdd},        {Instruction::ksd, alu::AluOp::kAdd},
+
+  {Instruction::kbeq, alu::AluOp::kSub},       {Instruction::kbne, alu::AluOp::kSub},
+  {Instruction::kblt, alu::AluOp::kSlt},       {Instruction::kbge, alu::AluOp::kSlt},
+  {Instruction::kbltu, alu::AluOp::kSltu},     {Instruction::kbgeu, alu::AluOp::kSltu},
+
+  {Instruction::klui, alu::AluOp::kAdd},       {Instruction::kauipc, alu::AluOp::kAdd},
+  {Instruction::kjal, alu::AluOp::kAdd},       {Instruction::kjalr, alu::AluOp::kAdd},
+
+  {Instruction::kflw, alu::AluOp::kAdd},       {Instruction::kfsw, alu::AluOp::kAdd},
+  {Instruction::kfld, alu::AluOp::kAdd},       {Instruction::kfsd, alu::AluOp::kAdd},
+
+  {Instruction::kfmadd_s, alu::AluOp::kFmadd_s},   {Instruction::kfmsub_s, alu::AluOp::kFmsub_s},
+  {Instruction::kfnmsub_s, alu::AluOp::kFnmsub_s}, {Instruction::kfnmadd_s, alu::AluOp::kFnmadd_s},
+  {Instruction::kfadd_s, alu::AluOp::FADD_S},      {Instruction::kfsub_s, alu::AluOp::FSUB_S},
+  {Instruction::kfmul_s, alu::AluOp::FMUL_S},      {Instruction::kfdiv_s, alu::AluOp::FDIV_S},
+  {Instruction::kfsqrt_s, alu::AluOp::FSQRT_S},
+  {Instruction::kfsgnj_s, alu::AluOp::FSGNJ_S},    {Instruction::kfsgnjn_s, alu::AluOp::FSGNJN_S},
+  {Instruction::kfsgnjx_s, alu::AluOp::FSGNJX_S},
+  {Instruction::kfmin_s, alu::AluOp::FMIN_S},      {Instruction::kfmax_s, alu::AluOp::FMAX_S},
+  {Instruction::kfeq_s, alu::AluOp::FEQ_S},        {Instruction::kflt_s, alu::AluOp::FLT_S},
+  {Instruction::kfle_s, alu::AluOp::FLE_S},        {Instruction::kfclass_s, alu::AluOp::FCLASS_S},
+  {Instruction::kfcvt_w_s, alu::AluOp::FCVT_W_S},  {Instruction::kfcvt_wu_s, alu::AluOp::FCVT_WU_S},
+  {Instruction::kfcvt_l_s, alu::AluOp::FCVT_L_S},  {Instruction::kfcvt_lu_s, alu::AluOp::FCVT_LU_S},
+  {Instruction::kfcvt_s_w, alu::AluOp::FCVT_S_W},  {Instruction::kfcvt_s_wu, alu::AluOp::FCVT_S_WU},
+  {Instruction::kfcvt_s_l, alu::AluOp::FCVT_S_L},  {Instruction::kfcvt_s_lu, alu::AluOp::FCVT_S_LU},
+  {Instruction::kfmv_x_w, alu::AluOp::FMV_X_W},    {Instruction::kfmv_w_x, alu::AluOp::FMV_W_X},
+
+  {Instruction::kfmadd_d, alu::AluOp::FMADD_D},    {Instruction::kfmsub_d, alu::AluOp::FMSUB_D},
+  {Instruction::kfnmsub_d, alu::AluOp::FNMSUB_D},  {Instruction::kfnmadd_d, alu::AluOp::FNMADD_D},
+  {Instruction::kfadd_d, alu::AluOp::FADD_D},      {Instruction::kfsub_d, alu::AluOp::FSUB_D},
+  {Instruction::kfmul_d, alu::AluOp::FMUL_D},      {Instruction::kfdiv_d, alu::AluOp::FDIV_D},
+  {Instruction::kfsqrt_d, alu::AluOp::FSQRT_D},
+  {Instruction::kfsgnj_d, alu::AluOp::FSGNJ_D},    {Instruction::kfsgnjn_d, alu::AluOp::FSGNJN_D},
+  {Instruction::kfsgnjx_d, alu::AluOp::FSGNJX_D},
+  {Instruction::kfmin_d, alu::AluOp::FMIN_D},      {Instruction::kfmax_d, alu::AluOp::FMAX_D},
+  {Instruction::kfeq_d, alu::AluOp::FEQ_D},        {Instruction::kflt_d, alu::AluOp::FLT_D},
+  {Instruction::kfle_d, alu::AluOp::FLE_D},        {Instruction::kfclass_d, alu::AluOp::FCLASS_D},
+  {Instruction::kfcvt_w_d, alu::AluOp::FCVT_W_D},  {Instruction::kfcvt_wu_d, alu::AluOp::FCVT_WU_D},
+  {Instruction::kfcvt_l_d, alu::AluOp::FCVT_L_D},  {Instruction::kfcvt_lu_d, alu::AluOp::FCVT_LU_D},
+  {Instruction::kfcvt_d_w, alu::AluOp::FCVT_D_W},  {Instruction::kfcvt_d_wu, alu::AluOp::FCVT_D_WU},
+  {Instruction::kfcvt_d_l, alu::AluOp::FCVT_D_L},  {Instruction::kfcvt_d_lu, alu::AluOp::FCVT_D_LU},
+  {Instruction::kfcvt_s_d, alu::AluOp::FCVT_S_D},  {Instruction::kfcvt_d_s, alu::AluOp::FCVT_D_S},
+  {Instruction::kfmv_x_d, alu::AluOp::FMV_X_D},    {Instruction::kfmv_d_x, alu::AluOp::FMV_D_X},
+};
+
+/**
+ * @brief Control signals per major opcode; the RVSS datapath does not look past the opcode for these.
+ */
+constexpr ControlSignals OpcodeSignals(uint8_t opcode) {
+  ControlSignals signals;
+  switch (opcode) {
+    case 0b0110011: // R-type
+    case 0b0000001: // kMul
+    case 0b1010011: // F/D R-type
+      signals.reg_write = true;
+      signals.alu_op = true;
+      break;
+    case 0b0000011: // Load
+    case 0b0000111: // F/D load
+      signals.alu_src = true;
+      signals.mem_to_reg = true;
+      signals.reg_write = true;
+      signals.mem_read = true;
+      break;
+    case 0b0100011: // Store
+    case 0b0100111: // F/D store
+      signals.alu_src = true;
+      signals.alu_op = true;
+      signals.mem_write = true;
+      break;
+    case 0b1100011: // Branch
+      signals.alu_op = true;
+      signals.branch = true;
+      break;
+    case 0b0010011: // I-type
+    case 0b0110111: // LUI
+    case 0b0010111: // AUIPC
+      signals.alu_src = true;
+      signals.reg_write = true;
+      signals.alu_op = true;
+      break;
+    case 0b0101010: // LDBM
+      signals.mem_read = true;
+      break;
+    case 0b0111111: // BIGMUL
+      signals.mem_write = true;
+      signals.bigmul_busy = true;
+      break;
+    case 0b1101111: // JAL
+      signals.reg_write = true;
+      signals.branch = true;
+      break;
+    case 0b1100111: // JALR
+      signals.alu_src = true;
+      signals.reg_write = true;
+      signals.branch = true;
+      break;
+    default:
+      break;
+  }
+  return signals;
+}
+
+/// Instruction fields a major opcode's second level is indexed by.
+enum KeyField : uint8_t {
+  kKeyFunct3 = 1 << 0,
+  kKeyFunct7 = 1 << 1,
+  kKeyFunct6 = 1 << 2,
+  kKeyFunct5 = 1 << 3,
+  kKeyFunct2 = 1 << 4,
+};
+
+/// First level: one entry per 7-bit opcode.
+struct MajorEntry {
+  ControlSignals signals;
+  uint32_t base = 0;      ///< Start of this opcode's slice of the second level.
+  uint16_t high_mask = 0; ///< Bits of (instruction >> high_shift) in the index.
+  uint8_t high_shift = 0;
+  uint8_t funct3_bits = 0; ///< 3 when funct3 is part of the index, else 0.
+  uint8_t funct3_mask = 0; ///< (1 << funct3_bits) - 1.
+};
+
+/// Second level: what a fully keyed encoding decodes to.
+struct DecodeEntry {
+  uint8_t instr = static_cast<uint8_t>(Instruction::INVALID);
+  uint8_t alu_op = static_cast<uint8_t>(alu::AluOp::kNone);
+
+  [[nodiscard]] constexpr Instruction GetInstruction() const { return static_cast<Instruction>(instr); }
+  [[nodiscard]] constexpr alu::AluOp GetAluOp() const { return static_cast<alu::AluOp>(alu_op); }
+};
+
+static_assert(static_cast<size_t>(Instruction::COUNT) <= 256, "DecodeEntry stores the instruction in a byte");
+static_assert(static_cast<size_t>(alu::AluOp::FMV_X_D) < 256, "DecodeEntry stores the ALU operation in a byte");
+
+/// Index of instruction inside its opcode's slice.
+constexpr uint32_t MinorIndex(const MajorEntry &major, uint32_t instruction) {
+  return (((instruction >> major.high_shift) & major.high_mask) << major.funct3_bits) |
+         ((instruction >> 12) & major.funct3_mask);
+}
+
+namespace detail {
+
+constexpr bool IsCategory(Instruction instr) {
+  return instr <= Instruction::kCsrType;
+}
+
+constexpr alu::AluOp SpecAluOp(Instruction instr) {
+  for (const AluOpSpec &spec : kAluOpSpecs) {
+    if (spec.instr == instr) return spec.alu_op;
+  }
+  return alu::AluOp::kNone;
+}
+
+/// Every field any encoding of the opcode constrains.
+constexpr uint8_t KeyFields(int opcode) {
+  uint8_t fields = 0;
+  for (const auto &encoding : instruction_set::compiletime_instruction_encoding_array) {
+    if (encoding.opcode != opcode || IsCategory(encoding.instr)) continue;
+    if (encoding.funct3 >= 0) fields |= kKeyFunct3;
+    if (encoding.funct7 >= 0) fields |= kKeyFunct7;
+    if (encoding.funct6 >= 0) fields |= kKeyFunct6;
+    if (encoding.funct5 >= 0) fields |= kKeyFunct5;
+    if (encoding.funct2 >= 0) fields |= kKeyFunct2;
+  }
+  return fields;
+}
+
+/// Places the fields above funct3 as one contiguous slice of the instruction.
+constexpr MajorEntry MakeMajor(uint8_t opcode, uint8_t fields) {
+  MajorEntry major;
+  major.signals = OpcodeSignals(opcode);
+  major.funct3_bits = (fields & kKeyFunct3) ? 3 : 0;
+  major.funct3_mask = static_cast<uint8_t>((1u << major.funct3_bits) - 1);
+  switch (fields & ~kKeyFunct3) {
+    case 0: break;
+    case kKeyFunct7 | kKeyFunct5: major.high_shift = 20; major.high_mask = 0xFFF; break;
+    case kKeyFunct7: major.high_shift = 25; major.high_mask = 0x7F; break;
+    case kKeyFunct6: major.high_shift = 26; major.high_mask = 0x3F; break;
+    case kKeyFunct2: major.high_shift = 25; major.high_mask = 0x3; break;
+    case kKeyFunct5: major.high_shift = 20; major.high_mask = 0x1F; break;
+    default: throw "unsupported combination of encoding fields for one opcode";
+  }
+  return major;
+}
+
+constexpr uint32_t SliceSize(const MajorEntry &major) {
+  return (static_cast<uint32_t>(major.high_mask) + 1) << major.funct3_bits;
+}
+
+constexpr size_t MinorSize() {
+  size_t size = 0;
+  for (int opcode = 0; opcode < 128; ++opcode) {
+    size += SliceSize(MakeMajor(static_cast<uint8_t>(opcode), KeyFields(opcode)));
+  }
+  return size;
+}
+
+/// Range a field takes over all instructions an encoding matches.
+struct FieldRange {
+  uint32_t first;
+  uint32_t last;
+};
+
+constexpr FieldRange Range(int value, bool keyed, uint32_t max) {
+  if (!keyed) return {0, 0};
+  if (value < 0) return {0, max};
+  return {static_cast<uint32_t>(value), static_cast<uint32_t>(value)};
+}
+
+} // namespace detail
+
+/**
+ * @brief Two-level decode table: opcode, then the funct fields that opcode needs.
+ *
+ * Built at compile time from compiletime_instruction_encoding_array. Where two
+ * encodings claim the same bits the one listed first wins, as in get_instr_encoding.
+ */
+struct DecodeTable {
+  std::array<MajorEntry, 128> major{};
+  std::array<DecodeEntry, detail::MinorSize()> minor{};
+
+  [[nodiscard]] constexpr const MajorEntry &Major(uint32_t instruction) const {
+    return major[instruction & 0b1111111];
+  }
+
+  [[nodiscard]] constexpr const DecodeEntry &Lookup(uint32_t instruction) const {
+    const MajorEntry &entry = Major(instruction);
+    return minor[entry.base + MinorIndex(entry, instruction)];
+  }
+};
+
+constexpr DecodeTable BuildDecodeTable() {
+  DecodeTable table;
+  uint32_t base = 0;
+  for (int opcode = 0; opcode < 128; ++opcode) {
+    table.major[opcode] = detail::MakeMajor(static_cast<uint8_t>(opcode), detail::KeyFields(opcode));
+    table.major[opcode].base = base;
+    base += detail::SliceSize(table.major[opcode]);
+  }
+
+  std::array<bool, detail::MinorSize()> claimed{};
+  for (const auto &encoding : instruction_set::compiletime_instruction_encoding_array) {
+    if (encoding.opcode < 0 || detail::IsCategory(encoding.instr)) continue;
+    const MajorEntry &major = table.major[encoding.opcode];
+    const uint8_t fields = detail::KeyFields(encoding.opcode);
+    const DecodeEntry entry{static_cast<uint8_t>(encoding.instr),
+                            static_cast<uint8_t>(detail::SpecAluOp(encoding.instr))};
+
+    const auto f3 = detail::Range(encoding.funct3, fields & kKeyFunct3, 0b111);
+    const auto f7 = detail::Range(encoding.funct7, fields & kKeyFunct7, 0b1111111);
+    const auto f6 = detail::Range(encoding.funct6, fields & kKeyFunct6, 0b111111);
+    const auto f5 = detail::Range(encoding.funct5, fields & kKeyFunct5, 0b11111);
+    const auto f2 = detail::Range(encoding.funct2, fields & kKeyFunct2, 0b11);
+    for (uint32_t funct3 = f3.first; funct3 <= f3.last; ++funct3) {
+      for (uint32_t funct7 = f7.first; funct7 <= f7.last; ++funct7) {
+        for (uint32_t funct6 = f6.first; funct6 <= f6.last; ++funct6) {
+          for (uint32_t funct5 = f5.first; funct5 <= f5.last; ++funct5) {
+            for (uint32_t funct2 = f2.first; funct2 <= f2.last; ++funct2) {
+              const uint32_t instruction = static_cast<uint32_t>(encoding.opcode) | funct3 << 12 | funct5 << 20 |
+                                           funct2 << 25 | funct7 << 25 | funct6 << 26;
+              const uint32_t index = major.base + MinorIndex(major, instruction);
+              if (!claimed[index]) {
+                claimed[index] = true;
+                table.minor[index] = entry;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  return table;
+}
+
+inline constexpr DecodeTable kDecodeTable = BuildDecodeTable();
+
+} // namespace rvss_decode
+
+#endif // RVSS_DECODE_TABLE_H
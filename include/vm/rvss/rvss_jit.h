@@ -0,0 +1,153 @@
+/**
+ * @file rvss_jit.h
+ * @brief x86-64 translation tier for hot basic blocks of the threaded engine
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+#ifndef RVSS_JIT_H
+#define RVSS_JIT_H
+
+#include "rvss_threaded_vm.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define RVSS_JIT_SUPPORTED 1
+#endif
+
+/**
+ * @brief State shared between the engine and translated code.
+ *
+ * Translated code keeps a pointer to this in r12 and the GPR file base in rbx.
+ * Field offsets are baked into the generated code, so keep the layout stable.
+ */
+struct JitContext {
+  uint64_t budget = 0;                   ///< Instructions translated code may still retire before returning.
+  uint64_t *gpr = nullptr;               ///< RegisterFile::GprData() of the running VM.
+  const uint8_t *stop_flag = nullptr;    ///< VmBase::stop_byte_, non-zero once a stop is requested.
+  bool *branch_flag = nullptr;
+  RVSSThreadedVM *vm = nullptr;
+  uint8_t fault = 0;                     ///< Set by a memory helper when the access faulted.
+};
+
+/**
+ * @brief Translates RV64I/M basic blocks taken from the threaded program into
+ * x86-64 code held in an executable code cache.
+ *
+ * Only the instructions with a dedicated ThreadedHandler are translated; a block
+ * stops in front of the first kGeneric entry (F/D, CSR, ecall, bigmul/ldbm, odd
+ * encodings) so those always go through the interpreter. Guest registers live in
+ * the RegisterFile, each instruction loads its operands from and writes its result
+ * back to it, and loads/stores call into the MemoryController. Direct branch exits
+ * are chained to the target translation once it exists.
+ *
+ * Translations are dropped page-wise when the guest writes into a page holding
+ * translated code; the code cache is flushed as a whole once it fills up.
+ *
+ * The code cache is never writable and executable at once: it stays read/execute
+ * and only turns read/write while code is emitted or chains are patched.
+ */
+class RVSSJit {
+ public:
+  /// @param code_cache_size Bytes of executable memory translations are emitted into.
+  explicit RVSSJit(size_t code_cache_size = kDefaultCodeCacheSize);
+  ~RVSSJit();
+  RVSSJit(const RVSSJit &) = delete;
+  RVSSJit &operator=(const RVSSJit &) = delete;
+
+  /// False when the code cache could not be mapped or made writable again; the engine then stays interpreted.
+  [[nodiscard]] bool Available() const { return code_begin_ != nullptr && !disabled_; }
+
+  /// Translation starting at pc, or nullptr when there is none.
+  [[nodiscard]] const uint8_t *Lookup(uint64_t pc) const {
+    uint64_t index = pc / 4;
+    return index < entries_.size() ? entries_[index] : nullptr;
+  }
+
+  /**
+   * @brief Translates the block starting at pc.
+   * @param program Threaded program the block is taken from, terminated by kTextEnd.
+   * @return The translation, or nullptr if the block has nothing translatable.
+   */
+  const uint8_t *Translate(uint64_t pc, const std::vector<ThreadedInstruction> &program);
+
+  /**
+   * @brief Runs translated code until it leaves the chained region.
+   * @return Address of the next instruction to execute.
+   */
+  uint64_t Execute(const uint8_t *code, JitContext &context) const;
+
+  /// Drops every translation overlapping a page touched by [address, address + size).
+  void InvalidateRange(uint64_t address, uint64_t size);
+
+  /// Drops all translations and empties the code cache.
+  void Flush();
+
+  [[nodiscard]] size_t TranslatedBlocks() const { return blocks_.size(); }
+
+  static constexpr size_t kDefaultCodeCacheSize = 16 * 1024 * 1024;
+
+ private:
+  static constexpr uint64_t kPageShift = 12;
+  static constexpr uint32_t kMaxBlockInstructions = 256;
+
+  /// A direct exit whose jump can be pointed at the target translation.
+  struct Link {
+    uint8_t *field;           ///< rel32 of the chaining jump.
+    uint8_t *unlinked_target; ///< Where the jump goes while the target is not translated.
+    uint64_t source_pc;
+    uint64_t target_pc;
+  };
+
+  struct Block {
+    uint64_t start;
+    uint64_t end; ///< One past the last translated byte.
+    uint8_t *code;
+    std::vector<uint64_t> exit_targets;
+  };
+
+  /**
+   * Makes the code cache read/write for as long as it lives, then read/execute again. Scopes nest.
+   * It may run under translated code, so a failing mprotect is reported through Writable()
+   * rather than thrown.
+   */
+  class WriteScope {
+   public:
+    explicit WriteScope(RVSSJit &jit);
+    ~WriteScope();
+    WriteScope(const WriteScope &) = delete;
+    WriteScope &operator=(const WriteScope &) = delete;
+
+    [[nodiscard]] bool Writable() const { return jit_.writable_; }
+
+   private:
+    RVSSJit &jit_;
+  };
+
+  size_t code_cache_size_ = 0; ///< Rounded up to whole pages.
+  size_t guard_size_ = 0;      ///< PROT_NONE page mapped right after code_end_.
+  uint8_t *code_begin_ = nullptr;
+  uint8_t *code_end_ = nullptr;
+  uint8_t *code_cursor_ = nullptr;
+  uint8_t *enter_ = nullptr;    ///< Trampoline: saves host registers, loads rbx/r12, jumps to the block.
+  uint8_t *epilogue_ = nullptr; ///< Restores host registers and returns the next pc in rax.
+
+  std::vector<uint8_t *> entries_; ///< Translation per instruction index, nullptr when none.
+  std::unordered_map<uint64_t, Block> blocks_;
+  std::unordered_map<uint64_t, std::vector<Link>> links_; ///< Keyed by target pc.
+  std::unordered_map<uint64_t, std::vector<uint64_t>> page_blocks_;
+  unsigned write_depth_ = 0; ///< Live WriteScopes.
+  bool writable_ = false;    ///< The outermost WriteScope got the cache read/write.
+  bool disabled_ = false;    ///< Set once the cache could not be made writable.
+
+  void EmitTrampolines();
+  uint8_t *Emit(uint64_t pc, uint32_t length, const std::vector<ThreadedInstruction> &program,
+               std::vector<Link> &exits);
+  void RemoveBlock(uint64_t start);
+  /// Forgets every translation without touching the cache and turns the JIT off for good.
+  void Disable();
+};
+
+#endif // RVSS_JIT_H
@@ -0,0 +1,89 @@
+/**
+ * @file rvss_threaded_vm.h
+ * @brief Threaded-code execution engine for the single-stage VM
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+#ifndef RVSS_THREADED_VM_H
+#define RVSS_THREADED_VM_H
+
+#include "rvss_vm.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class RVSSJit;
+
+/**
+ * @brief Handler selected for an instruction by the threaded engine.
+ *
+ * Everything that is not worth a dedicated handler (F/D, CSR, ecall, bigmul,
+ * and any encoding whose control signals deviate from the common case) is
+ * routed to kGeneric, which runs the regular RVSSVM stage chain.
+ */
+enum class ThreadedHandler : uint8_t {
+  kAdd, kSub, kAnd, kOr, kXor, kSll, kSrl, kSra, kSlt, kSltu, kAluReg,
+  kAddi, kAndi, kOri, kXori, kSlli, kSrli, kSrai, kSlti, kSltiu, kAluImm,
+  kLb, kLh, kLw, kLd, kLbu, kLhu, kLwu,
+  kSb, kSh, kSw, kSd,
+  kBeq, kBne, kBlt, kBge, kBltu, kBgeu,
+  kJal, kJalr, kLui, kAuipc,
+  kGeneric,
+  kTextEnd,
+  kCount
+};
+
+/**
+ * @brief Instruction as laid out for threaded dispatch.
+ */
+struct ThreadedInstruction {
+  ThreadedHandler handler = ThreadedHandler::kGeneric;
+  uint8_t rd = 0;
+  uint8_t rs1 = 0;
+  uint8_t rs2 = 0;
+  alu::AluOp alu_op = alu::AluOp::kNone;
+  uint32_t block_length = 1; ///< Instructions left in the basic block, this one included.
+  int64_t imm = 0;           ///< Immediate, already in the form the handler consumes.
+};
+
+/**
+ * @brief Single-stage VM whose Run() dispatches per-instruction handlers with
+ * computed goto instead of walking the Fetch/Decode/Execute/WriteMemory/WriteBack chain.
+ *
+ * Stop requests and the instruction limit are only checked when entering a
+ * basic block. Architectural state after a run matches RVSSVM::Run exactly;
+ * debugging entry points (DebugRun, Step, Undo, Redo) are inherited unchanged.
+ *
+ * Blocks entered more than jit_hot_threshold times are handed to RVSSJit when
+ * jit_enabled is set and the host supports it.
+ */
+class RVSSThreadedVM : public RVSSVM {
+ public:
+  RVSSThreadedVM();
+  ~RVSSThreadedVM() override;
+
+  void Run() override;
+  void OnTextModified(uint64_t address, uint64_t size) override;
+
+ private:
+  std::vector<ThreadedInstruction> threaded_program_;
+  uint64_t threaded_generation_ = 0;
+  /// Instruction indices written since the threaded program was last synced, empty when first > last.
+  uint64_t dirty_first_ = UINT64_MAX;
+  uint64_t dirty_last_ = 0;
+
+  std::unique_ptr<RVSSJit> jit_;
+  std::vector<uint32_t> block_heat_; ///< Block entries seen per instruction index while interpreting.
+
+  void BuildThreadedProgram();
+  /// Retranslates entries first..last and the block lengths leading into them.
+  void RetranslateRange(size_t first, size_t last);
+  /// Brings the threaded program up to text_write_generation_, rebuilding only what was written.
+  void SyncThreadedProgram();
+  ThreadedInstruction TranslateInstruction(const DecodedInstruction &decoded) const;
+  /// One instruction through the RVSSVM stages; false if it trapped.
+  bool ExecuteGeneric();
+  uint64_t RunTranslated(uint64_t &pc, uint64_t budget);
+};
+
+#endif // RVSS_THREADED_VM_H
@@ -18,22 +18,11 @@
 
 // TODO: use a circular buffer instead of a stack for undo/redo
 
-struct RegisterChange {
-  unsigned int reg_index;
-  unsigned int reg_type; // 0 for GPR, 1 for CSR, 2 for FPR
-  uint64_t old_value;
-  uint64_t new_value;
-};
-
-struct MemoryChange {
-  uint64_t address;
-  std::vector<uint8_t> old_bytes_vec; 
-  std::vector<uint8_t> new_bytes_vec; 
-};
-
 struct StepDelta {
   uint64_t old_pc;
   uint64_t new_pc;
+  uint64_t instructions = 1; // instructions the delta covers, more than one for a coalesced StepN batch
+  uint64_t penalty_cycles = 0; // cache miss cycles on top of one per instruction; cache contents are not rolled back
   std::vector<RegisterChange> register_changes;
   std::vector<MemoryChange> memory_changes;
 };
@@ -96,10 +85,42 @@ struct StepDelta {
 
 
 
+/// How often the retired-instruction and cycle counters are published by a run loop.
+enum class StatsGranularity {
+  kPerInstruction, ///< Counters are current after every instruction.
+  kPerRun,         ///< Counted locally and published when the loop returns.
+};
+
+/**
+ * @brief Compile-time switches for RVSSVM::RunLoop and the stages it drives.
+ *
+ * Features that are switched off are compiled out of the instantiation, so a
+ * batch run pays nothing for tracing or undo capture it does not use.
+ */
+template <bool Trace, bool RecordUndo, bool CheckBreakpoints, bool DumpEachStep, StatsGranularity Stats, bool Fuse>
+struct RunPolicy {
+  static constexpr bool kTrace = Trace;                       ///< Per-instruction debug output.
+  static constexpr bool kRecordUndo = RecordUndo;             ///< Capture a StepDelta per instruction for Undo/Redo.
+  static constexpr bool kCheckBreakpoints = CheckBreakpoints; ///< Stop in front of breakpoints.
+  static constexpr bool kDumpEachStep = DumpEachStep;         ///< Rewrite the JSON dumps and sleep run_step_delay per instruction.
+  static constexpr StatsGranularity kStats = Stats;
+  static constexpr bool kFuse = Fuse;                         ///< Execute recognised instruction pairs as superinstructions.
+
+  // A fused pair is one step: it has no boundary to trace, dump, stop at or undo to in between.
+  static_assert(!Fuse || (!Trace && !RecordUndo && !CheckBreakpoints && !DumpEachStep),
+                "fusion needs a policy without per-instruction observers");
+};
+
+/// Run(): architectural state only.
+using FastRunPolicy = RunPolicy<false, false, false, false, StatsGranularity::kPerRun, true>;
+/// DebugRun() and Step(): everything the debugger front end relies on.
+using DebugRunPolicy = RunPolicy<true, true, true, true, StatsGranularity::kPerInstruction, false>;
+/// StepN(): undo capture, but no per-instruction output or dumps.
+using StepBatchPolicy = RunPolicy<false, true, false, false, StatsGranularity::kPerInstruction, false>;
+
 class RVSSVM : public VmBase {
  public:
   RVSSControlUnit control_unit_;
-  std::atomic<bool> stop_requested_ = false;
 
 
   std::stack<StepDelta> undo_stack_;
@@ -108,6 +129,9 @@ class RVSSVM : public VmBase {
 
   StepDelta current_delta_;
 
+  // instruction currently flowing through the stages, taken from the predecoded text
+  DecodedInstruction current_decoded_;
+
   // intermediate variables
   int64_t execution_result_{};
   int64_t memory_result_{};
@@ -127,47 +151,62 @@ class RVSSVM : public VmBase {
   uint64_t csr_write_val_{};
   uint8_t csr_uimm_{};
 
+  DecodedInstruction DecodeInstruction(uint32_t instruction) override;
+  FusedPair ClassifyFusion(const DecodedInstruction &first, const DecodedInstruction &second) const override;
+
+  /// First half of a fusable pair at address, or nullptr when the instruction there runs alone.
+  const DecodedInstruction *FusedPairAt(uint64_t address) const;
+  /**
+   * @brief Executes first and the instruction after it as one superinstruction.
+   *
+   * Leaves the same state the two single steps would. The first half is complete and
+   * program_counter_ points at the second one before the second can fault.
+   * @return False if the second half trapped and did not retire.
+   */
+  bool ExecuteFusedPair(const DecodedInstruction &first);
+
   void Fetch();
 
+  /**
+   * @brief Load for funct3 (LB..LWU) at address into memory_result_, after Fetch has advanced the PC.
+   * @return False if the access faulted; the trap has been raised and memory_result_ is meaningless.
+   */
+  bool LoadMemory(uint8_t funct3, uint64_t address);
+
   void Decode();
 
-  void Execute();
+  template <typename Policy = DebugRunPolicy> void Execute();
   void ExecuteFloat();
   void ExecuteDouble();
   void ExecuteCsr();
-  void HandleSyscall();
+  template <typename Policy = DebugRunPolicy> void HandleSyscall();
 
-  void WriteMemory();
-  void WriteMemoryFloat();
-  void WriteMemoryDouble();
+  template <typename Policy = DebugRunPolicy> void WriteMemory();
+  template <typename Policy = DebugRunPolicy> void WriteMemoryFloat();
+  template <typename Policy = DebugRunPolicy> void WriteMemoryDouble();
 
-  void WriteBack();
-  void WriteBackFloat();
-  void WriteBackDouble();
+  template <typename Policy = DebugRunPolicy> void WriteBack();
+  template <typename Policy = DebugRunPolicy> void WriteBackFloat();
+  template <typename Policy = DebugRunPolicy> void WriteBackDouble();
   void WriteBackCsr();
 
+  /// Fetch through WriteBack for one instruction, plus the undo bookkeeping the policy asks for.
+  /// Returns false if the instruction trapped instead of retiring.
+  template <typename Policy> bool StepInstruction();
+  /// Run loop shared by Run() and DebugRun().
+  template <typename Policy> void RunLoop();
+
   RVSSVM();
-  ~RVSSVM();
+  ~RVSSVM() override;
 
   void Run() override;
   void DebugRun() override;
   void Step() override;
+  void StepN(uint64_t count) override;
   void Undo() override;
   void Redo() override;
   void Reset() override;
 
-  void RequestStop() {
-    stop_requested_ = true;
-  }
-
-  bool IsStopRequested() const {
-    return stop_requested_;
-  }
-  
-  void ClearStop() {
-    stop_requested_ = false;
-  }
-
   void PrintType() {
     std::cout << "rvssvm" << std::endl;
   }
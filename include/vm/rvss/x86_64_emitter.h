@@ -0,0 +1,253 @@
+/**
+ * @file x86_64_emitter.h
+ * @brief Minimal x86-64 machine code emitter used by the RVSS JIT
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+#ifndef X86_64_EMITTER_H
+#define X86_64_EMITTER_H
+
+#include <cstdint>
+#include <cstring>
+
+namespace x86_64 {
+
+enum Reg : uint8_t {
+  RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+  R8 = 8, R9 = 9, R10 = 10, R11 = 11, R12 = 12, R13 = 13, R14 = 14, R15 = 15,
+};
+
+/// Condition codes as encoded in Jcc / SETcc.
+enum Cond : uint8_t {
+  kBelow = 0x2, kAboveEqual = 0x3, kEqual = 0x4, kNotEqual = 0x5,
+  kAbove = 0x7, kLess = 0xC, kGreaterEqual = 0xD,
+};
+
+/// Two-operand ALU group, the value is the /digit used with opcode 0x81 (and op << 3 | 1 for reg forms).
+enum AluGroup : uint8_t {
+  kAddOp = 0, kOrOp = 1, kAndOp = 4, kSubOp = 5, kXorOp = 6, kCmpOp = 7,
+};
+
+/// Shift group, the value is the /digit used with opcodes 0xD3 / 0xC1.
+enum ShiftGroup : uint8_t {
+  kShl = 4, kShr = 5, kSar = 7,
+};
+
+/**
+ * @brief Writes instructions into a caller-provided buffer.
+ *
+ * Only the handful of forms the translator needs are provided. Memory operands
+ * are always [base + disp32]. Running past the end of the buffer sets the
+ * overflow flag instead of writing, so callers check Overflowed() once at the end
+ * and before patching a field returned by Jmp/Jcc, which is not backed by the
+ * buffer once it has overflowed.
+ */
+class Emitter {
+ public:
+  Emitter(uint8_t *begin, uint8_t *end) : cursor_(begin), end_(end) {}
+
+  [[nodiscard]] uint8_t *Cursor() const { return cursor_; }
+  [[nodiscard]] bool Overflowed() const { return overflowed_; }
+
+  void Byte(uint8_t value) {
+    if (cursor_ >= end_) {
+      overflowed_ = true;
+      return;
+    }
+    *cursor_++ = value;
+  }
+
+  void Dword(uint32_t value) {
+    for (int i = 0; i < 4; ++i) Byte(static_cast<uint8_t>(value >> (8 * i)));
+  }
+
+  void Qword(uint64_t value) {
+    for (int i = 0; i < 8; ++i) Byte(static_cast<uint8_t>(value >> (8 * i)));
+  }
+
+  // mov dst, [base + disp]
+  void MovLoad(Reg dst, Reg base, int32_t disp) {
+    Rex(true, dst, base);
+    Byte(0x8B);
+    ModRmDisp(dst, base, disp);
+  }
+
+  // mov [base + disp], src
+  void MovStore(Reg base, int32_t disp, Reg src) {
+    Rex(true, src, base);
+    Byte(0x89);
+    ModRmDisp(src, base, disp);
+  }
+
+  // mov qword [base + disp], simm32
+  void MovStoreImm(Reg base, int32_t disp, int32_t imm) {
+    Rex(true, RAX, base);
+    Byte(0xC7);
+    ModRmDisp(RAX, base, disp);
+    Dword(static_cast<uint32_t>(imm));
+  }
+
+  // mov dst, imm64
+  void MovImm64(Reg dst, uint64_t imm) {
+    Rex(true, RAX, dst);
+    Byte(0xB8 + (dst & 7));
+    Qword(imm);
+  }
+
+  // mov dst, src
+  void MovReg(Reg dst, Reg src) {
+    Rex(true, src, dst);
+    Byte(0x89);
+    Byte(0xC0 | ((src & 7) << 3) | (dst & 7));
+  }
+
+  // <op> dst, src
+  void AluReg(AluGroup op, Reg dst, Reg src) {
+    Rex(true, src, dst);
+    Byte(static_cast<uint8_t>((op << 3) | 0x01));
+    Byte(0xC0 | ((src & 7) << 3) | (dst & 7));
+  }
+
+  // <op> dst, simm32
+  void AluImm(AluGroup op, Reg dst, int32_t imm) {
+    Rex(true, RAX, dst);
+    Byte(0x81);
+    Byte(0xC0 | (op << 3) | (dst & 7));
+    Dword(static_cast<uint32_t>(imm));
+  }
+
+  // <op> qword [base + disp], simm32
+  void AluMemImm(AluGroup op, Reg base, int32_t disp, int32_t imm) {
+    Rex(true, RAX, base);
+    Byte(0x81);
+    ModRmDisp(static_cast<Reg>(op), base, disp);
+    Dword(static_cast<uint32_t>(imm));
+  }
+
+  // mov byte [base + disp], imm8
+  void MovByteStoreImm(Reg base, int32_t disp, uint8_t imm) {
+    Rex(false, RAX, base);
+    Byte(0xC6);
+    ModRmDisp(RAX, base, disp);
+    Byte(imm);
+  }
+
+  // cmp dword eax, imm8
+  void CmpEaxImm8(int8_t imm) {
+    Byte(0x83);
+    Byte(0xF8);
+    Byte(static_cast<uint8_t>(imm));
+  }
+
+  // cmp byte [base + disp], 0
+  void CmpByteMemZero(Reg base, int32_t disp) {
+    Rex(false, RAX, base);
+    Byte(0x80);
+    ModRmDisp(static_cast<Reg>(7), base, disp);
+    Byte(0x00);
+  }
+
+  // <shift> dst, cl
+  void ShiftCl(ShiftGroup op, Reg dst) {
+    Rex(true, RAX, dst);
+    Byte(0xD3);
+    Byte(0xC0 | (op << 3) | (dst & 7));
+  }
+
+  // <shift> dst, imm8
+  void ShiftImm(ShiftGroup op, Reg dst, uint8_t amount) {
+    Rex(true, RAX, dst);
+    Byte(0xC1);
+    Byte(0xC0 | (op << 3) | (dst & 7));
+    Byte(amount);
+  }
+
+  // imul dst, src
+  void Imul(Reg dst, Reg src) {
+    Rex(true, dst, src);
+    Byte(0x0F);
+    Byte(0xAF);
+    Byte(0xC0 | ((dst & 7) << 3) | (src & 7));
+  }
+
+  // set<cc> al ; movzx rax, al
+  void SetccRax(Cond cond) {
+    Byte(0x0F);
+    Byte(0x90 + cond);
+    Byte(0xC0);
+    Byte(0x48);
+    Byte(0x0F);
+    Byte(0xB6);
+    Byte(0xC0);
+  }
+
+  void Push(Reg reg) {
+    if (reg >= R8) Byte(0x41);
+    Byte(0x50 + (reg & 7));
+  }
+
+  void Pop(Reg reg) {
+    if (reg >= R8) Byte(0x41);
+    Byte(0x58 + (reg & 7));
+  }
+
+  void Ret() { Byte(0xC3); }
+
+  // call reg
+  void CallReg(Reg reg) {
+    if (reg >= R8) Byte(0x41);
+    Byte(0xFF);
+    Byte(0xD0 | (reg & 7));
+  }
+
+  // jmp reg
+  void JmpReg(Reg reg) {
+    if (reg >= R8) Byte(0x41);
+    Byte(0xFF);
+    Byte(0xE0 | (reg & 7));
+  }
+
+  /// Emits jmp rel32 to target and returns the address of the rel32 field.
+  uint8_t *Jmp(const uint8_t *target) {
+    Byte(0xE9);
+    uint8_t *field = cursor_;
+    Dword(0);
+    if (!overflowed_) PatchRel32(field, target);
+    return field;
+  }
+
+  /// Emits j<cc> rel32 to target and returns the address of the rel32 field.
+  uint8_t *Jcc(Cond cond, const uint8_t *target) {
+    Byte(0x0F);
+    Byte(0x80 + cond);
+    uint8_t *field = cursor_;
+    Dword(0);
+    if (!overflowed_) PatchRel32(field, target);
+    return field;
+  }
+
+  /// Points an already emitted rel32 field at a new target.
+  static void PatchRel32(uint8_t *field, const uint8_t *target) {
+    auto rel = static_cast<int32_t>(target - (field + 4));
+    std::memcpy(field, &rel, sizeof(rel));
+  }
+
+ private:
+  uint8_t *cursor_;
+  uint8_t *end_;
+  bool overflowed_ = false;
+
+  void Rex(bool wide, Reg reg, Reg base) {
+    uint8_t rex = 0x40 | (wide ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0) | ((base & 8) ? 0x01 : 0);
+    if (rex != 0x40) Byte(rex);
+  }
+
+  void ModRmDisp(Reg reg, Reg base, int32_t disp) {
+    Byte(0x80 | ((reg & 7) << 3) | (base & 7));
+    if ((base & 7) == RSP) Byte(0x24); // SIB required for rsp/r12 bases
+    Dword(static_cast<uint32_t>(disp));
+  }
+};
+
+} // namespace x86_64
+
+#endif // X86_64_EMITTER_H
@@ -10,6 +10,9 @@
 #include "registers.h"
 #include "memory_controller.h"
 #include "alu.h"
+#include "fp_environment.h"
+#include "decoded_instruction.h"
+#include "branch_predictor.h"
 
 #include "vm_asm_mw.h"
 
@@ -21,6 +24,8 @@
 #include <condition_variable>
 #include <queue>
 #include <atomic>
+#include <memory>
+#include <ostream>
 
 enum SyscallCode {
     SYSCALL_PRINT_INT = 1,
@@ -32,29 +37,72 @@ enum SyscallCode {
     SYSCALL_WRITE = 64,
 };
 
+/// Exception codes written to mcause for the synchronous traps the VM raises.
+enum class TrapCause : uint64_t {
+    kLoadAccessFault = 5,
+    kStoreAccessFault = 7,
+};
+
+/// The most recent trap, reported in the state dump.
+struct TrapRecord {
+    uint64_t count = 0; ///< Traps taken since the last reset.
+    uint64_t cause = 0; ///< mcause of the last trap.
+    uint64_t epc = 0;   ///< Address of the instruction that trapped.
+    uint64_t tval = 0;  ///< Faulting address.
+    bool halted = false; ///< No handler was installed and the VM stopped in front of the instruction.
+};
+
+/// One register write, as kept in the engines' undo history.
+struct RegisterChange {
+    unsigned int reg_index;
+    unsigned int reg_type; // 0 for GPR, 1 for CSR, 2 for FPR
+    uint64_t old_value;
+    uint64_t new_value;
+};
+
+/// One memory write, as kept in the engines' undo history.
+struct MemoryChange {
+    uint64_t address;
+    std::vector<uint8_t> old_bytes_vec;
+    std::vector<uint8_t> new_bytes_vec;
+};
 
 class VmBase {
 public:
     VmBase() = default;
-    ~VmBase() = default;
+    virtual ~VmBase() = default;
 
     AssembledProgram program_;
     std::atomic<bool> stop_requested_ = false;
+    /// Mirrors stop_requested_ for translated code, which polls it with a plain byte load.
+    /// C++ only touches it through std::atomic_ref.
+    alignas(std::atomic_ref<uint8_t>::required_alignment) uint8_t stop_byte_ = 0;
     std::mutex input_mutex_;
     std::condition_variable input_cv_;
     std::queue<std::string> input_queue_;
 
+    /// Breakpoint addresses in the order they were added, for the state dump.
     std::vector<uint64_t> breakpoints_;
+    /// One bit per 4-byte instruction slot of the text section, set where breakpoints_ has an address.
+    std::vector<uint64_t> breakpoint_bitmap_;
 
     uint32_t current_instruction_{};
     uint64_t program_counter_{};
     
-    unsigned int cycle_s_{};
-    unsigned int instructions_retired_{};
+    uint64_t cycle_s_{};
+    uint64_t instructions_retired_{};
     float cpi_{};
     float ipc_{};
-    unsigned int stall_cycles_{};
-    unsigned int branch_mispredictions_{};
+    uint64_t stall_cycles_{};
+    uint64_t branch_mispredictions_{};
+    uint64_t branch_predictions_{}; ///< Conditional branches branch_predictor_ was asked about.
+    uint64_t fused_pairs_{}; ///< Instruction pairs executed as one superinstruction, each retires two instructions.
+
+    TrapRecord trap_;
+    /// Set by RaiseTrap(); the engine abandons the faulting instruction and clears it.
+    bool trap_raised_ = false;
+    /// The mcause, mepc and mtval writes of the last RaiseTrap(), for the engines' undo history.
+    std::vector<RegisterChange> trap_csr_changes_;
 
     std::string output_status_;
 
@@ -66,19 +114,73 @@ public:
     RegisterFile registers_;
     
     alu::Alu alu_;
+    /// Host rounding mode and accrued exception flags for the guest F/D instructions.
+    alu::FpEnvironment fp_env_;
+    /// Predicts conditional branches, nullptr when the engine runs without one.
+    std::unique_ptr<BranchPredictor> branch_predictor_;
 
-
-    void LoadProgram(const AssembledProgram &program);
+    /// Also replaces branch_predictor_ with a fresh one from CreateBranchPredictor().
+    virtual void LoadProgram(const AssembledProgram &program);
+    /// The configured predictor if the single-stage predictor-only mode is on, nullptr otherwise.
+    virtual std::unique_ptr<BranchPredictor> CreateBranchPredictor() const;
+    /// Predictor-only mode: scores branch_predictor_ on a branch the engine has already resolved.
+    void ObserveBranch(uint64_t pc, uint64_t target, bool taken) {
+        branch_predictions_++;
+        if (branch_predictor_->Predict(pc, target) != taken) {
+            branch_mispredictions_++;
+        }
+        branch_predictor_->Update(pc, target, taken);
+    }
     uint64_t program_size_ = 0;
 
+    /// Predecoded text section, one entry per instruction word in [0, program_size_).
+    std::vector<DecodedInstruction> decoded_instructions_;
+    /// Bumped whenever a write invalidates predecoded text, so engines holding derived state can refresh it.
+    uint64_t text_write_generation_ = 0;
+    /// Takes the size bytes at address 0 as the text section: drops the breakpoints outside it and predecodes it.
+    void SetProgramSize(uint64_t size);
+
+    /// What LoadProgram() left behind, for ResetToLoaded(); memory is kept as a snapshot in memory_controller_.
+    struct LoadedState {
+        bool valid = false;
+        RegisterFile registers;
+        uint64_t program_counter = 0;
+        /// text_write_generation_ when the predecoded text last matched the loaded text.
+        uint64_t text_write_generation = 0;
+    } loaded_state_;
+    /// Snapshots memory and records the registers and program counter for ResetToLoaded().
+    void RememberLoadedState();
+
+    virtual DecodedInstruction DecodeInstruction(uint32_t instruction);
+    /// Engine-specific idiom recognition, stored on the first entry of the pair.
+    virtual FusedPair ClassifyFusion(const DecodedInstruction &first, const DecodedInstruction &second) const {
+        (void)first; (void)second;
+        return FusedPair::kNone;
+    }
+    void PredecodeProgram();
+    DecodedInstruction FetchDecoded(uint64_t address);
+    void InvalidateDecodedRange(uint64_t address, uint64_t size);
+    /// Called after text in [address, address + size) changed, for engines caching code derived from it.
+    virtual void OnTextModified(uint64_t address, uint64_t size) { (void)address; (void)size; }
+
     uint64_t GetProgramCounter() const;
     void UpdateProgramCounter(int64_t value);
     
     int32_t ImmGenerator(uint32_t instruction);
 
     void AddBreakpoint(uint64_t val, bool is_line = true);
+    /// Adds a breakpoint on each of the given lines and dumps the state once.
+    void AddBreakpoints(const std::vector<uint64_t> &lines);
     void RemoveBreakpoint(uint64_t val, bool is_line = true);
-    bool CheckBreakpoint(uint64_t address);
+    /// Constant time, however many breakpoints are set.
+    bool CheckBreakpoint(uint64_t address) const {
+        uint64_t slot = address >> 2;
+        return (address & 3) == 0 && (slot >> 6) < breakpoint_bitmap_.size() &&
+               ((breakpoint_bitmap_[slot >> 6] >> (slot & 63)) & 1);
+    }
+    /// Records a breakpoint without dumping the state; false and a message on stderr if it was rejected.
+    bool InsertBreakpoint(uint64_t val, bool is_line);
+    void SetBreakpointBit(uint64_t address, bool value);
 
     // void fetchInstruction();
     // void decodeInstruction();
@@ -88,14 +190,82 @@ public:
 
     // void HandleSyscall();
     void PrintString(uint64_t address);
+    /// Writes the length bytes at address to stdout as they are; returns length.
+    uint64_t PrintBytes(uint64_t address, uint64_t length);
 
     virtual void Run() = 0;
     virtual void DebugRun() = 0;
     virtual void Step() = 0;
+    /// Executes up to count instructions as one step: a single state dump and status line at the end.
+    virtual void StepN(uint64_t count) = 0;
     virtual void Undo() = 0;
     virtual void Redo() = 0;
     virtual void Reset() = 0;
+    /**
+     * @brief Resets the VM, then puts back the memory, registers and program counter the last
+     * LoadProgram() left, without assembling or writing the program again.
+     * @return False, with the VM reset, if no program was loaded since the memory settings last changed.
+     */
+    bool ResetToLoaded();
+
+    /**
+     * @brief Writes the program counter, the registers, memory, the bigmul buffers and the
+     * statistics to path, in the format of checkpoint::Header.
+     *
+     * Throws std::runtime_error if the file cannot be written or an instruction is partly executed.
+     */
+    void SaveCheckpoint(const std::filesystem::path &path);
+    /**
+     * @brief Resets the VM to what SaveCheckpoint() wrote to path, which ResetToLoaded() then returns to.
+     *
+     * Throws std::runtime_error, with the VM untouched, if path is not a checkpoint or its memory
+     * does not fit in memory_size. Caches and branch predictor start cold, and program_ and the
+     * breakpoints are cleared, since a checkpoint has no source lines.
+     */
+    void LoadCheckpoint(const std::filesystem::path &path);
+    /// False while an instruction is partly executed, which a checkpoint cannot hold.
+    virtual bool AtInstructionBoundary() const {
+        return true;
+    }
+
+    void RequestStop() {
+        stop_requested_ = true;
+        std::atomic_ref<uint8_t>(stop_byte_).store(1, std::memory_order_relaxed);
+    }
+
+    bool IsStopRequested() const {
+        return stop_requested_;
+    }
+
+    void ClearStop() {
+        stop_requested_ = false;
+        std::atomic_ref<uint8_t>(stop_byte_).store(0, std::memory_order_relaxed);
+        trap_.halted = false;
+    }
+
     void DumpState(const std::filesystem::path &filename);
+    /// Engine-specific fields for the state dump, each written as a `"key": value,` line.
+    virtual void DumpEngineState(std::ostream &file) const { (void)file; }
+
+    /**
+     * @brief Takes a synchronous trap for the instruction at epc.
+     *
+     * Writes mcause, mepc and mtval and continues at mtvec. While mtvec is 0 no handler is
+     * installed: the VM stops in front of the faulting instruction with status VM_TRAP instead.
+     * The faulting instruction does not retire either way.
+     */
+    void RaiseTrap(TrapCause cause, uint64_t epc, uint64_t tval);
+
+    /// Hands the host FP environment to guest instructions, see alu::FpEnvironment.
+    void EnterFloatEnvironment();
+    /// Takes the host FP environment back and folds the flags the guest raised into fflags and fcsr.
+    void LeaveFloatEnvironment();
+    /// Folds the flags raised since the last sync into fflags and fcsr, for CSR reads of either.
+    void SyncFloatCsrs();
+    /// ORs flags into fflags and mirrors the result into fcsr.
+    void AccrueFloatFlags(uint8_t flags);
+    /// Keeps fflags, frm and fcsr consistent after the CSR at csr was written.
+    void OnFloatCsrWritten(uint16_t csr);
 
     void ModifyRegister(const std::string &reg_name, uint64_t value);
     void PushInput(const std::string& input) {
@@ -106,4 +276,32 @@ public:
 
 };
 
+/**
+ * @brief Guest owns the host FP environment for the lifetime of this object.
+ *
+ * Close() ends the scope early, for engines that dump state before they return.
+ */
+class FloatEnvironmentScope {
+public:
+    explicit FloatEnvironmentScope(VmBase &vm) : vm_(vm) {
+        vm_.EnterFloatEnvironment();
+    }
+    ~FloatEnvironmentScope() {
+        Close();
+    }
+    FloatEnvironmentScope(const FloatEnvironmentScope &) = delete;
+    FloatEnvironmentScope &operator=(const FloatEnvironmentScope &) = delete;
+
+    void Close() {
+        if (open_) {
+            open_ = false;
+            vm_.LeaveFloatEnvironment();
+        }
+    }
+
+private:
+    VmBase &vm_;
+    bool open_ = true;
+};
+
 #endif // VM_BASE_H
@@ -9,6 +9,8 @@
 
 #include "vm/vm_base.h"
 #include "vm/rvss/rvss_vm.h"
+#include "vm/rvss/rvss_threaded_vm.h"
+#include "vm/rv5s/rv5s_vm.h"
 #include "config.h"
 #include "vm_asm_mw.h"
 
@@ -16,13 +18,18 @@
 #include <stdexcept>
 #include <sstream>
 
-// inline std::unique_ptr<VmBase> createVM(vm_config::VmTypes vmType) {
-//   if (vmType==vm_config::VmTypes::SINGLE_STAGE) {
-//     return std::make_unique<RVSSVM>();
-//   }
-
-//   return nullptr;
-// }
+/**
+ * @brief Creates the VM implementation selected by the given type.
+ */
+inline std::unique_ptr<VmBase> createVM(vm_config::VmTypes vmType) {
+  if (vmType==vm_config::VmTypes::SINGLE_STAGE_THREADED) {
+    return std::make_unique<RVSSThreadedVM>();
+  }
+  if (vmType==vm_config::VmTypes::MULTI_STAGE) {
+    return std::make_unique<RV5SVM>();
+  }
+  return std::make_unique<RVSSVM>();
+}
 
 // class VMRunner {
 //   std::unique_ptr<VmBase> vm_;
@@ -34,6 +34,8 @@ Command ParseCommand(const std::string &input) {
     command_type = command_handler::CommandType::REDO;
   } else if (command_str=="reset") {
     command_type = command_handler::CommandType::RESET;
+  } else if (command_str=="checkpoint" || command_str=="ckpt") {
+    command_type = command_handler::CommandType::CHECKPOINT;
   } else if (command_str=="modify_register" || command_str=="mreg") {
     command_type = command_handler::CommandType::MODIFY_REGISTER;
   } else if (command_str=="get_register" || command_str=="greg") {
@@ -7,6 +7,7 @@
 #include "command_handler.h"
 #include "config.h"
 
+#include <algorithm>
 #include <iostream>
 #include <thread>
 #include <bitset>
@@ -30,6 +31,7 @@ int main(int argc, char *argv[]) {
                   << "  --assemble <file>    Assemble the specified file\n"
                   << "  --run <file>         Run the specified file\n"
                   << "  --verbose-errors     Enable verbose error printing\n"
+                  << "  --no-jit             Keep the threaded engine interpreted (for debugging)\n"
                   << "  --start-vm           Start the VM with the default program\n"
                   << "  --start-vm --vm-as-backend  Start the VM with the default program in backend mode\n";
         return 0;
@@ -55,9 +57,9 @@ int main(int argc, char *argv[]) {
         }
         try {
             AssembledProgram program = assemble(argv[i]);
-            RVSSVM vm;
-            vm.LoadProgram(program);
-            vm.Run();
+            std::unique_ptr<VmBase> vm = createVM(vm_config::config.getVmType());
+            vm->LoadProgram(program);
+            vm->Run();
             std::cout << "Program running: " << program.filename << '\n';
             return 0;
         } catch (const std::runtime_error& e) {
@@ -69,6 +71,10 @@ int main(int argc, char *argv[]) {
         globals::verbose_errors_print = true;
         std::cout << "Verbose error printing enabled.\n";
 
+    } else if (arg == "--no-jit") {
+        vm_config::config.setJitEnabled(false);
+        std::cout << "JIT disabled.\n";
+
     } else if (arg == "--vm-as-backend") {
         globals::vm_as_backend = true;
         std::cout << "VM backend mode enabled.\n";
@@ -88,7 +94,8 @@ int main(int argc, char *argv[]) {
 
 
   AssembledProgram program;
-  RVSSVM vm;
+  vm_config::VmTypes vm_type = vm_config::config.getVmType();
+  std::unique_ptr<VmBase> vm = createVM(vm_type);
   // try {
   //   program = assemble("/home/vis/Desk/codes/assembler/examples/ntest1.s");
   // } catch (const std::runtime_error &e) {
@@ -120,11 +127,11 @@ int main(int argc, char *argv[]) {
 
   auto launch_vm_thread = [&](auto fn) {
     if (vm_thread.joinable()) {
-      vm.RequestStop();   
+      vm->RequestStop();   
       vm_thread.join();
     }
     vm_running = true;
-    vm_thread = std::thread([&]() {
+    vm_thread = std::thread([&, fn]() {
       fn();               
       vm_running = false;
     });
@@ -161,48 +168,101 @@ int main(int argc, char *argv[]) {
       try {
         program = assemble(command.args[0]);
         std::cout << "VM_PARSE_SUCCESS" << std::endl;
-        vm.output_status_ = "VM_PARSE_SUCCESS";
-        vm.DumpState(globals::vm_state_dump_file_path);
+        vm->output_status_ = "VM_PARSE_SUCCESS";
+        vm->DumpState(globals::vm_state_dump_file_path);
       } catch (const std::runtime_error &e) {
         std::cout << "VM_PARSE_ERROR" << std::endl;
-        vm.output_status_ = "VM_PARSE_ERROR";
-        vm.DumpState(globals::vm_state_dump_file_path);
+        vm->output_status_ = "VM_PARSE_ERROR";
+        vm->DumpState(globals::vm_state_dump_file_path);
         std::cerr << e.what() << '\n';
         continue;
       }
-      vm.LoadProgram(program);
+      if (vm_config::config.getVmType() != vm_type) {
+        if (vm_thread.joinable()) {
+          vm->RequestStop();
+          vm_thread.join();
+        }
+        vm_type = vm_config::config.getVmType();
+        vm = createVM(vm_type);
+      }
+      vm->LoadProgram(program);
       std::cout << "Program loaded: " << command.args[0] << std::endl;
     } else if (command.type==command_handler::CommandType::RUN) {
-      launch_vm_thread([&]() { vm.Run(); });
+      launch_vm_thread([&]() { vm->Run(); });
     } else if (command.type==command_handler::CommandType::DEBUG_RUN) {
-      launch_vm_thread([&]() { vm.DebugRun(); });
+      launch_vm_thread([&]() { vm->DebugRun(); });
     } else if (command.type==command_handler::CommandType::STOP) {
-      vm.RequestStop();
+      vm->RequestStop();
       std::cout << "VM_STOPPED" << std::endl;
-      vm.output_status_ = "VM_STOPPED";
-      vm.DumpState(globals::vm_state_dump_file_path);
+      vm->output_status_ = "VM_STOPPED";
+      vm->DumpState(globals::vm_state_dump_file_path);
     } else if (command.type==command_handler::CommandType::STEP) {
       if (vm_running) continue;
-      launch_vm_thread([&]() { vm.Step(); });
+      if (command.args.empty()) {
+        launch_vm_thread([&]() { vm->Step(); });
+        continue;
+      }
+      uint64_t count = 0;
+      try {
+        count = std::stoull(command.args[0]);
+      } catch (const std::exception &e) {
+        std::cout << "VM_STEP_ERROR" << std::endl;
+        continue;
+      }
+      launch_vm_thread([&, count]() { vm->StepN(count); });
 
     } else if (command.type==command_handler::CommandType::UNDO) {
       if (vm_running) continue;
-      vm.Undo();
+      vm->Undo();
     } else if (command.type==command_handler::CommandType::REDO) {
       if (vm_running) continue;
-      vm.Redo();
+      vm->Redo();
     } else if (command.type==command_handler::CommandType::RESET) {
-      vm.Reset();
+      if (std::find(command.args.begin(), command.args.end(), "--to-loaded") == command.args.end()) {
+        vm->Reset();
+      } else if (vm_running) {
+        std::cout << "VM_RESET_ERROR" << std::endl;
+        std::cerr << "VM is running; stop it first." << std::endl;
+      } else if (!vm->ResetToLoaded()) {
+        std::cout << "VM_RESET_ERROR" << std::endl;
+        std::cerr << "No loaded program to reset to." << std::endl;
+      }
+    } else if (command.type==command_handler::CommandType::CHECKPOINT) {
+      if (vm_running) continue;
+      if (command.args.size() != 2 || (command.args[0] != "save" && command.args[0] != "load")) {
+        std::cout << "VM_CHECKPOINT_ERROR" << std::endl;
+        std::cerr << "Usage: checkpoint save|load <file>" << std::endl;
+        continue;
+      }
+      try {
+        if (command.args[0] == "save") {
+          vm->SaveCheckpoint(command.args[1]);
+          std::cout << "VM_CHECKPOINT_SAVED" << std::endl;
+        } else {
+          vm->LoadCheckpoint(command.args[1]);
+        }
+      } catch (const std::runtime_error &e) {
+        std::cout << "VM_CHECKPOINT_ERROR" << std::endl;
+        std::cerr << e.what() << std::endl;
+      }
     } else if (command.type==command_handler::CommandType::EXIT) {
-      vm.RequestStop();
+      vm->RequestStop();
       if (vm_thread.joinable()) vm_thread.join(); // ensure clean exit
-      vm.output_status_ = "VM_EXITED";
-      vm.DumpState(globals::vm_state_dump_file_path);
+      vm->output_status_ = "VM_EXITED";
+      vm->DumpState(globals::vm_state_dump_file_path);
       break;
     } else if (command.type==command_handler::CommandType::ADD_BREAKPOINT) {
-      vm.AddBreakpoint(std::stoul(command.args[0], nullptr, 10));
+      if (command.args.size() == 1) {
+        vm->AddBreakpoint(std::stoul(command.args[0], nullptr, 10));
+      } else {
+        std::vector<uint64_t> lines;
+        for (const auto &arg : command.args) {
+          lines.push_back(std::stoul(arg, nullptr, 10));
+        }
+        vm->AddBreakpoints(lines);
+      }
     } else if (command.type==command_handler::CommandType::REMOVE_BREAKPOINT) {
-      vm.RemoveBreakpoint(std::stoul(command.args[0], nullptr, 10));
+      vm->RemoveBreakpoint(std::stoul(command.args[0], nullptr, 10));
     } else if (command.type==command_handler::CommandType::MODIFY_REGISTER) {
       try {
         if (command.args.size() != 2) {
@@ -211,8 +271,8 @@ int main(int argc, char *argv[]) {
         }
         std::string reg_name = command.args[0];
         uint64_t value = std::stoull(command.args[1], nullptr, 16);
-        vm.ModifyRegister(reg_name, value);
-        DumpRegisters(globals::registers_dump_file_path, vm.registers_);
+        vm->ModifyRegister(reg_name, value);
+        DumpRegisters(globals::registers_dump_file_path, vm->registers_);
         std::cout << "VM_MODIFY_REGISTER_SUCCESS" << std::endl;
       } catch (const std::out_of_range &e) {
         std::cout << "VM_MODIFY_REGISTER_ERROR" << std::endl;
@@ -227,7 +287,7 @@ int main(int argc, char *argv[]) {
         std::cout << "VM_REGISTER_VAL_START";
         std::cout << "0x"
                   << std::hex
-                  << vm.registers_.ReadGpr(std::stoi(reg_str.substr(1))) 
+                  << vm->registers_.ReadGpr(std::stoi(reg_str.substr(1))) 
                   << std::dec;
         std::cout << "VM_REGISTER_VAL_END"<< std::endl;
       } 
@@ -235,6 +295,12 @@ int main(int argc, char *argv[]) {
 
   
     else if (command.type==command_handler::CommandType::MODIFY_MEMORY) {
+      // The write invalidates the predecoded text and translations the VM thread runs from.
+      if (vm_running) {
+        std::cout << "VM_MODIFY_MEMORY_ERROR" << std::endl;
+        std::cerr << "VM is running; stop it first." << std::endl;
+        continue;
+      }
       if (command.args.size() != 3) {
         std::cout << "VM_MODIFY_MEMORY_ERROR" << std::endl;
         continue;
@@ -243,19 +309,25 @@ int main(int argc, char *argv[]) {
         uint64_t address = std::stoull(command.args[0], nullptr, 16);
         std::string type = command.args[1];
         uint64_t value = std::stoull(command.args[2], nullptr, 16);
+        uint64_t size = 0;
 
         if (type == "byte") {
-          vm.memory_controller_.WriteByte(address, static_cast<uint8_t>(value));
+          vm->memory_controller_.WriteByte(address, static_cast<uint8_t>(value));
+          size = 1;
         } else if (type == "half") {
-          vm.memory_controller_.WriteHalfWord(address, static_cast<uint16_t>(value));
+          vm->memory_controller_.WriteHalfWord(address, static_cast<uint16_t>(value));
+          size = 2;
         } else if (type == "word") {
-          vm.memory_controller_.WriteWord(address, static_cast<uint32_t>(value));
+          vm->memory_controller_.WriteWord(address, static_cast<uint32_t>(value));
+          size = 4;
         } else if (type == "double") {
-          vm.memory_controller_.WriteDoubleWord(address, value);
+          vm->memory_controller_.WriteDoubleWord(address, value);
+          size = 8;
         } else {
           std::cout << "VM_MODIFY_MEMORY_ERROR" << std::endl;
           continue;
         }
+        vm->InvalidateDecodedRange(address, size);
         std::cout << "VM_MODIFY_MEMORY_SUCCESS" << std::endl;
       } catch (const std::out_of_range &e) {
         std::cout << "VM_MODIFY_MEMORY_ERROR" << std::endl;
@@ -270,7 +342,7 @@ int main(int argc, char *argv[]) {
     
     else if (command.type==command_handler::CommandType::DUMP_MEMORY) {
       try {
-        vm.memory_controller_.DumpMemory(command.args);
+        vm->memory_controller_.DumpMemory(command.args);
       } catch (const std::out_of_range &e) {
         std::cout << "VM_MEMORY_DUMP_ERROR" << std::endl;
         continue;
@@ -282,7 +354,7 @@ int main(int argc, char *argv[]) {
       for (size_t i = 0; i < command.args.size(); i+=2) {
         uint64_t address = std::stoull(command.args[i], nullptr, 16);
         uint64_t rows = std::stoull(command.args[i+1]);
-        vm.memory_controller_.PrintMemory(address, rows);
+        vm->memory_controller_.PrintMemory(address, rows);
       }
       std::cout << std::endl;
     } else if (command.type==command_handler::CommandType::GET_MEMORY_POINT) {
@@ -291,16 +363,23 @@ int main(int argc, char *argv[]) {
         continue;
       }
       // uint64_t address = std::stoull(command.args[0], nullptr, 16);
-      vm.memory_controller_.GetMemoryPoint(command.args[0]);
+      vm->memory_controller_.GetMemoryPoint(command.args[0]);
     } 
 
 
     else if (command.type==command_handler::CommandType::VM_STDIN) {
-      vm.PushInput(command.args[0]);
+      vm->PushInput(command.args[0]);
     }
     
     
     else if (command.type==command_handler::CommandType::DUMP_CACHE) {
+      try {
+        vm->memory_controller_.DumpCache(globals::cache_dump_file_path, vm->instructions_retired_);
+      } catch (const std::exception &e) {
+        std::cout << "VM_CACHE_DUMP_ERROR" << std::endl;
+        continue;
+      }
+      vm->memory_controller_.PrintCacheStatus(vm->instructions_retired_);
       std::cout << "Cache dumped." << std::endl;
     } else {
       std::cout << "Invalid command.";
@@ -396,27 +396,76 @@ void SetupConfigFile() {
   config_file << "[Execution]\n";
   config_file << "run_step_delay=0   ; in ms\n";
   config_file << "processor_type=single_stage\n";
-  config_file << "hazard_detection=false\n";
-  config_file << "forwarding=false\n";
-  config_file << "branch_prediction=none\n\n";
+  config_file << "hazard_detection=true\n";
+  config_file << "forwarding=true\n\n";
 
   config_file << "[Memory]\n";
   config_file << "memory_size=0xffffffffffffffff\n";
-  config_file << "block_size=1024\n\n";
+  config_file << "block_size=1024\n";
+  config_file << "memory_backing=sparse   ; sparse | flat\n";
+  config_file << "memory_huge_pages=false\n\n";
 
   config_file << "[Cache]\n";
   config_file << "cache_enabled=false\n";
-  config_file << "cache_size=0\n";
-  config_file << "cache_block_size=0\n";
-  config_file << "cache_associativity=0\n";
-  config_file << "cache_read_miss_policy=read_allocate\n";
+  config_file << "cache_size=32768   ; in bytes\n";
+  config_file << "cache_block_size=64   ; in bytes\n";
+  config_file << "cache_associativity=8\n";
   config_file << "cache_replacement_policy=LRU\n";
   config_file << "cache_write_hit_policy=write_back\n";
-  config_file << "cache_write_miss_policy=write_allocate\n\n";
+  config_file << "cache_write_miss_policy=write_allocate\n";
+  config_file << "cache_miss_penalty=10   ; in cycles\n";
+  config_file << "cache_prefetcher=none   ; none, next_line, stride or stream\n";
+  config_file << "cache_prefetch_degree=1\n";
+  config_file << "cache_prefetch_distance=1\n";
+  config_file << "cache_prefetch_table_size=64\n";
+  config_file << "cache_mshrs=0   ; 0 for a blocking L1D\n";
+  config_file << "cache_write_buffer_entries=0   ; 0 for an unbounded one\n";
+  config_file << "cache_timing_only=false\n\n";
+
+  config_file << "[InstructionCache]\n";
+  config_file << "cache_enabled=false\n";
+  config_file << "cache_size=32768   ; in bytes\n";
+  config_file << "cache_block_size=64   ; in bytes\n";
+  config_file << "cache_associativity=8\n";
+  config_file << "cache_replacement_policy=LRU\n";
+  config_file << "cache_miss_penalty=10   ; in cycles\n\n";
+
+  config_file << "[L2Cache]\n";
+  config_file << "cache_enabled=false\n";
+  config_file << "cache_size=262144   ; in bytes\n";
+  config_file << "cache_block_size=64   ; in bytes\n";
+  config_file << "cache_associativity=16\n";
+  config_file << "cache_replacement_policy=LRU\n";
+  config_file << "cache_write_hit_policy=write_back\n";
+  config_file << "cache_write_miss_policy=write_allocate\n";
+  config_file << "cache_inclusion_policy=nine\n";
+  config_file << "cache_miss_penalty=40   ; in cycles\n";
+  config_file << "cache_prefetcher=none   ; none, next_line, stride or stream\n";
+  config_file << "cache_prefetch_degree=1\n";
+  config_file << "cache_prefetch_distance=1\n";
+  config_file << "cache_prefetch_table_size=64\n\n";
+
+
+  config_file << "[L3Cache]\n";
+  config_file << "cache_enabled=false\n";
+  config_file << "cache_size=2097152   ; in bytes\n";
+  config_file << "cache_block_size=64   ; in bytes\n";
+  config_file << "cache_associativity=16\n";
+  config_file << "cache_replacement_policy=LRU\n";
+  config_file << "cache_write_hit_policy=write_back\n";
+  config_file << "cache_write_miss_policy=write_allocate\n";
+  config_file << "cache_inclusion_policy=nine\n";
+  config_file << "cache_miss_penalty=100   ; in cycles\n";
+  config_file << "cache_prefetcher=none   ; none, next_line, stride or stream\n";
+  config_file << "cache_prefetch_degree=1\n";
+  config_file << "cache_prefetch_distance=1\n";
+  config_file << "cache_prefetch_table_size=64\n\n";
+
 
   config_file << "[BranchPrediction]\n";
   config_file << "branch_prediction_type=always_not_taken\n";
-  config_file << "branch_prediction_table_size=0\n";
-  config_file << "branch_prediction_table_associativity=0\n";
+  config_file << "branch_prediction_table_size=4096\n";
+  config_file << "branch_prediction_history_length=0   ; 0 for the predictor's default\n";
+  config_file << "branch_prediction_single_stage=false\n";
   config_file.close();
 }
\ No newline at end of file
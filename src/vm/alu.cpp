@@ -5,6 +5,7 @@
  */
 
 #include "vm/alu.h"
+#include "vm/fp_environment.h"
 
 #include <cfenv>
 #include <cmath>
@@ -238,11 +239,10 @@ namespace alu {
   }
 }
 
-[[nodiscard]] std::pair<uint64_t, uint8_t> Alu::fpexecute(AluOp op,
+[[nodiscard]] std::pair<uint64_t, uint8_t> Alu::fpcompute(AluOp op,
                                                           uint64_t ina,
                                                           uint64_t inb,
-                                                          uint64_t inc,
-                                                          uint8_t rm) {
+                                                          uint64_t inc) {
   float a, b, c;
   std::memcpy(&a, &ina, sizeof(float));
   std::memcpy(&b, &inb, sizeof(float));
@@ -251,23 +251,6 @@ namespace alu {
 
   uint8_t fcsr = 0;
 
-  int original_rm = std::fegetround();
-
-  switch (rm) {
-    case 0b000: std::fesetround(FE_TONEAREST);
-      break;  // RNE
-    case 0b001: std::fesetround(FE_TOWARDZERO);
-      break; // RTZ
-    case 0b010: std::fesetround(FE_DOWNWARD);
-      break;   // RDN
-    case 0b011: std::fesetround(FE_UPWARD);
-      break;     // RUP
-      // 0b100 RMM, unsupported
-    default: break;
-  }
-
-  std::feclearexcept(FE_ALL_EXCEPT);
-
   switch (op) {
     case AluOp::kAdd: {
       auto sa = static_cast<int64_t>(ina);
@@ -325,13 +308,11 @@ namespace alu {
     case AluOp::FCVT_W_S: {
       if (!std::isfinite(a) || a > static_cast<float>(INT32_MAX) || a < static_cast<float>(INT32_MIN)) {
         fcsr |= FCSR_INVALID_OP;
-        fesetround(original_rm);
         auto res = static_cast<int64_t>(static_cast<int32_t>(a > 0 ? INT32_MAX : INT32_MIN));
         return {static_cast<uint64_t>(res), fcsr};
       } else {
         auto ires = static_cast<int32_t>(std::nearbyint(a));
         auto res = static_cast<int64_t>(ires); // sign-extend
-        fesetround(original_rm);
         return {static_cast<uint64_t>(res), fcsr};
       }
       break;
@@ -339,14 +320,12 @@ namespace alu {
     case AluOp::FCVT_WU_S: {
       if (!std::isfinite(a) || a > static_cast<float>(UINT32_MAX) || a < 0.0f) {
         fcsr |= FCSR_INVALID_OP;
-        fesetround(original_rm);
         uint32_t saturate = (a < 0.0f) ? 0 : UINT32_MAX;
         auto res = static_cast<int64_t>(static_cast<int32_t>(saturate)); // sign-extend
         return {static_cast<uint64_t>(res), fcsr};
       } else {
         auto ires = static_cast<uint32_t>(std::nearbyint(a));
         auto res = static_cast<int64_t>(static_cast<int32_t>(ires)); // sign-extend
-        fesetround(original_rm);
         return {static_cast<uint64_t>(res), fcsr};
       }
       break;
@@ -354,12 +333,10 @@ namespace alu {
     case AluOp::FCVT_L_S: {
       if (!std::isfinite(a) || a > static_cast<float>(INT64_MAX) || a < static_cast<float>(INT64_MIN)) {
         fcsr |= FCSR_INVALID_OP;
-        fesetround(original_rm);
         int64_t saturate = (a < 0.0f) ? INT64_MIN : INT64_MAX;
         return {static_cast<uint64_t>(saturate), fcsr};
       } else {
         auto ires = static_cast<int64_t>(std::nearbyint(a));
-        fesetround(original_rm);
         return {static_cast<uint64_t>(ires), fcsr};
       }
       break;
@@ -367,12 +344,10 @@ namespace alu {
     case AluOp::FCVT_LU_S: {
       if (!std::isfinite(a) || a > static_cast<float>(UINT64_MAX) || a < 0.0f) {
         fcsr |= FCSR_INVALID_OP;
-        fesetround(original_rm);
         uint64_t saturate = (a < 0.0f) ? 0 : UINT64_MAX;
         return {saturate, fcsr};
       } else {
         auto ires = static_cast<uint64_t>(std::nearbyint(a));
-        fesetround(original_rm);
         return {ires, fcsr};
       }
       break;
@@ -494,7 +469,6 @@ namespace alu {
       else if (std::isnan(af) && (a_bits & 0x00400000)==0) res |= 1 << 8; // signaling NaN
       else if (std::isnan(af)) res |= 1 << 9; // quiet NaN
 
-      std::fesetround(original_rm);
       // std::cout << "Class: " << decode_fclass(res) << "\n";
 
 
@@ -514,25 +488,15 @@ namespace alu {
     default: break;
   }
 
-  int raised = std::fetestexcept(FE_ALL_EXCEPT);
-  if (raised & FE_INVALID) fcsr |= FCSR_INVALID_OP;
-  if (raised & FE_DIVBYZERO) fcsr |= FCSR_DIV_BY_ZERO;
-  if (raised & FE_OVERFLOW) fcsr |= FCSR_OVERFLOW;
-  if (raised & FE_UNDERFLOW) fcsr |= FCSR_UNDERFLOW;
-  if (raised & FE_INEXACT) fcsr |= FCSR_INEXACT;
-
-  std::fesetround(original_rm);
-
   uint32_t result_bits = 0;
   std::memcpy(&result_bits, &result, sizeof(result));
   return {static_cast<uint64_t>(result_bits), fcsr};
 }
 
-[[nodiscard]] std::pair<uint64_t, bool> Alu::dfpexecute(AluOp op,
-                                                        uint64_t ina,
-                                                        uint64_t inb,
-                                                        uint64_t inc,
-                                                        uint8_t rm) {
+[[nodiscard]] std::pair<uint64_t, uint8_t> Alu::dfpcompute(AluOp op,
+                                                         uint64_t ina,
+                                                         uint64_t inb,
+                                                         uint64_t inc) {
   double a, b, c;
   std::memcpy(&a, &ina, sizeof(double));
   std::memcpy(&b, &inb, sizeof(double));
@@ -541,23 +505,6 @@ namespace alu {
 
   uint8_t fcsr = 0;
 
-  int original_rm = std::fegetround();
-
-  switch (rm) {
-    case 0b000: std::fesetround(FE_TONEAREST);
-      break;  // RNE
-    case 0b001: std::fesetround(FE_TOWARDZERO);
-      break; // RTZ
-    case 0b010: std::fesetround(FE_DOWNWARD);
-      break;   // RDN
-    case 0b011: std::fesetround(FE_UPWARD);
-      break;     // RUP
-      // 0b100 RMM, unsupported
-    default: break;
-  }
-
-  std::feclearexcept(FE_ALL_EXCEPT);
-
   switch (op) {
     case AluOp::kAdd: {
       auto sa = static_cast<int64_t>(ina);
@@ -615,14 +562,12 @@ namespace alu {
     case AluOp::FCVT_W_D: {
       if (!std::isfinite(a) || a > static_cast<double>(INT32_MAX) || a < static_cast<double>(INT32_MIN)) {
         fcsr |= FCSR_INVALID_OP;
-        fesetround(original_rm);
         int32_t saturate = (a < 0.0) ? INT32_MIN : INT32_MAX;
         auto res = static_cast<int64_t>(saturate); // sign-extend to XLEN
         return {static_cast<uint64_t>(res), fcsr};
       } else {
         auto ires = static_cast<int32_t>(std::nearbyint(a));
         auto res = static_cast<int64_t>(ires); // sign-extend to XLEN
-        fesetround(original_rm);
         return {static_cast<uint64_t>(res), fcsr};
       }
       break;
@@ -630,14 +575,12 @@ namespace alu {
     case AluOp::FCVT_WU_D: {
       if (!std::isfinite(a) || a > static_cast<double>(UINT32_MAX) || a < 0.0) {
         fcsr |= FCSR_INVALID_OP;
-        fesetround(original_rm);
         uint32_t saturate = (a < 0.0) ? 0 : UINT32_MAX;
         auto res = static_cast<int64_t>(static_cast<int32_t>(saturate)); // sign-extend per spec
         return {static_cast<uint64_t>(res), fcsr};
       } else {
         auto ires = static_cast<uint32_t>(std::nearbyint(a));
         auto res = static_cast<int64_t>(static_cast<int32_t>(ires)); // sign-extend
-        fesetround(original_rm);
         return {static_cast<uint64_t>(res), fcsr};
       }
       break;
@@ -645,12 +588,10 @@ namespace alu {
     case AluOp::FCVT_L_D: {
       if (!std::isfinite(a) || a > static_cast<double>(INT64_MAX) || a < static_cast<double>(INT64_MIN)) {
         fcsr |= FCSR_INVALID_OP;
-        fesetround(original_rm);
         int64_t saturate = (a < 0.0) ? INT64_MIN : INT64_MAX;
         return {static_cast<uint64_t>(saturate), fcsr};
       } else {
         auto ires = static_cast<int64_t>(std::nearbyint(a));
-        fesetround(original_rm);
         return {static_cast<uint64_t>(ires), fcsr};
       }
       break;
@@ -658,12 +599,10 @@ namespace alu {
     case AluOp::FCVT_LU_D: {
       if (!std::isfinite(a) || a > static_cast<double>(UINT64_MAX) || a < 0.0) {
         fcsr |= FCSR_INVALID_OP;
-        fesetround(original_rm);
         uint64_t saturate = (a < 0.0) ? 0 : UINT64_MAX;
         return {saturate, fcsr};
       } else {
         auto ires = static_cast<uint64_t>(std::nearbyint(a));
-        fesetround(original_rm);
         return {ires, fcsr};
       }
       break;
@@ -785,7 +724,6 @@ namespace alu {
       else if (std::isnan(af) && (a_bits & 0x0008000000000000)==0) res |= 1 << 8; // signaling NaN
       else if (std::isnan(af)) res |= 1 << 9; // quiet NaN
 
-      std::fesetround(original_rm);
       return {res, fcsr};
     }
     case AluOp::FCVT_D_S: {
@@ -813,20 +751,43 @@ namespace alu {
     default: break;
   }
 
-  int raised = std::fetestexcept(FE_ALL_EXCEPT);
-  if (raised & FE_INVALID) fcsr |= FCSR_INVALID_OP;
-  if (raised & FE_DIVBYZERO) fcsr |= FCSR_DIV_BY_ZERO;
-  if (raised & FE_OVERFLOW) fcsr |= FCSR_OVERFLOW;
-  if (raised & FE_UNDERFLOW) fcsr |= FCSR_UNDERFLOW;
-  if (raised & FE_INEXACT) fcsr |= FCSR_INEXACT;
-
-  std::fesetround(original_rm);
-
   uint64_t result_bits = 0;
   std::memcpy(&result_bits, &result, sizeof(result));
   return {result_bits, fcsr};
 }
 
+[[nodiscard]] std::pair<uint64_t, uint8_t> Alu::fpexecute(AluOp op,
+                                                          uint64_t ina,
+                                                          uint64_t inb,
+                                                          uint64_t inc,
+                                                          uint8_t rm) {
+  int original_rm = std::fegetround();
+  std::fesetround(FpEnvironment::HostRoundingMode(rm));
+  std::feclearexcept(FE_ALL_EXCEPT);
+
+  auto [result, fcsr] = fpcompute(op, ina, inb, inc);
+  fcsr |= FpEnvironment::FlagsFromHost(std::fetestexcept(FE_ALL_EXCEPT));
+
+  std::fesetround(original_rm);
+  return {result, fcsr};
+}
+
+[[nodiscard]] std::pair<uint64_t, bool> Alu::dfpexecute(AluOp op,
+                                                        uint64_t ina,
+                                                        uint64_t inb,
+                                                        uint64_t inc,
+                                                        uint8_t rm) {
+  int original_rm = std::fegetround();
+  std::fesetround(FpEnvironment::HostRoundingMode(rm));
+  std::feclearexcept(FE_ALL_EXCEPT);
+
+  auto [result, fcsr] = dfpcompute(op, ina, inb, inc);
+  fcsr |= FpEnvironment::FlagsFromHost(std::fetestexcept(FE_ALL_EXCEPT));
+
+  std::fesetround(original_rm);
+  return {result, fcsr != 0};
+}
+
 void Alu::setFlags(bool carry, bool zero, bool negative, bool overflow) {
   carry_ = carry;
   zero_ = zero;
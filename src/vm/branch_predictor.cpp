@@ -0,0 +1,315 @@
+/**
+ * @file branch_predictor.cpp
+ * @brief Direction predictors for conditional branches
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+
+#include "vm/branch_predictor.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace {
+
+constexpr uint8_t kWeaklyNotTaken = 1;
+
+/// Table sizes are powers of two, and at least two entries so every index has a bit.
+uint64_t TableSize(uint64_t requested) {
+  return std::bit_floor(std::max<uint64_t>(requested, 2));
+}
+
+uint64_t LowBits(uint64_t length) {
+  return length >= 64 ? ~uint64_t{0} : (uint64_t{1} << length) - 1;
+}
+
+void Train(uint8_t &counter, bool taken) {
+  if (taken) {
+    counter = std::min<uint8_t>(counter + 1, 3);
+  } else if (counter > 0) {
+    counter--;
+  }
+}
+
+template <typename T>
+T Saturate(int value, int low, int high) {
+  return static_cast<T>(std::clamp(value, low, high));
+}
+
+} // namespace
+
+bool StaticBranchPredictor::Predict(uint64_t pc, uint64_t target) {
+  (void)pc; (void)target;
+  return taken_;
+}
+
+void StaticBranchPredictor::Update(uint64_t pc, uint64_t target, bool taken) {
+  (void)pc; (void)target; (void)taken;
+}
+
+std::string_view StaticBranchPredictor::Name() const {
+  return taken_ ? "always_taken" : "always_not_taken";
+}
+
+bool BtfnBranchPredictor::Predict(uint64_t pc, uint64_t target) {
+  return target <= pc;
+}
+
+void BtfnBranchPredictor::Update(uint64_t pc, uint64_t target, bool taken) {
+  (void)pc; (void)target; (void)taken;
+}
+
+std::string_view BtfnBranchPredictor::Name() const {
+  return "btfn";
+}
+
+BimodalBranchPredictor::BimodalBranchPredictor(uint64_t table_size)
+    : counters_(TableSize(table_size), kWeaklyNotTaken), mask_(TableSize(table_size) - 1) {}
+
+bool BimodalBranchPredictor::Predict(uint64_t pc, uint64_t target) {
+  (void)target;
+  return counters_[(pc >> 2) & mask_] >= 2;
+}
+
+void BimodalBranchPredictor::Update(uint64_t pc, uint64_t target, bool taken) {
+  (void)target;
+  Train(counters_[(pc >> 2) & mask_], taken);
+}
+
+void BimodalBranchPredictor::Reset() {
+  std::fill(counters_.begin(), counters_.end(), kWeaklyNotTaken);
+}
+
+std::string_view BimodalBranchPredictor::Name() const {
+  return "bimodal";
+}
+
+GshareBranchPredictor::GshareBranchPredictor(uint64_t table_size, uint64_t history_length)
+    : counters_(TableSize(table_size), kWeaklyNotTaken),
+      mask_(TableSize(table_size) - 1),
+      history_mask_(LowBits(history_length ? history_length : std::countr_zero(TableSize(table_size)))) {}
+
+uint64_t GshareBranchPredictor::Index(uint64_t pc) const {
+  return ((pc >> 2) ^ history_) & mask_;
+}
+
+bool GshareBranchPredictor::Predict(uint64_t pc, uint64_t target) {
+  (void)target;
+  return counters_[Index(pc)] >= 2;
+}
+
+void GshareBranchPredictor::Update(uint64_t pc, uint64_t target, bool taken) {
+  (void)target;
+  Train(counters_[Index(pc)], taken);
+  history_ = ((history_ << 1) | (taken ? 1 : 0)) & history_mask_;
+}
+
+void GshareBranchPredictor::Reset() {
+  std::fill(counters_.begin(), counters_.end(), kWeaklyNotTaken);
+  history_ = 0;
+}
+
+std::string_view GshareBranchPredictor::Name() const {
+  return "gshare";
+}
+
+TournamentBranchPredictor::TournamentBranchPredictor(uint64_t table_size, uint64_t history_length)
+    : bimodal_(table_size),
+      gshare_(table_size, history_length),
+      choosers_(TableSize(table_size), kWeaklyNotTaken),
+      mask_(TableSize(table_size) - 1) {}
+
+bool TournamentBranchPredictor::Predict(uint64_t pc, uint64_t target) {
+  return choosers_[(pc >> 2) & mask_] >= 2 ? gshare_.Predict(pc, target) : bimodal_.Predict(pc, target);
+}
+
+void TournamentBranchPredictor::Update(uint64_t pc, uint64_t target, bool taken) {
+  bool bimodal_prediction = bimodal_.Predict(pc, target);
+  bool gshare_prediction = gshare_.Predict(pc, target);
+  if (bimodal_prediction != gshare_prediction) {
+    Train(choosers_[(pc >> 2) & mask_], gshare_prediction == taken);
+  }
+  bimodal_.Update(pc, target, taken);
+  gshare_.Update(pc, target, taken);
+}
+
+void TournamentBranchPredictor::Reset() {
+  bimodal_.Reset();
+  gshare_.Reset();
+  std::fill(choosers_.begin(), choosers_.end(), kWeaklyNotTaken);
+}
+
+std::string_view TournamentBranchPredictor::Name() const {
+  return "tournament";
+}
+
+void TageBranchPredictor::FoldedHistory::Push(bool newest, bool oldest) {
+  value = (value << 1) | (newest ? 1 : 0);
+  value ^= static_cast<uint64_t>(oldest ? 1 : 0) << (length % width);
+  value ^= value >> width;
+  value &= LowBits(width);
+}
+
+TageBranchPredictor::TageBranchPredictor(uint64_t table_size, uint64_t history_length)
+    : base_(table_size),
+      mask_(TableSize(table_size) - 1),
+      index_bits_(std::countr_zero(TableSize(table_size))) {
+  // Geometric series from kMinHistory to the longest history, strictly increasing.
+  constexpr double kMinHistory = 4;
+  const double max_history = std::max<double>(history_length ? history_length : 64, kMinHistory + kTables);
+  for (size_t i = 0; i < kTables; ++i) {
+    double ratio = static_cast<double>(i) / (kTables - 1);
+    auto length = static_cast<unsigned>(std::lround(kMinHistory * std::pow(max_history / kMinHistory, ratio)));
+    history_lengths_[i] = i == 0 ? length : std::max(length, history_lengths_[i - 1] + 1);
+  }
+  for (size_t i = 0; i < kTables; ++i) {
+    tables_[i].assign(mask_ + 1, Entry());
+    index_history_[i] = {0, history_lengths_[i], index_bits_};
+    tag_history_[i] = {0, history_lengths_[i], kTagBits};
+    tag_history_short_[i] = {0, history_lengths_[i], kTagBits - 1};
+  }
+  history_.assign(history_lengths_.back() + 1, 0);
+}
+
+TageBranchPredictor::Lookup TageBranchPredictor::Find(uint64_t pc) {
+  Lookup lookup;
+  const uint64_t word = pc >> 2;
+  for (size_t i = 0; i < kTables; ++i) {
+    lookup.index[i] = (word ^ (word >> index_bits_) ^ index_history_[i].value) & mask_;
+    lookup.tag[i] = static_cast<uint16_t>(
+        (word ^ tag_history_[i].value ^ (tag_history_short_[i].value << 1)) & LowBits(kTagBits));
+  }
+  for (int i = kTables - 1; i >= 0; --i) {
+    if (tables_[i][lookup.index[i]].tag != lookup.tag[i]) {
+      continue;
+    }
+    if (lookup.provider < 0) {
+      lookup.provider = i;
+    } else {
+      lookup.alternate = i;
+      break;
+    }
+  }
+
+  const bool base_prediction = base_.Predict(pc, 0);
+  lookup.alternate_prediction =
+      lookup.alternate >= 0 ? tables_[lookup.alternate][lookup.index[lookup.alternate]].counter >= 0 : base_prediction;
+  if (lookup.provider < 0) {
+    lookup.provider_prediction = base_prediction;
+    lookup.prediction = base_prediction;
+    return lookup;
+  }
+  const Entry &provider = tables_[lookup.provider][lookup.index[lookup.provider]];
+  lookup.provider_prediction = provider.counter >= 0;
+  const bool newly_allocated = (provider.counter == 0 || provider.counter == -1) && provider.useful == 0;
+  lookup.prediction = newly_allocated && use_alternate_ >= 0 ? lookup.alternate_prediction : lookup.provider_prediction;
+  return lookup;
+}
+
+bool TageBranchPredictor::Predict(uint64_t pc, uint64_t target) {
+  (void)target;
+  return Find(pc).prediction;
+}
+
+void TageBranchPredictor::Update(uint64_t pc, uint64_t target, bool taken) {
+  const Lookup lookup = Find(pc);
+
+  if (lookup.provider >= 0) {
+    Entry &provider = tables_[lookup.provider][lookup.index[lookup.provider]];
+    const bool newly_allocated = (provider.counter == 0 || provider.counter == -1) && provider.useful == 0;
+    if (lookup.provider_prediction != lookup.alternate_prediction) {
+      if (newly_allocated) {
+        use_alternate_ = Saturate<int8_t>(use_alternate_ + (lookup.alternate_prediction == taken ? 1 : -1), -8, 7);
+      }
+      provider.useful = Saturate<uint8_t>(provider.useful + (lookup.provider_prediction == taken ? 1 : -1), 0, 3);
+    }
+    provider.counter = Saturate<int8_t>(provider.counter + (taken ? 1 : -1), -4, 3);
+    if (newly_allocated) {
+      // The alternate is still the better-trained predictor until this entry proves itself.
+      if (lookup.alternate >= 0) {
+        Entry &alternate = tables_[lookup.alternate][lookup.index[lookup.alternate]];
+        alternate.counter = Saturate<int8_t>(alternate.counter + (taken ? 1 : -1), -4, 3);
+      } else {
+        base_.Update(pc, target, taken);
+      }
+    }
+  } else {
+    base_.Update(pc, target, taken);
+  }
+
+  // On a misprediction, claim an entry in a table with a longer history than the provider.
+  if (lookup.prediction != taken && lookup.provider < static_cast<int>(kTables) - 1) {
+    bool allocated = false;
+    for (size_t i = lookup.provider + 1; i < kTables; ++i) {
+      Entry &entry = tables_[i][lookup.index[i]];
+      if (entry.useful == 0) {
+        entry = Entry{static_cast<int8_t>(taken ? 0 : -1), lookup.tag[i], 0};
+        allocated = true;
+        break;
+      }
+    }
+    if (!allocated) {
+      for (size_t i = lookup.provider + 1; i < kTables; ++i) {
+        Entry &entry = tables_[i][lookup.index[i]];
+        entry.useful--;
+      }
+    }
+  }
+
+  // Age the useful counters so entries that stopped paying off can be replaced.
+  if (++updates_ % kUsefulResetPeriod == 0) {
+    for (auto &table : tables_) {
+      for (auto &entry : table) {
+        entry.useful >>= 1;
+      }
+    }
+  }
+  PushHistory(taken);
+}
+
+void TageBranchPredictor::PushHistory(bool taken) {
+  const size_t size = history_.size();
+  for (size_t i = 0; i < kTables; ++i) {
+    const bool oldest = history_[(history_head_ + history_lengths_[i] - 1) % size] != 0;
+    index_history_[i].Push(taken, oldest);
+    tag_history_[i].Push(taken, oldest);
+    tag_history_short_[i].Push(taken, oldest);
+  }
+  history_head_ = (history_head_ + size - 1) % size;
+  history_[history_head_] = taken ? 1 : 0;
+}
+
+void TageBranchPredictor::Reset() {
+  base_.Reset();
+  for (size_t i = 0; i < kTables; ++i) {
+    std::fill(tables_[i].begin(), tables_[i].end(), Entry());
+    index_history_[i].value = 0;
+    tag_history_[i].value = 0;
+    tag_history_short_[i].value = 0;
+  }
+  std::fill(history_.begin(), history_.end(), 0);
+  history_head_ = 0;
+  use_alternate_ = 0;
+  updates_ = 0;
+}
+
+std::string_view TageBranchPredictor::Name() const {
+  return "tage";
+}
+
+std::unique_ptr<BranchPredictor> MakeBranchPredictor(vm_config::BranchPredictorType type,
+                                                     uint64_t table_size,
+                                                     uint64_t history_length) {
+  using vm_config::BranchPredictorType;
+  switch (type) {
+    case BranchPredictorType::NONE: return nullptr;
+    case BranchPredictorType::ALWAYS_NOT_TAKEN: return std::make_unique<StaticBranchPredictor>(false);
+    case BranchPredictorType::ALWAYS_TAKEN: return std::make_unique<StaticBranchPredictor>(true);
+    case BranchPredictorType::BTFN: return std::make_unique<BtfnBranchPredictor>();
+    case BranchPredictorType::BIMODAL: return std::make_unique<BimodalBranchPredictor>(table_size);
+    case BranchPredictorType::GSHARE: return std::make_unique<GshareBranchPredictor>(table_size, history_length);
+    case BranchPredictorType::TOURNAMENT: return std::make_unique<TournamentBranchPredictor>(table_size, history_length);
+    case BranchPredictorType::TAGE: return std::make_unique<TageBranchPredictor>(table_size, history_length);
+  }
+  return nullptr;
+}
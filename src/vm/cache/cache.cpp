@@ -4,3 +4,941 @@
  * @author Vishank Singh, https://github.com/VishankSingh
  */
 #include "vm/cache/cache.h"
+#include "vm/main_memory.h"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include <string>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace cache {
+
+namespace {
+
+/// Bit w is set when tags[w] == tag. Compares four ways at a time with AVX2, two with SSE2.
+uint64_t MatchTags(const uint64_t *tags, uint64_t tag, unsigned ways) {
+  uint64_t matches = 0;
+  unsigned way = 0;
+#if defined(__AVX2__)
+  const __m256i wide_needle = _mm256_set1_epi64x(static_cast<long long>(tag));
+  for (; way + 4 <= ways; way += 4) {
+    const __m256i lanes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(tags + way));
+    const __m256i equal = _mm256_cmpeq_epi64(lanes, wide_needle);
+    matches |= static_cast<uint64_t>(_mm256_movemask_pd(_mm256_castsi256_pd(equal))) << way;
+  }
+#endif
+#if defined(__SSE2__)
+  const __m128i needle = _mm_set1_epi64x(static_cast<long long>(tag));
+  for (; way + 2 <= ways; way += 2) {
+    const __m128i lanes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tags + way));
+    // SSE2 has no 64-bit compare: a lane matches when both of its 32-bit halves do.
+    const __m128i halves = _mm_cmpeq_epi32(lanes, needle);
+    const __m128i equal = _mm_and_si128(halves, _mm_shuffle_epi32(halves, _MM_SHUFFLE(2, 3, 0, 1)));
+    matches |= static_cast<uint64_t>(_mm_movemask_pd(_mm_castsi128_pd(equal))) << way;
+  }
+#endif
+  for (; way < ways; ++way) {
+    matches |= static_cast<uint64_t>(tags[way] == tag) << way;
+  }
+  return matches;
+}
+
+/// Copies size bytes of memory at address into bytes, a doubleword at a time when aligned.
+void CopyFromMemory(Memory &memory, uint64_t address, uint8_t *bytes, uint64_t size) {
+  if (address % 8 == 0 && size % 8 == 0 && memory.InBounds(address, size)) {
+    for (uint64_t i = 0; i < size; i += 8) {
+      const uint64_t doubleword = memory.ReadDoubleWord(address + i);
+      for (unsigned byte = 0; byte < 8; ++byte) {
+        bytes[i + byte] = static_cast<uint8_t>(doubleword >> (8 * byte));
+      }
+    }
+    return;
+  }
+  for (uint64_t i = 0; i < size; ++i) {
+    // the top line of a memory that does not end on a line boundary is only partly backed
+    bytes[i] = memory.InBounds(address + i, 1) ? memory.ReadByte(address + i) : 0;
+  }
+}
+
+/// Copies size bytes into memory at address, skipping any past its end.
+void CopyToMemory(Memory &memory, uint64_t address, const uint8_t *bytes, uint64_t size) {
+  if (address % 8 == 0 && size % 8 == 0 && memory.InBounds(address, size)) {
+    for (uint64_t i = 0; i < size; i += 8) {
+      uint64_t doubleword = 0;
+      for (unsigned byte = 0; byte < 8; ++byte) {
+        doubleword |= static_cast<uint64_t>(bytes[i + byte]) << (8 * byte);
+      }
+      memory.WriteDoubleWord(address + i, doubleword);
+    }
+    return;
+  }
+  for (uint64_t i = 0; i < size; ++i) {
+    if (memory.InBounds(address + i, 1)) {
+      memory.WriteByte(address + i, bytes[i]);
+    }
+  }
+}
+
+/// The size bytes (at most 8) of memory at address, little-endian, read at their native width.
+uint64_t LoadFromMemory(Memory &memory, uint64_t address, unsigned size) {
+  switch (size) {
+    case 1: return memory.ReadValue<uint8_t>(address);
+    case 2: return memory.ReadValue<uint16_t>(address);
+    case 4: return memory.ReadValue<uint32_t>(address);
+    case 8: return memory.ReadValue<uint64_t>(address);
+    default: break;
+  }
+  uint64_t value = 0;
+  for (unsigned i = 0; i < size; ++i) {
+    value |= static_cast<uint64_t>(memory.ReadByte(address + i)) << (8 * i);
+  }
+  return value;
+}
+
+/// Stores the low size bytes of value at address, at their native width.
+void StoreToMemory(Memory &memory, uint64_t address, uint64_t value, unsigned size) {
+  switch (size) {
+    case 1: memory.WriteValue(address, static_cast<uint8_t>(value)); return;
+    case 2: memory.WriteValue(address, static_cast<uint16_t>(value)); return;
+    case 4: memory.WriteValue(address, static_cast<uint32_t>(value)); return;
+    case 8: memory.WriteValue(address, value); return;
+    default: break;
+  }
+  for (unsigned i = 0; i < size; ++i) {
+    memory.WriteByte(address + i, static_cast<uint8_t>(value >> (8 * i)));
+  }
+}
+
+} // namespace
+
+CacheConfig CacheConfig::FromSizes(unsigned long size, unsigned long line_size, unsigned long associativity) {
+  if (!std::has_single_bit(size) || !std::has_single_bit(line_size) || !std::has_single_bit(associativity)) {
+    throw std::invalid_argument("Cache size, block size and associativity must be powers of two");
+  }
+  if (line_size < 4 || size < line_size * associativity) {
+    throw std::invalid_argument("Cache of " + std::to_string(size) + " bytes cannot hold one set of "
+                                + std::to_string(associativity) + " lines of " + std::to_string(line_size) + " bytes");
+  }
+  if (associativity > kMaxAssociativity) {
+    throw std::invalid_argument("Cache associativity cannot exceed " + std::to_string(kMaxAssociativity));
+  }
+  CacheConfig config;
+  config.size = size;
+  config.lines = size / line_size;
+  config.associativity = associativity;
+  config.words_per_line = line_size / 4;
+  return config;
+}
+
+Cache::Cache(const CacheConfig &config, Memory &memory)
+    : type(config.cache_type),
+      config(config),
+      stats(),
+      memory_(memory),
+      line_size_(config.words_per_line * 4),
+      sets_(config.lines / config.associativity),
+      ways_(static_cast<unsigned>(config.associativity)),
+      tags_(config.lines, 0),
+      valid_(sets_, 0),
+      dirty_(sets_, 0),
+      random_(0) {
+  switch (config.replacement_policy) {
+    case ReplacementPolicy::PLRU:
+      plru_.assign(sets_, 0);
+      break;
+    case ReplacementPolicy::SRRIP:
+    case ReplacementPolicy::BRRIP:
+    case ReplacementPolicy::DRRIP:
+      rrpv_.assign(2 * sets_, 0);
+      break;
+    case ReplacementPolicy::Random:
+      break;
+    default:
+      stamps_.assign(config.lines, 0);
+      break;
+  }
+  if (!config.timing_only) {
+    data_.assign(config.lines * line_size_, 0);
+  }
+  prefetcher_ = MakePrefetcher(config.prefetcher, line_size_);
+  if (prefetcher_) {
+    prefetched_.assign(sets_, 0);
+  }
+  if (config.mshrs) {
+    mshrs_ = std::make_unique<MshrFile>(config.mshrs);
+  }
+  if (config.write_buffer_entries) {
+    write_buffer_ = std::make_unique<WriteBuffer>(config.write_buffer_entries, line_size_);
+  }
+  if (prefetcher_ || mshrs_) {
+    ready_at_.assign(config.lines, 0);
+  }
+}
+
+int Cache::Find(uint64_t address) const {
+  const uint64_t set = SetIndex(address);
+  const uint64_t matches = MatchTags(&tags_[Slot(set, 0)], Tag(address), ways_) & valid_[set];
+  return matches ? std::countr_zero(matches) : -1;
+}
+
+void Cache::Touch(uint64_t set, unsigned way) {
+  switch (config.replacement_policy) {
+    case ReplacementPolicy::LRU:
+    case ReplacementPolicy::LIP:
+    case ReplacementPolicy::BIP:
+      stamps_[Slot(set, way)] = clock_;
+      break;
+    case ReplacementPolicy::PLRU:
+      // Every node on the path to way points the victim the other way.
+      for (unsigned node = way + ways_; node > 1; node /= 2) {
+        const uint64_t parent = uint64_t{1} << (node / 2);
+        plru_[set] = node % 2 ? plru_[set] & ~parent : plru_[set] | parent;
+      }
+      break;
+    case ReplacementPolicy::SRRIP:
+    case ReplacementPolicy::BRRIP:
+    case ReplacementPolicy::DRRIP:
+      SetRrpv(set, way, 0);
+      break;
+    case ReplacementPolicy::FIFO:
+    case ReplacementPolicy::Random:
+      break;
+  }
+}
+
+void Cache::SetRrpv(uint64_t set, unsigned way, unsigned rrpv) {
+  const uint64_t bit = uint64_t{1} << way;
+  uint64_t &low = rrpv_[2 * set];
+  uint64_t &high = rrpv_[2 * set + 1];
+  low = rrpv & 1 ? low | bit : low & ~bit;
+  high = rrpv & 2 ? high | bit : high & ~bit;
+}
+
+ReplacementPolicy Cache::SetPolicy(uint64_t set) const {
+  if (config.replacement_policy != ReplacementPolicy::DRRIP) {
+    return config.replacement_policy;
+  }
+  switch (LeaderOf(set)) {
+    case Leader::SRRIP: return ReplacementPolicy::SRRIP;
+    case Leader::BRRIP: return ReplacementPolicy::BRRIP;
+    case Leader::None: break;
+  }
+  return psel_ > kPselMax / 2 ? ReplacementPolicy::BRRIP : ReplacementPolicy::SRRIP;
+}
+
+void Cache::Insert(uint64_t set, unsigned way) {
+  switch (SetPolicy(set)) {
+    case ReplacementPolicy::LRU:
+    case ReplacementPolicy::FIFO:
+      stamps_[Slot(set, way)] = clock_;
+      break;
+    case ReplacementPolicy::LIP:
+      stamps_[Slot(set, way)] = 0;
+      break;
+    case ReplacementPolicy::BIP:
+      stamps_[Slot(set, way)] = BimodalFill() ? clock_ : 0;
+      break;
+    case ReplacementPolicy::PLRU:
+      Touch(set, way);
+      break;
+    case ReplacementPolicy::SRRIP:
+      SetRrpv(set, way, kRrpvMax - 1);
+      break;
+    case ReplacementPolicy::BRRIP:
+      SetRrpv(set, way, BimodalFill() ? kRrpvMax - 1 : kRrpvMax);
+      break;
+    case ReplacementPolicy::DRRIP: // SetPolicy() resolves DRRIP
+    case ReplacementPolicy::Random:
+      break;
+  }
+}
+
+bool Cache::UsePrefetched(uint64_t set, unsigned way, Access access) {
+  const uint64_t bit = uint64_t{1} << way;
+  if (prefetched_.empty() || !(prefetched_[set] & bit)) {
+    return false;
+  }
+  prefetched_[set] &= ~bit;
+  const uint64_t ready_at = ready_at_[Slot(set, way)];
+  if (now_ < ready_at) {
+    stats.prefetch_late++;
+    latency_ = ready_at - now_;
+    if (access == Access::Demand) {
+      stats.penalty_cycles += latency_;
+    }
+  } else {
+    stats.prefetch_useful++;
+  }
+  return true;
+}
+
+void Cache::DropPrefetched(uint64_t set, unsigned way) {
+  const uint64_t bit = uint64_t{1} << way;
+  if (prefetched_[set] & bit) {
+    prefetched_[set] &= ~bit;
+    stats.prefetch_useless++;
+  }
+}
+
+void Cache::Prefetch(uint64_t address, bool miss) {
+  prefetch_requests_.clear();
+  prefetcher_->Observe(pc_, address, miss, prefetch_requests_);
+  for (uint64_t target : prefetch_requests_) {
+    // Requests run off the ends of memory as readily as they stay inside it.
+    if (!memory_.InBounds(target, line_size_) || Find(target) >= 0) {
+      continue;
+    }
+    stats.prefetches++;
+    const uint64_t set = SetIndex(target);
+    const unsigned way = Allocate(target, true, Access::Prefetch);
+    prefetched_[set] |= uint64_t{1} << way;
+    ready_at_[Slot(set, way)] = now_ + BelowLatency();
+  }
+}
+
+void Cache::Stall(uint64_t cycles) {
+  stats.penalty_cycles += cycles;
+  access_stall_ += cycles;
+  now_ += cycles;
+}
+
+void Cache::IssueMiss(uint64_t set, unsigned way) {
+  if (const uint64_t wait = mshrs_->Allocate(now_, latency_)) {
+    stats.mshr_stall_cycles += wait;
+    Stall(wait);
+  }
+  ready_at_[Slot(set, way)] = now_ + latency_;
+}
+
+void Cache::AwaitFill(uint64_t set, unsigned way) {
+  const uint64_t ready_at = ready_at_[Slot(set, way)];
+  if (now_ < ready_at) {
+    stats.mshr_merges++;
+    latency_ = ready_at - now_;
+  }
+}
+
+void Cache::BufferWrite(uint64_t address) {
+  bool coalesced = false;
+  const uint64_t wait = write_buffer_->Insert(address, now_, config.miss_penalty, coalesced);
+  if (coalesced) {
+    stats.write_buffer_coalesced++;
+  }
+  if (wait) {
+    stats.write_buffer_stall_cycles += wait;
+    Stall(wait);
+  }
+}
+
+void Cache::CheckVictims(uint64_t address) {
+  const uint64_t line = address / line_size_;
+  const auto page = victims_.find(line / kVictimPageLines);
+  if (page == victims_.end()) {
+    return;
+  }
+  uint64_t &word = page->second[line % kVictimPageLines / 64];
+  const uint64_t bit = uint64_t{1} << (line % 64);
+  if (word & bit) {
+    word &= ~bit;
+    stats.replacement_misses++;
+  }
+}
+
+unsigned Cache::ChooseVictim(uint64_t set) {
+  if (const uint64_t invalid = ~valid_[set] & AllWays()) {
+    return std::countr_zero(invalid);
+  }
+  switch (config.replacement_policy) {
+    case ReplacementPolicy::LRU:
+    case ReplacementPolicy::FIFO:
+    case ReplacementPolicy::LIP:
+    case ReplacementPolicy::BIP: {
+      const auto first = stamps_.begin() + static_cast<long>(Slot(set, 0));
+      return static_cast<unsigned>(std::min_element(first, first + ways_) - first);
+    }
+    case ReplacementPolicy::PLRU: {
+      unsigned node = 1;
+      while (node < ways_) {
+        node = 2 * node + (plru_[set] >> node & 1);
+      }
+      return node - ways_;
+    }
+    case ReplacementPolicy::SRRIP:
+    case ReplacementPolicy::BRRIP:
+    case ReplacementPolicy::DRRIP: {
+      uint64_t &low = rrpv_[2 * set];
+      uint64_t &high = rrpv_[2 * set + 1];
+      // Age the whole set until a line is predicted distant. With none at kRrpvMax, adding one never saturates.
+      while (!(low & high)) {
+        high |= low;
+        low = ~low & AllWays();
+      }
+      return std::countr_zero(low & high);
+    }
+    case ReplacementPolicy::Random:
+      break;
+  }
+  return std::uniform_int_distribution<unsigned>(0, ways_ - 1)(random_);
+}
+
+void Cache::SetNextLevel(Cache *next) {
+  next_level_ = next;
+  if (next) {
+    next->upper_levels_.push_back(this);
+  }
+}
+
+void Cache::WriteLineToMemory(uint64_t set, unsigned way) const {
+  CopyToMemory(memory_, LineAddressOf(set, way), LineData(set, way), line_size_);
+}
+
+void Cache::ReadBelow(uint64_t address, uint8_t *bytes, uint64_t size, Access access) {
+  if (next_level_) {
+    next_level_->ReadWithinLine(address, bytes, size, access);
+    return;
+  }
+  if (bytes) {
+    CopyFromMemory(memory_, address, bytes, size);
+  }
+}
+
+void Cache::WriteBelow(uint64_t address, const uint8_t *bytes, uint64_t size) {
+  if (write_buffer_) {
+    BufferWrite(address);
+  }
+  if (next_level_) {
+    next_level_->WriteWithinLine(address, bytes, size, Access::Background);
+    return;
+  }
+  if (bytes) {
+    CopyToMemory(memory_, address, bytes, size);
+  }
+}
+
+void Cache::PeekBelow(uint64_t address, uint8_t *bytes, uint64_t size) const {
+  if (!bytes) {
+    return;
+  }
+  if (!next_level_) {
+    CopyFromMemory(memory_, address, bytes, size);
+    return;
+  }
+  for (uint64_t i = 0; i < size; ++i) {
+    bytes[i] = next_level_->PeekByte(address + i);
+  }
+}
+
+void Cache::Evict(uint64_t set, unsigned way) {
+  const uint64_t line_address = LineAddressOf(set, way);
+  uint8_t *data = LineData(set, way);
+  bool dirty = IsDirty(set, way);
+  // Invalid first, so that nothing the eviction sets off below finds the line here.
+  Invalidate(set, way);
+  if (config.inclusion_policy == InclusionPolicy::Inclusive) {
+    for (Cache *upper : upper_levels_) {
+      dirty |= upper->BackInvalidate(line_address, data, line_size_);
+    }
+  }
+  if (dirty) {
+    stats.writebacks++;
+  }
+  if (next_level_ && next_level_->IsExclusive()) {
+    if (write_buffer_) {
+      BufferWrite(line_address);
+    }
+    next_level_->InsertVictim(line_address, data, line_size_, dirty);
+  } else if (dirty) {
+    WriteBelow(line_address, data, line_size_);
+  }
+}
+
+unsigned Cache::Allocate(uint64_t address, bool fill, Access access) {
+  const uint64_t set = SetIndex(address);
+  const unsigned way = ChooseVictim(set);
+  if (valid_[set] >> way & 1) {
+    stats.evictions++;
+    const uint64_t line = LineAddressOf(set, way) / line_size_;
+    victims_[line / kVictimPageLines][line % kVictimPageLines / 64] |= uint64_t{1} << (line % 64);
+    Evict(set, way);
+  }
+  if (config.replacement_policy == ReplacementPolicy::DRRIP) {
+    // A fill in a leader set is a miss against its policy.
+    if (LeaderOf(set) == Leader::SRRIP) {
+      psel_ = std::min(psel_ + 1, kPselMax);
+    } else if (LeaderOf(set) == Leader::BRRIP && psel_ > 0) {
+      psel_--;
+    }
+  }
+  if (fill) {
+    ReadBelow(LineAddress(address), LineData(set, way), line_size_, access);
+  }
+  tags_[Slot(set, way)] = Tag(address);
+  valid_[set] |= uint64_t{1} << way;
+  Insert(set, way);
+  return way;
+}
+
+void Cache::ReadWithinLine(uint64_t address, uint8_t *bytes, uint64_t size, Access access) {
+  clock_++;
+  if (access == Access::Prefetch) {
+    stats.prefetch_accesses++;
+  } else {
+    stats.accesses++;
+    stats.reads++;
+  }
+  latency_ = 0;
+  const uint64_t set = SetIndex(address);
+  int found = Find(address);
+  bool miss = found < 0;
+  if (found < 0) {
+    if (access == Access::Prefetch) {
+      stats.prefetch_misses++;
+    } else {
+      stats.misses++;
+      stats.read_misses++;
+      CheckVictims(address);
+    }
+    if (access == Access::Demand) {
+      stats.penalty_cycles += config.miss_penalty;
+    }
+    if (IsExclusive()) {
+      // The line goes straight to the level above; it only comes here once evicted from there.
+      ReadBelow(address, bytes, size, access);
+      latency_ = BelowLatency();
+      if (prefetcher_ && access == Access::Demand) {
+        Prefetch(address, true);
+      }
+      return;
+    }
+    found = static_cast<int>(Allocate(address, true, access));
+    latency_ = BelowLatency();
+    if (mshrs_ && access == Access::Demand) {
+      IssueMiss(set, found);
+    }
+  } else {
+    if (access != Access::Prefetch) {
+      stats.hits++;
+    }
+    Touch(set, found);
+    if (access != Access::Background) {
+      miss = UsePrefetched(set, found, access);
+    }
+    if (mshrs_ && !miss && access == Access::Demand) {
+      AwaitFill(set, found);
+    }
+  }
+  const unsigned way = static_cast<unsigned>(found);
+  uint8_t *data = LineData(set, way);
+  if (bytes && data) {
+    std::copy_n(data + (address - LineAddress(address)), size, bytes);
+  }
+
+  if (IsExclusive()) {
+    // The line moves up clean; dirty data carries on down rather than being lost.
+    const bool dirty = IsDirty(set, way);
+    Invalidate(set, way);
+    if (dirty) {
+      stats.writebacks++;
+      const uint64_t line_address = LineAddress(address);
+      if (next_level_ && next_level_->IsExclusive()) {
+        next_level_->InsertVictim(line_address, data, line_size_, true);
+      } else {
+        WriteBelow(line_address, data, line_size_);
+      }
+    }
+  }
+  if (prefetcher_ && access == Access::Demand) {
+    Prefetch(address, miss);
+  }
+}
+
+void Cache::WriteWithinLine(uint64_t address, const uint8_t *bytes, uint64_t size, Access access) {
+  clock_++;
+  stats.accesses++;
+  stats.writes++;
+  latency_ = 0;
+  const uint64_t set = SetIndex(address);
+  int found = Find(address);
+  bool miss = found < 0;
+  if (found >= 0) {
+    stats.hits++;
+    Touch(set, found);
+    if (access == Access::Demand) {
+      miss = UsePrefetched(set, found, access);
+      if (mshrs_ && !miss) {
+        AwaitFill(set, found);
+      }
+    }
+  } else {
+    stats.misses++;
+    stats.write_misses++;
+    CheckVictims(address);
+    if (config.write_miss_policy == WriteMissPolicy::WriteAllocate && !IsExclusive()) {
+      // A write covering the whole line has nothing to wait for.
+      const bool fill = size < line_size_;
+      if (access == Access::Demand && fill) {
+        stats.penalty_cycles += config.miss_penalty;
+      }
+      found = static_cast<int>(Allocate(address, fill, access));
+      if (fill) {
+        latency_ = BelowLatency();
+        if (mshrs_ && access == Access::Demand) {
+          IssueMiss(set, found);
+        }
+      }
+    }
+  }
+
+  if (found >= 0) {
+    const unsigned way = static_cast<unsigned>(found);
+    if (uint8_t *data = LineData(set, way); bytes && data) {
+      std::copy_n(bytes, size, data + (address - LineAddress(address)));
+    }
+    if (config.write_hit_policy == WriteHitPolicy::WriteBack) {
+      dirty_[set] |= uint64_t{1} << way;
+    } else {
+      WriteBelow(address, bytes, size);
+    }
+  } else {
+    // a miss that does not allocate
+    WriteBelow(address, bytes, size);
+  }
+  if (prefetcher_ && access == Access::Demand) {
+    Prefetch(address, miss);
+  }
+}
+
+void Cache::InsertVictim(uint64_t address, const uint8_t *bytes, uint64_t size, bool dirty) {
+  const uint64_t set = SetIndex(address);
+  int found = Find(address);
+  if (found < 0) {
+    found = static_cast<int>(Allocate(address, false, Access::Background));
+    // A clean copy above may be stale (the instruction cache never sees stores), so
+    // clean data comes from below, without counting as an access there.
+    if (!dirty || size < line_size_) {
+      PeekBelow(LineAddress(address), LineData(set, found), line_size_);
+    }
+  } else {
+    Touch(set, found);
+  }
+  if (dirty) {
+    const unsigned way = static_cast<unsigned>(found);
+    if (uint8_t *data = LineData(set, way); bytes && data) {
+      std::copy_n(bytes, size, data + (address - LineAddress(address)));
+    }
+    dirty_[set] |= uint64_t{1} << way;
+  }
+}
+
+bool Cache::BackInvalidate(uint64_t address, uint8_t *bytes, uint64_t size) {
+  bool dirty = false;
+  for (uint64_t line_address = address; line_address < address + size; line_address += line_size_) {
+    const int found = Find(line_address);
+    if (found < 0) {
+      continue;
+    }
+    const uint64_t set = SetIndex(line_address);
+    const unsigned way = static_cast<unsigned>(found);
+    uint8_t *data = LineData(set, way);
+    if (config.inclusion_policy == InclusionPolicy::Inclusive) {
+      for (Cache *upper : upper_levels_) {
+        if (upper->BackInvalidate(line_address, data, line_size_)) {
+          dirty_[set] |= uint64_t{1} << way;
+        }
+      }
+    }
+    if (IsDirty(set, way)) {
+      if (bytes && data) {
+        std::copy_n(data, line_size_, bytes + (line_address - address));
+      }
+      dirty = true;
+    }
+    Invalidate(set, way);
+    stats.back_invalidations++;
+  }
+  return dirty;
+}
+
+uint64_t Cache::Read(uint64_t address, unsigned size) {
+  uint8_t bytes[8] = {};
+  uint8_t *destination = TimingOnly() ? nullptr : bytes;
+  const uint64_t start = BeginAccess();
+  const uint64_t first = std::min<uint64_t>(size, line_size_ - (address - LineAddress(address)));
+  ReadWithinLine(address, destination, first, Access::Demand);
+  uint64_t ready_at = now_ + latency_;
+  if (first < size) {
+    ReadWithinLine(address + first, destination ? destination + first : nullptr, size - first, Access::Demand);
+    ready_at = std::max(ready_at, now_ + latency_);
+  }
+  access_latency_ = ready_at - start;
+  if (TimingOnly()) {
+    CopyFromMemory(memory_, address, bytes, size);
+  }
+  uint64_t value = 0;
+  for (unsigned i = 0; i < size; ++i) {
+    value |= static_cast<uint64_t>(bytes[i]) << (8 * i);
+  }
+  return value;
+}
+
+void Cache::Write(uint64_t address, uint64_t value, unsigned size) {
+  uint8_t bytes[8] = {};
+  for (unsigned i = 0; i < size; ++i) {
+    bytes[i] = static_cast<uint8_t>(value >> (8 * i));
+  }
+  if (TimingOnly()) {
+    CopyToMemory(memory_, address, bytes, size);
+  }
+  const uint8_t *source = TimingOnly() ? nullptr : bytes;
+  const uint64_t start = BeginAccess();
+  const uint64_t first = std::min<uint64_t>(size, line_size_ - (address - LineAddress(address)));
+  WriteWithinLine(address, source, first, Access::Demand);
+  uint64_t ready_at = now_ + latency_;
+  if (first < size) {
+    WriteWithinLine(address + first, source ? source + first : nullptr, size - first, Access::Demand);
+    ready_at = std::max(ready_at, now_ + latency_);
+  }
+  access_latency_ = ready_at - start;
+}
+
+uint64_t Cache::BeginAccess() {
+  access_stall_ = 0;
+  if (mshrs_) {
+    mshrs_->Advance(now_);
+  }
+  return now_;
+}
+
+uint8_t Cache::PeekByte(uint64_t address) const {
+  if (TimingOnly()) {
+    return memory_.ReadByte(address);
+  }
+  if (const int way = Find(address); way >= 0) {
+    return LineData(SetIndex(address), way)[address - LineAddress(address)];
+  }
+  return next_level_ ? next_level_->PeekByte(address) : memory_.ReadByte(address);
+}
+
+void Cache::PokeByte(uint64_t address, uint8_t value) {
+  if (TimingOnly()) {
+    memory_.WriteByte(address, value);
+    return;
+  }
+  if (const int way = Find(address); way >= 0) {
+    LineData(SetIndex(address), way)[address - LineAddress(address)] = value;
+  }
+  if (next_level_) {
+    next_level_->PokeByte(address, value);
+  } else {
+    memory_.WriteByte(address, value);
+  }
+}
+
+uint64_t Cache::Peek(uint64_t address, unsigned size) const {
+  if (TimingOnly()) {
+    return LoadFromMemory(memory_, address, size);
+  }
+  uint64_t value = 0;
+  if (LineAddress(address) != LineAddress(address + size - 1)) {
+    for (unsigned i = 0; i < size; ++i) {
+      value |= static_cast<uint64_t>(PeekByte(address + i)) << (8 * i);
+    }
+    return value;
+  }
+  if (const int way = Find(address); way >= 0) {
+    const uint8_t *bytes = LineData(SetIndex(address), way) + (address - LineAddress(address));
+    for (unsigned i = 0; i < size; ++i) {
+      value |= static_cast<uint64_t>(bytes[i]) << (8 * i);
+    }
+    return value;
+  }
+  return next_level_ ? next_level_->Peek(address, size) : LoadFromMemory(memory_, address, size);
+}
+
+void Cache::Poke(uint64_t address, uint64_t value, unsigned size) {
+  if (TimingOnly()) {
+    StoreToMemory(memory_, address, value, size);
+    return;
+  }
+  if (LineAddress(address) != LineAddress(address + size - 1)) {
+    for (unsigned i = 0; i < size; ++i) {
+      PokeByte(address + i, static_cast<uint8_t>(value >> (8 * i)));
+    }
+    return;
+  }
+  if (const int way = Find(address); way >= 0) {
+    uint8_t *bytes = LineData(SetIndex(address), way) + (address - LineAddress(address));
+    for (unsigned i = 0; i < size; ++i) {
+      bytes[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+  }
+  if (next_level_) {
+    next_level_->Poke(address, value, size);
+  } else {
+    StoreToMemory(memory_, address, value, size);
+  }
+}
+
+void Cache::PeekBlock(uint64_t address, std::span<uint8_t> bytes) const {
+  if (TimingOnly()) {
+    memory_.ReadBlock(address, bytes);
+    return;
+  }
+  for (size_t done = 0; done < bytes.size();) {
+    const uint64_t at = address + done;
+    const std::span<uint8_t> piece = bytes.subspan(done, std::min<uint64_t>(bytes.size() - done, LineAddress(at) + line_size_ - at));
+    if (const int way = Find(at); way >= 0) {
+      std::copy_n(LineData(SetIndex(at), way) + (at - LineAddress(at)), piece.size(), piece.begin());
+    } else if (next_level_) {
+      next_level_->PeekBlock(at, piece);
+    } else {
+      memory_.ReadBlock(at, piece);
+    }
+    done += piece.size();
+  }
+}
+
+void Cache::PokeBlock(uint64_t address, std::span<const uint8_t> bytes) {
+  if (TimingOnly()) {
+    memory_.WriteBlock(address, bytes);
+    return;
+  }
+  for (size_t done = 0; done < bytes.size();) {
+    const uint64_t at = address + done;
+    const std::span<const uint8_t> piece = bytes.subspan(done, std::min<uint64_t>(bytes.size() - done, LineAddress(at) + line_size_ - at));
+    if (const int way = Find(at); way >= 0) {
+      std::copy(piece.begin(), piece.end(), LineData(SetIndex(at), way) + (at - LineAddress(at)));
+    }
+    done += piece.size();
+  }
+  // Levels below see the whole range at once and split it into their own, larger lines.
+  if (next_level_) {
+    next_level_->PokeBlock(address, bytes);
+  } else {
+    memory_.WriteBlock(address, bytes);
+  }
+}
+
+void Cache::SyncToMemory() const {
+  if (TimingOnly()) {
+    return;
+  }
+  for (uint64_t set = 0; set < sets_; ++set) {
+    for (uint64_t dirty = dirty_[set]; dirty; dirty &= dirty - 1) {
+      WriteLineToMemory(set, std::countr_zero(dirty));
+    }
+  }
+}
+
+void Cache::Reset() {
+  std::fill(valid_.begin(), valid_.end(), 0);
+  std::fill(dirty_.begin(), dirty_.end(), 0);
+  std::fill(stamps_.begin(), stamps_.end(), 0);
+  std::fill(plru_.begin(), plru_.end(), 0);
+  std::fill(rrpv_.begin(), rrpv_.end(), 0);
+  victims_.clear();
+  std::fill(prefetched_.begin(), prefetched_.end(), 0);
+  std::fill(ready_at_.begin(), ready_at_.end(), 0);
+  if (prefetcher_) {
+    prefetcher_->Reset();
+  }
+  if (mshrs_) {
+    mshrs_->Reset();
+  }
+  if (write_buffer_) {
+    write_buffer_->Reset();
+  }
+  access_latency_ = 0;
+  access_stall_ = 0;
+  psel_ = kPselMax / 2;
+  bimodal_fills_ = 0;
+  stats = CacheStats();
+  clock_ = 0;
+  random_.seed(0);
+}
+
+void Cache::DumpStats(std::ostream &out) const {
+  out << "{\"type\": \"" << (type == CacheType::Instruction ? "instruction" : "data") << "\""
+      << ", \"size\": " << config.size
+      << ", \"block_size\": " << line_size_
+      << ", \"associativity\": " << config.associativity
+      << ", \"sets\": " << sets_
+      << ", \"replacement_policy\": \"" << ToString(config.replacement_policy) << "\""
+      << ", \"write_hit_policy\": \"" << ToString(config.write_hit_policy) << "\""
+      << ", \"write_miss_policy\": \"" << ToString(config.write_miss_policy) << "\""
+      << ", \"miss_penalty\": " << config.miss_penalty
+      << ", \"inclusion_policy\": \"" << ToString(config.inclusion_policy) << "\""
+      << ", \"timing_only\": " << (TimingOnly() ? "true" : "false")
+      << ", \"prefetcher\": \"" << ToString(config.prefetcher.type) << "\""
+      << ", \"prefetch_degree\": " << config.prefetcher.degree
+      << ", \"prefetch_distance\": " << config.prefetcher.distance
+      << ", \"mshrs\": " << config.mshrs
+      << ", \"write_buffer_entries\": " << config.write_buffer_entries
+      << ", \"accesses\": " << stats.accesses
+      << ", \"hits\": " << stats.hits
+      << ", \"misses\": " << stats.misses
+      << ", \"reads\": " << stats.reads
+      << ", \"writes\": " << stats.writes
+      << ", \"read_misses\": " << stats.read_misses
+      << ", \"write_misses\": " << stats.write_misses
+      << ", \"evictions\": " << stats.evictions
+      << ", \"writebacks\": " << stats.writebacks
+      << ", \"penalty_cycles\": " << stats.penalty_cycles
+      << ", \"back_invalidations\": " << stats.back_invalidations
+      << ", \"replacement_misses\": " << stats.replacement_misses
+      << ", \"prefetches\": " << stats.prefetches
+      << ", \"prefetch_useful\": " << stats.prefetch_useful
+      << ", \"prefetch_late\": " << stats.prefetch_late
+      << ", \"prefetch_useless\": " << stats.prefetch_useless
+      << ", \"prefetch_accesses\": " << stats.prefetch_accesses
+      << ", \"prefetch_misses\": " << stats.prefetch_misses
+      << ", \"mshr_merges\": " << stats.mshr_merges
+      << ", \"mshr_stall_cycles\": " << stats.mshr_stall_cycles
+      << ", \"write_buffer_coalesced\": " << stats.write_buffer_coalesced
+      << ", \"write_buffer_stall_cycles\": " << stats.write_buffer_stall_cycles
+      << ", \"mshr_occupancy\": [";
+  const std::vector<uint64_t> occupancy = MshrOccupancy();
+  for (size_t busy = 0; busy < occupancy.size(); ++busy) {
+    out << (busy ? ", " : "") << occupancy[busy];
+  }
+  out << "]"
+      << ", \"hit_rate\": " << stats.HitRate() << "}";
+}
+
+std::string_view ToString(ReplacementPolicy policy) {
+  switch (policy) {
+    case ReplacementPolicy::LRU: return "LRU";
+    case ReplacementPolicy::FIFO: return "FIFO";
+    case ReplacementPolicy::Random: return "Random";
+    case ReplacementPolicy::PLRU: return "PLRU";
+    case ReplacementPolicy::LIP: return "LIP";
+    case ReplacementPolicy::BIP: return "BIP";
+    case ReplacementPolicy::SRRIP: return "SRRIP";
+    case ReplacementPolicy::BRRIP: return "BRRIP";
+    case ReplacementPolicy::DRRIP: return "DRRIP";
+  }
+  return "";
+}
+
+std::string_view ToString(WriteHitPolicy policy) {
+  return policy == WriteHitPolicy::WriteBack ? "write_back" : "write_through";
+}
+
+std::string_view ToString(WriteMissPolicy policy) {
+  return policy == WriteMissPolicy::WriteAllocate ? "write_allocate" : "no_write_allocate";
+}
+
+std::string_view ToString(InclusionPolicy policy) {
+  switch (policy) {
+    case InclusionPolicy::NINE: return "nine";
+    case InclusionPolicy::Inclusive: return "inclusive";
+    case InclusionPolicy::Exclusive: return "exclusive";
+  }
+  return "";
+}
+
+} // namespace cache
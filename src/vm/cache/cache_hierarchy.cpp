@@ -0,0 +1,118 @@
+/**
+ * @file cache_hierarchy.cpp
+ * @brief L1 instruction and data caches over a unified L2 and L3
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+#include "vm/cache/cache_hierarchy.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace cache {
+
+void CacheHierarchy::Configure(const CacheConfig *l1i, const CacheConfig *l1d,
+                               const CacheConfig *l2, const CacheConfig *l3) {
+  const std::array<const CacheConfig *, kLevels> configs = {l1i, l1d, l2, l3};
+  unsigned long upper_line = 0;
+  const CacheConfig *first = nullptr;
+  for (Level level : {kL1I, kL1D, kL2, kL3}) {
+    if (!configs[level]) {
+      continue;
+    }
+    if (!first) {
+      first = configs[level];
+    } else if (configs[level]->timing_only != first->timing_only) {
+      throw std::invalid_argument("Either every cache level is timing-only or none is");
+    }
+    const unsigned long line = configs[level]->words_per_line * 4;
+    if (level >= kL2 && line < upper_line) {
+      throw std::invalid_argument(std::string(Name(level)) + " lines are smaller than those of the level above");
+    }
+    upper_line = std::max(upper_line, line);
+  }
+
+  for (size_t level = 0; level < kLevels; ++level) {
+    levels_[level] = configs[level] ? std::make_unique<Cache>(*configs[level], memory_) : nullptr;
+  }
+  Cache *below_l1 = levels_[kL2] ? levels_[kL2].get() : levels_[kL3].get();
+  if (levels_[kL2]) {
+    levels_[kL2]->SetNextLevel(levels_[kL3].get());
+  }
+  for (Level level : {kL1I, kL1D}) {
+    if (levels_[level]) {
+      levels_[level]->SetNextLevel(below_l1);
+    }
+  }
+  instruction_path_ = levels_[kL1I].get();
+  data_path_ = levels_[kL1D].get();
+}
+
+double CacheHierarchy::Amat() const {
+  uint64_t accesses = 0;
+  for (Level level : {kL1I, kL1D}) {
+    if (levels_[level]) {
+      accesses += levels_[level]->GetStats().accesses;
+    }
+  }
+  if (accesses == 0) {
+    return 0.0;
+  }
+  return 1.0 + static_cast<double>(PenaltyCycles()) / static_cast<double>(accesses);
+}
+
+void CacheHierarchy::SyncToMemory() const {
+  for (Level level : {kL3, kL2, kL1I, kL1D}) {
+    if (levels_[level]) {
+      levels_[level]->SyncToMemory();
+    }
+  }
+}
+
+void CacheHierarchy::Reset() {
+  for (auto &level : levels_) {
+    if (level) {
+      level->Reset();
+    }
+  }
+}
+
+void CacheHierarchy::DumpStats(std::ostream &out, uint64_t instructions) const {
+  out << "{\n";
+  for (Level level : {kL1I, kL1D, kL2, kL3}) {
+    out << "    \"" << Name(level) << "\": ";
+    if (levels_[level]) {
+      levels_[level]->DumpStats(out);
+    } else {
+      out << "null";
+    }
+    out << ",\n";
+  }
+  out << "    \"mpki\": {";
+  bool first = true;
+  for (Level level : {kL1I, kL1D, kL2, kL3}) {
+    if (!levels_[level]) {
+      continue;
+    }
+    const double mpki = instructions
+        ? 1000.0 * static_cast<double>(levels_[level]->GetStats().misses) / static_cast<double>(instructions) : 0.0;
+    out << (first ? "" : ", ") << "\"" << Name(level) << "\": " << mpki;
+    first = false;
+  }
+  out << "},\n";
+  out << "    \"amat\": " << Amat() << "\n";
+  out << "}\n";
+}
+
+const char *CacheHierarchy::Name(Level level) {
+  switch (level) {
+    case kL1I: return "l1i";
+    case kL1D: return "l1d";
+    case kL2: return "l2";
+    case kL3: return "l3";
+    case kLevels: break;
+  }
+  return "";
+}
+
+} // namespace cache
@@ -0,0 +1,73 @@
+/**
+ * @file mshr.cpp
+ * @brief Miss-status holding registers and the coalescing write buffer of a non-blocking cache
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+#include "vm/cache/mshr.h"
+
+#include <algorithm>
+
+namespace cache {
+
+MshrFile::MshrFile(unsigned count) : count_(count), occupancy_(count + 1, 0) {
+  busy_until_.reserve(count);
+}
+
+void MshrFile::Advance(uint64_t now) {
+  std::sort(busy_until_.begin(), busy_until_.end());
+  uint64_t from = accounted_until_;
+  size_t freed = 0;
+  for (; freed < busy_until_.size() && busy_until_[freed] <= now; ++freed) {
+    if (busy_until_[freed] > from) {
+      occupancy_[busy_until_.size() - freed] += busy_until_[freed] - from;
+      from = busy_until_[freed];
+    }
+  }
+  if (now > from) {
+    occupancy_[busy_until_.size() - freed] += now - from;
+  }
+  busy_until_.erase(busy_until_.begin(), busy_until_.begin() + static_cast<long>(freed));
+  accounted_until_ = std::max(accounted_until_, now);
+}
+
+uint64_t MshrFile::Allocate(uint64_t now, uint64_t latency) {
+  Advance(now);
+  uint64_t wait = 0;
+  if (busy_until_.size() == count_) {
+    // Advance() left the registers sorted, and every one of them busy past now.
+    wait = busy_until_.front() - now;
+    Advance(busy_until_.front());
+  }
+  busy_until_.push_back(now + wait + latency);
+  return wait;
+}
+
+void MshrFile::Reset() {
+  busy_until_.clear();
+  std::fill(occupancy_.begin(), occupancy_.end(), 0);
+  accounted_until_ = 0;
+}
+
+WriteBuffer::WriteBuffer(unsigned entries, uint64_t line_size) : capacity_(entries), line_size_(line_size) {}
+
+uint64_t WriteBuffer::Insert(uint64_t address, uint64_t now, uint64_t drain_cycles, bool &coalesced) {
+  const uint64_t line = address / line_size_;
+  while (!entries_.empty() && entries_.front().drained_at <= now) {
+    entries_.pop_front();
+  }
+  coalesced = std::any_of(entries_.begin(), entries_.end(), [line](const Entry &entry) { return entry.line == line; });
+  if (coalesced) {
+    return 0;
+  }
+  uint64_t wait = 0;
+  if (entries_.size() == capacity_) {
+    wait = entries_.front().drained_at - now;
+    entries_.pop_front();
+  }
+  // Entries drain one after another, so this one starts once the newest ahead of it has left.
+  const uint64_t start = std::max(now + wait, entries_.empty() ? uint64_t{0} : entries_.back().drained_at);
+  entries_.push_back(Entry{line, start + drain_cycles});
+  return wait;
+}
+
+} // namespace cache
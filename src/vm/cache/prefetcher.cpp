@@ -0,0 +1,139 @@
+/**
+ * @file prefetcher.cpp
+ * @brief Hardware prefetchers that a cache level consults on demand accesses
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+#include "vm/cache/prefetcher.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace cache {
+
+NextLinePrefetcher::NextLinePrefetcher(const PrefetcherConfig &config, uint64_t line_size)
+    : config_(config), line_size_(line_size) {}
+
+void NextLinePrefetcher::Observe(uint64_t, uint64_t address, bool miss, std::vector<uint64_t> &requests) {
+  if (!miss) {
+    return;
+  }
+  const uint64_t line = address / line_size_;
+  for (unsigned i = 0; i < config_.degree; ++i) {
+    requests.push_back((line + config_.distance + i) * line_size_);
+  }
+}
+
+std::string_view NextLinePrefetcher::Name() const {
+  return "next_line";
+}
+
+StridePrefetcher::StridePrefetcher(const PrefetcherConfig &config, uint64_t line_size)
+    : config_(config),
+      line_size_(line_size),
+      table_(std::bit_floor(std::max(config.table_size, 1u))),
+      mask_(table_.size() - 1) {}
+
+void StridePrefetcher::Observe(uint64_t pc, uint64_t address, bool, std::vector<uint64_t> &requests) {
+  Entry &entry = table_[(pc / 4) & mask_];
+  if (!entry.valid || entry.pc != pc) {
+    entry = Entry{pc, address, 0, 0, true};
+    return;
+  }
+  const auto stride = static_cast<int64_t>(address - entry.last_address);
+  if (stride == entry.stride) {
+    entry.confidence = std::min<uint8_t>(entry.confidence + 1, 3);
+  } else if (entry.confidence > 0) {
+    entry.confidence--;
+  } else {
+    entry.stride = stride;
+  }
+  entry.last_address = address;
+  if (entry.confidence == 0 || entry.stride == 0) {
+    return;
+  }
+  // Strides shorter than a line land on the same line several times; ask for each line once.
+  uint64_t previous_line = address / line_size_;
+  for (unsigned i = 0; i < config_.degree; ++i) {
+    const uint64_t target = address + static_cast<uint64_t>(entry.stride * (config_.distance + i));
+    if (target / line_size_ != previous_line) {
+      previous_line = target / line_size_;
+      requests.push_back(previous_line * line_size_);
+    }
+  }
+}
+
+void StridePrefetcher::Reset() {
+  std::fill(table_.begin(), table_.end(), Entry{});
+}
+
+std::string_view StridePrefetcher::Name() const {
+  return "stride";
+}
+
+StreamPrefetcher::StreamPrefetcher(const PrefetcherConfig &config, uint64_t line_size)
+    : config_(config), line_size_(line_size), streams_(std::max(config.table_size, 1u)) {}
+
+void StreamPrefetcher::Observe(uint64_t, uint64_t address, bool miss, std::vector<uint64_t> &requests) {
+  if (!miss) {
+    return;
+  }
+  clock_++;
+  const uint64_t line = address / line_size_;
+  const uint64_t window = config_.distance + config_.degree;
+  for (Stream &stream : streams_) {
+    if (!stream.valid) {
+      continue;
+    }
+    const auto ahead = static_cast<int64_t>(line - stream.last_line) * (stream.direction ? stream.direction : 1);
+    const bool follows = stream.direction ? ahead > 0 && static_cast<uint64_t>(ahead) <= window
+                                          : line == stream.last_line + 1 || line + 1 == stream.last_line;
+    if (!follows) {
+      continue;
+    }
+    if (!stream.direction) {
+      stream.direction = line > stream.last_line ? 1 : -1;
+    }
+    stream.last_line = line;
+    stream.last_use = clock_;
+    for (unsigned i = 0; i < config_.degree; ++i) {
+      const auto offset = static_cast<int64_t>(config_.distance + i) * stream.direction;
+      requests.push_back((line + static_cast<uint64_t>(offset)) * line_size_);
+    }
+    return;
+  }
+  Stream &victim = *std::min_element(streams_.begin(), streams_.end(), [](const Stream &a, const Stream &b) {
+    return a.valid != b.valid ? !a.valid : a.last_use < b.last_use;
+  });
+  victim = Stream{line, 0, clock_, true};
+}
+
+void StreamPrefetcher::Reset() {
+  std::fill(streams_.begin(), streams_.end(), Stream{});
+  clock_ = 0;
+}
+
+std::string_view StreamPrefetcher::Name() const {
+  return "stream";
+}
+
+std::unique_ptr<Prefetcher> MakePrefetcher(const PrefetcherConfig &config, uint64_t line_size) {
+  switch (config.type) {
+    case PrefetcherType::None: return nullptr;
+    case PrefetcherType::NextLine: return std::make_unique<NextLinePrefetcher>(config, line_size);
+    case PrefetcherType::Stride: return std::make_unique<StridePrefetcher>(config, line_size);
+    case PrefetcherType::Stream: return std::make_unique<StreamPrefetcher>(config, line_size);
+  }
+  return nullptr;
+}
+
+std::string_view ToString(PrefetcherType type) {
+  switch (type) {
+    case PrefetcherType::None: return "none";
+    case PrefetcherType::NextLine: return "next_line";
+    case PrefetcherType::Stride: return "stride";
+    case PrefetcherType::Stream: return "stream";
+  }
+  return "";
+}
+
+} // namespace cache
@@ -0,0 +1,132 @@
+/**
+ * @file checkpoint.cpp
+ * @brief The binary checkpoint format that `checkpoint save` writes and `checkpoint load` maps back
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+#include "vm/checkpoint.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace checkpoint {
+
+namespace {
+
+/// Whether count entries of entry_size bytes at offset lie within a file of file_size bytes.
+bool Fits(uint64_t offset, uint64_t count, uint64_t entry_size, uint64_t file_size) {
+  return offset <= file_size && (count == 0 || entry_size <= (file_size - offset) / count);
+}
+
+} // namespace
+
+Writer::Writer(const std::filesystem::path &path, const Header &header, std::span<const CsrEntry> csrs)
+    : path_(path), file_(path, std::ios::binary | std::ios::trunc), header_(header) {
+  if (!file_) {
+    throw std::runtime_error("Unable to create checkpoint " + path.string());
+  }
+  std::memcpy(header_.magic, kMagic, sizeof(kMagic));
+  header_.version = kVersion;
+  header_.header_size = sizeof(Header);
+  header_.csr_offset = sizeof(Header);
+  header_.csr_count = csrs.size();
+  const uint64_t csr_end = header_.csr_offset + csrs.size_bytes();
+  header_.block_data_offset = (csr_end + kBlockDataAlignment - 1) / kBlockDataAlignment * kBlockDataAlignment;
+
+  // Finish() writes the header once the blocks are known.
+  file_.write(reinterpret_cast<const char *>(&header_), sizeof(Header));
+  file_.write(reinterpret_cast<const char *>(csrs.data()), static_cast<std::streamsize>(csrs.size_bytes()));
+  const std::vector<char> padding(header_.block_data_offset - csr_end, 0);
+  file_.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+}
+
+void Writer::AddBlock(uint64_t address, std::span<const uint8_t> bytes) {
+  if (std::all_of(bytes.begin(), bytes.end(), [](uint8_t byte) { return byte == 0; })) {
+    return;
+  }
+  file_.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+  // A block cut short by the end of memory still takes block_size bytes in the file.
+  const std::vector<char> padding(header_.block_size - bytes.size(), 0);
+  file_.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+  addresses_.push_back(address);
+}
+
+void Writer::Finish() {
+  header_.block_count = addresses_.size();
+  const uint64_t data_end = header_.block_data_offset + header_.block_count * header_.block_size;
+  header_.block_table_offset = (data_end + sizeof(uint64_t) - 1) / sizeof(uint64_t) * sizeof(uint64_t);
+  const std::vector<char> padding(header_.block_table_offset - data_end, 0);
+  file_.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+  file_.write(reinterpret_cast<const char *>(addresses_.data()),
+              static_cast<std::streamsize>(addresses_.size() * sizeof(uint64_t)));
+  file_.seekp(0);
+  file_.write(reinterpret_cast<const char *>(&header_), sizeof(Header));
+  file_.flush();
+  if (!file_) {
+    throw std::runtime_error("Unable to write checkpoint " + path_.string());
+  }
+}
+
+MappedFile::MappedFile(const std::filesystem::path &path) {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw std::runtime_error("Unable to open checkpoint " + path.string());
+  }
+  struct stat status{};
+  if (fstat(fd, &status) != 0 || static_cast<uint64_t>(status.st_size) < sizeof(Header)) {
+    close(fd);
+    throw std::runtime_error("Not a checkpoint: " + path.string());
+  }
+  size_ = static_cast<size_t>(status.st_size);
+  void *base = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    throw std::runtime_error("Unable to map checkpoint " + path.string());
+  }
+  data_ = static_cast<const uint8_t *>(base);
+
+  const Header &header = GetHeader();
+  std::string error;
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+    error = "Not a checkpoint: ";
+  } else if (header.version != kVersion || header.header_size != sizeof(Header)) {
+    error = "Unsupported checkpoint version " + std::to_string(header.version) + ": ";
+  } else if (header.csr_offset % alignof(CsrEntry) != 0 || header.block_table_offset % alignof(uint64_t) != 0
+             || (header.block_count != 0 && header.block_size == 0)
+             || !Fits(header.csr_offset, header.csr_count, sizeof(CsrEntry), size_)
+             || !Fits(header.block_data_offset, header.block_count, header.block_size, size_)
+             || !Fits(header.block_table_offset, header.block_count, sizeof(uint64_t), size_)) {
+    error = "Truncated or corrupt checkpoint: ";
+  }
+  if (!error.empty()) {
+    munmap(const_cast<uint8_t *>(data_), size_);
+    throw std::runtime_error(error + path.string());
+  }
+}
+
+MappedFile::~MappedFile() {
+  munmap(const_cast<uint8_t *>(data_), size_);
+}
+
+std::span<const CsrEntry> MappedFile::Csrs() const {
+  const Header &header = GetHeader();
+  return {reinterpret_cast<const CsrEntry *>(data_ + header.csr_offset), header.csr_count};
+}
+
+std::span<const uint64_t> MappedFile::BlockAddresses() const {
+  const Header &header = GetHeader();
+  return {reinterpret_cast<const uint64_t *>(data_ + header.block_table_offset), header.block_count};
+}
+
+std::span<const uint8_t> MappedFile::Block(uint64_t index) const {
+  const Header &header = GetHeader();
+  return {data_ + header.block_data_offset + index * header.block_size, header.block_size};
+}
+
+} // namespace checkpoint
@@ -34,4 +34,19 @@ uint8_t ControlUnit::GetAluOp() const {
 
 bool ControlUnit::GetBranch() const {
   return branch_;
-}
\ No newline at end of file
+}
+
+ControlSignals ControlUnit::GetControlSignals() const {
+  return {reg_write_, branch_, alu_src_, mem_read_, mem_write_, mem_to_reg_, bigmul_busy_, alu_op_};
+}
+
+void ControlUnit::LoadControlSignals(const ControlSignals &signals) {
+  reg_write_ = signals.reg_write;
+  branch_ = signals.branch;
+  alu_src_ = signals.alu_src;
+  mem_read_ = signals.mem_read;
+  mem_write_ = signals.mem_write;
+  mem_to_reg_ = signals.mem_to_reg;
+  bigmul_busy_ = signals.bigmul_busy;
+  alu_op_ = signals.alu_op;
+}
@@ -0,0 +1,62 @@
+/**
+ * @file fp_environment.cpp
+ * @brief Host floating-point environment shared by the guest F and D instructions
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+
+#include "vm/fp_environment.h"
+#include "vm/alu.h"
+
+#include <cfenv>
+#include <cstdint>
+
+namespace alu {
+
+void FpEnvironment::Enter() {
+  host_rm_ = std::fegetround();
+  guest_rm_ = kNoRoundingMode;
+  std::feclearexcept(FE_ALL_EXCEPT);
+}
+
+uint8_t FpEnvironment::Leave() {
+  uint8_t flags = TakeFlags();
+  if (guest_rm_ != kNoRoundingMode) {
+    std::fesetround(host_rm_);
+    guest_rm_ = kNoRoundingMode;
+  }
+  return flags;
+}
+
+uint8_t FpEnvironment::TakeFlags() {
+  uint8_t flags = raised_ | FlagsFromHost(std::fetestexcept(FE_ALL_EXCEPT));
+  std::feclearexcept(FE_ALL_EXCEPT);
+  raised_ = 0;
+  return flags;
+}
+
+void FpEnvironment::ApplyRoundingMode(uint8_t rm) {
+  std::fesetround(HostRoundingMode(rm));
+  guest_rm_ = rm;
+}
+
+int FpEnvironment::HostRoundingMode(uint8_t rm) {
+  switch (rm) {
+    case 0b000: return FE_TONEAREST;  // RNE
+    case 0b001: return FE_TOWARDZERO; // RTZ
+    case 0b010: return FE_DOWNWARD;   // RDN
+    case 0b011: return FE_UPWARD;     // RUP
+    default: return FE_TONEAREST;     // 0b100 RMM, unsupported
+  }
+}
+
+uint8_t FpEnvironment::FlagsFromHost(int raised) {
+  uint8_t flags = 0;
+  if (raised & FE_INVALID) flags |= FCSR_INVALID_OP;
+  if (raised & FE_DIVBYZERO) flags |= FCSR_DIV_BY_ZERO;
+  if (raised & FE_OVERFLOW) flags |= FCSR_OVERFLOW;
+  if (raised & FE_UNDERFLOW) flags |= FCSR_UNDERFLOW;
+  if (raised & FE_INEXACT) flags |= FCSR_INEXACT;
+  return flags;
+}
+
+} // namespace alu
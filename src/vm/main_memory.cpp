@@ -17,27 +17,195 @@
 #include <iomanip>
 #include <algorithm>
 #include <sstream>
+#include <bit>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Guest values are copied straight in and out of host memory.
+static_assert(std::endian::native == std::endian::little, "memory needs a little-endian host");
+
+Memory::Memory() {
+  Configure();
+}
+
+Memory::~Memory() {
+  DropSnapshot();
+  UnmapFlat();
+}
+
+void Memory::Configure() {
+  blocks_.clear();
+  FlushBlockTlb();
+  DropSnapshot();
+  UnmapFlat();
+  block_size_ = vm_config::config.getMemoryBlockSize();
+  memory_size_ = vm_config::config.getMemorySize();
+  huge_pages_ = vm_config::config.getMemoryHugePages();
+  if (vm_config::config.getMemoryBacking() != vm_config::MemoryBacking::FLAT) {
+    return;
+  }
+  // mmap rejects an empty mapping; a zero-sized memory still has nothing addressable.
+  flat_size_ = static_cast<size_t>(std::max<uint64_t>(memory_size_, 1));
+  MapFlat(-1);
+}
+
+void Memory::MapFlat(int fd) {
+  const int flags = MAP_PRIVATE | MAP_NORESERVE | (fd < 0 ? MAP_ANONYMOUS : 0) | (flat_ ? MAP_FIXED : 0);
+  void *base = mmap(flat_, flat_size_, PROT_READ | PROT_WRITE, flags, fd, 0);
+  if (base == MAP_FAILED) {
+    throw std::runtime_error("Unable to map " + std::to_string(memory_size_) + " bytes of flat memory");
+  }
+  flat_ = static_cast<uint8_t *>(base);
+#ifdef MADV_HUGEPAGE
+  if (huge_pages_) {
+    // Only advice: memory works the same if the kernel has no huge pages to give.
+    madvise(flat_, flat_size_, MADV_HUGEPAGE);
+  }
+#endif
+}
+
+void Memory::UnmapFlat() {
+  if (flat_) {
+    munmap(flat_, flat_size_);
+    flat_ = nullptr;
+    flat_size_ = 0;
+  }
+}
+
+void Memory::DropSnapshot() {
+  snapshot_blocks_.clear();
+  if (snapshot_fd_ >= 0) {
+    close(snapshot_fd_);
+    snapshot_fd_ = -1;
+  }
+  has_snapshot_ = false;
+  snapshot_live_ = false;
+}
+
+void Memory::Reset() {
+  const bool flat = vm_config::config.getMemoryBacking() == vm_config::MemoryBacking::FLAT;
+  const bool unchanged = flat == (flat_ != nullptr)
+      && vm_config::config.getMemorySize() == memory_size_
+      && vm_config::config.getMemoryBlockSize() == block_size_
+      && vm_config::config.getMemoryHugePages() == huge_pages_;
+  if (!unchanged) {
+    Configure();
+    return;
+  }
+  if (flat_ && snapshot_live_) {
+    MapFlat(-1);
+  } else if (flat_) {
+    // Drops every touched page; the next touch reads zeros again. Cheaper than a fresh mapping.
+    madvise(flat_, flat_size_, MADV_DONTNEED);
+  }
+  blocks_.clear();
+  FlushBlockTlb();
+  snapshot_live_ = false;
+}
+
+void Memory::TakeSnapshot() {
+  if (!flat_) {
+    if (!snapshot_live_) {
+      snapshot_blocks_.clear();
+    }
+    for (auto &[block_index, block] : blocks_) {
+      snapshot_blocks_.insert_or_assign(block_index, std::move(block));
+    }
+    blocks_.clear();
+    FlushBlockTlb();
+    has_snapshot_ = snapshot_live_ = true;
+    return;
+  }
+  const int fd = memfd_create("vm-memory-snapshot", MFD_CLOEXEC);
+  if (fd < 0 || ftruncate(fd, static_cast<off_t>(flat_size_)) != 0) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    throw std::runtime_error("Unable to create a memory snapshot");
+  }
+  // Blocks never written stay holes in the file.
+  const std::vector<uint8_t> zeros(block_size_, 0);
+  for (uint64_t address : UsedBlocks()) {
+    const auto size = static_cast<size_t>(std::min<uint64_t>(block_size_, memory_size_ - address));
+    if (std::memcmp(flat_ + address, zeros.data(), size) != 0
+        && pwrite(fd, flat_ + address, size, static_cast<off_t>(address)) != static_cast<ssize_t>(size)) {
+      close(fd);
+      throw std::runtime_error("Unable to create a memory snapshot");
+    }
+  }
+  DropSnapshot();
+  snapshot_fd_ = fd;
+  MapFlat(snapshot_fd_);
+  has_snapshot_ = snapshot_live_ = true;
+}
+
+std::vector<uint64_t> Memory::UsedBlocks() const {
+  std::vector<uint64_t> addresses;
+  if (!flat_) {
+    for (const auto &[block_index, block] : blocks_) {
+      addresses.push_back(block_index * block_size_);
+    }
+    if (snapshot_live_) {
+      for (const auto &[block_index, block] : snapshot_blocks_) {
+        if (!blocks_.contains(block_index)) {
+          addresses.push_back(block_index * block_size_);
+        }
+      }
+    }
+    std::sort(addresses.begin(), addresses.end());
+    return addresses;
+  }
+  // Only pages in memory can hold anything but zeros.
+  const auto page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+  const uint64_t window = page_size * 16384;
+  std::vector<unsigned char> resident(window / page_size);
+  uint64_t next_block = 0;
+  for (uint64_t start = 0; start < memory_size_; start += window) {
+    const uint64_t length = std::min(window, memory_size_ - start);
+    if (mincore(flat_ + start, length, resident.data()) != 0) {
+      std::fill(resident.begin(), resident.end(), 1);
+    }
+    for (uint64_t offset = 0; offset < length; offset += page_size) {
+      if (!(resident[offset / page_size] & 1)) {
+        continue;
+      }
+      const uint64_t last_block = (start + std::min(offset + page_size, length) - 1) / block_size_;
+      for (uint64_t block_index = std::max(next_block, (start + offset) / block_size_);
+           block_index <= last_block; ++block_index) {
+        addresses.push_back(block_index * block_size_);
+      }
+      next_block = last_block + 1;
+    }
+  }
+  return addresses;
+}
+
+bool Memory::RestoreSnapshot() {
+  if (!has_snapshot_) {
+    return false;
+  }
+  if (flat_) {
+    MapFlat(snapshot_fd_);
+  }
+  blocks_.clear();
+  FlushBlockTlb();
+  snapshot_live_ = true;
+  return true;
+}
 
 uint8_t Memory::Read(uint64_t address) {
   if (address >= memory_size_) {
     throw std::out_of_range("Memory address out of range: " + std::to_string(address));
   }
-  uint64_t block_index = GetBlockIndex(address);
-  uint64_t offset = GetBlockOffset(address);
-  if (!IsBlockPresent(block_index)) {
-    return 0;
-  }
-  return blocks_[block_index].data[offset];
+  return ReadByteUnchecked(address);
 }
 
 void Memory::Write(uint64_t address, uint8_t value) {
   if (address >= memory_size_) {
     throw std::out_of_range(std::string("Memory address out of range: ") + std::to_string(address));
   }
-  uint64_t block_index = GetBlockIndex(address);
-  uint64_t offset = GetBlockOffset(address);
-  EnsureBlockExists(block_index);
-  blocks_[block_index].data[offset] = value;
+  WriteByteUnchecked(address, value);
 }
 
 uint64_t Memory::GetBlockIndex(uint64_t address) const {
@@ -48,134 +216,260 @@ uint64_t Memory::GetBlockOffset(uint64_t address) const {
   return address%block_size_;
 }
 
+const uint8_t *Memory::FindBlock(uint64_t block_index) const {
+  BlockTlbEntry &entry = block_tlb_[block_index & (kBlockTlbEntries - 1)];
+  if (entry.block_index==block_index) {
+    return entry.data;
+  }
+  // Misses are cached too, so reads of untouched memory skip the maps as well. The entry also
+  // serves writes through GetOrCreateBlock() once writable, hence the cast.
+  if (auto it = blocks_.find(block_index); it!=blocks_.end()) {
+    entry = BlockTlbEntry{block_index, const_cast<uint8_t *>(it->second.data.data()), true};
+  } else if (auto shared = snapshot_blocks_.find(block_index); snapshot_live_ && shared!=snapshot_blocks_.end()) {
+    entry = BlockTlbEntry{block_index, const_cast<uint8_t *>(shared->second.data.data()), false};
+  } else {
+    entry = BlockTlbEntry{block_index, nullptr, false};
+  }
+  return entry.data;
+}
+
+uint8_t *Memory::GetOrCreateBlock(uint64_t block_index) {
+  BlockTlbEntry &entry = block_tlb_[block_index & (kBlockTlbEntries - 1)];
+  if (entry.block_index==block_index && entry.writable) {
+    return entry.data;
+  }
+  auto [it, created] = blocks_.try_emplace(block_index);
+  if (created && snapshot_live_) {
+    // First write since the snapshot: copy the block rather than change the snapshot.
+    if (auto shared = snapshot_blocks_.find(block_index); shared!=snapshot_blocks_.end()) {
+      it->second.data = shared->second.data;
+    }
+  }
+  // Replaces a cached miss or shared block for this index along with whatever else held the entry.
+  entry = BlockTlbEntry{block_index, it->second.data.data(), true};
+  return entry.data;
+}
+
 bool Memory::IsBlockPresent(uint64_t block_index) const {
-  return blocks_.find(block_index)!=blocks_.end();
+  return FindBlock(block_index)!=nullptr;
 }
 
 void Memory::EnsureBlockExists(uint64_t block_index) {
-  if (blocks_.find(block_index)==blocks_.end()) {
-    blocks_.emplace(block_index, MemoryBlock());
+  GetOrCreateBlock(block_index);
+}
+
+uint8_t Memory::ReadByteUnchecked(uint64_t address) const {
+  if (flat_) {
+    return flat_[address];
+  }
+  const uint8_t *block = FindBlock(GetBlockIndex(address));
+  return block ? block[GetBlockOffset(address)] : 0;
+}
+
+void Memory::WriteByteUnchecked(uint64_t address, uint8_t value) {
+  if (flat_) {
+    flat_[address] = value;
+    return;
   }
+  GetOrCreateBlock(GetBlockIndex(address))[GetBlockOffset(address)] = value;
 }
 
 template<typename T>
-T Memory::ReadGeneric(uint64_t address) {
+T Memory::ReadGeneric(uint64_t address) const {
   T value = 0;
+  if (flat_) {
+    std::memcpy(&value, flat_ + address, sizeof(T));
+    return value;
+  }
+  uint64_t offset = GetBlockOffset(address);
+  if (offset + sizeof(T) <= block_size_) {
+    const uint8_t *block = FindBlock(GetBlockIndex(address));
+    if (!block) {
+      return 0;
+    }
+    std::memcpy(&value, block + offset, sizeof(T));
+    return value;
+  }
+  // straddles two blocks
   for (size_t i = 0; i < sizeof(T); ++i) {
-    value |= static_cast<T>(Read(address + i)) << (8*i);
+    value |= static_cast<T>(ReadByteUnchecked(address + i)) << (8*i);
   }
   return value;
 }
 
 template<typename T>
 void Memory::WriteGeneric(uint64_t address, T value) {
+  if (flat_) {
+    std::memcpy(flat_ + address, &value, sizeof(T));
+    return;
+  }
+  uint64_t offset = GetBlockOffset(address);
+  if (offset + sizeof(T) <= block_size_) {
+    std::memcpy(GetOrCreateBlock(GetBlockIndex(address)) + offset, &value, sizeof(T));
+    return;
+  }
+  // straddles two blocks
   for (size_t i = 0; i < sizeof(T); ++i) {
-    Write(address + i, static_cast<uint8_t>(value >> (8*i)));
+    WriteByteUnchecked(address + i, static_cast<uint8_t>(value >> (8*i)));
   }
 }
 
-uint8_t Memory::ReadByte(uint64_t address) {
-  if (address >= memory_size_) {
-    throw std::out_of_range(std::string("Memory address out of range: ") + std::to_string(address));
+template<typename T>
+bool Memory::TryRead(uint64_t address, T &value) {
+  if (!InBounds(address, sizeof(T))) {
+    return false;
   }
-  return Read(address);
+  value = ReadGeneric<T>(address);
+  return true;
 }
 
-uint16_t Memory::ReadHalfWord(uint64_t address) {
-  if (address >= memory_size_ - 1) {
-    throw std::out_of_range(std::string("Memory address out of range: ") + std::to_string(address));
+template<typename T>
+bool Memory::TryWrite(uint64_t address, T value) {
+  if (!InBounds(address, sizeof(T))) {
+    return false;
   }
-  return ReadGeneric<uint16_t>(address);
+  WriteGeneric<T>(address, value);
+  return true;
 }
 
-uint32_t Memory::ReadWord(uint64_t address) {
-  if (address >= memory_size_ - 3) {
+template bool Memory::TryRead<uint8_t>(uint64_t, uint8_t &);
+template bool Memory::TryRead<uint16_t>(uint64_t, uint16_t &);
+template bool Memory::TryRead<uint32_t>(uint64_t, uint32_t &);
+template bool Memory::TryRead<uint64_t>(uint64_t, uint64_t &);
+template bool Memory::TryWrite<uint8_t>(uint64_t, uint8_t);
+template bool Memory::TryWrite<uint16_t>(uint64_t, uint16_t);
+template bool Memory::TryWrite<uint32_t>(uint64_t, uint32_t);
+template bool Memory::TryWrite<uint64_t>(uint64_t, uint64_t);
+
+template<typename T>
+T Memory::ReadValue(uint64_t address) {
+  if (!InBounds(address, sizeof(T))) {
     throw std::out_of_range(std::string("Memory address out of range: ") + std::to_string(address));
   }
-  return ReadGeneric<uint32_t>(address);
+  return ReadGeneric<T>(address);
 }
 
-uint64_t Memory::ReadDoubleWord(uint64_t address) {
-  if (address >= memory_size_ - 7) {
+template<typename T>
+void Memory::WriteValue(uint64_t address, T value) {
+  if (!InBounds(address, sizeof(T))) {
     throw std::out_of_range(std::string("Memory address out of range: ") + std::to_string(address));
   }
-  return ReadGeneric<uint64_t>(address);
+  WriteGeneric<T>(address, value);
 }
 
-float Memory::ReadFloat(uint64_t address) {
-  if (address >= memory_size_ - (sizeof(float) - 1)) {
-    throw std::out_of_range(std::string("Memory address out of range: ") + std::to_string(address));;
+template uint8_t Memory::ReadValue<uint8_t>(uint64_t);
+template uint16_t Memory::ReadValue<uint16_t>(uint64_t);
+template uint32_t Memory::ReadValue<uint32_t>(uint64_t);
+template uint64_t Memory::ReadValue<uint64_t>(uint64_t);
+template void Memory::WriteValue<uint8_t>(uint64_t, uint8_t);
+template void Memory::WriteValue<uint16_t>(uint64_t, uint16_t);
+template void Memory::WriteValue<uint32_t>(uint64_t, uint32_t);
+template void Memory::WriteValue<uint64_t>(uint64_t, uint64_t);
+
+void Memory::ReadBlock(uint64_t address, std::span<uint8_t> bytes) {
+  if (!InBounds(address, bytes.size())) {
+    throw std::out_of_range(std::string("Memory address out of range: ") + std::to_string(address));
   }
-  uint32_t value = 0;
-  for (size_t i = 0; i < sizeof(float); ++i) {
-    value |= static_cast<uint32_t>(Read(address + i)) << (8*i);
+  if (flat_) {
+    std::copy(flat_ + address, flat_ + address + bytes.size(), bytes.begin());
+    return;
+  }
+  for (size_t done = 0; done < bytes.size();) {
+    const uint64_t offset = GetBlockOffset(address + done);
+    const size_t chunk = std::min<uint64_t>(bytes.size() - done, block_size_ - offset);
+    if (const uint8_t *block = FindBlock(GetBlockIndex(address + done))) {
+      std::memcpy(bytes.data() + done, block + offset, chunk);
+    } else {
+      std::memset(bytes.data() + done, 0, chunk);
+    }
+    done += chunk;
   }
-  float result;
-  std::memcpy(&result, &value, sizeof(float));
-  return result;
 }
 
-double Memory::ReadDouble(uint64_t address) {
-  if (address >= memory_size_ - (sizeof(double) - 1)) {
+void Memory::WriteBlock(uint64_t address, std::span<const uint8_t> bytes) {
+  if (!InBounds(address, bytes.size())) {
     throw std::out_of_range(std::string("Memory address out of range: ") + std::to_string(address));
   }
-  uint64_t value = 0;
-  for (size_t i = 0; i < sizeof(double); ++i) {
-    value |= static_cast<uint64_t>(Read(address + i)) << (8*i);
+  if (flat_) {
+    std::copy(bytes.begin(), bytes.end(), flat_ + address);
+    return;
+  }
+  for (size_t done = 0; done < bytes.size();) {
+    const uint64_t offset = GetBlockOffset(address + done);
+    const size_t chunk = std::min<uint64_t>(bytes.size() - done, block_size_ - offset);
+    std::memcpy(GetOrCreateBlock(GetBlockIndex(address + done)) + offset, bytes.data() + done, chunk);
+    done += chunk;
   }
-  double result;
-  std::memcpy(&result, &value, sizeof(double));
-  return result;
 }
 
-void Memory::WriteByte(uint64_t address, uint8_t value) {
-  if (address >= memory_size_) {
-    throw std::out_of_range(std::string("Memory address out of range: ") + std::to_string(address));
+uint64_t Memory::FindByte(uint64_t address, uint8_t value, uint64_t max) {
+  // Only a search that has not found value yet gets to the end of memory.
+  const uint64_t searchable = address < memory_size_ ? std::min(max, memory_size_ - address) : 0;
+  for (uint64_t done = 0; done < searchable;) {
+    const uint64_t offset = flat_ ? address + done : GetBlockOffset(address + done);
+    const uint64_t chunk = flat_ ? searchable - done : std::min<uint64_t>(searchable - done, block_size_ - offset);
+    const uint8_t *bytes = flat_ ? flat_ : FindBlock(GetBlockIndex(address + done));
+    if (!bytes) {
+      if (value == 0) {
+        return done; // an unwritten block reads as zeros
+      }
+    } else if (const void *found = std::memchr(bytes + offset, value, chunk)) {
+      return done + static_cast<uint64_t>(static_cast<const uint8_t *>(found) - (bytes + offset));
+    }
+    done += chunk;
   }
-  Write(address, value);
+  if (searchable < max) {
+    throw std::out_of_range(std::string("Memory address out of range: ") + std::to_string(address + searchable));
+  }
+  return max;
+}
+
+uint8_t Memory::ReadByte(uint64_t address) {
+  return ReadValue<uint8_t>(address);
+}
+
+uint16_t Memory::ReadHalfWord(uint64_t address) {
+  return ReadValue<uint16_t>(address);
+}
+
+uint32_t Memory::ReadWord(uint64_t address) {
+  return ReadValue<uint32_t>(address);
+}
+
+uint64_t Memory::ReadDoubleWord(uint64_t address) {
+  return ReadValue<uint64_t>(address);
+}
+
+float Memory::ReadFloat(uint64_t address) {
+  return std::bit_cast<float>(ReadValue<uint32_t>(address));
+}
+
+double Memory::ReadDouble(uint64_t address) {
+  return std::bit_cast<double>(ReadValue<uint64_t>(address));
+}
+
+void Memory::WriteByte(uint64_t address, uint8_t value) {
+  WriteValue<uint8_t>(address, value);
 }
 
 void Memory::WriteHalfWord(uint64_t address, uint16_t value) {
-  if (address >= memory_size_ - 1) {
-    throw std::out_of_range(std::string("Memory address out of range: ") + std::to_string(address));
-  }
-  WriteGeneric<uint16_t>(address, value);
+  WriteValue<uint16_t>(address, value);
 }
 
 void Memory::WriteWord(uint64_t address, uint32_t value) {
-  if (address >= memory_size_ - 3) {
-    throw std::out_of_range(std::string("Memory address out of range: ") + std::to_string(address));
-  }
-  WriteGeneric<uint32_t>(address, value);
+  WriteValue<uint32_t>(address, value);
 }
 
 void Memory::WriteDoubleWord(uint64_t address, uint64_t value) {
-  if (address >= memory_size_ - 7) {
-    throw std::out_of_range(std::string("Memory address out of range: ") + std::to_string(address));
-  }
-  WriteGeneric<uint64_t>(address, value);
+  WriteValue<uint64_t>(address, value);
 }
 
 void Memory::WriteFloat(uint64_t address, float value) {
-  if (address >= memory_size_ - (sizeof(float) - 1)) {
-    throw std::out_of_range(std::string("Memory address out of range: ") + std::to_string(address));
-  }
-  uint32_t value_bits;
-  std::memcpy(&value_bits, &value, sizeof(float));
-  for (size_t i = 0; i < sizeof(float); ++i) {
-    Write(address + i, static_cast<uint8_t>((value_bits >> (8*i)) & 0xFF));
-  }
+  WriteValue<uint32_t>(address, std::bit_cast<uint32_t>(value));
 }
 
 void Memory::WriteDouble(uint64_t address, double value) {
-  if (address >= memory_size_ - (sizeof(double) - 1)) {
-    throw std::out_of_range(std::string("Memory address out of range: ") + std::to_string(address));
-  }
-  uint64_t value_bits;
-  std::memcpy(&value_bits, &value, sizeof(double));
-  for (size_t i = 0; i < sizeof(double); ++i) {
-    Write(address + i, static_cast<uint8_t>((value_bits >> (8*i)) & 0xFF));
-  }
+  WriteValue<uint64_t>(address, std::bit_cast<uint64_t>(value));
 }
 
 void Memory::PrintMemory(const uint64_t address, unsigned int rows) {
@@ -272,8 +566,25 @@ void Memory::GetMemoryPoint(std::string addr_str) {
 void Memory::printMemoryUsage() const {
   std::cout << "Memory Usage Report:\n";
   std::cout << "---------------------\n";
-  std::cout << "Block Count: " << blocks_.size() << "\n";
+  if (flat_) {
+    std::cout << "Flat backing: " << memory_size_ << " bytes reserved, allocated as pages are first touched\n";
+    return;
+  }
+  // Blocks still shared with the snapshot, then the ones written since.
+  std::vector<std::pair<uint64_t, const MemoryBlock *>> visible;
+  if (snapshot_live_) {
+    for (const auto &[block_index, block] : snapshot_blocks_) {
+      if (!blocks_.contains(block_index)) {
+        visible.emplace_back(block_index, &block);
+      }
+    }
+  }
   for (const auto &[block_index, block] : blocks_) {
+    visible.emplace_back(block_index, &block);
+  }
+  std::cout << "Block Count: " << visible.size() << "\n";
+  for (const auto &[block_index, block_pointer] : visible) {
+    const MemoryBlock &block = *block_pointer;
     size_t used_bytes = std::count_if(block.data.begin(), block.data.end(),
                                       [](uint8_t byte) { return byte!=0; });
     if (used_bytes > 0) {
@@ -4,4 +4,82 @@
  * @author Vishank Singh, https://github.com/VishankSingh
  */
 
-#include "vm/memory_controller.h"
\ No newline at end of file
+#include "vm/memory_controller.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+
+void MemoryController::ConfigureCache() {
+  SyncCache();
+  const vm_config::VmConfig &config = vm_config::config;
+  auto settings = [&config](const vm_config::CacheSettings &level, cache::CacheType type) {
+    if (!level.enabled) {
+      return std::optional<cache::CacheConfig>();
+    }
+    cache::CacheConfig cache_config = level.toCacheConfig(type);
+    cache_config.timing_only = config.getCacheTimingOnly();
+    return std::optional<cache::CacheConfig>(cache_config);
+  };
+  const auto l1i = settings(config.getInstructionCache(), cache::CacheType::Instruction);
+  auto l1d = settings(config.getDataCache(), cache::CacheType::Data);
+  if (l1d) {
+    l1d->mshrs = static_cast<unsigned>(config.getCacheMshrs());
+    l1d->write_buffer_entries = static_cast<unsigned>(config.getCacheWriteBufferEntries());
+  }
+  const auto l2 = settings(config.getL2Cache(), cache::CacheType::Data);
+  const auto l3 = settings(config.getL3Cache(), cache::CacheType::Data);
+  caches_.Configure(l1i ? &*l1i : nullptr, l1d ? &*l1d : nullptr, l2 ? &*l2 : nullptr, l3 ? &*l3 : nullptr);
+}
+
+void MemoryController::PrintCacheStatus(uint64_t instructions) const {
+  using cache::CacheHierarchy;
+  for (CacheHierarchy::Level level : {CacheHierarchy::kL1I, CacheHierarchy::kL1D,
+                                      CacheHierarchy::kL2, CacheHierarchy::kL3}) {
+    const cache::Cache *level_cache = caches_.Get(level);
+    if (!level_cache) {
+      continue;
+    }
+    const cache::CacheStats &stats = level_cache->GetStats();
+    std::cout << CacheHierarchy::Name(level) << ": " << stats.accesses << " accesses, "
+              << stats.hits << " hits, " << stats.misses << " misses ("
+              << std::fixed << std::setprecision(2) << 100.0 * stats.HitRate() << "% hit rate, "
+              << (instructions ? 1000.0 * static_cast<double>(stats.misses) / static_cast<double>(instructions) : 0.0)
+              << " MPKI), " << stats.replacement_misses << " replacement misses, "
+              << stats.evictions << " evictions, " << stats.writebacks << " writebacks, "
+              << stats.penalty_cycles << " penalty cycles"
+              << std::defaultfloat << std::endl;
+    if (level_cache->GetConfig().prefetcher.type != cache::PrefetcherType::None) {
+      std::cout << "    " << cache::ToString(level_cache->GetConfig().prefetcher.type) << " prefetcher: "
+                << stats.prefetches << " prefetches, " << stats.prefetch_useful << " useful, "
+                << stats.prefetch_late << " late, " << stats.prefetch_useless << " useless" << std::endl;
+    }
+    if (const std::vector<uint64_t> occupancy = level_cache->MshrOccupancy(); !occupancy.empty()) {
+      std::cout << "    " << occupancy.size() - 1 << " MSHRs: " << stats.mshr_merges << " merged misses, "
+                << stats.mshr_stall_cycles << " stall cycles; cycles with n busy:";
+      for (size_t busy = 0; busy < occupancy.size(); ++busy) {
+        std::cout << " " << busy << ": " << occupancy[busy];
+      }
+      std::cout << std::endl;
+    }
+    if (level_cache->GetConfig().write_buffer_entries) {
+      std::cout << "    " << level_cache->GetConfig().write_buffer_entries << "-entry write buffer: "
+                << stats.write_buffer_coalesced << " coalesced writes, "
+                << stats.write_buffer_stall_cycles << " stall cycles" << std::endl;
+    }
+  }
+  if (caches_.Empty()) {
+    std::cout << "Caches: no L1 cache enabled" << std::endl;
+  } else {
+    std::cout << "AMAT: " << caches_.Amat() << " cycles" << std::endl;
+  }
+}
+
+void MemoryController::DumpCache(const std::filesystem::path &filename, uint64_t instructions) const {
+  std::ofstream file(filename);
+  if (!file.is_open()) {
+    throw std::runtime_error("Unable to open cache dump file: " + filename.string());
+  }
+  caches_.DumpStats(file, instructions);
+}
@@ -105,13 +105,18 @@ const std::unordered_set<std::string> valid_floating_point_registers = {
 };
 
 const std::unordered_set<std::string> valid_csr_registers = {
-    "fflags", "frm", "fcsr"
+    "fflags", "frm", "fcsr",
+    "mtvec", "mepc", "mcause", "mtval"
 };
 
 const std::unordered_map<std::string, int> csr_to_address{
     {"fflags", 0x001},
     {"frm", 0x002},
     {"fcsr", 0x003},
+    {"mtvec", 0x305},
+    {"mepc", 0x341},
+    {"mcause", 0x342},
+    {"mtval", 0x343},
 };
 
 const std::unordered_map<std::string, std::string> reg_alias_to_name = {
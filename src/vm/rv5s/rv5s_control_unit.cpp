@@ -0,0 +1,149 @@
+/**
+ * @file rv5s_control_unit.cpp
+ * @brief RV5S Control Unit implementation
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+
+#include "vm/rv5s/rv5s_control_unit.h"
+#include "vm/rvss/rvss_decode_table.h"
+#include "vm/alu.h"
+
+#include <cstdint>
+
+namespace {
+
+constexpr uint8_t kOpLoad = 0b0000011;
+constexpr uint8_t kOpLoadFp = 0b0000111;
+constexpr uint8_t kOpImm = 0b0010011;
+constexpr uint8_t kOpAuipc = 0b0010111;
+constexpr uint8_t kOpImm32 = 0b0011011;
+constexpr uint8_t kOpStore = 0b0100011;
+constexpr uint8_t kOpStoreFp = 0b0100111;
+constexpr uint8_t kOpReg = 0b0110011;
+constexpr uint8_t kOpLui = 0b0110111;
+constexpr uint8_t kOpReg32 = 0b0111011;
+constexpr uint8_t kOpBranch = 0b1100011;
+constexpr uint8_t kOpJalr = 0b1100111;
+constexpr uint8_t kOpJal = 0b1101111;
+constexpr uint8_t kOpFp = 0b1010011;
+
+/// OP-FP encodings whose rs2 field selects the operation instead of naming a register.
+bool IsUnaryFp(uint8_t funct7) {
+  switch (funct7) {
+    case 0b0101100: case 0b0101101: // fsqrt.s, fsqrt.d
+    case 0b0100000: case 0b0100001: // fcvt.s.d, fcvt.d.s
+    case 0b1100000: case 0b1100001: // fcvt.(w|wu|l|lu).(s|d)
+    case 0b1101000: case 0b1101001: // fcvt.(s|d).(w|wu|l|lu)
+    case 0b1110000: case 0b1110001: // fmv.x.(w|d), fclass
+    case 0b1111000: case 0b1111001: // fmv.(w|d).x
+      return true;
+    default:
+      return false;
+  }
+}
+
+/// OP-FP encodings that take rs1 from the integer register file.
+bool ReadsGprFp(uint8_t funct7) {
+  return funct7 == 0b1101000 || funct7 == 0b1101001 || funct7 == 0b1111000 || funct7 == 0b1111001;
+}
+
+/// OP-FP encodings that write rd in the integer register file.
+bool WritesGprFp(uint8_t funct7) {
+  return funct7 == 0b1010000 || funct7 == 0b1010001 || // f(eq|lt|le)
+         funct7 == 0b1100000 || funct7 == 0b1100001 || // fcvt.(w|wu|l|lu)
+         funct7 == 0b1110000 || funct7 == 0b1110001;   // fmv.x, fclass
+}
+
+} // namespace
+
+void RV5SControlUnit::SetControlSignals(uint32_t instruction) {
+  LoadControlSignals(rvss_decode::kDecodeTable.Major(instruction).signals);
+}
+
+alu::AluOp RV5SControlUnit::GetAluSignal(uint32_t instruction, bool ALUOp) {
+  (void)ALUOp; // Suppress unused variable warning
+  return rvss_decode::kDecodeTable.Lookup(instruction).GetAluOp();
+}
+
+RegisterUse RV5SControlUnit::GetRegisterUse(const DecodedInstruction &decoded) {
+  using Kind = RegisterFileKind;
+  RegisterUse use;
+
+  switch (decoded.unit) {
+    case ExecutionUnit::kInteger: {
+      switch (decoded.opcode) {
+        case kOpReg:
+        case kOpReg32:
+        case kOpStore:
+        case kOpBranch:
+          use.rs1 = Kind::kGpr;
+          use.rs2 = Kind::kGpr;
+          break;
+        case kOpImm:
+        case kOpImm32:
+        case kOpLoad:
+        case kOpJalr:
+          use.rs1 = Kind::kGpr;
+          break;
+        default:
+          break;
+      }
+      // Same opcodes RVSSVM::WriteBack writes rd for
+      switch (decoded.opcode) {
+        case kOpReg: case kOpImm: case kOpAuipc: case kOpLoad: case kOpJalr: case kOpJal: case kOpLui:
+          use.rd = Kind::kGpr;
+          break;
+        default:
+          break;
+      }
+      break;
+    }
+    case ExecutionUnit::kFloat:
+    case ExecutionUnit::kDouble: {
+      if (decoded.opcode == kOpLoadFp) {
+        use.rs1 = Kind::kGpr;
+        use.rd = Kind::kFpr;
+      } else if (decoded.opcode == kOpStoreFp) {
+        use.rs1 = Kind::kGpr;
+        use.rs2 = Kind::kFpr;
+      } else if (decoded.opcode == kOpFp) {
+        use.rs1 = ReadsGprFp(decoded.funct7) ? Kind::kGpr : Kind::kFpr;
+        use.rs2 = IsUnaryFp(decoded.funct7) ? Kind::kNone : Kind::kFpr;
+        use.rd = WritesGprFp(decoded.funct7) ? Kind::kGpr : Kind::kFpr;
+      } else { // fused multiply-add
+        use.rs1 = Kind::kFpr;
+        use.rs2 = Kind::kFpr;
+        use.rs3 = Kind::kFpr;
+        use.rd = Kind::kFpr;
+      }
+      break;
+    }
+    case ExecutionUnit::kCsr: {
+      use.rs1 = (decoded.funct3 & 0b100) ? Kind::kNone : Kind::kGpr; // csrr*i carry a uimm in rs1
+      use.rd = Kind::kGpr;
+      break;
+    }
+    case ExecutionUnit::kLdbm: {
+      use.rs1 = Kind::kGpr;
+      use.rs2 = Kind::kGpr;
+      break;
+    }
+    case ExecutionUnit::kBigmul: {
+      use.rs1 = Kind::kGpr;
+      break;
+    }
+    case ExecutionUnit::kSyscall: {
+      // Reads a0-a2/a7 and writes a0 straight in the register file once the pipeline has drained
+      break;
+    }
+  }
+
+  // CSR instructions write rd whatever the signals say, as in RVSSVM::WriteBackCsr
+  if (!decoded.signals.reg_write && decoded.unit != ExecutionUnit::kCsr) {
+    use.rd = Kind::kNone;
+  }
+  if (use.rd == Kind::kGpr && decoded.rd == 0) {
+    use.rd = Kind::kNone;
+  }
+  return use;
+}
@@ -0,0 +1,1048 @@
+/**
+ * @file rv5s_vm.cpp
+ * @brief RV5S VM implementation
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+
+#include "vm/rv5s/rv5s_vm.h"
+
+#include "utils.h"
+#include "globals.h"
+#include "config.h"
+#include "vm/bigmul_unit.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <thread>
+#include <tuple>
+
+namespace {
+
+constexpr uint8_t kOpAuipc = 0b0010111;
+constexpr uint8_t kOpLui = 0b0110111;
+constexpr uint8_t kOpBranch = 0b1100011;
+constexpr uint8_t kOpJalr = 0b1100111;
+constexpr uint8_t kOpJal = 0b1101111;
+
+constexpr std::array<uint16_t, 3> kFloatCsrs = {0x001, 0x002, 0x003}; // fflags, frm, fcsr
+
+/// Folds next into batch so that undoing batch undoes both, as MergeStepDelta does for RVSSVM.
+void MergeCycleDelta(CycleDelta &batch, CycleDelta &&next) {
+  batch.after = next.after;
+  for (const auto &change : next.register_changes) {
+    auto it = std::find_if(batch.register_changes.begin(), batch.register_changes.end(),
+                           [&](const RegisterChange &existing) {
+                             return existing.reg_type == change.reg_type && existing.reg_index == change.reg_index;
+                           });
+    if (it == batch.register_changes.end()) {
+      batch.register_changes.push_back(change);
+    } else {
+      it->new_value = change.new_value;
+    }
+  }
+  for (auto &change : next.memory_changes) {
+    batch.memory_changes.push_back(std::move(change));
+  }
+}
+
+} // namespace
+
+RV5SVM::RV5SVM() : VmBase() {
+  DumpRegisters(globals::registers_dump_file_path, registers_);
+  DumpState(globals::vm_state_dump_file_path);
+}
+
+RV5SVM::~RV5SVM() = default;
+
+DecodedInstruction RV5SVM::DecodeInstruction(uint32_t instruction) {
+  DecodedInstruction decoded = VmBase::DecodeInstruction(instruction);
+
+  // Resolve signals on a scratch unit so predecoding never disturbs the live one.
+  RV5SControlUnit decoder;
+  decoder.SetControlSignals(instruction);
+  decoded.signals = decoder.GetControlSignals();
+  if (decoded.unit == ExecutionUnit::kInteger ||
+      decoded.unit == ExecutionUnit::kFloat ||
+      decoded.unit == ExecutionUnit::kDouble) {
+    decoded.alu_op = decoder.GetAluSignal(instruction, decoder.GetAluOp());
+  }
+  return decoded;
+}
+
+void RV5SVM::LoadProgram(const AssembledProgram &program) {
+  // Nothing of the previous program may still be in flight.
+  latches_ = PipelineRegisters();
+  scoreboard_ = LoadScoreboard();
+  VmBase::LoadProgram(program);
+}
+
+std::unique_ptr<BranchPredictor> RV5SVM::CreateBranchPredictor() const {
+  return MakeBranchPredictor(vm_config::config.getBranchPredictorType(),
+                             vm_config::config.getBranchPredictorTableSize(),
+                             vm_config::config.getBranchPredictorHistoryLength());
+}
+
+bool RV5SVM::PipelineEmpty() const {
+  return !latches_.if_id.valid && !latches_.id_ex.valid && !latches_.ex_mem.valid && !latches_.mem_wb.valid;
+}
+
+uint64_t RV5SVM::Forward(RegisterFileKind kind, uint8_t reg, uint64_t value) const {
+  // x0 reads as zero whatever an instruction ahead claims to write to it.
+  if (kind == RegisterFileKind::kNone || (kind == RegisterFileKind::kGpr && reg == 0)
+      || !vm_config::config.getForwarding()) {
+    return value;
+  }
+  const ExMemRegister &ex_mem = latches_.ex_mem;
+  if (ex_mem.valid && ex_mem.use.rd == kind && ex_mem.decoded.rd == reg) {
+    return ex_mem.result;
+  }
+  const MemWbRegister &mem_wb = latches_.mem_wb;
+  if (mem_wb.valid && mem_wb.use.rd == kind && mem_wb.decoded.rd == reg) {
+    return mem_wb.result;
+  }
+  return value;
+}
+
+bool RV5SVM::DetectHazard(const DecodedInstruction &decoded, const RegisterUse &use) const {
+  const PipelineRegisters &latches = latches_;
+  // ecall works on the register file directly, so everything ahead of it has to write back first.
+  // What is in MEM/WB now writes back before ecall reaches EX.
+  if (decoded.unit == ExecutionUnit::kSyscall) {
+    return latches.id_ex.valid || latches.ex_mem.valid;
+  }
+  if (!vm_config::config.getHazardDetection()) {
+    return false;
+  }
+
+  auto depends_on = [&](const RegisterUse &producer, uint8_t rd) {
+    if (producer.rd == RegisterFileKind::kNone || (producer.rd == RegisterFileKind::kGpr && rd == 0)) {
+      return false;
+    }
+    return (use.rs1 == producer.rd && decoded.rs1 == rd) ||
+           (use.rs2 == producer.rd && decoded.rs2 == rd) ||
+           (use.rs3 == producer.rd && decoded.rs3 == rd);
+  };
+  bool ex_dependency = latches.id_ex.valid && depends_on(latches.id_ex.use, latches.id_ex.decoded.rd);
+  if (vm_config::config.getForwarding()) {
+    // Load-use: the loaded value exists only after MEM, a cycle too late to forward into EX.
+    return (ex_dependency && latches.id_ex.decoded.signals.mem_read) || AwaitsLoad(decoded, use);
+  }
+  bool mem_dependency = latches.ex_mem.valid && depends_on(latches.ex_mem.use, latches.ex_mem.decoded.rd);
+  return ex_dependency || mem_dependency || AwaitsLoad(decoded, use);
+}
+
+bool RV5SVM::AwaitsLoad(const DecodedInstruction &decoded, const RegisterUse &use) const {
+  auto pending = [&](RegisterFileKind kind, uint8_t reg) {
+    switch (kind) {
+      case RegisterFileKind::kGpr: return scoreboard_.gpr[reg] > cycle_s_;
+      case RegisterFileKind::kFpr: return scoreboard_.fpr[reg] > cycle_s_;
+      default: return false;
+    }
+  };
+  return pending(use.rs1, decoded.rs1) || pending(use.rs2, decoded.rs2) || pending(use.rs3, decoded.rs3);
+}
+
+void RV5SVM::FetchStage(IfIdRegister &out) {
+  out = IfIdRegister();
+  if (program_counter_ >= program_size_) {
+    return;
+  }
+  out.valid = true;
+  out.pc = program_counter_;
+  memory_controller_.SetAccessContext(program_counter_, cycle_s_);
+  memory_controller_.AccessInstructionCache(program_counter_);
+  out.decoded = FetchDecoded(program_counter_);
+  current_instruction_ = out.decoded.instruction;
+  // The predecoded immediate stands in for a BTB: the taken target is known as soon as the branch is.
+  if (branch_predictor_ && out.decoded.opcode == kOpBranch && out.decoded.unit == ExecutionUnit::kInteger) {
+    out.predicted_taken = branch_predictor_->Predict(out.pc, out.pc + static_cast<int64_t>(out.decoded.imm));
+  }
+  if (out.predicted_taken) {
+    UpdateProgramCounter(out.decoded.imm);
+  } else {
+    UpdateProgramCounter(4);
+  }
+}
+
+bool RV5SVM::DecodeStage(const IfIdRegister &in, IdExRegister &out) {
+  out = IdExRegister();
+  if (!in.valid) {
+    return true;
+  }
+  const DecodedInstruction &decoded = in.decoded;
+  RegisterUse use = RV5SControlUnit::GetRegisterUse(decoded);
+  if (DetectHazard(decoded, use)) {
+    return false;
+  }
+  control_unit_.LoadControlSignals(decoded.signals);
+
+  auto read = [&](RegisterFileKind kind, uint8_t reg) -> uint64_t {
+    switch (kind) {
+      case RegisterFileKind::kGpr: return registers_.ReadGpr(reg);
+      case RegisterFileKind::kFpr: return registers_.ReadFpr(reg);
+      default: return 0;
+    }
+  };
+  out.valid = true;
+  out.pc = in.pc;
+  out.decoded = decoded;
+  out.use = use;
+  out.predicted_taken = in.predicted_taken;
+  out.rs1_value = read(use.rs1, decoded.rs1);
+  out.rs2_value = read(use.rs2, decoded.rs2);
+  out.rs3_value = read(use.rs3, decoded.rs3);
+  if (decoded.unit == ExecutionUnit::kFloat || decoded.unit == ExecutionUnit::kDouble) {
+    // The FP unit is handed every field, as in RVSSVM, even where the operation ignores it.
+    if (use.rs2 == RegisterFileKind::kNone) out.rs2_value = registers_.ReadFpr(decoded.rs2);
+    if (use.rs3 == RegisterFileKind::kNone) out.rs3_value = registers_.ReadFpr(decoded.rs3);
+  }
+  return true;
+}
+
+template <bool RecordHistory>
+void RV5SVM::ExecuteStage(const IdExRegister &in, ExMemRegister &out, bool &redirect, uint64_t &target) {
+  out = ExMemRegister();
+  if (!in.valid) {
+    return;
+  }
+  const DecodedInstruction &decoded = in.decoded;
+  out.valid = true;
+  out.pc = in.pc;
+  out.decoded = decoded;
+  out.use = in.use;
+
+  uint64_t rs1_value = Forward(in.use.rs1, decoded.rs1, in.rs1_value);
+  uint64_t rs2_value = Forward(in.use.rs2, decoded.rs2, in.rs2_value);
+  uint64_t rs3_value = Forward(in.use.rs3, decoded.rs3, in.rs3_value);
+  uint64_t operand2 = decoded.signals.alu_src ? static_cast<uint64_t>(static_cast<int64_t>(decoded.imm)) : rs2_value;
+  out.store_value = rs2_value;
+
+  switch (decoded.unit) {
+    case ExecutionUnit::kSyscall: {
+      HandleSyscall<RecordHistory>();
+      return;
+    }
+    case ExecutionUnit::kCsr: {
+      ExecuteCsr<RecordHistory>(decoded, rs1_value, out);
+      return;
+    }
+    case ExecutionUnit::kLdbm: {
+      out.result = rs1_value; // operands are fetched in MEM
+      return;
+    }
+    case ExecutionUnit::kBigmul: {
+      // LDBM ahead of us has already filled the operand caches in MEM this cycle or earlier
+      bigmul_unit::executeBigmul();
+      out.result = rs1_value + static_cast<int64_t>(decoded.imm);
+      return;
+    }
+    case ExecutionUnit::kFloat:
+    case ExecutionUnit::kDouble: {
+      if (alu::UsesRoundingMode(decoded.alu_op)) {
+        uint8_t rm = decoded.funct3;
+        if (rm == 0b111) {
+          rm = registers_.ReadCsr(0x002);
+        }
+        fp_env_.SetRoundingMode(rm);
+      }
+      uint8_t fcsr_status = 0;
+      if (decoded.unit == ExecutionUnit::kFloat) {
+        std::tie(out.result, fcsr_status) = alu::Alu::fpcompute(decoded.alu_op, rs1_value, operand2, rs3_value);
+      } else {
+        std::tie(out.result, fcsr_status) = alu::Alu::dfpcompute(decoded.alu_op, rs1_value, operand2, rs3_value);
+      }
+      fp_env_.Raise(fcsr_status);
+      return;
+    }
+    case ExecutionUnit::kInteger: break;
+  }
+
+  uint64_t result = alu_.execute(decoded.alu_op, rs1_value, operand2).first;
+  out.result = result;
+  // Same value RVSSVM derives from (imm << 12) on the 32-bit immediate.
+  const auto upper = static_cast<int64_t>(static_cast<int32_t>(static_cast<uint32_t>(decoded.imm) << 12));
+
+  switch (decoded.opcode) {
+    case kOpLui: {
+      out.result = static_cast<uint64_t>(upper);
+      break;
+    }
+    case kOpAuipc: {
+      out.result = in.pc + static_cast<uint64_t>(upper);
+      break;
+    }
+    case kOpJal: {
+      out.result = in.pc + 4;
+      redirect = true;
+      target = in.pc + static_cast<int64_t>(decoded.imm);
+      break;
+    }
+    case kOpJalr: {
+      out.result = in.pc + 4;
+      redirect = true;
+      target = result;
+      break;
+    }
+    case kOpBranch: {
+      bool taken = false;
+      switch (decoded.funct3) {
+        case 0b000: taken = (result == 0); break; // BEQ
+        case 0b001: taken = (result != 0); break; // BNE
+        case 0b100: taken = (result == 1); break; // BLT
+        case 0b101: taken = (result == 0); break; // BGE
+        case 0b110: taken = (result == 1); break; // BLTU
+        case 0b111: taken = (result == 0); break; // BGEU
+        default: break;
+      }
+      const uint64_t taken_target = in.pc + static_cast<int64_t>(decoded.imm);
+      if (branch_predictor_) {
+        branch_predictor_->Update(in.pc, taken_target, taken);
+      }
+      branch_predictions_++;
+      if (taken != in.predicted_taken) {
+        redirect = true;
+        target = taken ? taken_target : in.pc + 4;
+        branch_mispredictions_++;
+      }
+      break;
+    }
+    default: break;
+  }
+}
+
+template <bool RecordHistory>
+void RV5SVM::ExecuteCsr(const DecodedInstruction &decoded, uint64_t rs1_value, ExMemRegister &out) {
+  uint16_t csr = (decoded.instruction >> 20) & 0xFFF;
+  std::array<uint64_t, 3> old_float{};
+  uint64_t old_target = 0;
+  if constexpr (RecordHistory) {
+    for (size_t i = 0; i < kFloatCsrs.size(); ++i) {
+      old_float[i] = registers_.ReadCsr(kFloatCsrs[i]);
+    }
+    old_target = registers_.ReadCsr(csr);
+  }
+
+  if (csr == 0x001 || csr == 0x003) {
+    SyncFloatCsrs();
+  }
+  uint64_t old_value = registers_.ReadCsr(csr);
+  uint64_t uimm = decoded.rs1;
+
+  switch (decoded.funct3) {
+    case 0b001: { // CSRRW
+      registers_.WriteCsr(csr, rs1_value);
+      break;
+    }
+    case 0b010: { // CSRRS
+      if (rs1_value != 0) {
+        registers_.WriteCsr(csr, old_value | rs1_value);
+      }
+      break;
+    }
+    case 0b011: { // CSRRC
+      if (rs1_value != 0) {
+        registers_.WriteCsr(csr, old_value & ~rs1_value);
+      }
+      break;
+    }
+    case 0b101: { // CSRRWI
+      registers_.WriteCsr(csr, uimm);
+      break;
+    }
+    case 0b110: { // CSRRSI
+      if (uimm != 0) {
+        registers_.WriteCsr(csr, old_value | uimm);
+      }
+      break;
+    }
+    case 0b111: { // CSRRCI
+      if (uimm != 0) {
+        registers_.WriteCsr(csr, old_value & ~uimm);
+      }
+      break;
+    }
+    default: break;
+  }
+  if (csr >= 0x001 && csr <= 0x003) {
+    OnFloatCsrWritten(csr);
+  }
+  out.result = old_value; // rd, written back in WB
+
+  if constexpr (RecordHistory) {
+    for (size_t i = 0; i < kFloatCsrs.size(); ++i) {
+      RecordRegister(1, kFloatCsrs[i], old_float[i], registers_.ReadCsr(kFloatCsrs[i]));
+    }
+    if (csr < 0x001 || csr > 0x003) {
+      RecordRegister(1, csr, old_target, registers_.ReadCsr(csr));
+    }
+  }
+}
+
+bool RV5SVM::LoadMemory(uint8_t funct3, uint64_t address, uint64_t &value) {
+  bool loaded = false;
+  switch (funct3) {
+    case 0b000: { uint8_t v = 0; loaded = memory_controller_.TryRead(address, v); value = static_cast<int8_t>(v); break; }   // LB
+    case 0b001: { uint16_t v = 0; loaded = memory_controller_.TryRead(address, v); value = static_cast<int16_t>(v); break; } // LH
+    case 0b010: { uint32_t v = 0; loaded = memory_controller_.TryRead(address, v); value = static_cast<int32_t>(v); break; } // LW
+    case 0b011: { uint64_t v = 0; loaded = memory_controller_.TryRead(address, v); value = v; break; }                       // LD
+    case 0b100: { uint8_t v = 0; loaded = memory_controller_.TryRead(address, v); value = v; break; }  // LBU
+    case 0b101: { uint16_t v = 0; loaded = memory_controller_.TryRead(address, v); value = v; break; } // LHU
+    case 0b110: { uint32_t v = 0; loaded = memory_controller_.TryRead(address, v); value = v; break; } // LWU
+    default: return true;
+  }
+  return loaded;
+}
+
+template <bool RecordHistory>
+bool RV5SVM::StoreMemory(uint64_t address, uint64_t value, size_t width) {
+  std::vector<uint8_t> old_bytes_vec;
+  if constexpr (RecordHistory) {
+    if (memory_controller_.InBounds(address, width)) {
+      old_bytes_vec.resize(width);
+      memory_controller_.ReadBlock(address, old_bytes_vec);
+    }
+  }
+  bool stored = true;
+  switch (width) {
+    case 1: stored = memory_controller_.TryWrite<uint8_t>(address, value & 0xFF); break;
+    case 2: stored = memory_controller_.TryWrite<uint16_t>(address, value & 0xFFFF); break;
+    case 4: stored = memory_controller_.TryWrite<uint32_t>(address, value & 0xFFFFFFFF); break;
+    case 8: stored = memory_controller_.TryWrite<uint64_t>(address, value); break;
+    default: return true;
+  }
+  if (!stored) {
+    return false;
+  }
+  InvalidateDecodedRange(address, width);
+  if constexpr (RecordHistory) {
+    std::vector<uint8_t> new_bytes_vec(width);
+    memory_controller_.ReadBlock(address, new_bytes_vec);
+    if (old_bytes_vec != new_bytes_vec) {
+      current_cycle_.memory_changes.push_back({address, old_bytes_vec, new_bytes_vec});
+    }
+  }
+  return true;
+}
+
+template <bool RecordHistory>
+bool RV5SVM::MemoryStage(const ExMemRegister &in, MemWbRegister &out, uint64_t &stall) {
+  stall = 0;
+  out = MemWbRegister();
+  if (!in.valid) {
+    return true;
+  }
+  const DecodedInstruction &decoded = in.decoded;
+  out.valid = true;
+  out.pc = in.pc;
+  out.decoded = decoded;
+  out.use = in.use;
+  out.result = in.result;
+  memory_controller_.SetAccessContext(in.pc, cycle_s_);
+  const bool non_blocking = memory_controller_.NonBlockingData();
+  if (non_blocking) {
+    // A younger write to a register supersedes any load still on its way to it.
+    if (in.use.rd == RegisterFileKind::kGpr) {
+      scoreboard_.gpr[decoded.rd] = 0;
+    } else if (in.use.rd == RegisterFileKind::kFpr) {
+      scoreboard_.fpr[decoded.rd] = 0;
+    }
+  }
+
+  uint8_t load_funct3 = decoded.funct3;
+  size_t store_width = 0;
+  switch (decoded.unit) {
+    case ExecutionUnit::kLdbm: {
+      const size_t chunk_size = 512; // matches bigmul cache size in header
+      std::vector<uint8_t> buf_a(chunk_size), buf_b(chunk_size);
+      memory_controller_.ReadBlock(in.result, buf_a);
+      memory_controller_.ReadBlock(in.store_value, buf_b);
+      bigmul_unit::loadDatafrombuffer(buf_a, buf_b);
+      return true;
+    }
+    case ExecutionUnit::kBigmul: {
+      if (!decoded.signals.mem_write) {
+        return true;
+      }
+      uint64_t address = in.result;
+      size_t length = bigmul_unit::getResultSize();
+      std::vector<uint8_t> old_bytes_vec;
+      if constexpr (RecordHistory) {
+        old_bytes_vec.resize(length);
+        memory_controller_.ReadBlock(address, old_bytes_vec);
+      }
+      memory_controller_.WriteBlock(address, std::span(bigmul_unit::resultCache, length));
+      InvalidateDecodedRange(address, length);
+      if constexpr (RecordHistory) {
+        std::vector<uint8_t> new_bytes_vec(bigmul_unit::resultCache, bigmul_unit::resultCache + length);
+        if (old_bytes_vec != new_bytes_vec) {
+          current_cycle_.memory_changes.push_back({address, old_bytes_vec, new_bytes_vec});
+        }
+      }
+      bigmul_unit::invalidateCaches();
+      return true;
+    }
+    case ExecutionUnit::kFloat: {
+      load_funct3 = 0b110; // FLW
+      store_width = 4;
+      break;
+    }
+    case ExecutionUnit::kDouble: {
+      load_funct3 = 0b011; // FLD
+      store_width = 8;
+      break;
+    }
+    case ExecutionUnit::kInteger: {
+      store_width = decoded.funct3 <= 0b011 ? size_t{1} << decoded.funct3 : 0;
+      break;
+    }
+    default: return true;
+  }
+
+  auto trap = [&](TrapCause cause, uint64_t address) {
+    RaiseTrap(cause, in.pc, address);
+    if constexpr (RecordHistory) {
+      for (const RegisterChange &change : trap_csr_changes_) {
+        RecordRegister(1, change.reg_index, change.old_value, change.new_value);
+      }
+    }
+    out = MemWbRegister();
+    return false;
+  };
+
+  if (decoded.signals.mem_read && !LoadMemory(load_funct3, in.result, out.result)) {
+    return trap(TrapCause::kLoadAccessFault, in.result);
+  }
+  if (decoded.signals.mem_write && !StoreMemory<RecordHistory>(in.result, in.store_value, store_width)) {
+    return trap(TrapCause::kStoreAccessFault, in.result);
+  }
+  if (non_blocking && (decoded.signals.mem_read || decoded.signals.mem_write)) {
+    stall = memory_controller_.LastDataStall();
+    if (decoded.signals.mem_read && in.use.rd == RegisterFileKind::kGpr && decoded.rd != 0) {
+      scoreboard_.gpr[decoded.rd] = cycle_s_ + memory_controller_.LastDataLatency();
+    } else if (decoded.signals.mem_read && in.use.rd == RegisterFileKind::kFpr) {
+      scoreboard_.fpr[decoded.rd] = cycle_s_ + memory_controller_.LastDataLatency();
+    }
+  }
+  return true;
+}
+
+template <bool RecordHistory>
+void RV5SVM::WriteBackStage(const MemWbRegister &in) {
+  if (!in.valid) {
+    return;
+  }
+  uint8_t rd = in.decoded.rd;
+  if (in.use.rd == RegisterFileKind::kGpr) {
+    uint64_t old_value = registers_.ReadGpr(rd);
+    registers_.WriteGpr(rd, in.result);
+    if constexpr (RecordHistory) {
+      RecordRegister(0, rd, old_value, in.result);
+    }
+  } else if (in.use.rd == RegisterFileKind::kFpr) {
+    uint64_t old_value = registers_.ReadFpr(rd);
+    registers_.WriteFpr(rd, in.result);
+    if constexpr (RecordHistory) {
+      RecordRegister(2, rd, old_value, in.result);
+    }
+  }
+  instructions_retired_++;
+}
+
+template <bool RecordHistory>
+void RV5SVM::Cycle() {
+  if constexpr (RecordHistory) {
+    current_cycle_ = CycleDelta();
+    current_cycle_.before = Snapshot();
+  }
+
+  // Every stage reads the latches as they were at the start of the cycle.
+  const PipelineRegisters &now = latches_;
+  const uint64_t penalty_before = memory_controller_.MissPenaltyCycles();
+  PipelineRegisters next;
+
+  WriteBackStage<RecordHistory>(now.mem_wb);
+  uint64_t memory_stall = 0;
+  const bool memory_done = MemoryStage<RecordHistory>(now.ex_mem, next.mem_wb, memory_stall);
+  const uint64_t penalty_after_memory = memory_controller_.MissPenaltyCycles();
+  if (!memory_done) {
+    // Everything younger than the faulting access is squashed; RaiseTrap has set the PC.
+    trap_raised_ = false;
+  } else {
+    bool redirect = false;
+    uint64_t target = 0;
+    ExecuteStage<RecordHistory>(now.id_ex, next.ex_mem, redirect, target);
+    if (redirect) {
+      // Fetch went the wrong way: the instructions in IF and ID are on the wrong path.
+      program_counter_ = target;
+    } else if (DecodeStage(now.if_id, next.id_ex)) {
+      FetchStage(next.if_id);
+    } else {
+      // Bubble into EX; IF/ID and the fetch PC hold.
+      next.if_id = now.if_id;
+      stall_cycles_++;
+    }
+  }
+  latches_ = next;
+  if (memory_controller_.NonBlockingData()) {
+    // MEM misses wait in the scoreboard; only MSHR and write-buffer stalls, and fetch misses, freeze everything.
+    cycle_s_ += 1 + memory_stall + memory_controller_.MissPenaltyCycles() - penalty_after_memory;
+  } else {
+    // Caches block: a miss in IF or MEM freezes the whole pipeline for its penalty.
+    cycle_s_ += 1 + memory_controller_.MissPenaltyCycles() - penalty_before;
+  }
+
+  if constexpr (RecordHistory) {
+    current_cycle_.after = Snapshot();
+    undo_stack_.push(std::move(current_cycle_));
+    while (!redo_stack_.empty()) {
+      redo_stack_.pop();
+    }
+    current_cycle_ = CycleDelta();
+  }
+}
+
+template <bool RecordHistory>
+void RV5SVM::HandleSyscall() {
+  uint64_t syscall_number = registers_.ReadGpr(17);
+  // host formatting of float and double output must not round in the guest's mode
+  LeaveFloatEnvironment();
+  switch (syscall_number) {
+    case SYSCALL_PRINT_INT: {
+      if (!globals::vm_as_backend) {
+        std::cout << "[Syscall output: ";
+      } else {
+        std::cout << "VM_STDOUT_START";
+      }
+      std::cout << static_cast<int64_t>(registers_.ReadGpr(10)); // Print signed integer
+      if (!globals::vm_as_backend) {
+        std::cout << "]" << std::endl;
+      } else {
+        std::cout << "VM_STDOUT_END" << std::endl;
+      }
+      break;
+    }
+    case SYSCALL_PRINT_FLOAT: {
+      if (!globals::vm_as_backend) {
+        std::cout << "[Syscall output: ";
+      } else {
+        std::cout << "VM_STDOUT_START";
+      }
+      float float_value;
+      uint64_t raw = registers_.ReadGpr(10);
+      std::memcpy(&float_value, &raw, sizeof(float_value));
+      std::cout << std::setprecision(std::numeric_limits<float>::max_digits10) << float_value;
+      if (!globals::vm_as_backend) {
+        std::cout << "]" << std::endl;
+      } else {
+        std::cout << "VM_STDOUT_END" << std::endl;
+      }
+      break;
+    }
+    case SYSCALL_PRINT_DOUBLE: {
+      if (!globals::vm_as_backend) {
+        std::cout << "[Syscall output: ";
+      } else {
+        std::cout << "VM_STDOUT_START";
+      }
+      double double_value;
+      uint64_t raw = registers_.ReadGpr(10);
+      std::memcpy(&double_value, &raw, sizeof(double_value));
+      std::cout << std::setprecision(std::numeric_limits<double>::max_digits10) << double_value;
+      if (!globals::vm_as_backend) {
+        std::cout << "]" << std::endl;
+      } else {
+        std::cout << "VM_STDOUT_END" << std::endl;
+      }
+      break;
+    }
+    case SYSCALL_PRINT_STRING: {
+      if (!globals::vm_as_backend) {
+        std::cout << "[Syscall output: ";
+      }
+      PrintString(registers_.ReadGpr(10)); // Print string
+      if (!globals::vm_as_backend) {
+        std::cout << "]" << std::endl;
+      }
+      break;
+    }
+    case SYSCALL_EXIT: {
+      RequestStop();
+      if (!globals::vm_as_backend) {
+        std::cout << "VM_EXIT" << std::endl;
+      }
+      output_status_ = "VM_EXIT";
+      std::cout << "Exited with exit code: " << registers_.ReadGpr(10) << std::endl;
+      exit(0); // Exit the program
+      break;
+    }
+    case SYSCALL_READ: {
+      uint64_t file_descriptor = registers_.ReadGpr(10);
+      uint64_t buffer_address = registers_.ReadGpr(11);
+      uint64_t length = registers_.ReadGpr(12);
+
+      if (file_descriptor == 0) {
+        std::string input;
+        {
+          std::cout << "VM_STDIN_START" << std::endl;
+          output_status_ = "VM_STDIN_START";
+          std::unique_lock<std::mutex> lock(input_mutex_);
+          input_cv_.wait(lock, [this]() {
+            return !input_queue_.empty();
+          });
+          output_status_ = "VM_STDIN_END";
+          std::cout << "VM_STDIN_END" << std::endl;
+
+          input = input_queue_.front();
+          input_queue_.pop();
+        }
+
+        std::vector<uint8_t> old_bytes_vec;
+        if constexpr (RecordHistory) {
+          old_bytes_vec.resize(length);
+          memory_controller_.ReadBlock(buffer_address, old_bytes_vec);
+        }
+        // The input cut to length, then a terminator if there is room for one.
+        std::vector<uint8_t> bytes(input.begin(), input.begin() + static_cast<long>(std::min<uint64_t>(input.size(), length)));
+        if (input.size() < length) {
+          bytes.push_back('\0');
+        }
+        memory_controller_.WriteBlock(buffer_address, bytes);
+        InvalidateDecodedRange(buffer_address, length);
+        if constexpr (RecordHistory) {
+          std::vector<uint8_t> new_bytes_vec(length);
+          memory_controller_.ReadBlock(buffer_address, new_bytes_vec);
+          current_cycle_.memory_changes.push_back({buffer_address, old_bytes_vec, new_bytes_vec});
+        }
+
+        uint64_t old_reg = registers_.ReadGpr(10);
+        uint64_t new_reg = std::min(static_cast<uint64_t>(length), static_cast<uint64_t>(input.size()));
+        registers_.WriteGpr(10, new_reg);
+        if constexpr (RecordHistory) {
+          RecordRegister(0, 10, old_reg, new_reg);
+        }
+      } else {
+        std::cerr << "Unsupported file descriptor: " << file_descriptor << std::endl;
+      }
+      break;
+    }
+    case SYSCALL_WRITE: {
+      uint64_t file_descriptor = registers_.ReadGpr(10);
+      uint64_t buffer_address = registers_.ReadGpr(11);
+      uint64_t length = registers_.ReadGpr(12);
+
+      if (file_descriptor == 1) { // stdout
+        std::cout << "VM_STDOUT_START";
+        output_status_ = "VM_STDOUT_START";
+        uint64_t bytes_printed = PrintBytes(buffer_address, length);
+        std::cout << std::flush;
+        output_status_ = "VM_STDOUT_END";
+        std::cout << "VM_STDOUT_END" << std::endl;
+
+        uint64_t old_reg = registers_.ReadGpr(10);
+        uint64_t new_reg = std::min(static_cast<uint64_t>(length), bytes_printed);
+        registers_.WriteGpr(10, new_reg);
+        if constexpr (RecordHistory) {
+          RecordRegister(0, 10, old_reg, new_reg);
+        }
+      } else {
+        std::cerr << "Unsupported file descriptor: " << file_descriptor << std::endl;
+      }
+      break;
+    }
+    default: {
+      std::cerr << "Unknown syscall number: " << syscall_number << std::endl;
+      break;
+    }
+  }
+  EnterFloatEnvironment();
+}
+
+void RV5SVM::RecordRegister(unsigned int reg_type, unsigned int reg_index, uint64_t old_value, uint64_t new_value) {
+  if (old_value != new_value) {
+    current_cycle_.register_changes.push_back({reg_index, reg_type, old_value, new_value});
+  }
+}
+
+PipelineSnapshot RV5SVM::Snapshot() const {
+  PipelineSnapshot snapshot;
+  snapshot.latches = latches_;
+  snapshot.scoreboard = scoreboard_;
+  snapshot.program_counter = program_counter_;
+  snapshot.cycles = cycle_s_;
+  snapshot.instructions_retired = instructions_retired_;
+  snapshot.stall_cycles = stall_cycles_;
+  snapshot.branch_predictions = branch_predictions_;
+  snapshot.branch_mispredictions = branch_mispredictions_;
+  snapshot.trap = trap_;
+  return snapshot;
+}
+
+void RV5SVM::Restore(const PipelineSnapshot &snapshot) {
+  latches_ = snapshot.latches;
+  scoreboard_ = snapshot.scoreboard;
+  program_counter_ = snapshot.program_counter;
+  cycle_s_ = snapshot.cycles;
+  instructions_retired_ = snapshot.instructions_retired;
+  stall_cycles_ = snapshot.stall_cycles;
+  branch_predictions_ = snapshot.branch_predictions;
+  branch_mispredictions_ = snapshot.branch_mispredictions;
+  trap_ = snapshot.trap;
+}
+
+void RV5SVM::UpdateStatistics() {
+  cpi_ = instructions_retired_ ? static_cast<float>(cycle_s_) / static_cast<float>(instructions_retired_) : 0.0f;
+  ipc_ = cycle_s_ ? static_cast<float>(instructions_retired_) / static_cast<float>(cycle_s_) : 0.0f;
+}
+
+template <bool Debug>
+void RV5SVM::RunLoop() {
+  ClearStop();
+  const uint64_t retired_at_start = instructions_retired_;
+
+  {
+    FloatEnvironmentScope fp_scope(*this);
+    while (!stop_requested_ && (program_counter_ < program_size_ || !PipelineEmpty())) {
+      if (instructions_retired_ - retired_at_start > vm_config::config.getInstructionExecutionLimit())
+        break;
+      if constexpr (Debug) {
+        if (CheckBreakpoint(program_counter_)) {
+          std::cout << "VM_BREAKPOINT_HIT " << program_counter_ << std::endl;
+          output_status_ = "VM_BREAKPOINT_HIT";
+          break;
+        }
+      }
+
+      Cycle<Debug>();
+
+      if constexpr (Debug) {
+        if (trap_.halted) {
+          // RaiseTrap has reported VM_TRAP
+        } else if (program_counter_ < program_size_ || !PipelineEmpty()) {
+          std::cout << "VM_STEP_COMPLETED" << std::endl;
+          output_status_ = "VM_STEP_COMPLETED";
+        } else {
+          std::cout << "VM_LAST_INSTRUCTION_STEPPED" << std::endl;
+          output_status_ = "VM_LAST_INSTRUCTION_STEPPED";
+        }
+        LeaveFloatEnvironment();
+        // Host float division, it must not raise flags in the guest's fflags.
+        UpdateStatistics();
+        DumpRegisters(globals::registers_dump_file_path, registers_);
+        DumpState(globals::vm_state_dump_file_path);
+
+        unsigned int delay_ms = vm_config::config.getRunStepDelay();
+        std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+        EnterFloatEnvironment();
+      }
+    }
+  }
+  UpdateStatistics();
+
+  if (program_counter_ >= program_size_ && PipelineEmpty()) {
+    std::cout << "VM_PROGRAM_END" << std::endl;
+    output_status_ = "VM_PROGRAM_END";
+  }
+  DumpRegisters(globals::registers_dump_file_path, registers_);
+  DumpState(globals::vm_state_dump_file_path);
+}
+
+void RV5SVM::Run() {
+  RunLoop<false>();
+}
+
+void RV5SVM::DebugRun() {
+  RunLoop<true>();
+}
+
+void RV5SVM::Step() {
+  trap_.halted = false;
+  if (program_counter_ < program_size_ || !PipelineEmpty()) {
+    {
+      FloatEnvironmentScope fp_scope(*this);
+      Cycle<true>();
+    }
+    UpdateStatistics();
+    std::cout << "Program Counter: " << std::hex << program_counter_ << std::dec << std::endl;
+
+    if (trap_.halted) {
+      // RaiseTrap has reported VM_TRAP
+    } else if (program_counter_ < program_size_ || !PipelineEmpty()) {
+      std::cout << "VM_STEP_COMPLETED" << std::endl;
+      output_status_ = "VM_STEP_COMPLETED";
+    } else {
+      std::cout << "VM_LAST_INSTRUCTION_STEPPED" << std::endl;
+      output_status_ = "VM_LAST_INSTRUCTION_STEPPED";
+    }
+  } else {
+    std::cout << "VM_PROGRAM_END" << std::endl;
+    output_status_ = "VM_PROGRAM_END";
+  }
+  DumpRegisters(globals::registers_dump_file_path, registers_);
+  DumpState(globals::vm_state_dump_file_path);
+}
+
+void RV5SVM::StepN(uint64_t count) {
+  trap_.halted = false;
+  ClearStop();
+  const bool coalesce =
+      vm_config::config.getStepUndoGranularity() == vm_config::StepUndoGranularity::BATCH;
+  bool breakpoint_hit = false;
+  CycleDelta batch;
+  batch.before = Snapshot();
+  uint64_t cycles = 0;
+
+  {
+    FloatEnvironmentScope fp_scope(*this);
+    for (; cycles < count && (program_counter_ < program_size_ || !PipelineEmpty()) && !stop_requested_; ++cycles) {
+      // The breakpoint the step starts on has already been reported, step off it.
+      if (cycles > 0 && CheckBreakpoint(program_counter_)) {
+        std::cout << "VM_BREAKPOINT_HIT " << program_counter_ << std::endl;
+        output_status_ = "VM_BREAKPOINT_HIT";
+        breakpoint_hit = true;
+        break;
+      }
+      Cycle<true>();
+      if (coalesce) {
+        MergeCycleDelta(batch, std::move(undo_stack_.top()));
+        undo_stack_.pop();
+      }
+    }
+  }
+  if (coalesce && cycles > 0) {
+    undo_stack_.push(std::move(batch));
+  }
+  UpdateStatistics();
+  std::cout << "Program Counter: " << std::hex << program_counter_ << std::dec << std::endl;
+
+  if (trap_.halted || breakpoint_hit) {
+    // RaiseTrap or the loop has reported the reason
+  } else if (program_counter_ < program_size_ || !PipelineEmpty()) {
+    std::cout << "VM_STEP_COMPLETED" << std::endl;
+    output_status_ = "VM_STEP_COMPLETED";
+  } else {
+    std::cout << "VM_LAST_INSTRUCTION_STEPPED" << std::endl;
+    output_status_ = "VM_LAST_INSTRUCTION_STEPPED";
+  }
+  DumpRegisters(globals::registers_dump_file_path, registers_);
+  DumpState(globals::vm_state_dump_file_path);
+}
+
+void RV5SVM::Undo() {
+  if (undo_stack_.empty()) {
+    std::cout << "VM_NO_MORE_UNDO" << std::endl;
+    output_status_ = "VM_NO_MORE_UNDO";
+    return;
+  }
+
+  CycleDelta last = std::move(undo_stack_.top());
+  undo_stack_.pop();
+
+  for (auto change_it = last.register_changes.rbegin(); change_it != last.register_changes.rend(); ++change_it) {
+    const RegisterChange &change = *change_it;
+    switch (change.reg_type) {
+      case 0: registers_.WriteGpr(change.reg_index, change.old_value); break;
+      case 1: registers_.WriteCsr(change.reg_index, change.old_value); break;
+      case 2: registers_.WriteFpr(change.reg_index, change.old_value); break;
+      default: std::cerr << "Invalid register type: " << change.reg_type << std::endl; break;
+    }
+  }
+  for (auto change_it = last.memory_changes.rbegin(); change_it != last.memory_changes.rend(); ++change_it) {
+    const MemoryChange &change = *change_it;
+    memory_controller_.WriteBlock(change.address, change.old_bytes_vec);
+    InvalidateDecodedRange(change.address, change.old_bytes_vec.size());
+  }
+  Restore(last.before);
+  UpdateStatistics();
+  std::cout << "Program Counter: " << program_counter_ << std::endl;
+
+  redo_stack_.push(std::move(last));
+
+  output_status_ = "VM_UNDO_COMPLETED";
+  std::cout << "VM_UNDO_COMPLETED" << std::endl;
+
+  DumpRegisters(globals::registers_dump_file_path, registers_);
+  DumpState(globals::vm_state_dump_file_path);
+}
+
+void RV5SVM::Redo() {
+  if (redo_stack_.empty()) {
+    std::cout << "VM_NO_MORE_REDO" << std::endl;
+    return;
+  }
+
+  CycleDelta next = std::move(redo_stack_.top());
+  redo_stack_.pop();
+
+  for (const auto &change : next.register_changes) {
+    switch (change.reg_type) {
+      case 0: registers_.WriteGpr(change.reg_index, change.new_value); break;
+      case 1: registers_.WriteCsr(change.reg_index, change.new_value); break;
+      case 2: registers_.WriteFpr(change.reg_index, change.new_value); break;
+      default: std::cerr << "Invalid register type: " << change.reg_type << std::endl; break;
+    }
+  }
+  for (const auto &change : next.memory_changes) {
+    memory_controller_.WriteBlock(change.address, change.new_bytes_vec);
+    InvalidateDecodedRange(change.address, change.new_bytes_vec.size());
+  }
+  Restore(next.after);
+  UpdateStatistics();
+  DumpRegisters(globals::registers_dump_file_path, registers_);
+  DumpState(globals::vm_state_dump_file_path);
+  std::cout << "Program Counter: " << program_counter_ << std::endl;
+  undo_stack_.push(std::move(next));
+}
+
+void RV5SVM::Reset() {
+  program_counter_ = 0;
+  instructions_retired_ = 0;
+  cycle_s_ = 0;
+  cpi_ = 0;
+  ipc_ = 0;
+  stall_cycles_ = 0;
+  branch_predictions_ = 0;
+  branch_mispredictions_ = 0;
+  if (branch_predictor_) {
+    branch_predictor_->Reset();
+  }
+  trap_ = TrapRecord();
+  trap_raised_ = false;
+  latches_ = PipelineRegisters();
+  scoreboard_ = LoadScoreboard();
+  registers_.Reset();
+  (void)fp_env_.TakeFlags();
+  memory_controller_.Reset();
+  control_unit_.Reset();
+  current_cycle_ = CycleDelta();
+  undo_stack_ = std::stack<CycleDelta>();
+  redo_stack_ = std::stack<CycleDelta>();
+}
+
+void RV5SVM::DumpEngineState(std::ostream &file) const {
+  auto stage = [&](const char *name, bool valid, uint64_t pc, bool last) {
+    file << "\"" << name << "\": ";
+    if (valid) {
+      file << "\"0x" << std::hex << pc << std::dec << "\"";
+    } else {
+      file << "null";
+    }
+    if (!last) {
+      file << ", ";
+    }
+  };
+  file << "    \"pipeline\": {";
+  stage("IF/ID", latches_.if_id.valid, latches_.if_id.pc, false);
+  stage("ID/EX", latches_.id_ex.valid, latches_.id_ex.pc, false);
+  stage("EX/MEM", latches_.ex_mem.valid, latches_.ex_mem.pc, false);
+  stage("MEM/WB", latches_.mem_wb.valid, latches_.mem_wb.pc, true);
+  file << "},\n";
+}
+
+template void RV5SVM::Cycle<false>();
+template void RV5SVM::Cycle<true>();
@@ -0,0 +1,569 @@
+/**
+ * @file rvss_jit.cpp
+ * @brief x86-64 translation tier for hot basic blocks of the threaded engine
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+
+#include "vm/rvss/rvss_jit.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef RVSS_JIT_SUPPORTED
+
+#include "vm/rvss/x86_64_emitter.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int32_t kBudgetOffset = offsetof(JitContext, budget);
+constexpr int32_t kGprOffset = offsetof(JitContext, gpr);
+constexpr int32_t kStopFlagOffset = offsetof(JitContext, stop_flag);
+constexpr int32_t kBranchFlagOffset = offsetof(JitContext, branch_flag);
+constexpr int32_t kFaultOffset = offsetof(JitContext, fault);
+
+enum StoreOutcome : uint64_t {
+  kStoreDone = 0,
+  kStoreHitText = 1, ///< Store completed but overwrote text, the block has to end.
+  kStoreFaulted = 2, ///< Store did not happen, the interpreter re-executes it.
+};
+
+// Helpers called from translated code. A faulting access is reported back instead of
+// trapping here; the interpreter re-executes the instruction and takes the trap.
+
+uint64_t JitLoad(JitContext *context, uint64_t address, uint64_t handler) {
+  RVSSThreadedVM &vm = *context->vm;
+  MemoryController &memory = vm.memory_controller_;
+  bool loaded = false;
+  int64_t value = 0;
+  switch (static_cast<ThreadedHandler>(handler)) {
+    case ThreadedHandler::kLb: { uint8_t v = 0; loaded = memory.TryRead(address, v); value = static_cast<int8_t>(v); break; }
+    case ThreadedHandler::kLh: { uint16_t v = 0; loaded = memory.TryRead(address, v); value = static_cast<int16_t>(v); break; }
+    case ThreadedHandler::kLw: { uint32_t v = 0; loaded = memory.TryRead(address, v); value = static_cast<int32_t>(v); break; }
+    case ThreadedHandler::kLd: { uint64_t v = 0; loaded = memory.TryRead(address, v); value = static_cast<int64_t>(v); break; }
+    case ThreadedHandler::kLbu: { uint8_t v = 0; loaded = memory.TryRead(address, v); value = v; break; }
+    case ThreadedHandler::kLhu: { uint16_t v = 0; loaded = memory.TryRead(address, v); value = v; break; }
+    case ThreadedHandler::kLwu: { uint32_t v = 0; loaded = memory.TryRead(address, v); value = v; break; }
+    default: loaded = true; break;
+  }
+  if (!loaded) {
+    context->fault = 1;
+    return 0;
+  }
+  vm.memory_result_ = value;
+  return static_cast<uint64_t>(value);
+}
+
+uint64_t JitStore(JitContext *context, uint64_t address, uint64_t value, uint64_t handler) {
+  RVSSThreadedVM &vm = *context->vm;
+  MemoryController &memory = vm.memory_controller_;
+  bool stored = true;
+  uint64_t width = 0;
+  switch (static_cast<ThreadedHandler>(handler)) {
+    case ThreadedHandler::kSb: stored = memory.TryWrite<uint8_t>(address, value & 0xFF); width = 1; break;
+    case ThreadedHandler::kSh: stored = memory.TryWrite<uint16_t>(address, value & 0xFFFF); width = 2; break;
+    case ThreadedHandler::kSw: stored = memory.TryWrite<uint32_t>(address, value & 0xFFFFFFFF); width = 4; break;
+    case ThreadedHandler::kSd: stored = memory.TryWrite<uint64_t>(address, value); width = 8; break;
+    default: break;
+  }
+  if (!stored) {
+    context->fault = 1;
+    return kStoreFaulted;
+  }
+  if (address < vm.decoded_instructions_.size() * 4) {
+    vm.InvalidateDecodedRange(address, width);
+    return kStoreHitText;
+  }
+  return kStoreDone;
+}
+
+uint64_t JitAlu(uint64_t op, uint64_t a, uint64_t b) {
+  return alu::Alu::execute(static_cast<alu::AluOp>(op), a, b).first;
+}
+
+bool EndsBlock(ThreadedHandler handler) {
+  switch (handler) {
+    case ThreadedHandler::kBeq:
+    case ThreadedHandler::kBne:
+    case ThreadedHandler::kBlt:
+    case ThreadedHandler::kBge:
+    case ThreadedHandler::kBltu:
+    case ThreadedHandler::kBgeu:
+    case ThreadedHandler::kJal:
+    case ThreadedHandler::kJalr:
+      return true;
+    default:
+      return false;
+  }
+}
+
+} // namespace
+
+RVSSJit::RVSSJit(size_t code_cache_size) {
+  const auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  code_cache_size_ = (code_cache_size + page - 1) / page * page;
+  // One inaccessible page past the cache turns a stray write beyond code_end_ into a fault.
+  void *memory = mmap(nullptr, code_cache_size_ + page, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) {
+    return;
+  }
+  code_begin_ = static_cast<uint8_t *>(memory);
+  code_end_ = code_begin_ + code_cache_size_;
+  guard_size_ = page;
+  if (mprotect(code_begin_, code_cache_size_, PROT_READ | PROT_WRITE) != 0) {
+    munmap(code_begin_, code_cache_size_ + guard_size_);
+    code_begin_ = code_end_ = nullptr;
+    return;
+  }
+  EmitTrampolines();
+  // Hosts that refuse executable anonymous memory leave the engine interpreted.
+  if (mprotect(code_begin_, code_cache_size_, PROT_READ | PROT_EXEC) != 0) {
+    munmap(code_begin_, code_cache_size_ + guard_size_);
+    code_begin_ = code_end_ = code_cursor_ = nullptr;
+  }
+}
+
+RVSSJit::~RVSSJit() {
+  if (code_begin_) {
+    munmap(code_begin_, code_cache_size_ + guard_size_);
+  }
+}
+
+RVSSJit::WriteScope::WriteScope(RVSSJit &jit) : jit_(jit) {
+  if (jit_.write_depth_++ == 0) {
+    jit_.writable_ = mprotect(jit_.code_begin_, jit_.code_cache_size_, PROT_READ | PROT_WRITE) == 0;
+  }
+}
+
+RVSSJit::WriteScope::~WriteScope() {
+  // Nothing runs from the cache until this returns, so the old protection is back in time.
+  if (--jit_.write_depth_ == 0 && jit_.writable_) {
+    mprotect(jit_.code_begin_, jit_.code_cache_size_, PROT_READ | PROT_EXEC);
+    jit_.writable_ = false;
+  }
+}
+
+void RVSSJit::EmitTrampolines() {
+  using namespace x86_64;
+  Emitter emitter(code_begin_, code_end_);
+
+  // uint64_t enter(JitContext *context, const uint8_t *code)
+  // Three pushes keep rsp 16-byte aligned for the helper calls made by blocks.
+  enter_ = emitter.Cursor();
+  emitter.Push(RBX);
+  emitter.Push(R12);
+  emitter.Push(R13);
+  emitter.MovReg(R12, RDI);
+  emitter.MovLoad(RBX, R12, kGprOffset);
+  emitter.JmpReg(RSI);
+
+  epilogue_ = emitter.Cursor();
+  emitter.Pop(R13);
+  emitter.Pop(R12);
+  emitter.Pop(RBX);
+  emitter.Ret();
+
+  code_cursor_ = emitter.Cursor();
+}
+
+uint8_t *RVSSJit::Emit(uint64_t pc, uint32_t length, const std::vector<ThreadedInstruction> &program,
+                       std::vector<Link> &exits) {
+  using namespace x86_64;
+  Emitter e(code_cursor_, code_end_);
+  uint8_t *const entry = e.Cursor();
+
+  // Out-of-line exits that leave the block without chaining.
+  struct SideExit {
+    uint8_t *field;
+    uint64_t retired;
+    uint64_t next_pc;
+  };
+  std::vector<SideExit> side_exits;
+
+  auto gpr = [](uint8_t reg) { return static_cast<int32_t>(reg) * 8; };
+  auto call = [&](auto *helper) {
+    e.MovImm64(RAX, reinterpret_cast<uint64_t>(helper));
+    e.CallReg(RAX);
+  };
+  auto set_branch_flag = [&](bool taken) {
+    e.MovLoad(RAX, R12, kBranchFlagOffset);
+    e.MovByteStoreImm(RAX, 0, taken ? 1 : 0);
+  };
+  auto direct_exit = [&](uint64_t retired, uint64_t target) {
+    e.AluMemImm(kSubOp, R12, kBudgetOffset, static_cast<int32_t>(retired));
+    uint8_t *field = e.Jmp(e.Cursor() + 5); // falls through to the unlinked path until chained
+    uint8_t *unlinked = e.Cursor();
+    e.MovImm64(RAX, target);
+    e.Jmp(epilogue_);
+    exits.push_back({field, unlinked, pc, target});
+  };
+
+  // Only enter when the whole block fits in the budget and no stop is pending,
+  // the interpreter takes over otherwise.
+  e.AluMemImm(kCmpOp, R12, kBudgetOffset, static_cast<int32_t>(length));
+  side_exits.push_back({e.Jcc(kBelow, e.Cursor()), 0, pc});
+  e.MovLoad(RAX, R12, kStopFlagOffset);
+  e.CmpByteMemZero(RAX, 0);
+  side_exits.push_back({e.Jcc(kNotEqual, e.Cursor()), 0, pc});
+
+  bool terminated = false;
+  for (uint32_t i = 0; i < length; ++i) {
+    const ThreadedInstruction &ins = program[pc / 4 + i];
+    const uint64_t current_pc = pc + 4ull * i;
+    const auto imm = static_cast<int32_t>(ins.imm);
+
+    auto alu_reg = [&](auto &&op) {
+      if (ins.rd == 0) return;
+      e.MovLoad(RAX, RBX, gpr(ins.rs1));
+      e.MovLoad(RCX, RBX, gpr(ins.rs2));
+      op();
+      e.MovStore(RBX, gpr(ins.rd), RAX);
+    };
+    auto alu_imm = [&](auto &&op) {
+      if (ins.rd == 0) return;
+      e.MovLoad(RAX, RBX, gpr(ins.rs1));
+      op();
+      e.MovStore(RBX, gpr(ins.rd), RAX);
+    };
+    auto branch = [&](Cond condition) {
+      e.MovLoad(RAX, RBX, gpr(ins.rs1));
+      e.MovLoad(RCX, RBX, gpr(ins.rs2));
+      e.AluReg(kCmpOp, RAX, RCX);
+      uint8_t *taken = e.Jcc(condition, e.Cursor());
+      set_branch_flag(false);
+      direct_exit(i + 1, current_pc + 4);
+      if (!e.Overflowed()) Emitter::PatchRel32(taken, e.Cursor());
+      set_branch_flag(true);
+      direct_exit(i + 1, current_pc + static_cast<uint64_t>(ins.imm));
+      terminated = true;
+    };
+
+    switch (ins.handler) {
+      case ThreadedHandler::kAdd: alu_reg([&] { e.AluReg(kAddOp, RAX, RCX); }); break;
+      case ThreadedHandler::kSub: alu_reg([&] { e.AluReg(kSubOp, RAX, RCX); }); break;
+      case ThreadedHandler::kAnd: alu_reg([&] { e.AluReg(kAndOp, RAX, RCX); }); break;
+      case ThreadedHandler::kOr: alu_reg([&] { e.AluReg(kOrOp, RAX, RCX); }); break;
+      case ThreadedHandler::kXor: alu_reg([&] { e.AluReg(kXorOp, RAX, RCX); }); break;
+      case ThreadedHandler::kSll: alu_reg([&] { e.ShiftCl(kShl, RAX); }); break;
+      case ThreadedHandler::kSrl: alu_reg([&] { e.ShiftCl(kShr, RAX); }); break;
+      case ThreadedHandler::kSra: alu_reg([&] { e.ShiftCl(kSar, RAX); }); break;
+      case ThreadedHandler::kSlt: alu_reg([&] { e.AluReg(kCmpOp, RAX, RCX); e.SetccRax(kLess); }); break;
+      case ThreadedHandler::kSltu: alu_reg([&] { e.AluReg(kCmpOp, RAX, RCX); e.SetccRax(kBelow); }); break;
+      case ThreadedHandler::kAluReg: {
+        if (ins.alu_op == alu::AluOp::kMul) {
+          alu_reg([&] { e.Imul(RAX, RCX); });
+        } else if (ins.rd != 0) {
+          e.MovImm64(RDI, static_cast<uint64_t>(ins.alu_op));
+          e.MovLoad(RSI, RBX, gpr(ins.rs1));
+          e.MovLoad(RDX, RBX, gpr(ins.rs2));
+          call(&JitAlu);
+          e.MovStore(RBX, gpr(ins.rd), RAX);
+        }
+        break;
+      }
+
+      case ThreadedHandler::kAddi: alu_imm([&] { e.AluImm(kAddOp, RAX, imm); }); break;
+      case ThreadedHandler::kAndi: alu_imm([&] { e.AluImm(kAndOp, RAX, imm); }); break;
+      case ThreadedHandler::kOri: alu_imm([&] { e.AluImm(kOrOp, RAX, imm); }); break;
+      case ThreadedHandler::kXori: alu_imm([&] { e.AluImm(kXorOp, RAX, imm); }); break;
+      case ThreadedHandler::kSlli: alu_imm([&] { e.ShiftImm(kShl, RAX, imm & 63); }); break;
+      case ThreadedHandler::kSrli: alu_imm([&] { e.ShiftImm(kShr, RAX, imm & 63); }); break;
+      case ThreadedHandler::kSrai: alu_imm([&] { e.ShiftImm(kSar, RAX, imm & 63); }); break;
+      case ThreadedHandler::kSlti: alu_imm([&] { e.AluImm(kCmpOp, RAX, imm); e.SetccRax(kLess); }); break;
+      case ThreadedHandler::kSltiu: alu_imm([&] { e.AluImm(kCmpOp, RAX, imm); e.SetccRax(kBelow); }); break;
+      case ThreadedHandler::kAluImm: {
+        if (ins.rd != 0) {
+          e.MovImm64(RDI, static_cast<uint64_t>(ins.alu_op));
+          e.MovLoad(RSI, RBX, gpr(ins.rs1));
+          e.MovImm64(RDX, static_cast<uint64_t>(ins.imm));
+          call(&JitAlu);
+          e.MovStore(RBX, gpr(ins.rd), RAX);
+        }
+        break;
+      }
+
+      case ThreadedHandler::kLb:
+      case ThreadedHandler::kLh:
+      case ThreadedHandler::kLw:
+      case ThreadedHandler::kLd:
+      case ThreadedHandler::kLbu:
+      case ThreadedHandler::kLhu:
+      case ThreadedHandler::kLwu: {
+        e.MovLoad(RSI, RBX, gpr(ins.rs1));
+        e.AluImm(kAddOp, RSI, imm);
+        e.MovReg(RDI, R12);
+        e.MovImm64(RDX, static_cast<uint64_t>(ins.handler));
+        call(&JitLoad);
+        e.CmpByteMemZero(R12, kFaultOffset);
+        side_exits.push_back({e.Jcc(kNotEqual, e.Cursor()), i, current_pc});
+        if (ins.rd != 0) e.MovStore(RBX, gpr(ins.rd), RAX);
+        break;
+      }
+
+      case ThreadedHandler::kSb:
+      case ThreadedHandler::kSh:
+      case ThreadedHandler::kSw:
+      case ThreadedHandler::kSd: {
+        e.MovLoad(RSI, RBX, gpr(ins.rs1));
+        e.AluImm(kAddOp, RSI, imm);
+        e.MovLoad(RDX, RBX, gpr(ins.rs2));
+        e.MovReg(RDI, R12);
+        e.MovImm64(RCX, static_cast<uint64_t>(ins.handler));
+        call(&JitStore);
+        e.CmpEaxImm8(static_cast<int8_t>(kStoreHitText));
+        side_exits.push_back({e.Jcc(kEqual, e.Cursor()), i + 1, current_pc + 4});
+        side_exits.push_back({e.Jcc(kAbove, e.Cursor()), i, current_pc});
+        break;
+      }
+
+      case ThreadedHandler::kBeq: branch(kEqual); break;
+      case ThreadedHandler::kBne: branch(kNotEqual); break;
+      case ThreadedHandler::kBlt: branch(kLess); break;
+      case ThreadedHandler::kBge: branch(kGreaterEqual); break;
+      case ThreadedHandler::kBltu: branch(kBelow); break;
+      case ThreadedHandler::kBgeu: branch(kAboveEqual); break;
+
+      case ThreadedHandler::kJal: {
+        if (ins.rd != 0) {
+          e.MovImm64(RAX, current_pc + 4);
+          e.MovStore(RBX, gpr(ins.rd), RAX);
+        }
+        direct_exit(i + 1, current_pc + static_cast<uint64_t>(ins.imm));
+        terminated = true;
+        break;
+      }
+      case ThreadedHandler::kJalr: {
+        // Target is computed before the link is written, rd may equal rs1.
+        e.MovLoad(RAX, RBX, gpr(ins.rs1));
+        e.AluImm(kAddOp, RAX, imm);
+        if (ins.rd != 0) {
+          e.MovImm64(RCX, current_pc + 4);
+          e.MovStore(RBX, gpr(ins.rd), RCX);
+        }
+        e.AluMemImm(kSubOp, R12, kBudgetOffset, static_cast<int32_t>(i + 1));
+        e.Jmp(epilogue_);
+        terminated = true;
+        break;
+      }
+      case ThreadedHandler::kLui: {
+        if (ins.rd != 0) e.MovStoreImm(RBX, gpr(ins.rd), imm);
+        break;
+      }
+      case ThreadedHandler::kAuipc: {
+        if (ins.rd != 0) {
+          e.MovImm64(RAX, current_pc + static_cast<uint64_t>(ins.imm));
+          e.MovStore(RBX, gpr(ins.rd), RAX);
+        }
+        break;
+      }
+      default: break;
+    }
+  }
+  if (!terminated) {
+    direct_exit(length, pc + 4ull * length);
+  }
+
+  // An overflowed emitter hands out fields at the end of the cache, patching them would write past it.
+  if (e.Overflowed()) {
+    return nullptr;
+  }
+  for (const SideExit &side_exit : side_exits) {
+    Emitter::PatchRel32(side_exit.field, e.Cursor());
+    if (side_exit.retired != 0) {
+      e.AluMemImm(kSubOp, R12, kBudgetOffset, static_cast<int32_t>(side_exit.retired));
+    }
+    e.MovImm64(RAX, side_exit.next_pc);
+    e.Jmp(epilogue_);
+  }
+
+  if (e.Overflowed()) {
+    return nullptr;
+  }
+  code_cursor_ = e.Cursor();
+  return entry;
+}
+
+const uint8_t *RVSSJit::Translate(uint64_t pc, const std::vector<ThreadedInstruction> &program) {
+  if (!Available() || pc % 4 != 0 || pc / 4 + 1 >= program.size()) {
+    return nullptr;
+  }
+
+  uint32_t length = 0;
+  for (uint64_t index = pc / 4; length < kMaxBlockInstructions; ++index) {
+    ThreadedHandler handler = program[index].handler;
+    if (handler == ThreadedHandler::kGeneric || handler == ThreadedHandler::kTextEnd) {
+      break;
+    }
+    ++length;
+    if (EndsBlock(handler)) {
+      break;
+    }
+  }
+  if (length == 0) {
+    return nullptr;
+  }
+
+  WriteScope write(*this);
+  if (!write.Writable()) {
+    Disable();
+    return nullptr;
+  }
+  std::vector<Link> exits;
+  uint8_t *code = Emit(pc, length, program, exits);
+  if (!code) {
+    Flush();
+    exits.clear();
+    code = Emit(pc, length, program, exits);
+    if (!code) {
+      return nullptr;
+    }
+  }
+
+  if (entries_.size() < program.size()) {
+    entries_.resize(program.size(), nullptr);
+  }
+  Block &block = blocks_[pc];
+  block = Block{pc, pc + 4ull * length, code, {}};
+  entries_[pc / 4] = code;
+  for (uint64_t page = block.start >> kPageShift; page <= (block.end - 1) >> kPageShift; ++page) {
+    page_blocks_[page].push_back(pc);
+  }
+
+  for (const Link &link : exits) {
+    if (std::find(block.exit_targets.begin(), block.exit_targets.end(), link.target_pc) == block.exit_targets.end()) {
+      block.exit_targets.push_back(link.target_pc);
+    }
+    links_[link.target_pc].push_back(link);
+    if (const uint8_t *target = Lookup(link.target_pc)) {
+      x86_64::Emitter::PatchRel32(link.field, target);
+    }
+  }
+  // Chain everything that was waiting for this block, including its own back edge.
+  for (const Link &link : links_[pc]) {
+    x86_64::Emitter::PatchRel32(link.field, code);
+  }
+  return code;
+}
+
+uint64_t RVSSJit::Execute(const uint8_t *code, JitContext &context) const {
+  using EnterFunction = uint64_t (*)(JitContext *, const uint8_t *);
+  EnterFunction enter;
+  std::memcpy(&enter, &enter_, sizeof(enter));
+  uint64_t next_pc = enter(&context, code);
+  context.fault = 0;
+  return next_pc;
+}
+
+void RVSSJit::RemoveBlock(uint64_t start) {
+  auto it = blocks_.find(start);
+  if (it == blocks_.end()) {
+    return;
+  }
+  const Block &block = it->second;
+
+  auto incoming = links_.find(start);
+  if (incoming != links_.end()) {
+    for (const Link &link : incoming->second) {
+      x86_64::Emitter::PatchRel32(link.field, link.unlinked_target);
+    }
+  }
+  for (uint64_t target : block.exit_targets) {
+    auto outgoing = links_.find(target);
+    if (outgoing == links_.end()) continue;
+    std::erase_if(outgoing->second, [start](const Link &link) { return link.source_pc == start; });
+    if (outgoing->second.empty()) links_.erase(outgoing);
+  }
+  for (uint64_t page = block.start >> kPageShift; page <= (block.end - 1) >> kPageShift; ++page) {
+    auto blocks_in_page = page_blocks_.find(page);
+    if (blocks_in_page == page_blocks_.end()) continue;
+    std::erase(blocks_in_page->second, start);
+    if (blocks_in_page->second.empty()) page_blocks_.erase(blocks_in_page);
+  }
+  entries_[start / 4] = nullptr;
+  blocks_.erase(it);
+}
+
+void RVSSJit::InvalidateRange(uint64_t address, uint64_t size) {
+  if (size == 0 || blocks_.empty()) {
+    return;
+  }
+  uint64_t last = address + (size - 1);
+  if (last < address) {
+    last = UINT64_MAX;
+  }
+  const uint64_t first_page = address >> kPageShift;
+  const uint64_t last_page = last >> kPageShift;
+
+  std::vector<uint64_t> doomed;
+  if (last_page - first_page >= page_blocks_.size()) {
+    for (const auto &[page, starts] : page_blocks_) {
+      if (page >= first_page && page <= last_page) doomed.insert(doomed.end(), starts.begin(), starts.end());
+    }
+  } else {
+    for (uint64_t page = first_page; page <= last_page; ++page) {
+      auto blocks_in_page = page_blocks_.find(page);
+      if (blocks_in_page != page_blocks_.end()) {
+        doomed.insert(doomed.end(), blocks_in_page->second.begin(), blocks_in_page->second.end());
+      }
+    }
+  }
+  if (doomed.empty()) {
+    return;
+  }
+  // Called from a store helper in the middle of translated code; the scope has the cache
+  // executable again before the helper returns into it. Nothing may unwind through the
+  // translated frames, so a cache that cannot be unlinked only takes the JIT offline: the
+  // store helper side-exits to the interpreter anyway and no translation is found again.
+  WriteScope write(*this);
+  if (!write.Writable()) {
+    Disable();
+    return;
+  }
+  for (uint64_t start : doomed) {
+    RemoveBlock(start);
+  }
+}
+
+void RVSSJit::Flush() {
+  blocks_.clear();
+  links_.clear();
+  page_blocks_.clear();
+  std::fill(entries_.begin(), entries_.end(), nullptr);
+  if (Available()) {
+    WriteScope write(*this);
+    if (!write.Writable()) {
+      Disable();
+      return;
+    }
+    EmitTrampolines();
+  }
+}
+
+void RVSSJit::Disable() {
+  disabled_ = true;
+  blocks_.clear();
+  links_.clear();
+  page_blocks_.clear();
+  std::fill(entries_.begin(), entries_.end(), nullptr);
+}
+
+#else // !RVSS_JIT_SUPPORTED
+
+RVSSJit::RVSSJit(size_t) {}
+RVSSJit::~RVSSJit() = default;
+
+const uint8_t *RVSSJit::Translate(uint64_t, const std::vector<ThreadedInstruction> &) {
+  return nullptr;
+}
+
+uint64_t RVSSJit::Execute(const uint8_t *, JitContext &) const {
+  return 0;
+}
+
+void RVSSJit::InvalidateRange(uint64_t, uint64_t) {}
+
+void RVSSJit::Flush() {}
+
+#endif // RVSS_JIT_SUPPORTED
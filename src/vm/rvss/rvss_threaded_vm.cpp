@@ -0,0 +1,517 @@
+/**
+ * @file rvss_threaded_vm.cpp
+ * @brief Threaded-code execution engine for the single-stage VM
+ * @author Vishank Singh, https://github.com/VishankSingh
+ */
+
+#include "vm/rvss/rvss_threaded_vm.h"
+#include "vm/rvss/rvss_jit.h"
+
+#include "utils.h"
+#include "globals.h"
+#include "config.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <type_traits>
+
+#if defined(__GNUC__)
+#define RVSS_THREADED_COMPUTED_GOTO 1
+#endif
+
+namespace {
+
+/// True when a basic block ends with this entry, whatever follows it.
+bool EndsBlock(ThreadedHandler handler) {
+  switch (handler) {
+    case ThreadedHandler::kBeq:
+    case ThreadedHandler::kBne:
+    case ThreadedHandler::kBlt:
+    case ThreadedHandler::kBge:
+    case ThreadedHandler::kBltu:
+    case ThreadedHandler::kBgeu:
+    case ThreadedHandler::kJal:
+    case ThreadedHandler::kJalr:
+    case ThreadedHandler::kGeneric:
+      return true;
+    default:
+      return false;
+  }
+}
+
+} // namespace
+
+RVSSThreadedVM::RVSSThreadedVM() = default;
+
+RVSSThreadedVM::~RVSSThreadedVM() = default;
+
+ThreadedInstruction RVSSThreadedVM::TranslateInstruction(const DecodedInstruction &decoded) const {
+  ThreadedInstruction threaded;
+  threaded.rd = decoded.rd;
+  threaded.rs1 = decoded.rs1;
+  threaded.rs2 = decoded.rs2;
+  threaded.alu_op = decoded.alu_op;
+  threaded.imm = decoded.imm;
+
+  if (decoded.unit != ExecutionUnit::kInteger) {
+    return threaded;
+  }
+
+  const ControlSignals &signals = decoded.signals;
+  const bool plain_alu = signals.reg_write && !signals.branch && !signals.mem_read && !signals.mem_write;
+
+  switch (decoded.opcode) {
+    case 0b0110011: { // R-type
+      if (!plain_alu || signals.alu_src) break;
+      switch (decoded.alu_op) {
+        case alu::AluOp::kAdd: threaded.handler = ThreadedHandler::kAdd; break;
+        case alu::AluOp::kSub: threaded.handler = ThreadedHandler::kSub; break;
+        case alu::AluOp::kAnd: threaded.handler = ThreadedHandler::kAnd; break;
+        case alu::AluOp::kOr: threaded.handler = ThreadedHandler::kOr; break;
+        case alu::AluOp::kXor: threaded.handler = ThreadedHandler::kXor; break;
+        case alu::AluOp::kSll: threaded.handler = ThreadedHandler::kSll; break;
+        case alu::AluOp::kSrl: threaded.handler = ThreadedHandler::kSrl; break;
+        case alu::AluOp::kSra: threaded.handler = ThreadedHandler::kSra; break;
+        case alu::AluOp::kSlt: threaded.handler = ThreadedHandler::kSlt; break;
+        case alu::AluOp::kSltu: threaded.handler = ThreadedHandler::kSltu; break;
+        default: threaded.handler = ThreadedHandler::kAluReg; break;
+      }
+      break;
+    }
+    case 0b0010011: { // I-type
+      if (!plain_alu || !signals.alu_src) break;
+      switch (decoded.alu_op) {
+        case alu::AluOp::kAdd: threaded.handler = ThreadedHandler::kAddi; break;
+        case alu::AluOp::kAnd: threaded.handler = ThreadedHandler::kAndi; break;
+        case alu::AluOp::kOr: threaded.handler = ThreadedHandler::kOri; break;
+        case alu::AluOp::kXor: threaded.handler = ThreadedHandler::kXori; break;
+        case alu::AluOp::kSll: threaded.handler = ThreadedHandler::kSlli; break;
+        case alu::AluOp::kSrl: threaded.handler = ThreadedHandler::kSrli; break;
+        case alu::AluOp::kSra: threaded.handler = ThreadedHandler::kSrai; break;
+        case alu::AluOp::kSlt: threaded.handler = ThreadedHandler::kSlti; break;
+        case alu::AluOp::kSltu: threaded.handler = ThreadedHandler::kSltiu; break;
+        default: threaded.handler = ThreadedHandler::kAluImm; break;
+      }
+      break;
+    }
+    case 0b0000011: { // Load
+      if (!signals.mem_read || !signals.reg_write || !signals.alu_src || signals.mem_write ||
+          signals.branch || decoded.alu_op != alu::AluOp::kAdd) break;
+      switch (decoded.funct3) {
+        case 0b000: threaded.handler = ThreadedHandler::kLb; break;
+        case 0b001: threaded.handler = ThreadedHandler::kLh; break;
+        case 0b010: threaded.handler = ThreadedHandler::kLw; break;
+        case 0b011: threaded.handler = ThreadedHandler::kLd; break;
+        case 0b100: threaded.handler = ThreadedHandler::kLbu; break;
+        case 0b101: threaded.handler = ThreadedHandler::kLhu; break;
+        case 0b110: threaded.handler = ThreadedHandler::kLwu; break;
+        default: break;
+      }
+      break;
+    }
+    case 0b0100011: { // Store
+      if (!signals.mem_write || !signals.alu_src || signals.mem_read || signals.reg_write ||
+          signals.branch || decoded.alu_op != alu::AluOp::kAdd) break;
+      switch (decoded.funct3) {
+        case 0b000: threaded.handler = ThreadedHandler::kSb; break;
+        case 0b001: threaded.handler = ThreadedHandler::kSh; break;
+        case 0b010: threaded.handler = ThreadedHandler::kSw; break;
+        case 0b011: threaded.handler = ThreadedHandler::kSd; break;
+        default: break;
+      }
+      break;
+    }
+    case 0b1100011: { // Branch
+      if (!signals.branch || signals.alu_src || signals.reg_write || signals.mem_read || signals.mem_write) break;
+      switch (decoded.funct3) {
+        case 0b000:
+          if (decoded.alu_op == alu::AluOp::kSub) threaded.handler = ThreadedHandler::kBeq;
+          break;
+        case 0b001:
+          if (decoded.alu_op == alu::AluOp::kSub) threaded.handler = ThreadedHandler::kBne;
+          break;
+        case 0b100:
+          if (decoded.alu_op == alu::AluOp::kSlt) threaded.handler = ThreadedHandler::kBlt;
+          break;
+        case 0b101:
+          if (decoded.alu_op == alu::AluOp::kSlt) threaded.handler = ThreadedHandler::kBge;
+          break;
+        case 0b110:
+          if (decoded.alu_op == alu::AluOp::kSltu) threaded.handler = ThreadedHandler::kBltu;
+          break;
+        case 0b111:
+          if (decoded.alu_op == alu::AluOp::kSltu) threaded.handler = ThreadedHandler::kBgeu;
+          break;
+        default: break;
+      }
+      break;
+    }
+    case 0b1101111: { // JAL
+      if (signals.branch && signals.reg_write && !signals.mem_read && !signals.mem_write) {
+        threaded.handler = ThreadedHandler::kJal;
+      }
+      break;
+    }
+    case 0b1100111: { // JALR
+      if (signals.branch && signals.reg_write && signals.alu_src && !signals.mem_read &&
+          !signals.mem_write && decoded.alu_op == alu::AluOp::kAdd) {
+        threaded.handler = ThreadedHandler::kJalr;
+      }
+      break;
+    }
+    case 0b0110111: // LUI
+    case 0b0010111: { // AUIPC
+      if (!plain_alu) break;
+      // Same value WriteBack/Execute produce from (imm << 12) on a 32-bit immediate.
+      threaded.imm = static_cast<int32_t>(static_cast<uint32_t>(decoded.imm) << 12);
+      threaded.handler = decoded.opcode == 0b0110111 ? ThreadedHandler::kLui : ThreadedHandler::kAuipc;
+      break;
+    }
+    default: break;
+  }
+  return threaded;
+}
+
+void RVSSThreadedVM::BuildThreadedProgram() {
+  const size_t count = decoded_instructions_.size();
+  threaded_program_.assign(count + 1, ThreadedInstruction());
+
+  for (size_t i = 0; i < count; ++i) {
+    threaded_program_[i] = TranslateInstruction(FetchDecoded(i * 4));
+  }
+  threaded_program_[count].handler = ThreadedHandler::kTextEnd;
+  threaded_program_[count].block_length = 0;
+
+  // Walk backwards so each entry knows how far its basic block extends.
+  for (size_t i = count; i-- > 0;) {
+    threaded_program_[i].block_length =
+        EndsBlock(threaded_program_[i].handler) ? 1 : threaded_program_[i + 1].block_length + 1;
+  }
+  block_heat_.assign(count, 0);
+}
+
+void RVSSThreadedVM::RetranslateRange(size_t first, size_t last) {
+  for (size_t i = first; i <= last; ++i) {
+    threaded_program_[i] = TranslateInstruction(FetchDecoded(i * 4));
+    block_heat_[i] = 0;
+  }
+  // Entries back to the previous block end run into the retranslated ones, so their block
+  // lengths change and a block given up as untranslatable may translate now.
+  for (size_t i = last + 1; i-- > 0;) {
+    ThreadedInstruction &entry = threaded_program_[i];
+    const bool ends_block = EndsBlock(entry.handler);
+    if (i < first && ends_block) {
+      break;
+    }
+    entry.block_length = ends_block ? 1 : threaded_program_[i + 1].block_length + 1;
+    if (block_heat_[i] == UINT32_MAX) {
+      block_heat_[i] = 0;
+    }
+  }
+}
+
+void RVSSThreadedVM::SyncThreadedProgram() {
+  const size_t count = decoded_instructions_.size();
+  if (threaded_program_.size() != count + 1 || dirty_first_ > dirty_last_ || dirty_last_ >= count) {
+    BuildThreadedProgram();
+  } else {
+    RetranslateRange(dirty_first_, dirty_last_);
+  }
+  threaded_generation_ = text_write_generation_;
+  dirty_first_ = UINT64_MAX;
+  dirty_last_ = 0;
+}
+
+void RVSSThreadedVM::OnTextModified(uint64_t address, uint64_t size) {
+  const uint64_t last = size > UINT64_MAX - address ? UINT64_MAX : address + size - 1;
+  dirty_first_ = std::min(dirty_first_, address / 4);
+  dirty_last_ = std::max(dirty_last_, last / 4);
+  if (jit_) {
+    jit_->InvalidateRange(address, size);
+  }
+}
+
+uint64_t RVSSThreadedVM::RunTranslated(uint64_t &pc, uint64_t budget) {
+  if (!jit_->Available()) {
+    return 0; // went offline during this run, see RVSSJit::InvalidateRange
+  }
+  const uint8_t *code = jit_->Lookup(pc);
+  if (!code) {
+    uint32_t &heat = block_heat_[pc / 4];
+    if (heat == UINT32_MAX || ++heat < vm_config::config.getJitHotThreshold()) {
+      return 0;
+    }
+    code = jit_->Translate(pc, threaded_program_);
+    if (!code) {
+      heat = UINT32_MAX; // nothing translatable here, stop counting
+      return 0;
+    }
+  }
+
+  JitContext context;
+  context.budget = budget;
+  context.gpr = registers_.GprData();
+  context.stop_flag = &stop_byte_;
+  context.branch_flag = &branch_flag_;
+  context.vm = this;
+  pc = jit_->Execute(code, context);
+  return budget - context.budget;
+}
+
+bool RVSSThreadedVM::ExecuteGeneric() {
+  return StepInstruction<FastRunPolicy>();
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+void RVSSThreadedVM::Run() {
+  if (branch_predictor_ || memory_controller_.HasCaches()) {
+    // Predictor-only mode has to see every branch resolve, and the caches every fetch and
+    // every miss penalty, which the interpreter reports.
+    RVSSVM::Run();
+    return;
+  }
+  ClearStop();
+  const uint64_t limit = vm_config::config.getInstructionExecutionLimit();
+  uint64_t instruction_executed = 0;
+
+  if (threaded_program_.size() != decoded_instructions_.size() + 1 ||
+      threaded_generation_ != text_write_generation_) {
+    SyncThreadedProgram();
+  }
+  if (vm_config::config.getJitEnabled() && !jit_) {
+    jit_ = std::make_unique<RVSSJit>(vm_config::config.getJitCodeCacheSize());
+  }
+  const bool jit_active = vm_config::config.getJitEnabled() && jit_->Available();
+  FloatEnvironmentScope fp_scope(*this);
+
+  uint64_t *gpr = registers_.GprData();
+  const uint64_t text_instructions = decoded_instructions_.size();
+  const uint64_t text_end = text_instructions * 4;
+  uint64_t pc = program_counter_;
+  const ThreadedInstruction *entry = nullptr;
+  const ThreadedInstruction *block_start = nullptr;
+
+#ifdef RVSS_THREADED_COMPUTED_GOTO
+  // Must stay in ThreadedHandler order.
+  static void *const dispatch_table[] = {
+    &&label_kAdd, &&label_kSub, &&label_kAnd, &&label_kOr, &&label_kXor,
+    &&label_kSll, &&label_kSrl, &&label_kSra, &&label_kSlt, &&label_kSltu, &&label_kAluReg,
+    &&label_kAddi, &&label_kAndi, &&label_kOri, &&label_kXori,
+    &&label_kSlli, &&label_kSrli, &&label_kSrai, &&label_kSlti, &&label_kSltiu, &&label_kAluImm,
+    &&label_kLb, &&label_kLh, &&label_kLw, &&label_kLd, &&label_kLbu, &&label_kLhu, &&label_kLwu,
+    &&label_kSb, &&label_kSh, &&label_kSw, &&label_kSd,
+    &&label_kBeq, &&label_kBne, &&label_kBlt, &&label_kBge, &&label_kBltu, &&label_kBgeu,
+    &&label_kJal, &&label_kJalr, &&label_kLui, &&label_kAuipc,
+    &&label_kGeneric,
+    &&label_kTextEnd,
+  };
+  static_assert(sizeof(dispatch_table) / sizeof(dispatch_table[0]) ==
+                static_cast<size_t>(ThreadedHandler::kCount));
+#define DISPATCH() goto *dispatch_table[static_cast<size_t>(entry->handler)]
+#define HANDLER(name) label_##name
+#else
+#define DISPATCH() goto dispatch
+#define HANDLER(name) case ThreadedHandler::name
+#endif
+
+#define WRITE_RD(value) do { uint64_t result_ = (value); if (entry->rd != 0) gpr[entry->rd] = result_; } while (0)
+#define NEXT() do { pc += 4; ++entry; DISPATCH(); } while (0)
+#define END_BLOCK() do { \
+    uint64_t retired_ = static_cast<uint64_t>(entry - block_start) + 1; \
+    instructions_retired_ += retired_; \
+    cycle_s_ += retired_; \
+    instruction_executed += retired_; \
+    goto block_entry; \
+  } while (0)
+// The current instruction did not retire: account for the ones before it and continue wherever it went.
+#define ABANDON_BLOCK() do { \
+    uint64_t retired_ = static_cast<uint64_t>(entry - block_start); \
+    instructions_retired_ += retired_; \
+    cycle_s_ += retired_; \
+    instruction_executed += retired_; \
+    pc = program_counter_; \
+    goto block_entry; \
+  } while (0)
+#define TRAP(cause) do { \
+    RaiseTrap(cause, pc, address_); \
+    trap_raised_ = false; \
+    ABANDON_BLOCK(); \
+  } while (0)
+#define STORE(type, value) do { \
+    uint64_t address_ = gpr[entry->rs1] + static_cast<uint64_t>(entry->imm); \
+    if (!memory_controller_.TryWrite<type>(address_, static_cast<type>(value))) { \
+      TRAP(TrapCause::kStoreAccessFault); \
+    } \
+    if (address_ < text_end) { \
+      InvalidateDecodedRange(address_, sizeof(type)); \
+      pc += 4; \
+      END_BLOCK(); \
+    } \
+    NEXT(); \
+  } while (0)
+#define LOAD(type) do { \
+    uint64_t address_ = gpr[entry->rs1] + static_cast<uint64_t>(entry->imm); \
+    std::make_unsigned_t<type> value_ = 0; \
+    if (!memory_controller_.TryRead(address_, value_)) { \
+      TRAP(TrapCause::kLoadAccessFault); \
+    } \
+    memory_result_ = static_cast<type>(value_); \
+    WRITE_RD(static_cast<uint64_t>(memory_result_)); \
+    NEXT(); \
+  } while (0)
+#define BRANCH(condition) do { \
+    branch_flag_ = (condition); \
+    pc = branch_flag_ ? pc + static_cast<uint64_t>(entry->imm) : pc + 4; \
+    END_BLOCK(); \
+  } while (0)
+
+block_entry:
+  program_counter_ = pc;
+  if (stop_requested_ || pc >= program_size_ || instruction_executed > limit) {
+    goto done;
+  }
+  if (threaded_generation_ != text_write_generation_) {
+    SyncThreadedProgram();
+  }
+  if (jit_active && pc % 4 == 0 && pc / 4 < text_instructions) {
+    uint64_t remaining = limit - instruction_executed;
+    uint64_t retired = RunTranslated(pc, remaining == UINT64_MAX ? remaining : remaining + 1);
+    if (retired != 0) {
+      instructions_retired_ += retired;
+      cycle_s_ += retired;
+      instruction_executed += retired;
+      goto block_entry;
+    }
+  }
+  if (pc % 4 != 0 || pc / 4 >= text_instructions ||
+      threaded_program_[pc / 4].block_length - 1 > limit - instruction_executed) {
+    // Not enough budget left for the whole block (or an odd PC): take a single instruction slowly.
+    if (ExecuteGeneric()) {
+      instructions_retired_++;
+      cycle_s_++;
+      instruction_executed++;
+    }
+    pc = program_counter_;
+    goto block_entry;
+  }
+  entry = threaded_program_.data() + pc / 4;
+  block_start = entry;
+  DISPATCH();
+
+#ifndef RVSS_THREADED_COMPUTED_GOTO
+dispatch:
+  switch (entry->handler) {
+#endif
+
+  HANDLER(kAdd): WRITE_RD(gpr[entry->rs1] + gpr[entry->rs2]); NEXT();
+  HANDLER(kSub): WRITE_RD(gpr[entry->rs1] - gpr[entry->rs2]); NEXT();
+  HANDLER(kAnd): WRITE_RD(gpr[entry->rs1] & gpr[entry->rs2]); NEXT();
+  HANDLER(kOr): WRITE_RD(gpr[entry->rs1] | gpr[entry->rs2]); NEXT();
+  HANDLER(kXor): WRITE_RD(gpr[entry->rs1] ^ gpr[entry->rs2]); NEXT();
+  HANDLER(kSll): WRITE_RD(gpr[entry->rs1] << (gpr[entry->rs2] & 63)); NEXT();
+  HANDLER(kSrl): WRITE_RD(gpr[entry->rs1] >> (gpr[entry->rs2] & 63)); NEXT();
+  HANDLER(kSra):
+    WRITE_RD(static_cast<uint64_t>(static_cast<int64_t>(gpr[entry->rs1]) >> (gpr[entry->rs2] & 63)));
+    NEXT();
+  HANDLER(kSlt):
+    WRITE_RD(static_cast<uint64_t>(static_cast<int64_t>(gpr[entry->rs1]) < static_cast<int64_t>(gpr[entry->rs2])));
+    NEXT();
+  HANDLER(kSltu): WRITE_RD(static_cast<uint64_t>(gpr[entry->rs1] < gpr[entry->rs2])); NEXT();
+  HANDLER(kAluReg): WRITE_RD(alu::Alu::execute(entry->alu_op, gpr[entry->rs1], gpr[entry->rs2]).first); NEXT();
+
+  HANDLER(kAddi): WRITE_RD(gpr[entry->rs1] + static_cast<uint64_t>(entry->imm)); NEXT();
+  HANDLER(kAndi): WRITE_RD(gpr[entry->rs1] & static_cast<uint64_t>(entry->imm)); NEXT();
+  HANDLER(kOri): WRITE_RD(gpr[entry->rs1] | static_cast<uint64_t>(entry->imm)); NEXT();
+  HANDLER(kXori): WRITE_RD(gpr[entry->rs1] ^ static_cast<uint64_t>(entry->imm)); NEXT();
+  HANDLER(kSlli): WRITE_RD(gpr[entry->rs1] << (entry->imm & 63)); NEXT();
+  HANDLER(kSrli): WRITE_RD(gpr[entry->rs1] >> (entry->imm & 63)); NEXT();
+  HANDLER(kSrai):
+    WRITE_RD(static_cast<uint64_t>(static_cast<int64_t>(gpr[entry->rs1]) >> (entry->imm & 63)));
+    NEXT();
+  HANDLER(kSlti): WRITE_RD(static_cast<uint64_t>(static_cast<int64_t>(gpr[entry->rs1]) < entry->imm)); NEXT();
+  HANDLER(kSltiu): WRITE_RD(static_cast<uint64_t>(gpr[entry->rs1] < static_cast<uint64_t>(entry->imm))); NEXT();
+  HANDLER(kAluImm):
+    WRITE_RD(alu::Alu::execute(entry->alu_op, gpr[entry->rs1], static_cast<uint64_t>(entry->imm)).first);
+    NEXT();
+
+  HANDLER(kLb): LOAD(int8_t);
+  HANDLER(kLh): LOAD(int16_t);
+  HANDLER(kLw): LOAD(int32_t);
+  HANDLER(kLd): LOAD(int64_t);
+  HANDLER(kLbu): LOAD(uint8_t);
+  HANDLER(kLhu): LOAD(uint16_t);
+  HANDLER(kLwu): LOAD(uint32_t);
+
+  HANDLER(kSb): STORE(uint8_t, gpr[entry->rs2]);
+  HANDLER(kSh): STORE(uint16_t, gpr[entry->rs2]);
+  HANDLER(kSw): STORE(uint32_t, gpr[entry->rs2]);
+  HANDLER(kSd): STORE(uint64_t, gpr[entry->rs2]);
+
+  HANDLER(kBeq): BRANCH(gpr[entry->rs1] == gpr[entry->rs2]);
+  HANDLER(kBne): BRANCH(gpr[entry->rs1] != gpr[entry->rs2]);
+  HANDLER(kBlt): BRANCH(static_cast<int64_t>(gpr[entry->rs1]) < static_cast<int64_t>(gpr[entry->rs2]));
+  HANDLER(kBge): BRANCH(!(static_cast<int64_t>(gpr[entry->rs1]) < static_cast<int64_t>(gpr[entry->rs2])));
+  HANDLER(kBltu): BRANCH(gpr[entry->rs1] < gpr[entry->rs2]);
+  HANDLER(kBgeu): BRANCH(!(gpr[entry->rs1] < gpr[entry->rs2]));
+
+  HANDLER(kJal): {
+    uint64_t link = pc + 4;
+    pc += static_cast<uint64_t>(entry->imm);
+    WRITE_RD(link);
+    END_BLOCK();
+  }
+  HANDLER(kJalr): {
+    uint64_t link = pc + 4;
+    pc = gpr[entry->rs1] + static_cast<uint64_t>(entry->imm);
+    WRITE_RD(link);
+    END_BLOCK();
+  }
+  HANDLER(kLui): WRITE_RD(static_cast<uint64_t>(entry->imm)); NEXT();
+  HANDLER(kAuipc): WRITE_RD(pc + static_cast<uint64_t>(entry->imm)); NEXT();
+
+  HANDLER(kGeneric): {
+    program_counter_ = pc;
+    if (!ExecuteGeneric()) {
+      ABANDON_BLOCK();
+    }
+    pc = program_counter_;
+    END_BLOCK();
+  }
+
+  HANDLER(kTextEnd): {
+    // Fell through the last instruction; the sentinel itself is not retired.
+    --entry;
+    END_BLOCK();
+  }
+
+#ifndef RVSS_THREADED_COMPUTED_GOTO
+    default: goto done;
+  }
+#endif
+
+#undef BRANCH
+#undef LOAD
+#undef STORE
+#undef TRAP
+#undef ABANDON_BLOCK
+#undef END_BLOCK
+#undef NEXT
+#undef WRITE_RD
+#undef HANDLER
+#undef DISPATCH
+
+done:
+  fp_scope.Close();
+  program_counter_ = pc;
+  if (program_counter_ >= program_size_) {
+    std::cout << "VM_PROGRAM_END" << std::endl;
+    output_status_ = "VM_PROGRAM_END";
+  }
+  DumpRegisters(globals::registers_dump_file_path, registers_);
+  DumpState(globals::vm_state_dump_file_path);
+}
+
+#pragma GCC diagnostic pop
@@ -36,82 +36,281 @@ RVSSVM::RVSSVM() : VmBase() {
 
 RVSSVM::~RVSSVM() = default;
 
+DecodedInstruction RVSSVM::DecodeInstruction(uint32_t instruction) {
+  DecodedInstruction decoded = VmBase::DecodeInstruction(instruction);
+
+  // Resolve signals on a scratch unit so predecoding never disturbs the live one.
+  RVSSControlUnit decoder;
+  decoder.SetControlSignals(instruction);
+  decoded.signals = decoder.GetControlSignals();
+  if (decoded.unit == ExecutionUnit::kInteger ||
+      decoded.unit == ExecutionUnit::kFloat ||
+      decoded.unit == ExecutionUnit::kDouble) {
+    decoded.alu_op = decoder.GetAluSignal(instruction, decoder.GetAluOp());
+  }
+  return decoded;
+}
+
 void RVSSVM::Fetch() {
-  current_instruction_ = memory_controller_.ReadWord(program_counter_);
+  memory_controller_.SetAccessContext(program_counter_, cycle_s_);
+  memory_controller_.AccessInstructionCache(program_counter_);
+  current_decoded_ = FetchDecoded(program_counter_);
+  current_instruction_ = current_decoded_.instruction;
   UpdateProgramCounter(4);
 }
 
 void RVSSVM::Decode() {
-  control_unit_.SetControlSignals(current_instruction_);
+  control_unit_.LoadControlSignals(current_decoded_.signals);
 }
 
-void RVSSVM::Execute() {
-  uint8_t opcode = current_instruction_ & 0b1111111;
-  uint8_t funct3 = (current_instruction_ >> 12) & 0b111;
+namespace {
 
-  if (opcode == get_instr_encoding(Instruction::kecall).opcode && 
-      funct3 == get_instr_encoding(Instruction::kecall).funct3) {
-    HandleSyscall();
-    return;
+bool IsPlainAlu(const DecodedInstruction &decoded) {
+  const ControlSignals &signals = decoded.signals;
+  return decoded.unit == ExecutionUnit::kInteger &&
+         signals.reg_write && !signals.branch && !signals.mem_read && !signals.mem_write;
+}
+
+bool IsAddi(const DecodedInstruction &decoded) {
+  return decoded.opcode == 0b0010011 && IsPlainAlu(decoded) && decoded.signals.alu_src &&
+         decoded.alu_op == alu::AluOp::kAdd;
+}
+
+bool IsLoad(const DecodedInstruction &decoded) {
+  const ControlSignals &signals = decoded.signals;
+  return decoded.opcode == 0b0000011 && decoded.unit == ExecutionUnit::kInteger && decoded.funct3 != 0b111 &&
+         signals.mem_read && signals.reg_write && signals.alu_src && !signals.mem_write && !signals.branch &&
+         decoded.alu_op == alu::AluOp::kAdd;
+}
+
+bool IsJalr(const DecodedInstruction &decoded) {
+  const ControlSignals &signals = decoded.signals;
+  return decoded.opcode == 0b1100111 && decoded.unit == ExecutionUnit::kInteger &&
+         signals.branch && signals.reg_write && signals.alu_src && !signals.mem_read && !signals.mem_write &&
+         decoded.alu_op == alu::AluOp::kAdd;
+}
+
+bool IsBranch(const DecodedInstruction &decoded) {
+  const ControlSignals &signals = decoded.signals;
+  if (decoded.opcode != 0b1100011 || decoded.unit != ExecutionUnit::kInteger || !signals.branch ||
+      signals.alu_src || signals.reg_write || signals.mem_read || signals.mem_write) {
+    return false;
+  }
+  switch (decoded.funct3) {
+    case 0b000: case 0b001: return decoded.alu_op == alu::AluOp::kSub;
+    case 0b100: case 0b101: return decoded.alu_op == alu::AluOp::kSlt;
+    case 0b110: case 0b111: return decoded.alu_op == alu::AluOp::kSltu;
+    default: return false;
   }
+}
 
-  if (instruction_set::isFInstruction(current_instruction_)) { // RV64 F
-    ExecuteFloat();
-    return;
-  } else if (instruction_set::isDInstruction(current_instruction_)) {
-    ExecuteDouble();
-    return;
-  } else if (opcode==0b1110011) {
-    ExecuteCsr();
-    return;
+bool IsSetLessThan(const DecodedInstruction &decoded) {
+  if (!IsPlainAlu(decoded) || (decoded.alu_op != alu::AluOp::kSlt && decoded.alu_op != alu::AluOp::kSltu)) {
+    return false;
+  }
+  return (decoded.opcode == 0b0010011 && decoded.signals.alu_src) ||
+         (decoded.opcode == 0b0110011 && !decoded.signals.alu_src);
+}
+
+} // namespace
+
+FusedPair RVSSVM::ClassifyFusion(const DecodedInstruction &first, const DecodedInstruction &second) const {
+  // Only pairs whose first half writes a register the second one reads.
+  if (!IsPlainAlu(first) || first.rd == 0) {
+    return FusedPair::kNone;
   }
+  const uint8_t rd = first.rd;
 
+  switch (first.opcode) {
+    case 0b0110111: // LUI
+      if (IsAddi(second) && second.rs1 == rd) return FusedPair::kLuiAddi;
+      break;
+    case 0b0010111: // AUIPC
+      if (second.rs1 != rd) break;
+      if (IsAddi(second)) return FusedPair::kAuipcAddi;
+      if (IsLoad(second)) return FusedPair::kAuipcLoad;
+      if (IsJalr(second)) return FusedPair::kAuipcJalr;
+      break;
+    default:
+      if (IsSetLessThan(first) && IsBranch(second) && second.funct3 <= 0b001 &&
+          ((second.rs1 == rd && second.rs2 == 0) || (second.rs1 == 0 && second.rs2 == rd))) {
+        return FusedPair::kSetBranch;
+      }
+      if (IsAddi(first) && first.rs1 == rd && IsBranch(second) && (second.rs1 == rd || second.rs2 == rd)) {
+        return FusedPair::kAddiBranch;
+      }
+      break;
+  }
+  return FusedPair::kNone;
+}
 
+const DecodedInstruction *RVSSVM::FusedPairAt(uint64_t address) const {
+  const uint64_t index = address / 4;
+  if (address % 4 != 0 || index + 1 >= decoded_instructions_.size()) {
+    return nullptr;
+  }
+  const DecodedInstruction &first = decoded_instructions_[index];
+  if (!first.valid || first.fusion == FusedPair::kNone || !decoded_instructions_[index + 1].valid) {
+    return nullptr;
+  }
+  return &first;
+}
+
+bool RVSSVM::LoadMemory(uint8_t funct3, uint64_t address) {
+  bool loaded = false;
+  switch (funct3) {
+    case 0b000: { uint8_t v = 0; loaded = memory_controller_.TryRead(address, v); memory_result_ = static_cast<int8_t>(v); break; }   // LB
+    case 0b001: { uint16_t v = 0; loaded = memory_controller_.TryRead(address, v); memory_result_ = static_cast<int16_t>(v); break; } // LH
+    case 0b010: { uint32_t v = 0; loaded = memory_controller_.TryRead(address, v); memory_result_ = static_cast<int32_t>(v); break; } // LW
+    case 0b011: { uint64_t v = 0; loaded = memory_controller_.TryRead(address, v); memory_result_ = static_cast<int64_t>(v); break; } // LD
+    case 0b100: { uint8_t v = 0; loaded = memory_controller_.TryRead(address, v); memory_result_ = v; break; }  // LBU
+    case 0b101: { uint16_t v = 0; loaded = memory_controller_.TryRead(address, v); memory_result_ = v; break; } // LHU
+    case 0b110: { uint32_t v = 0; loaded = memory_controller_.TryRead(address, v); memory_result_ = v; break; } // LWU
+    default: return true;
+  }
+  if (!loaded) {
+    RaiseTrap(TrapCause::kLoadAccessFault, program_counter_ - 4, address);
+  }
+  return loaded;
+}
+
+bool RVSSVM::ExecuteFusedPair(const DecodedInstruction &first) {
+  const uint64_t pc = program_counter_;
+  const DecodedInstruction &second = decoded_instructions_[pc / 4 + 1];
+  memory_controller_.SetAccessContext(pc, cycle_s_);
+  memory_controller_.AccessInstructionCache(pc);
+  memory_controller_.SetAccessContext(pc + 4, cycle_s_);
+  memory_controller_.AccessInstructionCache(pc + 4);
+  // Same value Execute/WriteBack derive from (imm << 12) on the 32-bit immediate.
+  const auto upper = static_cast<int64_t>(static_cast<int32_t>(static_cast<uint32_t>(first.imm) << 12));
+
+  uint64_t first_value = 0;
+  switch (first.opcode) {
+    case 0b0110111: first_value = static_cast<uint64_t>(upper); break;       // LUI
+    case 0b0010111: first_value = pc + static_cast<uint64_t>(upper); break;  // AUIPC
+    default: {
+      uint64_t operand = first.signals.alu_src ? static_cast<uint64_t>(static_cast<int64_t>(first.imm))
+                                               : registers_.ReadGpr(first.rs2);
+      first_value = static_cast<uint64_t>(alu_.execute(first.alu_op, registers_.ReadGpr(first.rs1), operand).first);
+      break;
+    }
+  }
+  registers_.WriteGpr(first.rd, first_value);
+
+  current_decoded_ = second;
+  current_instruction_ = second.instruction;
+  control_unit_.LoadControlSignals(second.signals);
+  program_counter_ = pc + 4;
+
+  const uint64_t reg1_value = registers_.ReadGpr(second.rs1);
+  const auto imm = static_cast<int64_t>(second.imm);
+  switch (first.fusion) {
+    case FusedPair::kLuiAddi:
+    case FusedPair::kAuipcAddi: {
+      execution_result_ = static_cast<int64_t>(reg1_value + imm);
+      registers_.WriteGpr(second.rd, execution_result_);
+      program_counter_ += 4;
+      break;
+    }
+    case FusedPair::kAuipcLoad: {
+      execution_result_ = static_cast<int64_t>(reg1_value + imm);
+      program_counter_ += 4; // as after Fetch, so a fault reports the load itself
+      if (!LoadMemory(second.funct3, execution_result_)) {
+        trap_raised_ = false;
+        return false;
+      }
+      registers_.WriteGpr(second.rd, memory_result_);
+      break;
+    }
+    case FusedPair::kAuipcJalr: {
+      execution_result_ = static_cast<int64_t>(reg1_value + imm);
+      next_pc_ = static_cast<int64_t>(program_counter_ + 4);
+      return_address_ = program_counter_ + 4;
+      program_counter_ = execution_result_;
+      registers_.WriteGpr(second.rd, next_pc_);
+      break;
+    }
+    case FusedPair::kSetBranch:
+    case FusedPair::kAddiBranch: {
+      execution_result_ = alu_.execute(second.alu_op, reg1_value, registers_.ReadGpr(second.rs2)).first;
+      // Same flag Execute derives from the ALU result: sub for beq/bne, slt(u) for the rest.
+      switch (second.funct3) {
+        case 0b001: case 0b100: case 0b110: branch_flag_ = execution_result_ != 0; break;
+        default: branch_flag_ = execution_result_ == 0; break;
+      }
+      if (branch_predictor_) {
+        ObserveBranch(program_counter_, program_counter_ + imm, branch_flag_);
+      }
+      program_counter_ += branch_flag_ ? imm : 4;
+      break;
+    }
+    case FusedPair::kNone: break;
+  }
+  return true;
+}
+
+template <typename Policy>
+void RVSSVM::Execute() {
+  switch (current_decoded_.unit) {
+    case ExecutionUnit::kSyscall: {
+      HandleSyscall<Policy>();
+      return;
+    }
+    case ExecutionUnit::kFloat: { // RV64 F
+      ExecuteFloat();
+      return;
+    }
+    case ExecutionUnit::kDouble: {
+      ExecuteDouble();
+      return;
+    }
+    case ExecutionUnit::kCsr: {
+      ExecuteCsr();
+      return;
+    }
+    default: break;
+  }
 
-  uint8_t rs1 = (current_instruction_ >> 15) & 0b11111;
-  uint8_t rs2 = (current_instruction_ >> 20) & 0b11111;
+  uint8_t opcode = current_decoded_.opcode;
+  uint8_t funct3 = current_decoded_.funct3;
+  uint8_t rs1 = current_decoded_.rs1;
+  uint8_t rs2 = current_decoded_.rs2;
 
-  int32_t imm = ImmGenerator(current_instruction_);
+  int32_t imm = current_decoded_.imm;
 
   uint64_t reg1_value = registers_.ReadGpr(rs1);
   uint64_t reg2_value = registers_.ReadGpr(rs2);
 
   bool overflow = false;
-  // DEBUG: print current instruction fields
-{
-  uint8_t opcode_dbg = current_instruction_ & 0x7F;
-  uint8_t funct3_dbg = (current_instruction_ >> 12) & 0x7;
-  uint8_t rs1_dbg = (current_instruction_ >> 15) & 0x1F;
-  uint8_t rs2_dbg = (current_instruction_ >> 20) & 0x1F;
-  int32_t imm_dbg = ImmGenerator(current_instruction_);
-  std::cout << "[DBG Execute] pc=0x" << std::hex << program_counter_ - 4
-            << " instr=0x" << current_instruction_
-            << " opcode=" << std::dec << (int)opcode_dbg
-            << " funct3=" << (int)funct3_dbg
-            << " rs1=x" << (int)rs1_dbg
-            << " rs2=x" << (int)rs2_dbg
-            << " imm=" << std::dec << imm_dbg
-            << " reg1=0x" << std::hex << reg1_value
-            << " reg2=0x" << reg2_value
-            << std::endl;
-}
+  if constexpr (Policy::kTrace) {
+    std::cout << "[DBG Execute] pc=0x" << std::hex << program_counter_ - 4
+              << " instr=0x" << current_instruction_
+              << " opcode=" << std::dec << (int)opcode
+              << " funct3=" << (int)funct3
+              << " rs1=x" << (int)rs1
+              << " rs2=x" << (int)rs2
+              << " imm=" << std::dec << imm
+              << " reg1=0x" << std::hex << reg1_value
+              << " reg2=0x" << reg2_value
+              << std::endl;
+  }
 
 
-  if(opcode == get_instr_encoding(Instruction::kldbm).opcode){
+  if (current_decoded_.unit == ExecutionUnit::kLdbm) {
     uint64_t addr_A = reg1_value;
     uint64_t addr_B = reg2_value;
 
     const size_t chunkSize = 512; // matches bigmul cache size in header
     std::vector<uint8_t> bufA(chunkSize), bufB(chunkSize);
-    for (size_t i = 0; i < chunkSize; ++i) {
-      bufA[i] = memory_controller_.ReadByte(addr_A + i);
-      bufB[i] = memory_controller_.ReadByte(addr_B + i);
+    memory_controller_.ReadBlock(addr_A, bufA);
+    memory_controller_.ReadBlock(addr_B, bufB);
+    if constexpr (Policy::kTrace) {
+      std::cout << "[DBG ldbm] addrA=0x" << std::hex << addr_A << " addrB=0x" << addr_B << " bufA[0..7]=";
+      for (int i=0;i<8;i++) std::cout << std::hex << (int)bufA[i] << " ";
+      std::cout << " bufB[0..7]=";
+      for (int i=0;i<8;i++) std::cout << std::hex << (int)bufB[i] << " ";
+      std::cout << std::endl;
     }
-    std::cout << "[DBG ldbm] addrA=0x" << std::hex << addr_A << " addrB=0x" << addr_B << " bufA[0..7]=";
-for (int i=0;i<8;i++) std::cout << std::hex << (int)bufA[i] << " ";
-std::cout << " bufB[0..7]=";
-for (int i=0;i<8;i++) std::cout << std::hex << (int)bufB[i] << " ";
-std::cout << std::endl;
 
     // call into bigmul unit to load caches from buffers
     bigmul_unit::loadDatafrombuffer(bufA, bufB);
@@ -119,22 +318,28 @@ std::cout << std::endl;
     // LDBM is a memory-stage operation — stop further ALU execution for this inst.
     return;
   }
-   std::cout << "BIGMUL opcode: " 
-              << (int)get_instr_encoding(Instruction::kbigmul).opcode 
+  if constexpr (Policy::kTrace) {
+    std::cout << "BIGMUL opcode: "
+              << (int)get_instr_encoding(Instruction::kbigmul).opcode
               << std::endl;
-  if (opcode == get_instr_encoding(Instruction::kbigmul).opcode) {
-    std::cerr << "[BIGMUL] Executing multiplication\n";
+  }
+  if (current_decoded_.unit == ExecutionUnit::kBigmul) {
+    if constexpr (Policy::kTrace) {
+      std::cerr << "[BIGMUL] Executing multiplication\n";
+    }
     // BIGMUL: compute using accelerator (bypass ALU) and schedule a memory write at rs1+imm
     uint64_t target_addr = reg1_value + static_cast<int64_t>(imm);
     // run the accelerator once; it will fill bigmul_unit::resultCache and record result length
     bigmul_unit::executeBigmul();
-    size_t dbg_len = bigmul_unit::getResultSize();
-std::cout << "[DBG bigmul exec] target_addr=0x" << std::hex << target_addr
-          << " resultLen=" << std::dec << dbg_len << " result[0..7]=";
-for (size_t i=0; i < std::min<size_t>(dbg_len, 8); ++i) {
-  std::cout << std::hex << (int)bigmul_unit::resultCache[i] << " ";
-}
-std::cout << std::endl;
+    if constexpr (Policy::kTrace) {
+      size_t dbg_len = bigmul_unit::getResultSize();
+      std::cout << "[DBG bigmul exec] target_addr=0x" << std::hex << target_addr
+                << " resultLen=" << std::dec << dbg_len << " result[0..7]=";
+      for (size_t i=0; i < std::min<size_t>(dbg_len, 8); ++i) {
+        std::cout << std::hex << (int)bigmul_unit::resultCache[i] << " ";
+      }
+      std::cout << std::endl;
+    }
 
     execution_result_ = target_addr;
     return;
@@ -144,8 +349,7 @@ std::cout << std::endl;
     reg2_value = static_cast<uint64_t>(static_cast<int64_t>(imm));
   }
 
-  alu::AluOp aluOperation = control_unit_.GetAluSignal(current_instruction_, control_unit_.GetAluOp());
-  std::tie(execution_result_, overflow) = alu_.execute(aluOperation, reg1_value, reg2_value);
+  std::tie(execution_result_, overflow) = alu_.execute(current_decoded_.alu_op, reg1_value, reg2_value);
 
 
   if (control_unit_.GetBranch()) {
@@ -198,7 +402,11 @@ std::cout << std::endl;
 
   }
 
-  
+
+  if (branch_predictor_ && opcode==0b1100011) {
+    uint64_t branch_pc = program_counter_ - 4;
+    ObserveBranch(branch_pc, branch_pc + imm, branch_flag_);
+  }
   if (branch_flag_ && opcode==0b1100011) {
     UpdateProgramCounter(-4);
     UpdateProgramCounter(imm);
@@ -212,20 +420,22 @@ std::cout << std::endl;
 }
 
 void RVSSVM::ExecuteFloat() {
-  uint8_t opcode = current_instruction_ & 0b1111111;
-  uint8_t funct3 = (current_instruction_ >> 12) & 0b111;
-  uint8_t funct7 = (current_instruction_ >> 25) & 0b1111111;
-  uint8_t rm = funct3;
-  uint8_t rs1 = (current_instruction_ >> 15) & 0b11111;
-  uint8_t rs2 = (current_instruction_ >> 20) & 0b11111;
-  uint8_t rs3 = (current_instruction_ >> 27) & 0b11111;
+  uint8_t opcode = current_decoded_.opcode;
+  uint8_t funct7 = current_decoded_.funct7;
+  uint8_t rm = current_decoded_.funct3;
+  uint8_t rs1 = current_decoded_.rs1;
+  uint8_t rs2 = current_decoded_.rs2;
+  uint8_t rs3 = current_decoded_.rs3;
 
   uint8_t fcsr_status = 0;
 
-  int32_t imm = ImmGenerator(current_instruction_);
+  int32_t imm = current_decoded_.imm;
 
-  if (rm==0b111) {
-    rm = registers_.ReadCsr(0x002);
+  if (alu::UsesRoundingMode(current_decoded_.alu_op)) {
+    if (rm==0b111) {
+      rm = registers_.ReadCsr(0x002);
+    }
+    fp_env_.SetRoundingMode(rm);
   }
 
   uint64_t reg1_value = registers_.ReadFpr(rs1);
@@ -240,27 +450,32 @@ void RVSSVM::ExecuteFloat() {
     reg2_value = static_cast<uint64_t>(static_cast<int64_t>(imm));
   }
 
-  alu::AluOp aluOperation = control_unit_.GetAluSignal(current_instruction_, control_unit_.GetAluOp());
-  std::tie(execution_result_, fcsr_status) = alu::Alu::fpexecute(aluOperation, reg1_value, reg2_value, reg3_value, rm);
+  std::tie(execution_result_, fcsr_status) = alu::Alu::fpcompute(current_decoded_.alu_op, reg1_value, reg2_value, reg3_value);
 
   // std::cout << "+++++ Float execution result: " << execution_result_ << std::endl;
 
-
-  registers_.WriteCsr(0x003, fcsr_status);
+  // host-raised flags stay in the host status word until fflags is read
+  fp_env_.Raise(fcsr_status);
 }
 
 void RVSSVM::ExecuteDouble() {
-  uint8_t opcode = current_instruction_ & 0b1111111;
-  uint8_t funct3 = (current_instruction_ >> 12) & 0b111;
-  uint8_t funct7 = (current_instruction_ >> 25) & 0b1111111;
-  uint8_t rm = funct3;
-  uint8_t rs1 = (current_instruction_ >> 15) & 0b11111;
-  uint8_t rs2 = (current_instruction_ >> 20) & 0b11111;
-  uint8_t rs3 = (current_instruction_ >> 27) & 0b11111;
+  uint8_t opcode = current_decoded_.opcode;
+  uint8_t funct7 = current_decoded_.funct7;
+  uint8_t rm = current_decoded_.funct3;
+  uint8_t rs1 = current_decoded_.rs1;
+  uint8_t rs2 = current_decoded_.rs2;
+  uint8_t rs3 = current_decoded_.rs3;
 
   uint8_t fcsr_status = 0;
 
-  int32_t imm = ImmGenerator(current_instruction_);
+  int32_t imm = current_decoded_.imm;
+
+  if (alu::UsesRoundingMode(current_decoded_.alu_op)) {
+    if (rm==0b111) {
+      rm = registers_.ReadCsr(0x002);
+    }
+    fp_env_.SetRoundingMode(rm);
+  }
 
   uint64_t reg1_value = registers_.ReadFpr(rs1);
   uint64_t reg2_value = registers_.ReadFpr(rs2);
@@ -274,13 +489,16 @@ void RVSSVM::ExecuteDouble() {
     reg2_value = static_cast<uint64_t>(static_cast<int64_t>(imm));
   }
 
-  alu::AluOp aluOperation = control_unit_.GetAluSignal(current_instruction_, control_unit_.GetAluOp());
-  std::tie(execution_result_, fcsr_status) = alu::Alu::dfpexecute(aluOperation, reg1_value, reg2_value, reg3_value, rm);
+  std::tie(execution_result_, fcsr_status) = alu::Alu::dfpcompute(current_decoded_.alu_op, reg1_value, reg2_value, reg3_value);
+  fp_env_.Raise(fcsr_status);
 }
 
 void RVSSVM::ExecuteCsr() {
-  uint8_t rs1 = (current_instruction_ >> 15) & 0b11111;
-  uint16_t csr = (current_instruction_ >> 20) & 0xFFF;
+  uint8_t rs1 = current_decoded_.rs1;
+  uint16_t csr = (current_decoded_.instruction >> 20) & 0xFFF;
+  if (csr==0x001 || csr==0x003) {
+    SyncFloatCsrs();
+  }
   uint64_t csr_val = registers_.ReadCsr(csr);
 
   csr_target_address_ = csr;
@@ -290,8 +508,11 @@ void RVSSVM::ExecuteCsr() {
 }
 
 // TODO: implement writeback for syscalls
+template <typename Policy>
 void RVSSVM::HandleSyscall() {
   uint64_t syscall_number = registers_.ReadGpr(17);
+  // host formatting of float and double output must not round in the guest's mode
+  LeaveFloatEnvironment();
   switch (syscall_number) {
     case SYSCALL_PRINT_INT: {
         if (!globals::vm_as_backend) {
@@ -352,7 +573,7 @@ void RVSSVM::HandleSyscall() {
         break;
     }
     case SYSCALL_EXIT: {
-        stop_requested_ = true; // Stop the VM
+        RequestStop();
         if (!globals::vm_as_backend) {
             std::cout << "VM_EXIT" << std::endl;
         }
@@ -384,36 +605,39 @@ void RVSSVM::HandleSyscall() {
         }
 
 
-        std::vector<uint8_t> old_bytes_vec(length, 0);
-        std::vector<uint8_t> new_bytes_vec(length, 0);
+        std::vector<uint8_t> old_bytes_vec;
+        std::vector<uint8_t> new_bytes_vec;
 
-        for (size_t i = 0; i < length; ++i) {
-          old_bytes_vec[i] = memory_controller_.ReadByte(buffer_address + i);
+        if constexpr (Policy::kRecordUndo) {
+          old_bytes_vec.resize(length);
+          memory_controller_.ReadBlock(buffer_address, old_bytes_vec);
         }
         
-        for (size_t i = 0; i < input.size() && i < length; ++i) {
-          memory_controller_.WriteByte(buffer_address + i, static_cast<uint8_t>(input[i]));
-        }
+        // The input cut to length, then a terminator if there is room for one.
+        std::vector<uint8_t> bytes(input.begin(), input.begin() + static_cast<long>(std::min<uint64_t>(input.size(), length)));
         if (input.size() < length) {
-          memory_controller_.WriteByte(buffer_address + input.size(), '\0');
+          bytes.push_back('\0');
         }
+        memory_controller_.WriteBlock(buffer_address, bytes);
+        InvalidateDecodedRange(buffer_address, length);
 
-        for (size_t i = 0; i < length; ++i) {
-          new_bytes_vec[i] = memory_controller_.ReadByte(buffer_address + i);
-        }
+        if constexpr (Policy::kRecordUndo) {
+          new_bytes_vec.resize(length);
+          memory_controller_.ReadBlock(buffer_address, new_bytes_vec);
 
-        current_delta_.memory_changes.push_back({
-          buffer_address, 
-          old_bytes_vec, 
-          new_bytes_vec
-        });
+          current_delta_.memory_changes.push_back({
+            buffer_address,
+            old_bytes_vec,
+            new_bytes_vec
+          });
+        }
 
         uint64_t old_reg = registers_.ReadGpr(10);
         unsigned int reg_index = 10;
         unsigned int reg_type = 0; // 0 for GPR, 1 for CSR, 2 for FPR
         uint64_t new_reg = std::min(static_cast<uint64_t>(length), static_cast<uint64_t>(input.size()));
         registers_.WriteGpr(10, new_reg); 
-        if (old_reg != new_reg) {
+        if (Policy::kRecordUndo && old_reg != new_reg) {
           current_delta_.register_changes.push_back({reg_index, reg_type, old_reg, new_reg});
         }
 
@@ -430,15 +654,7 @@ void RVSSVM::HandleSyscall() {
         if (file_descriptor == 1) { // stdout
           std::cout << "VM_STDOUT_START";
           output_status_ = "VM_STDOUT_START";
-          uint64_t bytes_printed = 0;
-          for (uint64_t i = 0; i < length; ++i) {
-              char c = memory_controller_.ReadByte(buffer_address + i);
-              // if (c == '\0') {
-              //     break;
-              // }
-              std::cout << c;
-              bytes_printed++;
-          }
+          uint64_t bytes_printed = PrintBytes(buffer_address, length);
           std::cout << std::flush; 
           output_status_ = "VM_STDOUT_END";
           std::cout << "VM_STDOUT_END" << std::endl;
@@ -448,7 +664,7 @@ void RVSSVM::HandleSyscall() {
           unsigned int reg_type = 0; // 0 for GPR, 1 for CSR, 2 for FPR
           uint64_t new_reg = std::min(static_cast<uint64_t>(length), bytes_printed);
           registers_.WriteGpr(10, new_reg);
-          if (old_reg != new_reg) {
+          if (Policy::kRecordUndo && old_reg != new_reg) {
             current_delta_.register_changes.push_back({reg_index, reg_type, old_reg, new_reg});
           }
         } else {
@@ -461,56 +677,31 @@ void RVSSVM::HandleSyscall() {
       break;
     }
   }
+  EnterFloatEnvironment();
 }
 
+template <typename Policy>
 void RVSSVM::WriteMemory() {
-  uint8_t opcode = current_instruction_ & 0b1111111;
-  uint8_t rs2 = (current_instruction_ >> 20) & 0b11111;
-  uint8_t funct3 = (current_instruction_ >> 12) & 0b111;
-
-  if (opcode == 0b1110011 && funct3 == 0b000) {
-    return;
-  }
+  uint8_t rs2 = current_decoded_.rs2;
+  uint8_t funct3 = current_decoded_.funct3;
 
-  if (instruction_set::isFInstruction(current_instruction_)) { // RV64 F
-    WriteMemoryFloat();
-    return;
-  } else if (instruction_set::isDInstruction(current_instruction_)) {
-    WriteMemoryDouble();
-    return;
+  switch (current_decoded_.unit) {
+    case ExecutionUnit::kSyscall: {
+      return;
+    }
+    case ExecutionUnit::kFloat: { // RV64 F
+      WriteMemoryFloat<Policy>();
+      return;
+    }
+    case ExecutionUnit::kDouble: {
+      WriteMemoryDouble<Policy>();
+      return;
+    }
+    default: break;
   }
 
   if (control_unit_.GetMemRead()) {
-    switch (funct3) {
-      case 0b000: {// LB
-        memory_result_ = static_cast<int8_t>(memory_controller_.ReadByte(execution_result_));
-        break;
-      }
-      case 0b001: {// LH
-        memory_result_ = static_cast<int16_t>(memory_controller_.ReadHalfWord(execution_result_));
-        break;
-      }
-      case 0b010: {// LW
-        memory_result_ = static_cast<int32_t>(memory_controller_.ReadWord(execution_result_));
-        break;
-      }
-      case 0b011: {// LD
-        memory_result_ = memory_controller_.ReadDoubleWord(execution_result_);
-        break;
-      }
-      case 0b100: {// LBU
-        memory_result_ = static_cast<uint8_t>(memory_controller_.ReadByte(execution_result_));
-        break;
-      }
-      case 0b101: {// LHU
-        memory_result_ = static_cast<uint16_t>(memory_controller_.ReadHalfWord(execution_result_));
-        break;
-      }
-      case 0b110: {// LWU
-        memory_result_ = static_cast<uint32_t>(memory_controller_.ReadWord(execution_result_));
-        break;
-      }
-    }
+    LoadMemory(funct3, execution_result_);
   }
 
   uint64_t addr = 0;
@@ -521,74 +712,77 @@ void RVSSVM::WriteMemory() {
 
 
   if (control_unit_.GetMemWrite()) {
-    if (opcode == get_instr_encoding(Instruction::kbigmul).opcode) {
+    if (current_decoded_.unit == ExecutionUnit::kBigmul) {
       addr = execution_result_;
-      old_bytes_vec.clear();
-      new_bytes_vec.clear();
       size_t resultLen = bigmul_unit::getResultSize();
-      // read old bytes
-      for (size_t i = 0; i < resultLen; ++i) {
-        old_bytes_vec.push_back(memory_controller_.ReadByte(addr + i));
+      if constexpr (Policy::kRecordUndo) {
+        // read old bytes
+        old_bytes_vec.resize(resultLen);
+        memory_controller_.ReadBlock(addr, old_bytes_vec);
       }
       // write result bytes from bigmul_unit::resultCache
-      for (size_t i = 0; i < resultLen; ++i) {
-        memory_controller_.WriteByte(addr + i, bigmul_unit::resultCache[i]);
-      }
-      // read new bytes
-      for (size_t i = 0; i < resultLen; ++i) {
-        new_bytes_vec.push_back(memory_controller_.ReadByte(addr + i));
+      memory_controller_.WriteBlock(addr, std::span(bigmul_unit::resultCache, resultLen));
+      InvalidateDecodedRange(addr, resultLen);
+      if constexpr (Policy::kRecordUndo) {
+        // read new bytes
+        new_bytes_vec.resize(resultLen);
+        memory_controller_.ReadBlock(addr, new_bytes_vec);
+        if (old_bytes_vec != new_bytes_vec) {
+          current_delta_.memory_changes.push_back({addr, old_bytes_vec, new_bytes_vec});
+        }
       }
-      if (old_bytes_vec != new_bytes_vec) {
-        current_delta_.memory_changes.push_back({addr, old_bytes_vec, new_bytes_vec});
+      if constexpr (Policy::kTrace) {
+        std::cout << "[DBG bigmul write] addr=0x" << std::hex << addr << " wrote " << std::dec << resultLen << " bytes: ";
+        for (size_t i=0;i<resultLen;i++) std::cout << std::hex << (int)memory_controller_.ReadByte(addr + i) << " ";
+        std::cout << std::endl;
       }
-      std::cout << "[DBG bigmul write] addr=0x" << std::hex << addr << " wrote " << std::dec << resultLen << " bytes: ";
-for (size_t i=0;i<resultLen;i++) std::cout << std::hex << (int)memory_controller_.ReadByte(addr + i) << " ";
-std::cout << std::endl;
       bigmul_unit::invalidateCaches();
       return;
     }
+
+    addr = execution_result_;
+    size_t width = 0;
+    switch (funct3) {
+      case 0b000: width = 1; break; // SB
+      case 0b001: width = 2; break; // SH
+      case 0b010: width = 4; break; // SW
+      case 0b011: width = 8; break; // SD
+      default: break;
+    }
+    if constexpr (Policy::kRecordUndo) {
+      if (memory_controller_.InBounds(addr, width)) {
+        old_bytes_vec.resize(width);
+        memory_controller_.ReadBlock(addr, old_bytes_vec);
+      }
+    }
+    bool stored = true;
     switch (funct3) {
       case 0b000: {// SB
-        addr = execution_result_;
-        old_bytes_vec.push_back(memory_controller_.ReadByte(addr));
-        memory_controller_.WriteByte(execution_result_, registers_.ReadGpr(rs2) & 0xFF);
-        new_bytes_vec.push_back(memory_controller_.ReadByte(addr));
+        stored = memory_controller_.TryWrite<uint8_t>(addr, registers_.ReadGpr(rs2) & 0xFF);
         break;
       }
       case 0b001: {// SH
-        addr = execution_result_;
-        for (size_t i = 0; i < 2; ++i) {
-          old_bytes_vec.push_back(memory_controller_.ReadByte(addr + i));
-        }
-        memory_controller_.WriteHalfWord(execution_result_, registers_.ReadGpr(rs2) & 0xFFFF);
-        for (size_t i = 0; i < 2; ++i) {
-          new_bytes_vec.push_back(memory_controller_.ReadByte(addr + i));
-        }
+        stored = memory_controller_.TryWrite<uint16_t>(addr, registers_.ReadGpr(rs2) & 0xFFFF);
         break;
       }
       case 0b010: {// SW
-        addr = execution_result_;
-        for (size_t i = 0; i < 4; ++i) {
-          old_bytes_vec.push_back(memory_controller_.ReadByte(addr + i));
-        }
-        memory_controller_.WriteWord(execution_result_, registers_.ReadGpr(rs2) & 0xFFFFFFFF);
-        for (size_t i = 0; i < 4; ++i) {
-          new_bytes_vec.push_back(memory_controller_.ReadByte(addr + i));
-        }
+        stored = memory_controller_.TryWrite<uint32_t>(addr, registers_.ReadGpr(rs2) & 0xFFFFFFFF);
         break;
       }
       case 0b011: {// SD
-        addr = execution_result_;
-        for (size_t i = 0; i < 8; ++i) {
-          old_bytes_vec.push_back(memory_controller_.ReadByte(addr + i));
-        }
-        memory_controller_.WriteDoubleWord(execution_result_, registers_.ReadGpr(rs2) & 0xFFFFFFFFFFFFFFFF);
-        for (size_t i = 0; i < 8; ++i) {
-          new_bytes_vec.push_back(memory_controller_.ReadByte(addr + i));
-        }
+        stored = memory_controller_.TryWrite<uint64_t>(addr, registers_.ReadGpr(rs2) & 0xFFFFFFFFFFFFFFFF);
         break;
       }
     }
+    if (!stored) {
+      RaiseTrap(TrapCause::kStoreAccessFault, program_counter_ - 4, addr);
+      return;
+    }
+    InvalidateDecodedRange(addr, width);
+    if constexpr (Policy::kRecordUndo) {
+      new_bytes_vec.resize(width);
+      memory_controller_.ReadBlock(addr, new_bytes_vec);
+    }
   }
 
   if (old_bytes_vec != new_bytes_vec) {
@@ -600,11 +794,12 @@ std::cout << std::endl;
   }
 }
 
+template <typename Policy>
 void RVSSVM::WriteMemoryFloat() {
-  uint8_t rs2 = (current_instruction_ >> 20) & 0b11111;
+  uint8_t rs2 = current_decoded_.rs2;
 
   if (control_unit_.GetMemRead()) { // FLW
-    memory_result_ = memory_controller_.ReadWord(execution_result_);
+    LoadMemory(0b110, execution_result_);
   }
 
   // std::cout << "+++++ Memory result: " << memory_result_ << std::endl;
@@ -615,14 +810,21 @@ void RVSSVM::WriteMemoryFloat() {
 
   if (control_unit_.GetMemWrite()) { // FSW
     addr = execution_result_;
-    for (size_t i = 0; i < 4; ++i) {
-      old_bytes_vec.push_back(memory_controller_.ReadByte(addr + i));
+    if constexpr (Policy::kRecordUndo) {
+      if (memory_controller_.InBounds(addr, 4)) {
+        old_bytes_vec.resize(4);
+        memory_controller_.ReadBlock(addr, old_bytes_vec);
+      }
     }
     uint32_t val = registers_.ReadFpr(rs2) & 0xFFFFFFFF;
-    memory_controller_.WriteWord(execution_result_, val);
-    // new_bytes_vec.push_back(memory_controller_.ReadByte(addr));
-    for (size_t i = 0; i < 4; ++i) {
-      new_bytes_vec.push_back(memory_controller_.ReadByte(addr + i));
+    if (!memory_controller_.TryWrite<uint32_t>(addr, val)) {
+      RaiseTrap(TrapCause::kStoreAccessFault, program_counter_ - 4, addr);
+      return;
+    }
+    InvalidateDecodedRange(addr, 4);
+    if constexpr (Policy::kRecordUndo) {
+      new_bytes_vec.resize(4);
+      memory_controller_.ReadBlock(addr, new_bytes_vec);
     }
   }
 
@@ -631,11 +833,12 @@ void RVSSVM::WriteMemoryFloat() {
   }
 }
 
+template <typename Policy>
 void RVSSVM::WriteMemoryDouble() {
-  uint8_t rs2 = (current_instruction_ >> 20) & 0b11111;
+  uint8_t rs2 = current_decoded_.rs2;
 
   if (control_unit_.GetMemRead()) {// FLD
-    memory_result_ = memory_controller_.ReadDoubleWord(execution_result_);
+    LoadMemory(0b011, execution_result_);
   }
 
   uint64_t addr = 0;
@@ -644,12 +847,20 @@ void RVSSVM::WriteMemoryDouble() {
 
   if (control_unit_.GetMemWrite()) {// FSD
     addr = execution_result_;
-    for (size_t i = 0; i < 8; ++i) {
-      old_bytes_vec.push_back(memory_controller_.ReadByte(addr + i));
+    if constexpr (Policy::kRecordUndo) {
+      if (memory_controller_.InBounds(addr, 8)) {
+        old_bytes_vec.resize(8);
+        memory_controller_.ReadBlock(addr, old_bytes_vec);
+      }
+    }
+    if (!memory_controller_.TryWrite<uint64_t>(addr, registers_.ReadFpr(rs2))) {
+      RaiseTrap(TrapCause::kStoreAccessFault, program_counter_ - 4, addr);
+      return;
     }
-    memory_controller_.WriteDoubleWord(execution_result_, registers_.ReadFpr(rs2));
-    for (size_t i = 0; i < 8; ++i) {
-      new_bytes_vec.push_back(memory_controller_.ReadByte(addr + i));
+    InvalidateDecodedRange(addr, 8);
+    if constexpr (Policy::kRecordUndo) {
+      new_bytes_vec.resize(8);
+      memory_controller_.ReadBlock(addr, new_bytes_vec);
     }
   }
 
@@ -658,29 +869,32 @@ void RVSSVM::WriteMemoryDouble() {
   }
 }
 
+template <typename Policy>
 void RVSSVM::WriteBack() {
-  uint8_t opcode = current_instruction_ & 0b1111111;
-  uint8_t funct3 = (current_instruction_ >> 12) & 0b111;
-  uint8_t rd = (current_instruction_ >> 7) & 0b11111;
-  int32_t imm = ImmGenerator(current_instruction_);
-
-  if (opcode == get_instr_encoding(Instruction::kecall).opcode && 
-      funct3 == get_instr_encoding(Instruction::kecall).funct3) { // ecall
-    return;
-  }
+  uint8_t opcode = current_decoded_.opcode;
+  uint8_t rd = current_decoded_.rd;
+  int32_t imm = current_decoded_.imm;
 
-  if (instruction_set::isFInstruction(current_instruction_)) { // RV64 F
-    WriteBackFloat();
-    return;
-  } else if (instruction_set::isDInstruction(current_instruction_)) {
-    WriteBackDouble();
-    return;
-  } else if (opcode==0b1110011) { // CSR opcode
-    WriteBackCsr();
-    return;
+  switch (current_decoded_.unit) {
+    case ExecutionUnit::kSyscall: { // ecall
+      return;
+    }
+    case ExecutionUnit::kFloat: { // RV64 F
+      WriteBackFloat<Policy>();
+      return;
+    }
+    case ExecutionUnit::kDouble: {
+      WriteBackDouble<Policy>();
+      return;
+    }
+    case ExecutionUnit::kCsr: {
+      WriteBackCsr();
+      return;
+    }
+    default: break;
   }
 
-  uint64_t old_reg = registers_.ReadGpr(rd);
+  uint64_t old_reg = Policy::kRecordUndo ? registers_.ReadGpr(rd) : 0;
   unsigned int reg_index = rd;
   unsigned int reg_type = 0; // 0 for GPR, 1 for CSR, 2 for FPR
 
@@ -718,17 +932,18 @@ void RVSSVM::WriteBack() {
     // Updated in Execute()
   }
 
-  uint64_t new_reg = registers_.ReadGpr(rd);
-  if (old_reg!=new_reg) {
+  uint64_t new_reg = Policy::kRecordUndo ? registers_.ReadGpr(rd) : 0;
+  if (Policy::kRecordUndo && old_reg!=new_reg) {
     current_delta_.register_changes.push_back({reg_index, reg_type, old_reg, new_reg});
   }
 
 }
 
+template <typename Policy>
 void RVSSVM::WriteBackFloat() {
-  uint8_t opcode = current_instruction_ & 0b1111111;
-  uint8_t funct7 = (current_instruction_ >> 25) & 0b1111111;
-  uint8_t rd = (current_instruction_ >> 7) & 0b11111;
+  uint8_t opcode = current_decoded_.opcode;
+  uint8_t funct7 = current_decoded_.funct7;
+  uint8_t rd = current_decoded_.rd;
 
   uint64_t old_reg = 0;
   unsigned int reg_index = rd;
@@ -795,15 +1010,16 @@ void RVSSVM::WriteBackFloat() {
     // }
   }
 
-  if (old_reg!=new_reg) {
+  if (Policy::kRecordUndo && old_reg!=new_reg) {
     current_delta_.register_changes.push_back({reg_index, reg_type, old_reg, new_reg});
   }
 }
 
+template <typename Policy>
 void RVSSVM::WriteBackDouble() {
-  uint8_t opcode = current_instruction_ & 0b1111111;
-  uint8_t funct7 = (current_instruction_ >> 25) & 0b1111111;
-  uint8_t rd = (current_instruction_ >> 7) & 0b11111;
+  uint8_t opcode = current_decoded_.opcode;
+  uint8_t funct7 = current_decoded_.funct7;
+  uint8_t rd = current_decoded_.rd;
 
   uint64_t old_reg = 0;
   unsigned int reg_index = rd;
@@ -834,7 +1050,7 @@ void RVSSVM::WriteBackDouble() {
     }
   }
 
-  if (old_reg!=new_reg) {
+  if (Policy::kRecordUndo && old_reg!=new_reg) {
     current_delta_.register_changes.push_back({reg_index, reg_type, old_reg, new_reg});
   }
 
@@ -842,8 +1058,8 @@ void RVSSVM::WriteBackDouble() {
 }
 
 void RVSSVM::WriteBackCsr() {
-  uint8_t rd = (current_instruction_ >> 7) & 0b11111;
-  uint8_t funct3 = (current_instruction_ >> 12) & 0b111;
+  uint8_t rd = current_decoded_.rd;
+  uint8_t funct3 = current_decoded_.funct3;
 
   switch (funct3) {
     case get_instr_encoding(Instruction::kcsrrw).funct3: { // CSRRW
@@ -886,81 +1102,133 @@ void RVSSVM::WriteBackCsr() {
     }
   }
 
+  if (csr_target_address_>=0x001 && csr_target_address_<=0x003) {
+    OnFloatCsrWritten(csr_target_address_);
+  }
 }
 
-void RVSSVM::Run() {
-  ClearStop();
-  uint64_t instruction_executed = 0;
-
-  while (!stop_requested_ && program_counter_ < program_size_) {
-    if (instruction_executed > vm_config::config.getInstructionExecutionLimit())
-      break;
-
-    //Custom
-    if(stall_flag_) continue;
-
-    Fetch();
-    Decode();
-    Execute();
-    WriteMemory();
-    WriteBack();
-    instructions_retired_++;
-    instruction_executed++;
-    cycle_s_++;
-    std::cout << "Program Counter: " << program_counter_ << std::endl;
+template <typename Policy>
+bool RVSSVM::StepInstruction() {
+  if constexpr (Policy::kRecordUndo) {
+    current_delta_.old_pc = program_counter_;
   }
-  if (program_counter_ >= program_size_) {
-    std::cout << "VM_PROGRAM_END" << std::endl;
-    output_status_ = "VM_PROGRAM_END";
+  const uint64_t penalty_before = memory_controller_.MissPenaltyCycles();
+  Fetch();
+  Decode();
+  Execute<Policy>();
+  WriteMemory<Policy>();
+  const uint64_t penalty = memory_controller_.MissPenaltyCycles() - penalty_before;
+  cycle_s_ += penalty;
+  const bool trapped = trap_raised_;
+  if (trapped) {
+    // The faulting access changed nothing itself, but taking the trap wrote the trap CSRs
+    // and moved the PC, so undo still has something to put back.
+    trap_raised_ = false;
+    if constexpr (Policy::kRecordUndo) {
+      current_delta_.instructions = 0;
+      current_delta_.register_changes.insert(current_delta_.register_changes.end(),
+                                             trap_csr_changes_.begin(), trap_csr_changes_.end());
+    }
+  } else {
+    WriteBack<Policy>();
   }
-  DumpRegisters(globals::registers_dump_file_path, registers_);
-  DumpState(globals::vm_state_dump_file_path);
+  if constexpr (Policy::kRecordUndo) {
+    current_delta_.penalty_cycles = penalty;
+    current_delta_.new_pc = program_counter_;
+    // history_.push(current_delta_);
+    undo_stack_.push(current_delta_);
+    while (!redo_stack_.empty()) {
+      redo_stack_.pop();
+    }
+    current_delta_ = StepDelta();
+  }
+  return !trapped;
 }
 
-void RVSSVM::DebugRun() {
+template <typename Policy>
+void RVSSVM::RunLoop() {
   ClearStop();
   uint64_t instruction_executed = 0;
-  while (!stop_requested_ && program_counter_ < program_size_) {
-    if (instruction_executed > vm_config::config.getInstructionExecutionLimit())
-      break;
-    current_delta_.old_pc = program_counter_;
-    if (std::find(breakpoints_.begin(), breakpoints_.end(), program_counter_) == breakpoints_.end()) {
-      Fetch();
-      Decode();
-      Execute();
-      WriteMemory();
-      WriteBack();
+
+  // With per-run stats the counters are only published on the way out, exceptions included.
+  auto publish_stats = [&]() {
+    if constexpr (Policy::kStats == StatsGranularity::kPerRun) {
+      instructions_retired_ += instruction_executed;
+      cycle_s_ += instruction_executed;
+    }
+  };
+  auto retire = [&]() {
+    instruction_executed++;
+    if constexpr (Policy::kStats == StatsGranularity::kPerInstruction) {
       instructions_retired_++;
-      instruction_executed++;
       cycle_s_++;
-      std::cout << "Program Counter: " << program_counter_ << std::endl;
+    }
+  };
 
-      current_delta_.new_pc = program_counter_;
-      // history_.push(current_delta_);
-      undo_stack_.push(current_delta_);
-      while (!redo_stack_.empty()) {
-        redo_stack_.pop();
+  try {
+    FloatEnvironmentScope fp_scope(*this);
+    while (!stop_requested_ && program_counter_ < program_size_) {
+      if (instruction_executed > vm_config::config.getInstructionExecutionLimit())
+        break;
+      if constexpr (Policy::kCheckBreakpoints) {
+        if (CheckBreakpoint(program_counter_)) {
+          std::cout << "VM_BREAKPOINT_HIT " << program_counter_ << std::endl;
+          output_status_ = "VM_BREAKPOINT_HIT";
+          break;
+        }
       }
-      current_delta_ = StepDelta();
-      if (program_counter_ < program_size_) {
-        std::cout << "VM_STEP_COMPLETED" << std::endl;
-        output_status_ = "VM_STEP_COMPLETED";
-      } else if (program_counter_ >= program_size_) {
-        std::cout << "VM_LAST_INSTRUCTION_STEPPED" << std::endl;
-        output_status_ = "VM_LAST_INSTRUCTION_STEPPED";
+
+      //Custom
+      if(stall_flag_) continue;
+
+      if constexpr (Policy::kFuse) {
+        // Both halves have to fit under the execution limit.
+        if (instruction_executed < vm_config::config.getInstructionExecutionLimit()) {
+          if (const DecodedInstruction *first = FusedPairAt(program_counter_)) {
+            const uint64_t penalty_before = memory_controller_.MissPenaltyCycles();
+            retire(); // the first half has retired before the second can fault
+            if (ExecuteFusedPair(*first)) {
+              retire();
+              fused_pairs_++;
+            }
+            cycle_s_ += memory_controller_.MissPenaltyCycles() - penalty_before;
+            continue;
+          }
+        }
       }
-      DumpRegisters(globals::registers_dump_file_path, registers_);
-      DumpState(globals::vm_state_dump_file_path);
 
-      unsigned int delay_ms = vm_config::config.getRunStepDelay();
-      std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
-      
-    } else {
-      std::cout << "VM_BREAKPOINT_HIT " << program_counter_ << std::endl;
-      output_status_ = "VM_BREAKPOINT_HIT";
-      break;
+      if (StepInstruction<Policy>()) {
+        retire();
+      }
+      if constexpr (Policy::kTrace) {
+        std::cout << "Program Counter: " << program_counter_ << std::endl;
+      }
+
+      if constexpr (Policy::kDumpEachStep) {
+        if (trap_.halted) {
+          // RaiseTrap has reported VM_TRAP
+        } else if (program_counter_ < program_size_) {
+          std::cout << "VM_STEP_COMPLETED" << std::endl;
+          output_status_ = "VM_STEP_COMPLETED";
+        } else if (program_counter_ >= program_size_) {
+          std::cout << "VM_LAST_INSTRUCTION_STEPPED" << std::endl;
+          output_status_ = "VM_LAST_INSTRUCTION_STEPPED";
+        }
+        LeaveFloatEnvironment();
+        DumpRegisters(globals::registers_dump_file_path, registers_);
+        DumpState(globals::vm_state_dump_file_path);
+
+        unsigned int delay_ms = vm_config::config.getRunStepDelay();
+        std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+        EnterFloatEnvironment();
+      }
     }
+  } catch (...) {
+    publish_stats();
+    throw;
   }
+  publish_stats();
+
   if (program_counter_ >= program_size_) {
     std::cout << "VM_PROGRAM_END" << std::endl;
     output_status_ = "VM_PROGRAM_END";
@@ -969,31 +1237,31 @@ void RVSSVM::DebugRun() {
   DumpState(globals::vm_state_dump_file_path);
 }
 
-void RVSSVM::Step() {
-  current_delta_.old_pc = program_counter_;
-  if (program_counter_ < program_size_) {
-    Fetch();
-    Decode();
-    Execute();
-    WriteMemory();
-    WriteBack();
-    instructions_retired_++;
-    cycle_s_++;
-    std::cout << "Program Counter: " << std::hex << program_counter_ << std::dec << std::endl;
-
-    current_delta_.new_pc = program_counter_;
+void RVSSVM::Run() {
+  RunLoop<FastRunPolicy>();
+}
 
-    // history_.push(current_delta_);
+void RVSSVM::DebugRun() {
+  RunLoop<DebugRunPolicy>();
+}
 
-    undo_stack_.push(current_delta_);
-    while (!redo_stack_.empty()) {
-      redo_stack_.pop();
+void RVSSVM::Step() {
+  trap_.halted = false;
+  if (program_counter_ < program_size_) {
+    bool retired = false;
+    {
+      FloatEnvironmentScope fp_scope(*this);
+      retired = StepInstruction<DebugRunPolicy>();
     }
+    if (retired) {
+      instructions_retired_++;
+      cycle_s_++;
+    }
+    std::cout << "Program Counter: " << std::hex << program_counter_ << std::dec << std::endl;
 
-    current_delta_ = StepDelta();
-
-
-    if (program_counter_ < program_size_) {
+    if (trap_.halted) {
+      // RaiseTrap has reported VM_TRAP
+    } else if (program_counter_ < program_size_) {
       std::cout << "VM_STEP_COMPLETED" << std::endl;
       output_status_ = "VM_STEP_COMPLETED";
     } else if (program_counter_ >= program_size_) {
@@ -1009,6 +1277,87 @@ void RVSSVM::Step() {
   DumpState(globals::vm_state_dump_file_path);
 }
 
+namespace {
+
+/// Folds next into batch so that undoing batch undoes both. Registers keep their
+/// oldest old value; memory changes stay in order and are undone back to front.
+void MergeStepDelta(StepDelta &batch, StepDelta &&next) {
+  batch.new_pc = next.new_pc;
+  batch.instructions += next.instructions;
+  batch.penalty_cycles += next.penalty_cycles;
+  for (const auto &change : next.register_changes) {
+    auto it = std::find_if(batch.register_changes.begin(), batch.register_changes.end(),
+                           [&](const RegisterChange &existing) {
+                             return existing.reg_type == change.reg_type && existing.reg_index == change.reg_index;
+                           });
+    if (it == batch.register_changes.end()) {
+      batch.register_changes.push_back(change);
+    } else {
+      it->new_value = change.new_value;
+    }
+  }
+  for (auto &change : next.memory_changes) {
+    batch.memory_changes.push_back(std::move(change));
+  }
+}
+
+} // namespace
+
+void RVSSVM::StepN(uint64_t count) {
+  trap_.halted = false;
+  ClearStop();
+  const bool coalesce =
+      vm_config::config.getStepUndoGranularity() == vm_config::StepUndoGranularity::BATCH;
+  bool breakpoint_hit = false;
+  bool stepped = false;
+  StepDelta batch;
+  batch.old_pc = program_counter_;
+  batch.instructions = 0;
+
+  {
+    FloatEnvironmentScope fp_scope(*this);
+    for (uint64_t i = 0; i < count && program_counter_ < program_size_ && !stop_requested_; ++i) {
+      // The breakpoint the step starts on has already been reported, step off it.
+      if (i > 0 && CheckBreakpoint(program_counter_)) {
+        std::cout << "VM_BREAKPOINT_HIT " << program_counter_ << std::endl;
+        output_status_ = "VM_BREAKPOINT_HIT";
+        breakpoint_hit = true;
+        break;
+      }
+      // A step that traps does not retire, but still leaves a delta for taking the trap.
+      const bool retired = StepInstruction<StepBatchPolicy>();
+      stepped = true;
+      if (retired) {
+        instructions_retired_++;
+        cycle_s_++;
+      }
+      if (coalesce) {
+        MergeStepDelta(batch, std::move(undo_stack_.top()));
+        undo_stack_.pop();
+      }
+      if (!retired && trap_.halted) {
+        break;
+      }
+    }
+  }
+  if (coalesce && stepped) {
+    undo_stack_.push(std::move(batch));
+  }
+  std::cout << "Program Counter: " << std::hex << program_counter_ << std::dec << std::endl;
+
+  if (trap_.halted || breakpoint_hit) {
+    // RaiseTrap or the loop has reported the reason
+  } else if (program_counter_ < program_size_) {
+    std::cout << "VM_STEP_COMPLETED" << std::endl;
+    output_status_ = "VM_STEP_COMPLETED";
+  } else {
+    std::cout << "VM_LAST_INSTRUCTION_STEPPED" << std::endl;
+    output_status_ = "VM_LAST_INSTRUCTION_STEPPED";
+  }
+  DumpRegisters(globals::registers_dump_file_path, registers_);
+  DumpState(globals::vm_state_dump_file_path);
+}
+
 void RVSSVM::Undo() {
   if (undo_stack_.empty()) {
     std::cout << "VM_NO_MORE_UNDO" << std::endl;
@@ -1026,7 +1375,8 @@ void RVSSVM::Undo() {
 
   // StepDelta last = history_.undo();
 
-  for (const auto &change : last.register_changes) {
+  for (auto change_it = last.register_changes.rbegin(); change_it != last.register_changes.rend(); ++change_it) {
+    const RegisterChange &change = *change_it;
     switch (change.reg_type) {
       case 0: { // GPR
         registers_.WriteGpr(change.reg_index, change.old_value);
@@ -1045,15 +1395,15 @@ void RVSSVM::Undo() {
     }
   }
 
-  for (const auto &change : last.memory_changes) {
-    for (size_t i = 0; i < change.old_bytes_vec.size(); ++i) {
-      memory_controller_.WriteByte(change.address + i, change.old_bytes_vec[i]);
-    }
+  for (auto change_it = last.memory_changes.rbegin(); change_it != last.memory_changes.rend(); ++change_it) {
+    const MemoryChange &change = *change_it;
+    memory_controller_.WriteBlock(change.address, change.old_bytes_vec);
+    InvalidateDecodedRange(change.address, change.old_bytes_vec.size());
   }
 
   program_counter_ = last.old_pc;
-  instructions_retired_--;
-  cycle_s_--;
+  instructions_retired_ -= last.instructions;
+  cycle_s_ -= last.instructions + last.penalty_cycles;
   std::cout << "Program Counter: " << program_counter_ << std::endl;
 
   redo_stack_.push(last);
@@ -1101,14 +1451,13 @@ void RVSSVM::Redo() {
   }
 
   for (const auto &change : next.memory_changes) {
-    for (size_t i = 0; i < change.new_bytes_vec.size(); ++i) {
-      memory_controller_.WriteByte(change.address + i, change.new_bytes_vec[i]);
-    }
+    memory_controller_.WriteBlock(change.address, change.new_bytes_vec);
+    InvalidateDecodedRange(change.address, change.new_bytes_vec.size());
   }
 
   program_counter_ = next.new_pc;
-  instructions_retired_++;
-  cycle_s_++;
+  instructions_retired_ += next.instructions;
+  cycle_s_ += next.instructions + next.penalty_cycles;
   DumpRegisters(globals::registers_dump_file_path, registers_);
   DumpState(globals::vm_state_dump_file_path);
   std::cout << "Program Counter: " << program_counter_ << std::endl;
@@ -1120,7 +1469,16 @@ void RVSSVM::Reset() {
   program_counter_ = 0;
   instructions_retired_ = 0;
   cycle_s_ = 0;
+  fused_pairs_ = 0;
+  branch_predictions_ = 0;
+  branch_mispredictions_ = 0;
+  if (branch_predictor_) {
+    branch_predictor_->Reset();
+  }
+  trap_ = TrapRecord();
+  trap_raised_ = false;
   registers_.Reset();
+  (void)fp_env_.TakeFlags();
   memory_controller_.Reset();
   control_unit_.Reset();
   branch_flag_ = false;
@@ -1142,6 +1500,21 @@ void RVSSVM::Reset() {
 
 }
 
-
-
-
+// The stages are also driven from RVSSThreadedVM and the tests, so instantiate both flavours here.
+#define RVSS_INSTANTIATE_STAGES(Policy) \
+  template void RVSSVM::Execute<Policy>(); \
+  template void RVSSVM::HandleSyscall<Policy>(); \
+  template void RVSSVM::WriteMemory<Policy>(); \
+  template void RVSSVM::WriteMemoryFloat<Policy>(); \
+  template void RVSSVM::WriteMemoryDouble<Policy>(); \
+  template void RVSSVM::WriteBack<Policy>(); \
+  template void RVSSVM::WriteBackFloat<Policy>(); \
+  template void RVSSVM::WriteBackDouble<Policy>(); \
+  template bool RVSSVM::StepInstruction<Policy>(); \
+  template void RVSSVM::RunLoop<Policy>();
+
+RVSS_INSTANTIATE_STAGES(FastRunPolicy)
+RVSS_INSTANTIATE_STAGES(DebugRunPolicy)
+RVSS_INSTANTIATE_STAGES(StepBatchPolicy)
+
+#undef RVSS_INSTANTIATE_STAGES
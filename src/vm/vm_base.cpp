@@ -8,6 +8,9 @@
 
 #include "globals.h"
 #include "config.h"
+#include "common/instructions.h"
+#include "vm/bigmul_unit.h"
+#include "vm/checkpoint.h"
 
 #include <cstdint>
 #include <iostream>
@@ -17,17 +20,21 @@
 #include <algorithm>
 #include <cstring>
 #include <thread>
+#include <array>
+#include <span>
+#include <stdexcept>
 
 
 void VmBase::LoadProgram(const AssembledProgram &program) {
   program_ = program;
-  unsigned int counter = 0;
-  for (const auto &instruction: program.text_buffer) {
-    memory_controller_.WriteWord(counter, instruction);
-      counter += 4;
-  }
-  program_size_ = counter;
-  AddBreakpoint(program_size_, false);  // address
+  memory_controller_.ConfigureCache();
+  // Memory is little-endian, like the host, so the words go in as they are.
+  memory_controller_.WriteBlock(0, std::span(reinterpret_cast<const uint8_t *>(program.text_buffer.data()),
+                                             program.text_buffer.size() * sizeof(uint32_t)));
+  SetProgramSize(program.text_buffer.size() * sizeof(uint32_t));
+  branch_predictor_ = CreateBranchPredictor();
+  branch_predictions_ = 0;
+  branch_mispredictions_ = 0;
 
   unsigned int data_counter = 0;
   uint64_t base_data_address = vm_config::config.getDataSectionStart();
@@ -70,13 +77,13 @@ void VmBase::LoadProgram(const AssembledProgram &program) {
         data_counter += 8;
       } else if constexpr (std::is_same_v<T, std::string>) {
         align(1);
-        for (size_t i = 0; i < value.size(); i++) {
-          memory_controller_.WriteByte(base_data_address + data_counter, static_cast<uint8_t>(value[i]));  // Write each byte of the string
-          data_counter += 1;
-        }
+        memory_controller_.WriteBlock(base_data_address + data_counter,
+                                      std::span(reinterpret_cast<const uint8_t *>(value.data()), value.size()));
+        data_counter += value.size();
       }
     }, data);
   }
+  RememberLoadedState();
   std::cout << "VM_PROGRAM_LOADED" << std::endl;
   output_status_ = "VM_PROGRAM_LOADED";
 
@@ -85,6 +92,134 @@ void VmBase::LoadProgram(const AssembledProgram &program) {
 
 }
 
+void VmBase::SetProgramSize(uint64_t size) {
+  program_size_ = size;
+  // Breakpoints carried over from the previous program only survive inside the new text.
+  breakpoint_bitmap_.assign((program_size_ / 4 + 63) / 64, 0);
+  std::erase_if(breakpoints_, [&](uint64_t address) { return address >= program_size_; });
+  for (uint64_t address : breakpoints_) {
+    SetBreakpointBit(address, true);
+  }
+  PredecodeProgram();
+}
+
+void VmBase::RememberLoadedState() {
+  memory_controller_.TakeMemorySnapshot();
+  loaded_state_ = LoadedState{true, registers_, program_counter_, text_write_generation_};
+}
+
+bool VmBase::ResetToLoaded() {
+  Reset();
+  if (!loaded_state_.valid || !memory_controller_.RestoreMemorySnapshot()) {
+    return false;
+  }
+  registers_ = loaded_state_.registers;
+  program_counter_ = loaded_state_.program_counter;
+  // The program may have stored over its own text; memory has the loaded text back, so decode it again.
+  if (text_write_generation_ != loaded_state_.text_write_generation) {
+    PredecodeProgram();
+    loaded_state_.text_write_generation = text_write_generation_;
+  }
+  return true;
+}
+
+void VmBase::SaveCheckpoint(const std::filesystem::path &path) {
+  if (!AtInstructionBoundary()) {
+    throw std::runtime_error("Cannot checkpoint with an instruction in flight; step until the pipeline drains");
+  }
+  checkpoint::Header header{};
+  header.program_counter = program_counter_;
+  header.program_size = program_size_;
+  header.memory_size = memory_controller_.MemorySize();
+  header.block_size = memory_controller_.MemoryBlockSize();
+  header.instructions_retired = instructions_retired_;
+  header.cycles = cycle_s_;
+  header.stall_cycles = stall_cycles_;
+  header.branch_predictions = branch_predictions_;
+  header.branch_mispredictions = branch_mispredictions_;
+  header.fused_pairs = fused_pairs_;
+  for (size_t reg = 0; reg < RegisterFile::NUM_GPR; ++reg) {
+    header.gpr[reg] = registers_.ReadGpr(reg);
+  }
+  for (size_t reg = 0; reg < RegisterFile::NUM_FPR; ++reg) {
+    header.fpr[reg] = registers_.ReadFpr(reg);
+  }
+  std::memcpy(header.bigmul_a, bigmul_unit::cacheA, sizeof(header.bigmul_a));
+  std::memcpy(header.bigmul_b, bigmul_unit::cacheB, sizeof(header.bigmul_b));
+  std::memcpy(header.bigmul_result, bigmul_unit::resultCache, sizeof(header.bigmul_result));
+  std::vector<checkpoint::CsrEntry> csrs;
+  for (size_t reg = 0; reg < RegisterFile::NUM_CSR; ++reg) {
+    if (uint64_t value = registers_.ReadCsr(reg)) {
+      csrs.push_back({reg, value});
+    }
+  }
+
+  checkpoint::Writer writer(path, header, csrs);
+  std::vector<uint8_t> block(header.block_size);
+  for (uint64_t address : memory_controller_.UsedBlocks()) {
+    auto bytes = std::span(block).first(std::min(header.block_size, header.memory_size - address));
+    memory_controller_.ReadBlock(address, bytes);
+    writer.AddBlock(address, bytes);
+  }
+  writer.Finish();
+}
+
+void VmBase::LoadCheckpoint(const std::filesystem::path &path) {
+  checkpoint::MappedFile file(path);
+  const checkpoint::Header &header = file.GetHeader();
+  const uint64_t memory_size = memory_controller_.MemorySize();
+  if (header.program_size % 4 != 0 || header.program_size > memory_size) {
+    throw std::runtime_error("Corrupt checkpoint text size: " + path.string());
+  }
+  for (uint64_t address : file.BlockAddresses()) {
+    if (address >= header.memory_size || address >= memory_size
+        || std::min(header.block_size, header.memory_size - address) > memory_size - address) {
+      throw std::runtime_error("Checkpoint memory does not fit in memory_size " + std::to_string(memory_size));
+    }
+  }
+  for (const checkpoint::CsrEntry &csr : file.Csrs()) {
+    if (csr.index >= RegisterFile::NUM_CSR) {
+      throw std::runtime_error("Corrupt checkpoint CSR index: " + path.string());
+    }
+  }
+
+  Reset();
+  for (uint64_t index = 0; index < header.block_count; ++index) {
+    const uint64_t address = file.BlockAddresses()[index];
+    memory_controller_.WriteBlock(address,
+                                  file.Block(index).first(std::min(header.block_size, header.memory_size - address)));
+  }
+  registers_ = RegisterFile();
+  for (size_t reg = 0; reg < RegisterFile::NUM_GPR; ++reg) {
+    registers_.WriteGpr(reg, header.gpr[reg]);
+  }
+  for (size_t reg = 0; reg < RegisterFile::NUM_FPR; ++reg) {
+    registers_.WriteFpr(reg, header.fpr[reg]);
+  }
+  for (const checkpoint::CsrEntry &csr : file.Csrs()) {
+    registers_.WriteCsr(csr.index, csr.value);
+  }
+  program_counter_ = header.program_counter;
+  instructions_retired_ = header.instructions_retired;
+  cycle_s_ = header.cycles;
+  stall_cycles_ = header.stall_cycles;
+  branch_predictions_ = header.branch_predictions;
+  branch_mispredictions_ = header.branch_mispredictions;
+  fused_pairs_ = header.fused_pairs;
+  std::memcpy(bigmul_unit::cacheA, header.bigmul_a, sizeof(header.bigmul_a));
+  std::memcpy(bigmul_unit::cacheB, header.bigmul_b, sizeof(header.bigmul_b));
+  std::memcpy(bigmul_unit::resultCache, header.bigmul_result, sizeof(header.bigmul_result));
+  // The checkpoint has no source, so nothing maps its text to lines; neither do the old program's breakpoints.
+  program_ = AssembledProgram();
+  breakpoints_.clear();
+  SetProgramSize(header.program_size);
+  RememberLoadedState();
+
+  std::cout << "VM_CHECKPOINT_LOADED" << std::endl;
+  output_status_ = "VM_CHECKPOINT_LOADED";
+  DumpState(globals::vm_state_dump_file_path);
+}
+
 uint64_t VmBase::GetProgramCounter() const {
     return program_counter_;
 }
@@ -173,36 +308,150 @@ int32_t VmBase::ImmGenerator(uint32_t instruction) {
 }
 
 
-void VmBase::AddBreakpoint(uint64_t val, bool is_line) {
+DecodedInstruction VmBase::DecodeInstruction(uint32_t instruction) {
+    using instruction_set::Instruction;
+    using instruction_set::get_instr_encoding;
+
+    DecodedInstruction decoded;
+    decoded.instruction = instruction;
+    decoded.opcode = instruction & 0b1111111;
+    decoded.rd = (instruction >> 7) & 0b11111;
+    decoded.funct3 = (instruction >> 12) & 0b111;
+    decoded.rs1 = (instruction >> 15) & 0b11111;
+    decoded.rs2 = (instruction >> 20) & 0b11111;
+    decoded.rs3 = (instruction >> 27) & 0b11111;
+    decoded.funct7 = (instruction >> 25) & 0b1111111;
+    decoded.imm = ImmGenerator(instruction);
+
+    // Same precedence the execution stages use when routing an instruction.
+    if (decoded.opcode == get_instr_encoding(Instruction::kecall).opcode &&
+        decoded.funct3 == get_instr_encoding(Instruction::kecall).funct3) {
+        decoded.unit = ExecutionUnit::kSyscall;
+    } else if (instruction_set::isFInstruction(instruction)) {
+        decoded.unit = ExecutionUnit::kFloat;
+    } else if (instruction_set::isDInstruction(instruction)) {
+        decoded.unit = ExecutionUnit::kDouble;
+    } else if (decoded.opcode == 0b1110011) {
+        decoded.unit = ExecutionUnit::kCsr;
+    } else if (decoded.opcode == get_instr_encoding(Instruction::kldbm).opcode) {
+        decoded.unit = ExecutionUnit::kLdbm;
+    } else if (decoded.opcode == get_instr_encoding(Instruction::kbigmul).opcode) {
+        decoded.unit = ExecutionUnit::kBigmul;
+    } else {
+        decoded.unit = ExecutionUnit::kInteger;
+    }
+
+    decoded.valid = true;
+    return decoded;
+}
+
+void VmBase::PredecodeProgram() {
+    decoded_instructions_.clear();
+    decoded_instructions_.reserve(program_size_ / 4);
+    for (uint64_t address = 0; address < program_size_; address += 4) {
+        decoded_instructions_.push_back(DecodeInstruction(memory_controller_.ReadWord(address)));
+    }
+    for (size_t index = 0; index + 1 < decoded_instructions_.size(); ++index) {
+        decoded_instructions_[index].fusion =
+            ClassifyFusion(decoded_instructions_[index], decoded_instructions_[index + 1]);
+    }
+    ++text_write_generation_;
+    OnTextModified(0, UINT64_MAX);
+}
+
+DecodedInstruction VmBase::FetchDecoded(uint64_t address) {
+    if (address % 4 == 0 && address / 4 < decoded_instructions_.size()) {
+        DecodedInstruction &entry = decoded_instructions_[address / 4];
+        if (!entry.valid) {
+            DecodedInstruction decoded = DecodeInstruction(memory_controller_.ReadWord(address));
+            if (address / 4 + 1 < decoded_instructions_.size()) {
+                // An invalid successor is decoded on the side rather than through FetchDecoded(), so a
+                // long invalidated run costs no stack; it gets its own entry when it is fetched.
+                const DecodedInstruction &next = decoded_instructions_[address / 4 + 1];
+                decoded.fusion = ClassifyFusion(decoded, next.valid ? next
+                                                                    : DecodeInstruction(memory_controller_.ReadWord(address + 4)));
+            }
+            entry = decoded;
+        }
+        return entry;
+    }
+    // Outside the loaded text section (or misaligned), decode on the fly.
+    return DecodeInstruction(memory_controller_.ReadWord(address));
+}
+
+void VmBase::InvalidateDecodedRange(uint64_t address, uint64_t size) {
+    uint64_t text_end = decoded_instructions_.size() * 4;
+    if (size == 0 || address >= text_end) {
+        return;
+    }
+    uint64_t last = std::min(text_end - 1, address + (size - 1));
+    if (last < address) { // wrapped around the address space
+        last = text_end - 1;
+    }
+    // The entry in front may have been fused with the first overwritten one.
+    for (uint64_t index = address / 4 == 0 ? 0 : address / 4 - 1; index <= last / 4; ++index) {
+        decoded_instructions_[index].valid = false;
+    }
+    ++text_write_generation_;
+    OnTextModified(address, last - address + 1);
+}
+
+
+bool VmBase::InsertBreakpoint(uint64_t val, bool is_line) {
+    uint64_t address = val;
     if (is_line) {
+        if (program_.line_number_instruction_number_mapping.empty()) {
+            std::cerr << "No source lines to resolve line " << val << " against; use load to set line breakpoints" << std::endl;
+            return false;
+        }
         // If the value is a line number, convert it to an instruction address
         if (program_.line_number_instruction_number_mapping.find(val) == program_.line_number_instruction_number_mapping.end()) {
             std::cerr << "Invalid line number: " << val << std::endl;
-            return;
+            return false;
         }
         uint64_t line = val;
-        uint64_t bp = program_.line_number_instruction_number_mapping[line] * 4;
-        if (CheckBreakpoint(bp)) {
+        address = program_.line_number_instruction_number_mapping[line] * 4;
+        if (CheckBreakpoint(address)) {
             std::cerr << "Breakpoint already exists at line: " << line << std::endl;
-            return;
+            return false;
         }
-        breakpoints_.emplace_back(bp);
     } else {
         if (val % 4 != 0) {
             std::cerr << "Invalid instruction address: " << val << ". Must be a multiple of 4." << std::endl;
-            return;
+            return false;
         }
         if (CheckBreakpoint(val)) {
             std::cerr << "Breakpoint already exists at address: " << val << std::endl;
-            return;
+            return false;
         }
-        breakpoints_.emplace_back(val);
     }
+    if (address >= program_size_) {
+        std::cerr << "Invalid instruction address: " << address << ". Outside the text section." << std::endl;
+        return false;
+    }
+    breakpoints_.emplace_back(address);
+    SetBreakpointBit(address, true);
+    return true;
+}
 
-    DumpState(globals::vm_state_dump_file_path);
+void VmBase::AddBreakpoint(uint64_t val, bool is_line) {
+    if (InsertBreakpoint(val, is_line)) {
+        DumpState(globals::vm_state_dump_file_path);
+    }
+}
+
+void VmBase::AddBreakpoints(const std::vector<uint64_t> &lines) {
+    bool added = false;
+    for (uint64_t line : lines) {
+        added |= InsertBreakpoint(line, true);
+    }
+    if (added) {
+        DumpState(globals::vm_state_dump_file_path);
+    }
 }
 
 void VmBase::RemoveBreakpoint(uint64_t val, bool is_line) {
+    uint64_t address = val;
     if (is_line) {
         // If the value is a line number, convert it to an instruction address
         if (program_.line_number_instruction_number_mapping.find(val) == program_.line_number_instruction_number_mapping.end()) {
@@ -210,12 +459,11 @@ void VmBase::RemoveBreakpoint(uint64_t val, bool is_line) {
             return;
         }
         uint64_t line = val;
-        uint64_t bp = program_.line_number_instruction_number_mapping[line] * 4;
-        if (!CheckBreakpoint(bp)) {
+        address = program_.line_number_instruction_number_mapping[line] * 4;
+        if (!CheckBreakpoint(address)) {
             std::cerr << "No breakpoint exists at line: " << line << std::endl;
             return;
         }
-        breakpoints_.erase(std::remove(breakpoints_.begin(), breakpoints_.end(), bp), breakpoints_.end());
     } else {
         if (val % 4 != 0) {
             std::cerr << "Invalid instruction address: " << val << ". Must be a multiple of 4." << std::endl;
@@ -225,25 +473,47 @@ void VmBase::RemoveBreakpoint(uint64_t val, bool is_line) {
             std::cerr << "No breakpoint exists at address: " << val << std::endl;
             return;
         }
-        breakpoints_.erase(std::remove(breakpoints_.begin(), breakpoints_.end(), val), breakpoints_.end());
     }
+    breakpoints_.erase(std::remove(breakpoints_.begin(), breakpoints_.end(), address), breakpoints_.end());
+    SetBreakpointBit(address, false);
     DumpState(globals::vm_state_dump_file_path);
 
 
 }
 
-bool VmBase::CheckBreakpoint(uint64_t address) {
-    return std::find(breakpoints_.begin(), breakpoints_.end(), address) != breakpoints_.end();
+void VmBase::SetBreakpointBit(uint64_t address, bool value) {
+    uint64_t slot = address >> 2;
+    uint64_t mask = uint64_t{1} << (slot & 63);
+    if (value) {
+        breakpoint_bitmap_[slot >> 6] |= mask;
+    } else {
+        breakpoint_bitmap_[slot >> 6] &= ~mask;
+    }
 }
 
 
 void VmBase::PrintString(uint64_t address) {
-    while (true) {
-        char c = memory_controller_.ReadByte(address);
-        if (c == '\0') break;
-        std::cout << c;
-        address++;
+    PrintBytes(address, memory_controller_.FindByte(address, '\0', UINT64_MAX));
+}
+
+uint64_t VmBase::PrintBytes(uint64_t address, uint64_t length) {
+    std::array<uint8_t, 4096> chunk;
+    for (uint64_t done = 0; done < length;) {
+        const auto size = static_cast<size_t>(std::min<uint64_t>(chunk.size(), length - done));
+        memory_controller_.ReadBlock(address + done, std::span(chunk).first(size));
+        std::cout.write(reinterpret_cast<const char *>(chunk.data()), static_cast<std::streamsize>(size));
+        done += size;
     }
+    return length;
+}
+
+std::unique_ptr<BranchPredictor> VmBase::CreateBranchPredictor() const {
+  if (!vm_config::config.getBranchPredictorSingleStage()) {
+    return nullptr;
+  }
+  return MakeBranchPredictor(vm_config::config.getBranchPredictorType(),
+                             vm_config::config.getBranchPredictorTableSize(),
+                             vm_config::config.getBranchPredictorHistoryLength());
 }
 
 void VmBase::DumpState(const std::filesystem::path &filename) {
@@ -275,9 +545,45 @@ void VmBase::DumpState(const std::filesystem::path &filename) {
     file << "    \"ipc\": " << ipc_ << ",\n";
     file << "    \"stall_cycles\": " << stall_cycles_ << ",\n";
     file << "    \"branch_mispredictions\": " << branch_mispredictions_ << ",\n";
+    file << "    \"fused_pairs\": " << fused_pairs_ << ",\n";
+    file << "    \"fusion_hit_rate\": "
+         << (instructions_retired_ ? 2.0 * static_cast<double>(fused_pairs_) / instructions_retired_ : 0.0) << ",\n";
+    file << "    \"trap\": {\"count\": " << trap_.count
+         << ", \"cause\": " << trap_.cause
+         << ", \"epc\": \"0x" << std::hex << trap_.epc
+         << "\", \"tval\": \"0x" << trap_.tval << std::dec
+         << "\", \"halted\": " << (trap_.halted ? "true" : "false") << "},\n";
+    if (branch_predictor_) {
+        double accuracy = branch_predictions_
+            ? 1.0 - static_cast<double>(branch_mispredictions_) / branch_predictions_ : 0.0;
+        double mpki = instructions_retired_
+            ? 1000.0 * static_cast<double>(branch_mispredictions_) / instructions_retired_ : 0.0;
+        file << "    \"branch_predictor\": {\"type\": \"" << branch_predictor_->Name()
+             << "\", \"predictions\": " << branch_predictions_
+             << ", \"mispredictions\": " << branch_mispredictions_
+             << ", \"accuracy\": " << accuracy
+             << ", \"mpki\": " << mpki << "},\n";
+    }
+    if (const cache::CacheHierarchy &caches = memory_controller_.GetCaches(); !caches.Empty()) {
+        file << "    \"caches\": {\"amat\": " << caches.Amat();
+        for (auto level : {cache::CacheHierarchy::kL1I, cache::CacheHierarchy::kL1D,
+                           cache::CacheHierarchy::kL2, cache::CacheHierarchy::kL3}) {
+            if (const cache::Cache *level_cache = caches.Get(level)) {
+                const cache::CacheStats &stats = level_cache->GetStats();
+                double mpki = instructions_retired_
+                    ? 1000.0 * static_cast<double>(stats.misses) / instructions_retired_ : 0.0;
+                file << ", \"" << cache::CacheHierarchy::Name(level) << "\": {\"accesses\": " << stats.accesses
+                     << ", \"misses\": " << stats.misses
+                     << ", \"hit_rate\": " << stats.HitRate()
+                     << ", \"mpki\": " << mpki
+                     << ", \"penalty_cycles\": " << stats.penalty_cycles << "}";
+            }
+        }
+        file << "},\n";
+    }
+    DumpEngineState(file);
     file << "    \"breakpoints\": [";
-    for (size_t i = 1; i < breakpoints_.size(); ++i) {
-        program_.instruction_number_line_number_mapping[breakpoints_[i] / 4];
+    for (size_t i = 0; i < breakpoints_.size(); ++i) {
         file << program_.instruction_number_line_number_mapping[breakpoints_[i] / 4];
         if (i < breakpoints_.size() - 1) {
             file << ", ";
@@ -290,6 +596,68 @@ void VmBase::DumpState(const std::filesystem::path &filename) {
 
 }
 
+void VmBase::RaiseTrap(TrapCause cause, uint64_t epc, uint64_t tval) {
+    trap_csr_changes_.clear();
+    auto write_csr = [&](unsigned int csr, uint64_t value) {
+        trap_csr_changes_.push_back({csr, 1, registers_.ReadCsr(csr), value});
+        registers_.WriteCsr(csr, value);
+    };
+    write_csr(0x342, static_cast<uint64_t>(cause)); // mcause
+    write_csr(0x341, epc);                          // mepc
+    write_csr(0x343, tval);                         // mtval
+    trap_.count++;
+    trap_.cause = static_cast<uint64_t>(cause);
+    trap_.epc = epc;
+    trap_.tval = tval;
+    trap_raised_ = true;
+
+    uint64_t handler = registers_.ReadCsr(0x305) & ~uint64_t{0b11}; // mtvec, direct mode
+    if (handler != 0) {
+        trap_.halted = false;
+        program_counter_ = handler;
+        return;
+    }
+    trap_.halted = true;
+    program_counter_ = epc;
+    RequestStop();
+    std::cout << "VM_TRAP" << std::endl;
+    output_status_ = "VM_TRAP";
+}
+
+void VmBase::EnterFloatEnvironment() {
+    fp_env_.Enter();
+}
+
+void VmBase::LeaveFloatEnvironment() {
+    AccrueFloatFlags(fp_env_.Leave());
+}
+
+void VmBase::SyncFloatCsrs() {
+    AccrueFloatFlags(fp_env_.TakeFlags());
+}
+
+void VmBase::AccrueFloatFlags(uint8_t flags) {
+    if (flags == 0) {
+        return;
+    }
+    uint64_t fflags = registers_.ReadCsr(0x001) | flags;
+    registers_.WriteCsr(0x001, fflags);
+    registers_.WriteCsr(0x003, (registers_.ReadCsr(0x002) << 5) | fflags);
+}
+
+void VmBase::OnFloatCsrWritten(uint16_t csr) {
+    if (csr == 0x003) {
+        uint64_t fcsr = registers_.ReadCsr(0x003) & 0xFF;
+        registers_.WriteCsr(0x001, fcsr & 0x1F);
+        registers_.WriteCsr(0x002, fcsr >> 5);
+    }
+    uint64_t fflags = registers_.ReadCsr(0x001) & 0x1F;
+    uint64_t frm = registers_.ReadCsr(0x002) & 0x7;
+    registers_.WriteCsr(0x001, fflags);
+    registers_.WriteCsr(0x002, frm);
+    registers_.WriteCsr(0x003, (frm << 5) | fflags);
+}
+
 void VmBase::ModifyRegister(const std::string &reg_name, uint64_t value) {
     registers_.ModifyRegister(reg_name, value);
 }
\ No newline at end of file
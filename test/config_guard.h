@@ -0,0 +1,24 @@
+/**
+ * File Name: config_guard.h
+ * Author: Vishank Singh
+ * Github: https://github.com/VishankSingh
+ */
+
+#ifndef TEST_CONFIG_GUARD_H
+#define TEST_CONFIG_GUARD_H
+
+#include "../src/config.h"
+
+/// Puts vm_config::config back as the test found it, also when a failing ASSERT returns early.
+class ConfigGuard {
+ public:
+  ConfigGuard() : saved_(vm_config::config) {}
+  ~ConfigGuard() { vm_config::config = saved_; }
+  ConfigGuard(const ConfigGuard &) = delete;
+  ConfigGuard &operator=(const ConfigGuard &) = delete;
+
+ private:
+  vm_config::VmConfig saved_;
+};
+
+#endif // TEST_CONFIG_GUARD_H
@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+#include "../src/vm/branch_predictor.h"
+
+namespace {
+
+/// Mispredictions over the last half of rounds repetitions of pattern at one branch.
+unsigned int LateMispredictions(BranchPredictor &predictor, const std::vector<bool> &pattern, int rounds) {
+  unsigned int mispredictions = 0;
+  for (int round = 0; round < rounds; ++round) {
+    for (bool taken : pattern) {
+      if (predictor.Predict(0x40, 0x20) != taken && round >= rounds / 2) {
+        mispredictions++;
+      }
+      predictor.Update(0x40, 0x20, taken);
+    }
+  }
+  return mispredictions;
+}
+
+} // namespace
+
+TEST(BranchPredictorTest, StaticTest) {
+  auto taken = MakeBranchPredictor(vm_config::BranchPredictorType::ALWAYS_TAKEN, 16, 0);
+  auto btfn = MakeBranchPredictor(vm_config::BranchPredictorType::BTFN, 16, 0);
+  ASSERT_TRUE(taken->Predict(0x40, 0x80));
+  ASSERT_TRUE(btfn->Predict(0x40, 0x20));
+  ASSERT_FALSE(btfn->Predict(0x40, 0x80));
+  ASSERT_EQ(MakeBranchPredictor(vm_config::BranchPredictorType::NONE, 16, 0), nullptr);
+}
+
+TEST(BranchPredictorTest, BimodalTest) {
+  BimodalBranchPredictor predictor(1000); // rounded down to 512 entries
+  ASSERT_FALSE(predictor.Predict(0x40, 0x20));
+  predictor.Update(0x40, 0x20, true);
+  ASSERT_TRUE(predictor.Predict(0x40, 0x20));
+  ASSERT_TRUE(predictor.Predict(0x40 + 512 * 4, 0x20)); // aliases
+  ASSERT_FALSE(predictor.Predict(0x44, 0x20));
+  predictor.Reset();
+  ASSERT_FALSE(predictor.Predict(0x40, 0x20));
+}
+
+TEST(BranchPredictorTest, HistoryPatternTest) {
+  // A loop running three times: taken, taken, not taken.
+  const std::vector<bool> loop = {true, true, false};
+  BimodalBranchPredictor bimodal(4096);
+  GshareBranchPredictor gshare(4096, 8);
+  TournamentBranchPredictor tournament(4096, 8);
+  TageBranchPredictor tage(1024, 32);
+  ASSERT_EQ(LateMispredictions(bimodal, loop, 100), 50);
+  ASSERT_EQ(LateMispredictions(gshare, loop, 100), 0);
+  ASSERT_EQ(LateMispredictions(tournament, loop, 100), 0);
+  ASSERT_EQ(LateMispredictions(tage, loop, 100), 0);
+
+  // Only a long history separates the last iteration of a 20-iteration loop.
+  std::vector<bool> long_loop(20, true);
+  long_loop.back() = false;
+  TageBranchPredictor long_tage(1024, 64);
+  GshareBranchPredictor short_gshare(4096, 8);
+  ASSERT_EQ(LateMispredictions(long_tage, long_loop, 200), 0);
+  ASSERT_GT(LateMispredictions(short_gshare, long_loop, 200), 0);
+}
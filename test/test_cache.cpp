@@ -0,0 +1,449 @@
+#include <gtest/gtest.h>
+#include "../src/vm/cache/cache.h"
+#include "../src/vm/cache/cache_hierarchy.h"
+#include "../src/vm/main_memory.h"
+
+namespace {
+
+/// 4 sets of 2 lines of 16 bytes, write-back and write-allocate.
+cache::CacheConfig SmallConfig() {
+  cache::CacheConfig config = cache::CacheConfig::FromSizes(128, 16, 2);
+  config.write_miss_policy = cache::WriteMissPolicy::WriteAllocate;
+  return config;
+}
+
+/// Direct-mapped L1D of 4 lines over an L2 of 8 lines, both with 16-byte lines.
+void ConfigureTwoLevels(cache::CacheHierarchy &caches, cache::InclusionPolicy policy, unsigned long l2_associativity = 2) {
+  cache::CacheConfig l1 = cache::CacheConfig::FromSizes(64, 16, 1);
+  l1.write_miss_policy = cache::WriteMissPolicy::WriteAllocate;
+  l1.miss_penalty = 10;
+  cache::CacheConfig l2 = cache::CacheConfig::FromSizes(128, 16, l2_associativity);
+  l2.write_miss_policy = cache::WriteMissPolicy::WriteAllocate;
+  l2.miss_penalty = 100;
+  l2.inclusion_policy = policy;
+  caches.Configure(nullptr, &l1, &l2, nullptr);
+}
+
+/// Replacement misses of one 4-way set under a two-line working set interleaved with a scan.
+unsigned long ScanReplacementMisses(cache::ReplacementPolicy policy, unsigned long &hits) {
+  Memory memory;
+  cache::CacheConfig config = cache::CacheConfig::FromSizes(64, 16, 4);
+  config.replacement_policy = policy;
+  cache::Cache cache(config, memory);
+  uint64_t scan = 0x1000;
+  for (int round = 0; round < 50; ++round) {
+    for (uint64_t address : {0x000, 0x010, 0x000, 0x010}) {
+      cache.Read(address, 4);
+    }
+    for (int i = 0; i < 3; ++i, scan += 0x10) {
+      cache.Read(scan, 4);
+    }
+  }
+  hits = cache.GetStats().hits;
+  return cache.GetStats().replacement_misses;
+}
+
+} // namespace
+
+TEST(CacheTest, GeometryTest) {
+  cache::CacheConfig config = cache::CacheConfig::FromSizes(32768, 64, 8);
+  ASSERT_EQ(config.lines, 512);
+  ASSERT_EQ(config.words_per_line, 16);
+  ASSERT_THROW(cache::CacheConfig::FromSizes(3000, 64, 8), std::invalid_argument);
+  ASSERT_THROW(cache::CacheConfig::FromSizes(256, 64, 8), std::invalid_argument);
+  ASSERT_THROW(cache::CacheConfig::FromSizes(256, 2, 1), std::invalid_argument);
+  ASSERT_THROW(cache::CacheConfig::FromSizes(8192, 64, 128), std::invalid_argument);
+}
+
+TEST(CacheTest, LruTest) {
+  Memory memory;
+  cache::Cache cache(SmallConfig(), memory);
+  // 0x000, 0x040 and 0x080 all map to set 0.
+  cache.Read(0x000, 4);
+  cache.Read(0x040, 4);
+  cache.Read(0x000, 4);
+  cache.Read(0x080, 4); // evicts 0x040
+  cache.Read(0x000, 4);
+  cache.Read(0x040, 4);
+  const cache::CacheStats &stats = cache.GetStats();
+  ASSERT_EQ(stats.accesses, 6);
+  ASSERT_EQ(stats.hits, 2);
+  ASSERT_EQ(stats.misses, 4);
+  ASSERT_EQ(stats.evictions, 2);
+  ASSERT_EQ(stats.writebacks, 0);
+}
+
+TEST(CacheTest, FifoTest) {
+  Memory memory;
+  cache::CacheConfig config = SmallConfig();
+  config.replacement_policy = cache::ReplacementPolicy::FIFO;
+  cache::Cache cache(config, memory);
+  cache.Read(0x000, 4);
+  cache.Read(0x040, 4);
+  cache.Read(0x000, 4);
+  cache.Read(0x080, 4); // evicts 0x000, the oldest fill
+  cache.Read(0x040, 4);
+  cache.Read(0x000, 4);
+  ASSERT_EQ(cache.GetStats().hits, 2);
+  ASSERT_EQ(cache.GetStats().misses, 4);
+}
+
+TEST(CacheTest, PlruTest) {
+  Memory memory;
+  cache::CacheConfig config = cache::CacheConfig::FromSizes(64, 16, 4);
+  config.replacement_policy = cache::ReplacementPolicy::PLRU;
+  cache::Cache cache(config, memory);
+  for (uint64_t address : {0x000, 0x010, 0x020, 0x030, 0x000}) {
+    cache.Read(address, 4);
+  }
+  cache.Read(0x040, 4); // the tree points away from 0x000 and 0x030: evicts 0x020, where LRU would take 0x010
+  cache.Read(0x010, 4);
+  ASSERT_EQ(cache.GetStats().hits, 2);
+  cache.Read(0x020, 4);
+  ASSERT_EQ(cache.GetStats().misses, 6);
+  ASSERT_EQ(cache.GetStats().replacement_misses, 1);
+}
+
+TEST(CacheTest, InsertionPolicyTest) {
+  // Three lines cycling through one 2-way set: LRU always evicts the next one needed.
+  for (auto [policy, expected_hits] : {std::pair{cache::ReplacementPolicy::LRU, 0},
+                                       std::pair{cache::ReplacementPolicy::LIP, 29},
+                                       std::pair{cache::ReplacementPolicy::BIP, 29}}) {
+    Memory memory;
+    cache::CacheConfig config = cache::CacheConfig::FromSizes(32, 16, 2);
+    config.replacement_policy = policy;
+    cache::Cache cache(config, memory);
+    for (int round = 0; round < 30; ++round) {
+      for (uint64_t address : {0x000, 0x010, 0x020}) {
+        cache.Read(address, 4);
+      }
+    }
+    ASSERT_EQ(cache.GetStats().hits, expected_hits) << cache::ToString(policy);
+  }
+}
+
+TEST(CacheTest, ScanResistanceTest) {
+  unsigned long lru_hits = 0;
+  const unsigned long lru_misses = ScanReplacementMisses(cache::ReplacementPolicy::LRU, lru_hits);
+  ASSERT_EQ(lru_misses, 98); // the working set misses twice a round after the first
+  for (auto policy : {cache::ReplacementPolicy::SRRIP, cache::ReplacementPolicy::DRRIP}) {
+    unsigned long hits = 0;
+    ASSERT_EQ(ScanReplacementMisses(policy, hits), 0) << cache::ToString(policy);
+    ASSERT_EQ(hits, 50 * 4 - 2) << cache::ToString(policy);
+  }
+  unsigned long brrip_hits = 0;
+  ScanReplacementMisses(cache::ReplacementPolicy::BRRIP, brrip_hits);
+  ASSERT_GT(brrip_hits, lru_hits);
+}
+
+TEST(CacheTest, RandomIsRepeatableTest) {
+  Memory memory;
+  cache::CacheConfig config = SmallConfig();
+  config.replacement_policy = cache::ReplacementPolicy::Random;
+  cache::Cache first(config, memory);
+  cache::Cache second(config, memory);
+  for (uint64_t i = 0; i < 200; ++i) {
+    first.Read((i * 0x40) % 0x140, 4);
+    second.Read((i * 0x40) % 0x140, 4);
+  }
+  ASSERT_EQ(first.GetStats().hits, second.GetStats().hits);
+  ASSERT_GT(first.GetStats().hits, 0);
+  ASSERT_LT(first.GetStats().hits, 200);
+}
+
+TEST(CacheTest, WriteBackTest) {
+  Memory memory;
+  cache::Cache cache(SmallConfig(), memory);
+  cache.Write(0x004, 0x11223344, 4);
+  ASSERT_EQ(memory.ReadWord(0x004), 0);
+  ASSERT_EQ(cache.PeekByte(0x004), 0x44);
+  ASSERT_EQ(cache.Read(0x004, 4), 0x11223344);
+
+  cache.Read(0x040, 4);
+  cache.Read(0x080, 4); // evicts the dirty line at 0x000
+  ASSERT_EQ(memory.ReadWord(0x004), 0x11223344);
+  ASSERT_EQ(cache.GetStats().writebacks, 1);
+  ASSERT_EQ(cache.GetStats().write_misses, 1);
+}
+
+TEST(CacheTest, WriteThroughNoAllocateTest) {
+  Memory memory;
+  cache::CacheConfig config = SmallConfig();
+  config.write_hit_policy = cache::WriteHitPolicy::WriteThrough;
+  config.write_miss_policy = cache::WriteMissPolicy::NoWriteAllocate;
+  cache::Cache cache(config, memory);
+  cache.Write(0x004, 0xAB, 1);
+  ASSERT_EQ(memory.ReadByte(0x004), 0xAB);
+  cache.Read(0x004, 1); // the write did not allocate
+  ASSERT_EQ(cache.GetStats().misses, 2);
+  cache.Write(0x005, 0xCD, 1);
+  ASSERT_EQ(memory.ReadByte(0x005), 0xCD);
+  ASSERT_EQ(cache.Read(0x004, 2), 0xCDAB);
+  ASSERT_EQ(cache.GetStats().hits, 2);
+  ASSERT_EQ(cache.GetStats().writebacks, 0);
+}
+
+TEST(CacheTest, StraddlingAccessTest) {
+  Memory memory;
+  cache::Cache cache(SmallConfig(), memory);
+  cache.Write(0x00C, 0x0102030405060708, 8);
+  ASSERT_EQ(cache.GetStats().accesses, 2);
+  ASSERT_EQ(cache.Read(0x00C, 8), 0x0102030405060708);
+  cache.SyncToMemory();
+  ASSERT_EQ(memory.ReadDoubleWord(0x00C), 0x0102030405060708);
+}
+
+TEST(CacheTest, PeekPokeTest) {
+  Memory memory;
+  cache::Cache cache(SmallConfig(), memory);
+  cache.Write(0x010, 0x55, 1);
+  cache.PokeByte(0x011, 0x66);
+  ASSERT_EQ(memory.ReadByte(0x011), 0x66);
+  ASSERT_EQ(cache.Read(0x010, 2), 0x6655);
+  ASSERT_EQ(cache.GetStats().accesses, 2);
+
+  cache.Reset();
+  ASSERT_EQ(cache.GetStats().accesses, 0);
+  ASSERT_EQ(cache.PeekByte(0x010), 0); // the dirty line was dropped
+}
+
+TEST(CacheTest, WidePeekPokeTest) {
+  Memory memory;
+  cache::CacheHierarchy caches(memory);
+  ConfigureTwoLevels(caches, cache::InclusionPolicy::Exclusive);
+  cache::Cache &l1 = *caches.DataPath();
+  l1.Write(0x000, 0x1122334455667788, 8);
+  l1.Read(0x040, 4); // the dirty line moves down into L2
+  ASSERT_EQ(l1.Peek(0x000, 8), 0x1122334455667788);
+  ASSERT_EQ(l1.Peek(0x004, 2), 0x3344);
+  l1.Poke(0x00C, 0xAABBCCDDEEFF0011, 8); // straddles the lines at 0x000 and 0x010
+  ASSERT_EQ(l1.Peek(0x00C, 8), 0xAABBCCDDEEFF0011);
+  ASSERT_EQ(memory.ReadDoubleWord(0x00C), 0xAABBCCDDEEFF0011);
+
+  std::vector<uint8_t> bytes(40);
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    bytes[i] = static_cast<uint8_t>(i + 1);
+  }
+  l1.PokeBlock(0x03C, bytes); // four lines, of which L1 holds the one at 0x040
+  std::vector<uint8_t> read(40);
+  l1.PeekBlock(0x03C, read);
+  ASSERT_EQ(read, bytes);
+  ASSERT_EQ(memory.ReadByte(0x063), 40);
+  ASSERT_EQ(l1.GetStats().accesses, 2);
+}
+
+TEST(CacheTest, TimingOnlyTest) {
+  Memory memory;
+  cache::CacheConfig config = SmallConfig();
+  config.timing_only = true;
+  cache::Cache cache(config, memory);
+  ASSERT_TRUE(cache.TimingOnly());
+  cache.Write(0x004, 0x11223344, 4);
+  ASSERT_EQ(memory.ReadWord(0x004), 0x11223344); // memory holds the data
+  memory.WriteByte(0x005, 0x99);
+  ASSERT_EQ(cache.Read(0x004, 4), 0x11229944);
+  cache.Read(0x040, 4);
+  cache.Read(0x080, 4); // evicts the dirty line at 0x000
+  ASSERT_EQ(cache.GetStats().hits, 1);
+  ASSERT_EQ(cache.GetStats().misses, 3);
+  ASSERT_EQ(cache.GetStats().writebacks, 1);
+  ASSERT_EQ(memory.ReadWord(0x004), 0x11229944);
+
+  cache::CacheHierarchy caches(memory);
+  cache::CacheConfig with_data = SmallConfig();
+  ASSERT_THROW(caches.Configure(nullptr, &config, &with_data, nullptr), std::invalid_argument);
+}
+
+TEST(CacheTest, HierarchyNineTest) {
+  Memory memory;
+  cache::CacheHierarchy caches(memory);
+  ConfigureTwoLevels(caches, cache::InclusionPolicy::NINE);
+  cache::Cache &l1 = *caches.DataPath();
+  l1.Read(0x000, 4);
+  l1.Read(0x040, 4); // same L1 set: evicts 0x000 from L1 only
+  l1.Read(0x000, 4);
+  const cache::Cache &l2 = *caches.Get(cache::CacheHierarchy::kL2);
+  ASSERT_EQ(l1.GetStats().misses, 3);
+  ASSERT_EQ(l2.GetStats().accesses, 3);
+  ASSERT_EQ(l2.GetStats().hits, 1);
+  ASSERT_EQ(caches.PenaltyCycles(), 3 * 10 + 2 * 100);
+  ASSERT_DOUBLE_EQ(caches.Amat(), 1.0 + 230.0 / 3.0);
+}
+
+TEST(CacheTest, HierarchyInclusiveTest) {
+  Memory memory;
+  cache::CacheHierarchy caches(memory);
+  ConfigureTwoLevels(caches, cache::InclusionPolicy::Inclusive, 4);
+  cache::Cache &l1 = *caches.DataPath();
+  l1.Write(0x000, 0xAB, 1);
+  // Four more lines for L2 set 0, none of them in the L1 set of 0x000: the last evicts 0x000 from L2,
+  // which pulls the dirty line out of L1.
+  for (uint64_t address : {0x020, 0x060, 0x0A0, 0x0E0}) {
+    l1.Read(address, 4);
+  }
+  ASSERT_EQ(l1.GetStats().back_invalidations, 1);
+  ASSERT_EQ(memory.ReadByte(0x000), 0xAB);
+  l1.Read(0x000, 1);
+  ASSERT_EQ(l1.GetStats().misses, 6);
+}
+
+TEST(CacheTest, HierarchyExclusiveTest) {
+  Memory memory;
+  cache::CacheHierarchy caches(memory);
+  ConfigureTwoLevels(caches, cache::InclusionPolicy::Exclusive);
+  cache::Cache &l1 = *caches.DataPath();
+  const cache::Cache &l2 = *caches.Get(cache::CacheHierarchy::kL2);
+  l1.Write(0x000, 0xCD, 1);
+  l1.Read(0x040, 4); // the dirty victim moves down into L2
+  ASSERT_EQ(memory.ReadByte(0x000), 0);
+  ASSERT_EQ(l1.PeekByte(0x000), 0xCD);
+  ASSERT_EQ(l1.Read(0x000, 1), 0xCD); // an L2 hit, which moves the line back up
+  ASSERT_EQ(l2.GetStats().hits, 1);
+  ASSERT_EQ(l2.GetStats().misses, 2);
+
+  caches.SyncToMemory();
+  ASSERT_EQ(memory.ReadByte(0x000), 0xCD);
+}
+
+TEST(CacheTest, HierarchyLineSizeTest) {
+  Memory memory;
+  cache::CacheHierarchy caches(memory);
+  cache::CacheConfig l1 = cache::CacheConfig::FromSizes(1024, 64, 2);
+  cache::CacheConfig l2 = cache::CacheConfig::FromSizes(4096, 32, 2);
+  ASSERT_THROW(caches.Configure(&l1, &l1, &l2, nullptr), std::invalid_argument);
+}
+
+TEST(CacheTest, NextLinePrefetchTest) {
+  Memory memory;
+  cache::CacheConfig config = SmallConfig();
+  config.miss_penalty = 10;
+  config.prefetcher.type = cache::PrefetcherType::NextLine;
+  cache::Cache cache(config, memory);
+  for (uint64_t line = 0; line < 8; ++line) {
+    cache.SetAccessContext(0, line * 100);
+    cache.Read(line * 16, 4);
+  }
+  ASSERT_EQ(cache.GetStats().misses, 1);
+  ASSERT_EQ(cache.GetStats().prefetches, 8);
+  ASSERT_EQ(cache.GetStats().prefetch_useful, 7);
+  ASSERT_EQ(cache.GetStats().prefetch_late, 0);
+  ASSERT_EQ(cache.GetStats().penalty_cycles, 10);
+
+  cache.Reset();
+  cache.SetAccessContext(0, 0);
+  cache.Read(0x000, 4);
+  cache.SetAccessContext(0, 4); // the prefetch of 0x010 lands in cycle 10
+  cache.Read(0x010, 4);
+  ASSERT_EQ(cache.GetStats().prefetch_late, 1);
+  ASSERT_EQ(cache.GetStats().penalty_cycles, 10 + 6);
+
+  cache.Reset();
+  cache.Read(0x000, 4); // prefetches 0x010 into set 1
+  cache.Read(0x050, 4);
+  cache.Read(0x090, 4); // set 1 again: evicts the unused 0x010
+  ASSERT_EQ(cache.GetStats().prefetch_useless, 1);
+}
+
+TEST(CacheTest, StridePrefetchTest) {
+  Memory memory;
+  cache::CacheConfig config = cache::CacheConfig::FromSizes(1024, 16, 4);
+  config.prefetcher.type = cache::PrefetcherType::Stride;
+  cache::Cache cache(config, memory);
+  for (uint64_t i = 0; i < 10; ++i) {
+    cache.SetAccessContext(0x100, 200 * i);
+    cache.Read(0x1000 + i * 0x40, 8);
+    // A second load in between, to a fixed address, keeps its own table entry.
+    cache.SetAccessContext(0x104, 200 * i + 100);
+    cache.Read(0x8000, 8);
+  }
+  // The strided load misses until its stride has repeated, then finds every line prefetched.
+  ASSERT_EQ(cache.GetStats().misses, 3 + 1);
+  ASSERT_EQ(cache.GetStats().prefetch_useful, 7);
+  ASSERT_EQ(cache.GetStats().prefetches, 8);
+}
+
+TEST(CacheTest, StreamPrefetchTest) {
+  Memory memory;
+  cache::CacheConfig config = cache::CacheConfig::FromSizes(1024, 16, 4);
+  config.prefetcher.type = cache::PrefetcherType::Stream;
+  config.prefetcher.degree = 2;
+  cache::Cache cache(config, memory);
+  for (uint64_t i = 0; i < 10; ++i) {
+    cache.SetAccessContext(0, 100 * i);
+    cache.Read(0x2000 - i * 16, 4); // a descending stream
+  }
+  ASSERT_EQ(cache.GetStats().misses, 2);
+  ASSERT_EQ(cache.GetStats().prefetch_useful, 8);
+}
+
+TEST(CacheTest, PrefetchBelowL1Test) {
+  Memory memory;
+  cache::CacheHierarchy caches(memory);
+  cache::CacheConfig l1 = cache::CacheConfig::FromSizes(64, 16, 1);
+  l1.miss_penalty = 10;
+  l1.prefetcher.type = cache::PrefetcherType::NextLine;
+  cache::CacheConfig l2 = cache::CacheConfig::FromSizes(128, 16, 2);
+  l2.miss_penalty = 100;
+  caches.Configure(nullptr, &l1, &l2, nullptr);
+  cache::Cache &data = *caches.DataPath();
+  const cache::Cache &below = *caches.Get(cache::CacheHierarchy::kL2);
+  data.Read(0x000, 4); // the prefetch of 0x010 misses L2 too, so it lands in cycle 110
+  ASSERT_EQ(below.GetStats().accesses, 1);
+  ASSERT_EQ(below.GetStats().prefetch_accesses, 1);
+  ASSERT_EQ(below.GetStats().prefetch_misses, 1);
+  ASSERT_EQ(below.GetStats().penalty_cycles, 100);
+
+  caches.SetAccessContext(0, 50);
+  data.Read(0x010, 4);
+  ASSERT_EQ(data.GetStats().prefetch_late, 1);
+  ASSERT_EQ(data.GetStats().penalty_cycles, 10 + 60);
+  ASSERT_EQ(below.GetStats().accesses, 1);
+}
+
+TEST(CacheTest, MshrTest) {
+  Memory memory;
+  cache::CacheConfig config = SmallConfig();
+  config.miss_penalty = 100;
+  config.mshrs = 2;
+  cache::Cache cache(config, memory);
+  cache.Read(0x000, 4);
+  ASSERT_EQ(cache.LastLatency(), 100);
+  cache.SetAccessContext(0, 1);
+  cache.Read(0x010, 4);
+  cache.SetAccessContext(0, 2);
+  cache.Read(0x020, 4); // both MSHRs busy: waits for the first line, in cycle 100
+  ASSERT_EQ(cache.LastStall(), 98);
+  ASSERT_EQ(cache.LastLatency(), 198);
+  ASSERT_EQ(cache.GetStats().mshr_stall_cycles, 98);
+
+  cache.SetAccessContext(0, 50);
+  cache.Read(0x004, 4); // a secondary miss on the first line
+  ASSERT_EQ(cache.GetStats().mshr_merges, 1);
+  ASSERT_EQ(cache.LastStall(), 0);
+  ASSERT_EQ(cache.LastLatency(), 50);
+
+  cache.SetAccessContext(0, 300);
+  cache.Read(0x004, 4);
+  ASSERT_EQ(cache.LastLatency(), 0);
+  ASSERT_EQ(cache.MshrOccupancy(), (std::vector<uint64_t>{100, 100, 100}));
+}
+
+TEST(CacheTest, WriteBufferTest) {
+  Memory memory;
+  cache::CacheConfig config = SmallConfig();
+  config.write_hit_policy = cache::WriteHitPolicy::WriteThrough;
+  config.write_miss_policy = cache::WriteMissPolicy::NoWriteAllocate;
+  config.miss_penalty = 10;
+  config.write_buffer_entries = 2;
+  cache::Cache cache(config, memory);
+  cache.Write(0x000, 1, 4);
+  cache.Write(0x010, 2, 4);
+  cache.Write(0x004, 3, 4); // joins the entry for 0x000
+  ASSERT_EQ(cache.GetStats().write_buffer_coalesced, 1);
+  ASSERT_EQ(cache.LastStall(), 0);
+  cache.Write(0x020, 4, 4); // full until 0x000 drains in cycle 10
+  ASSERT_EQ(cache.LastStall(), 10);
+  ASSERT_EQ(cache.GetStats().write_buffer_stall_cycles, 10);
+  ASSERT_EQ(cache.GetStats().penalty_cycles, 10);
+  ASSERT_EQ(memory.ReadWord(0x020), 4);
+}
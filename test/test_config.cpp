@@ -29,3 +29,57 @@
 //   ASSERT_THROW(vm_config::ini::Get("NonExistentSection", "non_existent_key"), std::invalid_argument);
 //   ASSERT_THROW(vm_config::ini::Set("NonExistentSection", "non_existent_key", "value"), std::invalid_argument);
 // }
+
+TEST(ConfigTest, MemorySizeTest) {
+  vm_config::VmConfig config;
+  config.modifyConfig("Memory", "memory_size", "0xffffffffffffffff");
+  ASSERT_EQ(config.getMemorySize(), 0xffffffffffffffffULL);
+  config.modifyConfig("Memory", "memory_size", "0X100000");
+  ASSERT_EQ(config.getMemorySize(), 0x100000u);
+  config.modifyConfig("Memory", "memory_size", "1048576");
+  ASSERT_EQ(config.getMemorySize(), 1048576u);
+  config.modifyConfig("Memory", "memory_size", "0100000"); // decimal, not octal
+  ASSERT_EQ(config.getMemorySize(), 100000u);
+
+  ASSERT_THROW(config.modifyConfig("Memory", "memory_size", "0x"), std::invalid_argument);
+  ASSERT_THROW(config.modifyConfig("Memory", "memory_size", "12kb"), std::invalid_argument);
+  ASSERT_THROW(config.modifyConfig("Memory", "memory_size", "-1"), std::invalid_argument);
+  ASSERT_EQ(config.getMemorySize(), 100000u);
+}
+
+TEST(ConfigTest, JitCodeCacheSizeTest) {
+  vm_config::VmConfig config;
+  config.modifyConfig("Execution", "jit_code_cache_size", "65536");
+  ASSERT_EQ(config.getJitCodeCacheSize(), 65536u);
+
+  ASSERT_THROW(config.modifyConfig("Execution", "jit_code_cache_size", "0"), std::invalid_argument);
+  ASSERT_THROW(config.modifyConfig("Execution", "jit_code_cache_size", "4095"), std::invalid_argument);
+  ASSERT_EQ(config.getJitCodeCacheSize(), 65536u);
+}
+
+TEST(ConfigTest, BranchPredictorHistoryLengthTest) {
+  vm_config::VmConfig config;
+  config.modifyConfig("BranchPrediction", "branch_prediction_history_length", "1024");
+  ASSERT_EQ(config.getBranchPredictorHistoryLength(), 1024u);
+  config.modifyConfig("BranchPrediction", "branch_prediction_history_length", "0");
+  ASSERT_EQ(config.getBranchPredictorHistoryLength(), 0u);
+
+  ASSERT_THROW(config.modifyConfig("BranchPrediction", "branch_prediction_history_length", "1025"),
+               std::invalid_argument);
+  ASSERT_THROW(config.modifyConfig("BranchPrediction", "branch_prediction_history_length", "4294967296"),
+               std::invalid_argument);
+  ASSERT_EQ(config.getBranchPredictorHistoryLength(), 0u);
+}
+
+TEST(ConfigTest, BranchPredictorTableSizeTest) {
+  vm_config::VmConfig config;
+  config.modifyConfig("BranchPrediction", "branch_prediction_table_size", "16777216");
+  ASSERT_EQ(config.getBranchPredictorTableSize(), 16777216u);
+
+  ASSERT_THROW(config.modifyConfig("BranchPrediction", "branch_prediction_table_size", "0"), std::invalid_argument);
+  ASSERT_THROW(config.modifyConfig("BranchPrediction", "branch_prediction_table_size", "16777217"),
+               std::invalid_argument);
+  ASSERT_THROW(config.modifyConfig("BranchPrediction", "branch_prediction_table_size", "1000000000000"),
+               std::invalid_argument);
+  ASSERT_EQ(config.getBranchPredictorTableSize(), 16777216u);
+}
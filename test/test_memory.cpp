@@ -6,6 +6,7 @@
 
 #include <gtest/gtest.h>
 #include "../vm/main_memory.h"
+#include "config_guard.h"
 
 TEST(MemoryTest, ReadWriteTest) {
   Memory memory;
@@ -87,4 +88,149 @@ TEST(MemoryTest, ReadWriteLargeDoubleTest) {
   EXPECT_DOUBLE_EQ(memory.ReadDouble(4096), large_value4);
 }
 
+TEST(MemoryTest, FlatBackingTest) {
+  ConfigGuard config_guard;
+  vm_config::config.setMemorySize(1ULL << 32);
+  vm_config::config.setMemoryBacking(vm_config::MemoryBacking::FLAT);
+  Memory memory;
+
+  uint64_t value = 0;
+  EXPECT_TRUE(memory.TryRead<uint64_t>(0x10000000, value));
+  EXPECT_EQ(value, 0u);
+  // Crosses what would be a block boundary in the sparse backing.
+  EXPECT_TRUE(memory.TryWrite<uint64_t>(1020, 0x0123456789abcdefULL));
+  EXPECT_EQ(memory.ReadDoubleWord(1020), 0x0123456789abcdefULL);
+  EXPECT_EQ(memory.ReadByte(1020), 0xef);
+  EXPECT_EQ(memory.ReadHalfWord(1026), 0x0123);
+  memory.WriteDouble(4096, -2.5);
+  EXPECT_DOUBLE_EQ(memory.ReadDouble(4096), -2.5);
+  EXPECT_FALSE(memory.TryWrite<uint32_t>((1ULL << 32) - 2, 1));
+  EXPECT_THROW(memory.ReadWord((1ULL << 32) - 2), std::out_of_range);
+
+  memory.Reset();
+  EXPECT_EQ(memory.ReadDoubleWord(1020), 0u);
+}
+
+TEST(MemoryTest, FlatBackingConfigTest) {
+  vm_config::VmConfig config;
+  EXPECT_THROW(config.modifyConfig("Memory", "memory_backing", "flat"), std::invalid_argument);
+  config.modifyConfig("Memory", "memory_size", "0x100000000");
+  EXPECT_EQ(config.getMemorySize(), 1ULL << 32);
+  config.modifyConfig("Memory", "memory_backing", "flat");
+  EXPECT_EQ(config.getMemoryBacking(), vm_config::MemoryBacking::FLAT);
+  EXPECT_THROW(config.modifyConfig("Memory", "memory_size", "0xffffffffffffffff"), std::invalid_argument);
+  EXPECT_EQ(config.getMemorySize(), 1ULL << 32);
+}
+
+TEST(MemoryTest, BlockTlbTest) {
+  Memory memory;
+  // A read of an unwritten block caches the miss; the write that creates the block must replace it.
+  EXPECT_EQ(memory.ReadWord(0x10000000), 0u);
+  memory.WriteWord(0x10000000, 0xdeadbeef);
+  EXPECT_EQ(memory.ReadWord(0x10000000), 0xdeadbeefu);
+  // 64 blocks apart, so both land on the same TLB entry.
+  memory.WriteWord(0x10000000 + 64 * 1024, 0x12345678);
+  EXPECT_EQ(memory.ReadWord(0x10000000), 0xdeadbeefu);
+  EXPECT_EQ(memory.ReadWord(0x10000000 + 64 * 1024), 0x12345678u);
+  // Straddles two blocks.
+  memory.WriteDoubleWord(1020, 0x0123456789abcdefULL);
+  EXPECT_EQ(memory.ReadDoubleWord(1020), 0x0123456789abcdefULL);
+
+  memory.Reset();
+  EXPECT_EQ(memory.ReadWord(0x10000000), 0u);
+  EXPECT_EQ(memory.ReadDoubleWord(1020), 0u);
+}
+
+TEST(MemoryTest, BlockAccessTest) {
+  ConfigGuard config_guard;
+  Memory memory;
+  std::vector<uint8_t> bytes(3000);
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    bytes[i] = static_cast<uint8_t>(i % 251 + 1);
+  }
+  // Starts mid-block and spans four blocks.
+  memory.WriteBlock(1000, bytes);
+  EXPECT_EQ(memory.ReadByte(1000 + 2999), bytes[2999]);
+  std::vector<uint8_t> read(3100, 0xFF);
+  memory.ReadBlock(900, read);
+  EXPECT_EQ(read[99], 0);
+  EXPECT_TRUE(std::equal(bytes.begin(), bytes.end(), read.begin() + 100));
+
+  EXPECT_EQ(memory.FindByte(1000, 0, 10000), 3000u);
+  EXPECT_EQ(memory.FindByte(1000, bytes[2500], 10000), 2500u % 251);
+  EXPECT_EQ(memory.FindByte(1000, 0, 100), 100u);
+  EXPECT_EQ(memory.FindByte(0x20000000, 0, 100), 0u); // never written
+
+  vm_config::config.setMemorySize(8192);
+  memory.Reset();
+  EXPECT_THROW(memory.WriteBlock(8000, bytes), std::out_of_range);
+  EXPECT_EQ(memory.ReadByte(8000), 0);
+  memory.WriteBlock(8190, std::vector<uint8_t>{7, 7});
+  EXPECT_THROW((void)memory.FindByte(8190, 0, 10), std::out_of_range);
+  EXPECT_EQ(memory.FindByte(8190, 0, 2), 2u);
+}
 
+TEST(MemoryTest, SnapshotTest) {
+  ConfigGuard config_guard;
+  vm_config::config.setMemorySize(1ULL << 32);
+  for (auto backing : {vm_config::MemoryBacking::SPARSE, vm_config::MemoryBacking::FLAT}) {
+    vm_config::config.setMemoryBacking(backing);
+    Memory memory;
+    EXPECT_FALSE(memory.RestoreSnapshot());
+    memory.WriteWord(0x10000000, 0x11111111);
+    memory.WriteWord(0x10000400, 0x22222222);
+    memory.TakeSnapshot();
+    EXPECT_TRUE(memory.HasSnapshot());
+    EXPECT_EQ(memory.ReadWord(0x10000000), 0x11111111u);
+
+    // Writes after the snapshot, including one into a block shared with it, leave it alone.
+    memory.WriteWord(0x10000004, 0x33333333);
+    memory.WriteWord(0x20000000, 0x44444444);
+    EXPECT_EQ(memory.ReadWord(0x10000000), 0x11111111u);
+    EXPECT_TRUE(memory.RestoreSnapshot());
+    EXPECT_EQ(memory.ReadWord(0x10000004), 0u);
+    EXPECT_EQ(memory.ReadWord(0x20000000), 0u);
+    EXPECT_EQ(memory.ReadWord(0x10000400), 0x22222222u);
+
+    // Reset hides the snapshot until it is restored.
+    memory.Reset();
+    EXPECT_EQ(memory.ReadWord(0x10000000), 0u);
+    EXPECT_TRUE(memory.RestoreSnapshot());
+    EXPECT_EQ(memory.ReadWord(0x10000000), 0x11111111u);
+
+    // A second snapshot takes in what was written on top of the first.
+    memory.WriteWord(0x10000008, 0x55555555);
+    memory.TakeSnapshot();
+    memory.WriteWord(0x10000008, 0);
+    EXPECT_TRUE(memory.RestoreSnapshot());
+    EXPECT_EQ(memory.ReadWord(0x10000008), 0x55555555u);
+    EXPECT_EQ(memory.ReadWord(0x10000400), 0x22222222u);
+
+    // Changed settings drop it.
+    vm_config::config.setMemorySize(1ULL << 31);
+    memory.Reset();
+    EXPECT_FALSE(memory.HasSnapshot());
+    vm_config::config.setMemorySize(1ULL << 32);
+  }
+}
+
+TEST(MemoryTest, UsedBlocksTest) {
+  ConfigGuard config_guard;
+  vm_config::config.setMemorySize(1ULL << 32);
+  for (auto backing : {vm_config::MemoryBacking::SPARSE, vm_config::MemoryBacking::FLAT}) {
+    vm_config::config.setMemoryBacking(backing);
+    Memory memory;
+    const uint64_t block_size = memory.BlockSize();
+    memory.WriteByte(3 * block_size + 5, 1);
+    memory.TakeSnapshot();
+    memory.WriteByte(0x10000000, 2);
+    std::vector<uint64_t> used = memory.UsedBlocks();
+    // The flat backing may add other blocks on the same pages.
+    EXPECT_TRUE(std::is_sorted(used.begin(), used.end()));
+    EXPECT_TRUE(std::binary_search(used.begin(), used.end(), 3 * block_size));
+    EXPECT_TRUE(std::binary_search(used.begin(), used.end(), 0x10000000 / block_size * block_size));
+    if (backing == vm_config::MemoryBacking::SPARSE) {
+      EXPECT_EQ(used.size(), 2u);
+    }
+  }
+}
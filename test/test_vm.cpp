@@ -6,7 +6,12 @@
 
 #include <gtest/gtest.h>
 #include "../src/vm/rvss/rvss_vm.h"
+#include "../src/vm/rvss/rvss_threaded_vm.h"
+#include "../src/vm/rv5s/rv5s_vm.h"
+#include "../src/vm/rvss/rvss_decode_table.h"
+#include "../src/config.h"
 #include "../src/assembler/assembler.h"
+#include "config_guard.h"
 
 TEST(VmTest, ImmGenTest1) {
   RVSSVM vm;
@@ -209,4 +214,773 @@ TEST(VmTest, ExecutionTest11) {
   ASSERT_EQ(vm.registers_.ReadGpr(3), 0x0000000000100000);
   vm.Step();
   ASSERT_EQ(vm.registers_.ReadGpr(4), 0x0000000000100004);
-}
\ No newline at end of file
+}
+TEST(VmTest, PredecodeInvalidationTest) {
+  RVSSVM vm;
+  AssembledProgram program;
+  program.text_buffer.push_back(0x00c02303); // lw x6, 12(x0)
+  program.text_buffer.push_back(0x00602423); // sw x6, 8(x0)
+  program.text_buffer.push_back(0x00100513); // addi x10, x0, 1
+  program.text_buffer.push_back(0x00700513); // addi x10, x0, 7
+  vm.LoadProgram(program);
+  ASSERT_EQ(vm.decoded_instructions_.size(), 4);
+  vm.Step();
+  vm.Step();
+  ASSERT_FALSE(vm.decoded_instructions_[2].valid);
+  vm.Step();
+  ASSERT_EQ(vm.registers_.ReadGpr(10), 7);
+  vm.Undo();
+  vm.Undo();
+  ASSERT_EQ(vm.FetchDecoded(8).instruction, 0x00100513);
+}
+
+TEST(VmTest, LongInvalidatedTextTest) {
+  RVSSVM vm;
+  AssembledProgram program;
+  program.text_buffer.assign(200000, 0x00150513); // addi x10, x10, 1
+  vm.LoadProgram(program);
+  vm.InvalidateDecodedRange(0, vm.program_size_);
+  // Decoding the first entry must not walk the whole invalidated run.
+  ASSERT_EQ(vm.FetchDecoded(0).instruction, 0x00150513);
+  ASSERT_FALSE(vm.decoded_instructions_[1].valid);
+  ASSERT_EQ(vm.FetchDecoded(vm.program_size_ - 4).instruction, 0x00150513);
+}
+
+TEST(VmTest, ResetToLoadedTest) {
+  AssembledProgram program;
+  program.text_buffer.push_back(0x00c02303); // lw x6, 12(x0)
+  program.text_buffer.push_back(0x00602423); // sw x6, 8(x0), patches the next instruction
+  program.text_buffer.push_back(0x00100513); // addi x10, x0, 1
+  program.text_buffer.push_back(0x00700513); // addi x10, x0, 7
+
+  for (bool threaded : {false, true}) {
+    std::unique_ptr<VmBase> vm;
+    if (threaded) {
+      vm = std::make_unique<RVSSThreadedVM>();
+    } else {
+      vm = std::make_unique<RVSSVM>();
+    }
+    ASSERT_FALSE(vm->ResetToLoaded());
+    vm->LoadProgram(program);
+    vm->Run();
+    ASSERT_EQ(vm->registers_.ReadGpr(10), 7);
+    ASSERT_EQ(vm->memory_controller_.ReadWord(8), 0x00700513);
+
+    ASSERT_TRUE(vm->ResetToLoaded());
+    ASSERT_EQ(vm->program_counter_, 0);
+    ASSERT_EQ(vm->instructions_retired_, 0);
+    ASSERT_EQ(vm->registers_.ReadGpr(10), 0);
+    ASSERT_EQ(vm->memory_controller_.ReadWord(8), 0x00100513);
+    ASSERT_EQ(vm->FetchDecoded(8).instruction, 0x00100513);
+    vm->Step();
+    vm->Step();
+    vm->Step();
+    ASSERT_EQ(vm->registers_.ReadGpr(10), 7);
+  }
+}
+
+TEST(VmTest, ResetToLoadedLargeTextTest) {
+  ConfigGuard config_guard;
+  AssembledProgram program;
+  program.text_buffer.assign(200000, 0x00150513); // addi x10, x10, 1
+  program.text_buffer[0] = 0x00002023;            // sw x0, 0(x0), overwrites itself
+
+  vm_config::config.setInstructionExecutionLimit(1000000);
+  for (bool threaded : {false, true}) {
+    std::unique_ptr<VmBase> vm;
+    if (threaded) {
+      vm = std::make_unique<RVSSThreadedVM>();
+    } else {
+      vm = std::make_unique<RVSSVM>();
+    }
+    vm->LoadProgram(program);
+    vm->Run();
+    ASSERT_EQ(vm->registers_.ReadGpr(10), 199999);
+    ASSERT_TRUE(vm->ResetToLoaded());
+    ASSERT_EQ(vm->FetchDecoded(0).instruction, 0x00002023);
+    vm->Run();
+    ASSERT_EQ(vm->registers_.ReadGpr(10), 199999);
+  }
+}
+
+TEST(VmTest, CheckpointTest) {
+  AssembledProgram program;
+  program.text_buffer.push_back(0x00a00293); // addi x5, x0, 10
+  program.text_buffer.push_back(0x00550533); // add x10, x10, x5
+  program.text_buffer.push_back(0x10a02023); // sw x10, 256(x0)
+  program.text_buffer.push_back(0xfff28293); // addi x5, x5, -1
+  program.text_buffer.push_back(0xfe029ae3); // bne x5, x0, -12
+  const std::filesystem::path path = std::filesystem::temp_directory_path() / "vm_test_checkpoint.bin";
+
+  RVSSVM reference;
+  reference.LoadProgram(program);
+  reference.StepN(13);
+  reference.registers_.WriteCsr(0x340, 0x1234); // mscratch
+  reference.SaveCheckpoint(path);
+  reference.Run();
+
+  std::vector<std::unique_ptr<VmBase>> vms;
+  vms.push_back(std::make_unique<RVSSVM>());
+  vms.push_back(std::make_unique<RVSSThreadedVM>());
+  vms.push_back(std::make_unique<RV5SVM>());
+  for (auto &vm : vms) {
+    vm->LoadCheckpoint(path);
+    ASSERT_EQ(vm->program_counter_, 0x4);
+    ASSERT_EQ(vm->instructions_retired_, 13);
+    ASSERT_EQ(vm->registers_.ReadCsr(0x340), 0x1234);
+    vm->Run();
+    ASSERT_EQ(vm->registers_.GetGprValues(), reference.registers_.GetGprValues());
+    ASSERT_EQ(vm->memory_controller_.ReadWord(0x100), reference.memory_controller_.ReadWord(0x100));
+    ASSERT_TRUE(vm->ResetToLoaded());
+    ASSERT_EQ(vm->program_counter_, 0x4);
+    ASSERT_EQ(vm->memory_controller_.ReadWord(0x100), 10 + 9 + 8u);
+  }
+
+  // The checkpoint carries no source lines, so the previous program's lines and breakpoints go.
+  AssembledProgram with_lines = program;
+  with_lines.line_number_instruction_number_mapping[3] = 1;
+  with_lines.instruction_number_line_number_mapping[1] = 3;
+  RVSSVM lined;
+  lined.LoadProgram(with_lines);
+  ASSERT_TRUE(lined.InsertBreakpoint(3, true));
+  lined.LoadCheckpoint(path);
+  ASSERT_TRUE(lined.breakpoints_.empty());
+  ASSERT_FALSE(lined.CheckBreakpoint(4));
+  ASSERT_TRUE(lined.program_.line_number_instruction_number_mapping.empty());
+  ASSERT_FALSE(lined.InsertBreakpoint(3, true));
+
+  // Counters past 32 bits survive the round trip.
+  reference.instructions_retired_ = 5000000000ULL;
+  reference.cycle_s_ = 7000000000ULL;
+  reference.branch_predictions_ = 4300000000ULL;
+  reference.SaveCheckpoint(path);
+  RV5SVM restored;
+  restored.LoadCheckpoint(path);
+  ASSERT_EQ(restored.instructions_retired_, 5000000000ULL);
+  ASSERT_EQ(restored.cycle_s_, 7000000000ULL);
+  ASSERT_EQ(restored.branch_predictions_, 4300000000ULL);
+
+  // A file that is not a checkpoint leaves the VM alone.
+  std::ofstream(path, std::ios::binary | std::ios::trunc) << "not a checkpoint";
+  ASSERT_THROW(reference.LoadCheckpoint(path), std::runtime_error);
+  ASSERT_EQ(reference.memory_controller_.ReadWord(0x100), 55u);
+  std::filesystem::remove(path);
+}
+
+TEST(VmTest, ThreadedEngineMatchesRvssTest) {
+  ConfigGuard config_guard;
+  AssembledProgram program;
+  program.text_buffer.push_back(0x00a00293); // addi x5, x0, 10
+  program.text_buffer.push_back(0x00550533); // add x10, x10, x5
+  program.text_buffer.push_back(0xfff28293); // addi x5, x5, -1
+  program.text_buffer.push_back(0xfe029ce3); // bne x5, x0, -8
+  program.text_buffer.push_back(0x00a02223); // sw x10, 4(x0)
+
+  for (uint64_t limit : {3, 6, 1000}) {
+    vm_config::config.setInstructionExecutionLimit(limit);
+    RVSSVM reference;
+    RVSSThreadedVM threaded;
+    reference.LoadProgram(program);
+    threaded.LoadProgram(program);
+    reference.Run();
+    threaded.Run();
+    ASSERT_EQ(threaded.program_counter_, reference.program_counter_);
+    ASSERT_EQ(threaded.instructions_retired_, reference.instructions_retired_);
+    ASSERT_EQ(threaded.registers_.GetGprValues(), reference.registers_.GetGprValues());
+    ASSERT_EQ(threaded.memory_controller_.ReadWord(4), reference.memory_controller_.ReadWord(4));
+  }
+}
+
+TEST(VmTest, ThreadedEngineSelfModifyingBlockTest) {
+  ConfigGuard config_guard;
+  // The loop body turns an addi into a jump over the next instruction, splitting its block.
+  AssembledProgram program;
+  program.text_buffer.push_back(0x00300293); // addi x5, x0, 3
+  program.text_buffer.push_back(0x008003b7); // lui x7, 0x800
+  program.text_buffer.push_back(0x06f38393); // addi x7, x7, 0x6f (x7 = jal x0, 8)
+  program.text_buffer.push_back(0x00158593); // addi x11, x11, 1
+  program.text_buffer.push_back(0x00150513); // addi x10, x10, 1, patched
+  program.text_buffer.push_back(0x00160613); // addi x12, x12, 1
+  program.text_buffer.push_back(0x00702823); // sw x7, 16(x0)
+  program.text_buffer.push_back(0xfff28293); // addi x5, x5, -1
+  program.text_buffer.push_back(0xfe0296e3); // bne x5, x0, -20
+
+  vm_config::config.setInstructionExecutionLimit(1000);
+  for (bool jit : {false, true}) {
+    vm_config::config.setJitEnabled(jit);
+    vm_config::config.setJitHotThreshold(1);
+    RVSSVM reference;
+    RVSSThreadedVM threaded;
+    reference.LoadProgram(program);
+    threaded.LoadProgram(program);
+    reference.Run();
+    threaded.Run();
+    ASSERT_EQ(threaded.registers_.ReadGpr(11), 3);
+    ASSERT_EQ(threaded.registers_.ReadGpr(10), 1);
+    ASSERT_EQ(threaded.registers_.ReadGpr(12), 1);
+    ASSERT_EQ(threaded.program_counter_, reference.program_counter_);
+    ASSERT_EQ(threaded.instructions_retired_, reference.instructions_retired_);
+    ASSERT_EQ(threaded.registers_.GetGprValues(), reference.registers_.GetGprValues());
+  }
+}
+
+TEST(VmTest, JitMatchesRvssTest) {
+  ConfigGuard config_guard;
+  AssembledProgram program;
+  program.text_buffer.push_back(0x002503b7); // lui x7, 0x250
+  program.text_buffer.push_back(0x51338393); // addi x7, x7, 0x513 (x7 = addi x10, x10, 2)
+  program.text_buffer.push_back(0x00a00293); // addi x5, x0, 10
+  program.text_buffer.push_back(0x00150513); // addi x10, x10, 1
+  program.text_buffer.push_back(0xfff28293); // addi x5, x5, -1
+  program.text_buffer.push_back(0x00702623); // sw x7, 12(x0), patches the loop head
+  program.text_buffer.push_back(0xfe029ae3); // bne x5, x0, -12
+
+  vm_config::config.setJitHotThreshold(1);
+  for (uint64_t limit : {4, 9, 1000}) {
+    vm_config::config.setInstructionExecutionLimit(limit);
+    RVSSVM reference;
+    RVSSThreadedVM threaded;
+    reference.LoadProgram(program);
+    threaded.LoadProgram(program);
+    reference.Run();
+    threaded.Run();
+    ASSERT_EQ(threaded.program_counter_, reference.program_counter_);
+    ASSERT_EQ(threaded.instructions_retired_, reference.instructions_retired_);
+    ASSERT_EQ(threaded.registers_.GetGprValues(), reference.registers_.GetGprValues());
+  }
+}
+
+TEST(VmTest, JitCodeCacheFullTest) {
+  ConfigGuard config_guard;
+  // Every pass rewrites the loop head, so each retranslation lands in fresh cache
+  // space until a block no longer fits and the cache is flushed.
+  AssembledProgram program;
+  program.text_buffer.push_back(0x002503b7); // lui x7, 0x250
+  program.text_buffer.push_back(0x51338393); // addi x7, x7, 0x513 (x7 = addi x10, x10, 2)
+  program.text_buffer.push_back(0x7d000293); // addi x5, x0, 2000
+  program.text_buffer.push_back(0x00150513); // addi x10, x10, 1
+  program.text_buffer.push_back(0x00a58593); // addi x11, x11, 10
+  program.text_buffer.push_back(0x00b60633); // add x12, x12, x11
+  program.text_buffer.push_back(0x40a686b3); // sub x13, x13, x10
+  program.text_buffer.push_back(0xfff28293); // addi x5, x5, -1
+  program.text_buffer.push_back(0x00702623); // sw x7, 12(x0), patches the loop head
+  program.text_buffer.push_back(0xfe0294e3); // bne x5, x0, -24
+
+  vm_config::config.setJitHotThreshold(1);
+  vm_config::config.setJitCodeCacheSize(vm_config::kMinJitCodeCacheSize);
+  vm_config::config.setInstructionExecutionLimit(20000);
+  RVSSVM reference;
+  RVSSThreadedVM threaded;
+  reference.LoadProgram(program);
+  threaded.LoadProgram(program);
+  reference.Run();
+  threaded.Run();
+  ASSERT_EQ(threaded.program_counter_, reference.program_counter_);
+  ASSERT_EQ(threaded.instructions_retired_, reference.instructions_retired_);
+  ASSERT_EQ(threaded.registers_.GetGprValues(), reference.registers_.GetGprValues());
+}
+
+TEST(VmTest, RunPolicyUndoCaptureTest) {
+  AssembledProgram program;
+  program.text_buffer.push_back(0x00a00293); // addi x5, x0, 10
+  program.text_buffer.push_back(0x00550533); // add x10, x10, x5
+  program.text_buffer.push_back(0x00a02223); // sw x10, 4(x0)
+
+  RVSSVM fast;
+  fast.LoadProgram(program);
+  fast.Run();
+  ASSERT_EQ(fast.instructions_retired_, 3);
+  ASSERT_TRUE(fast.undo_stack_.empty());
+  ASSERT_TRUE(fast.current_delta_.register_changes.empty());
+  ASSERT_TRUE(fast.current_delta_.memory_changes.empty());
+
+  RVSSVM stepped;
+  stepped.LoadProgram(program);
+  stepped.Step();
+  stepped.Step();
+  stepped.Step();
+  ASSERT_EQ(stepped.instructions_retired_, 3);
+  ASSERT_EQ(stepped.undo_stack_.size(), 3);
+  ASSERT_EQ(stepped.undo_stack_.top().memory_changes.size(), 1);
+  ASSERT_EQ(stepped.registers_.GetGprValues(), fast.registers_.GetGprValues());
+}
+
+TEST(VmTest, FusedPairsMatchSteppedTest) {
+  AssembledProgram program;
+  program.text_buffer.push_back(0x000012b7); // lui x5, 0x1
+  program.text_buffer.push_back(0x00528293); // addi x5, x5, 5
+  program.text_buffer.push_back(0x00400513); // addi x10, x0, 4
+  program.text_buffer.push_back(0x00138393); // addi x7, x7, 1
+  program.text_buffer.push_back(0xfea39ee3); // bne x7, x10, -4
+
+  RVSSVM fused;
+  fused.LoadProgram(program);
+  fused.Run();
+  ASSERT_EQ(fused.instructions_retired_, 11);
+  ASSERT_EQ(fused.fused_pairs_, 5);
+
+  RVSSVM stepped;
+  stepped.LoadProgram(program);
+  for (int i = 0; i < 11; ++i) {
+    stepped.Step();
+  }
+  ASSERT_EQ(stepped.fused_pairs_, 0);
+  ASSERT_EQ(stepped.undo_stack_.size(), 11);
+  ASSERT_EQ(stepped.program_counter_, fused.program_counter_);
+  ASSERT_EQ(stepped.registers_.GetGprValues(), fused.registers_.GetGprValues());
+  ASSERT_EQ(fused.registers_.ReadGpr(5), 0x1005);
+}
+
+TEST(VmTest, DecodeTableRoundTripTest) {
+  using instruction_set::Instruction;
+  for (const auto &encoding : instruction_set::compiletime_instruction_encoding_array) {
+    if (encoding.opcode < 0 || encoding.instr <= Instruction::kCsrType) continue;
+    uint32_t word = static_cast<uint32_t>(encoding.opcode);
+    if (encoding.funct3 >= 0) word |= static_cast<uint32_t>(encoding.funct3) << 12;
+    if (encoding.funct5 >= 0) word |= static_cast<uint32_t>(encoding.funct5) << 20;
+    if (encoding.funct2 >= 0) word |= static_cast<uint32_t>(encoding.funct2) << 25;
+    if (encoding.funct7 >= 0) word |= static_cast<uint32_t>(encoding.funct7) << 25;
+    if (encoding.funct6 >= 0) word |= static_cast<uint32_t>(encoding.funct6) << 26;
+    ASSERT_EQ(rvss_decode::kDecodeTable.Lookup(word).GetInstruction(), encoding.instr) << "opcode " << encoding.opcode;
+  }
+
+  RVSSControlUnit unit;
+  ASSERT_EQ(unit.GetAluSignal(0x40a1d093, false), alu::AluOp::kSra);  // srai x1, x3, 10
+  ASSERT_EQ(unit.GetAluSignal(0x0230d093, false), alu::AluOp::kSrl);  // srli x1, x1, 35
+  ASSERT_EQ(unit.GetAluSignal(0x02b57543, false), alu::AluOp::FMADD_D); // fmadd.d f10, f10, f11, f0
+  unit.SetControlSignals(0x00b50533); // add x10, x10, x11
+  ASSERT_TRUE(unit.GetRegWrite());
+  ASSERT_FALSE(unit.GetAluSrc());
+}
+
+TEST(VmTest, FloatEnvironmentTest) {
+  AssembledProgram program;
+  program.text_buffer.push_back(0x00100293); // addi x5, x0, 1
+  program.text_buffer.push_back(0xd00280d3); // fcvt.s.w f1, x5
+  program.text_buffer.push_back(0x00300313); // addi x6, x0, 3
+  program.text_buffer.push_back(0xd0030153); // fcvt.s.w f2, x6
+  program.text_buffer.push_back(0x1820f1d3); // fdiv.s f3, f1, f2, dyn
+  program.text_buffer.push_back(0x00102573); // csrrs x10, fflags, x0
+  program.text_buffer.push_back(0x02000393); // addi x7, x0, 0x20
+  program.text_buffer.push_back(0x00339073); // csrrw x0, fcsr, x7
+  program.text_buffer.push_back(0x1820f253); // fdiv.s f4, f1, f2, dyn
+  program.text_buffer.push_back(0x002025f3); // csrrs x11, frm, x0
+  program.text_buffer.push_back(0x00302673); // csrrs x12, fcsr, x0
+
+  RVSSVM vm;
+  vm.LoadProgram(program);
+  vm.Run();
+  ASSERT_EQ(vm.registers_.ReadFpr(3) & 0xFFFFFFFF, 0x3eaaaaab); // 1/3 to nearest
+  ASSERT_EQ(vm.registers_.ReadFpr(4) & 0xFFFFFFFF, 0x3eaaaaaa); // 1/3 towards zero
+  ASSERT_EQ(vm.registers_.ReadGpr(10), FCSR_INEXACT);
+  ASSERT_EQ(vm.registers_.ReadGpr(11), 0b001);
+  ASSERT_EQ(vm.registers_.ReadGpr(12), 0x20 | FCSR_INEXACT);
+  ASSERT_EQ(vm.registers_.ReadCsr(0x001), FCSR_INEXACT);
+  ASSERT_EQ(vm.registers_.ReadCsr(0x003), 0x20 | FCSR_INEXACT);
+  ASSERT_EQ(std::fegetround(), FE_TONEAREST); // the host gets its own mode back
+}
+
+TEST(VmTest, TrapTest) {
+  AssembledProgram halting;
+  halting.text_buffer.push_back(0xffc00293); // addi x5, x0, -4
+  halting.text_buffer.push_back(0x00700313); // addi x6, x0, 7
+  halting.text_buffer.push_back(0x0062a023); // sw x6, 0(x5)
+  halting.text_buffer.push_back(0x00100393); // addi x7, x0, 1
+
+  RVSSVM reference;
+  RVSSThreadedVM threaded;
+  reference.LoadProgram(halting);
+  threaded.LoadProgram(halting);
+  reference.Run();
+  threaded.Run();
+  for (VmBase *vm : {static_cast<VmBase *>(&reference), static_cast<VmBase *>(&threaded)}) {
+    ASSERT_TRUE(vm->trap_.halted);
+    ASSERT_EQ(vm->trap_.count, 1);
+    ASSERT_EQ(vm->program_counter_, 8);
+    ASSERT_EQ(vm->instructions_retired_, 2);
+    ASSERT_EQ(vm->registers_.ReadGpr(7), 0);
+    ASSERT_EQ(vm->registers_.ReadCsr(0x342), static_cast<uint64_t>(TrapCause::kStoreAccessFault));
+    ASSERT_EQ(vm->registers_.ReadCsr(0x341), 8);
+    ASSERT_EQ(vm->registers_.ReadCsr(0x343), 0xFFFFFFFFFFFFFFFCULL);
+  }
+
+  AssembledProgram handled;
+  handled.text_buffer.push_back(0x01400293); // addi x5, x0, 20
+  handled.text_buffer.push_back(0x30529073); // csrrw x0, mtvec, x5
+  handled.text_buffer.push_back(0xffc00313); // addi x6, x0, -4
+  handled.text_buffer.push_back(0x00032383); // lw x7, 0(x6)
+  handled.text_buffer.push_back(0x0140006f); // jal x0, 20
+  handled.text_buffer.push_back(0x34202573); // handler: csrrs x10, mcause, x0
+  handled.text_buffer.push_back(0x341025f3); // csrrs x11, mepc, x0
+  handled.text_buffer.push_back(0x00458593); // addi x11, x11, 4
+  handled.text_buffer.push_back(0x00058067); // jalr x0, 0(x11)
+  handled.text_buffer.push_back(0x00100613); // addi x12, x0, 1
+
+  RVSSVM vm;
+  vm.LoadProgram(handled);
+  vm.Run();
+  ASSERT_FALSE(vm.trap_.halted);
+  ASSERT_EQ(vm.trap_.count, 1);
+  ASSERT_EQ(vm.registers_.ReadGpr(7), 0);
+  ASSERT_EQ(vm.registers_.ReadGpr(10), static_cast<uint64_t>(TrapCause::kLoadAccessFault));
+  ASSERT_EQ(vm.registers_.ReadGpr(11), 16);
+  ASSERT_EQ(vm.registers_.ReadGpr(12), 1);
+  ASSERT_EQ(vm.registers_.ReadCsr(0x343), 0xFFFFFFFFFFFFFFFCULL);
+}
+
+TEST(VmTest, TrapUndoTest) {
+  ConfigGuard config_guard;
+  AssembledProgram handled;
+  handled.text_buffer.push_back(0x01400293); // addi x5, x0, 20
+  handled.text_buffer.push_back(0x30529073); // csrrw x0, mtvec, x5
+  handled.text_buffer.push_back(0xffc00313); // addi x6, x0, -4
+  handled.text_buffer.push_back(0x00032383); // lw x7, 0(x6)
+  handled.text_buffer.push_back(0x0140006f); // jal x0, 20
+  handled.text_buffer.push_back(0x34202573); // handler: csrrs x10, mcause, x0
+
+  RVSSVM vm;
+  vm.LoadProgram(handled);
+  for (int i = 0; i < 4; ++i) {
+    vm.Step();
+  }
+  ASSERT_EQ(vm.program_counter_, 20);
+  ASSERT_EQ(vm.instructions_retired_, 3);
+  vm.Undo();
+  ASSERT_EQ(vm.program_counter_, 12);
+  ASSERT_EQ(vm.instructions_retired_, 3);
+  ASSERT_EQ(vm.registers_.ReadCsr(0x342), 0);
+  ASSERT_EQ(vm.registers_.ReadCsr(0x341), 0);
+  ASSERT_EQ(vm.registers_.ReadCsr(0x343), 0);
+  vm.Redo();
+  ASSERT_EQ(vm.program_counter_, 20);
+  ASSERT_EQ(vm.registers_.ReadCsr(0x341), 12);
+
+  // A batch step that ends in the trap undoes as a whole, trap included.
+  vm_config::config.setStepUndoGranularity(vm_config::StepUndoGranularity::BATCH);
+  RVSSVM batched;
+  batched.LoadProgram(handled);
+  batched.StepN(4);
+  ASSERT_EQ(batched.program_counter_, 20);
+  batched.Undo();
+  ASSERT_EQ(batched.program_counter_, 0);
+  ASSERT_EQ(batched.instructions_retired_, 0);
+  ASSERT_EQ(batched.registers_.ReadCsr(0x342), 0);
+  vm_config::config.setStepUndoGranularity(vm_config::StepUndoGranularity::INSTRUCTION);
+
+  // Without a handler the PC stays on the access, but the trap CSRs are still undone.
+  AssembledProgram halting;
+  halting.text_buffer.push_back(0xffc00293); // addi x5, x0, -4
+  halting.text_buffer.push_back(0x0062a023); // sw x6, 0(x5)
+  RVSSVM halted;
+  halted.LoadProgram(halting);
+  halted.Step();
+  halted.Step();
+  ASSERT_TRUE(halted.trap_.halted);
+  ASSERT_EQ(halted.registers_.ReadCsr(0x341), 4);
+  halted.Undo();
+  ASSERT_EQ(halted.program_counter_, 4);
+  ASSERT_EQ(halted.registers_.ReadCsr(0x341), 0);
+  halted.Undo();
+  ASSERT_EQ(halted.program_counter_, 0);
+}
+
+TEST(VmTest, StepNTest) {
+  ConfigGuard config_guard;
+  AssembledProgram program;
+  program.text_buffer.push_back(0x00a00293); // addi x5, x0, 10
+  program.text_buffer.push_back(0x00550533); // add x10, x10, x5
+  program.text_buffer.push_back(0xfff28293); // addi x5, x5, -1
+  program.text_buffer.push_back(0xfe029ce3); // bne x5, x0, -8
+  program.text_buffer.push_back(0x00a02223); // sw x10, 4(x0)
+
+  RVSSVM stepped;
+  stepped.LoadProgram(program);
+  for (int i = 0; i < 20; ++i) {
+    stepped.Step();
+  }
+
+  RVSSVM batched;
+  batched.LoadProgram(program);
+  batched.StepN(20);
+  ASSERT_EQ(batched.instructions_retired_, 20);
+  ASSERT_EQ(batched.undo_stack_.size(), 20);
+  ASSERT_EQ(batched.program_counter_, stepped.program_counter_);
+  ASSERT_EQ(batched.registers_.GetGprValues(), stepped.registers_.GetGprValues());
+  batched.StepN(1000);
+  ASSERT_EQ(batched.instructions_retired_, 32);
+  ASSERT_EQ(batched.memory_controller_.ReadWord(4), 55);
+
+  vm_config::config.setStepUndoGranularity(vm_config::StepUndoGranularity::BATCH);
+  RVSSVM coalesced;
+  coalesced.LoadProgram(program);
+  const auto initial_gprs = coalesced.registers_.GetGprValues();
+  coalesced.StepN(1000);
+  vm_config::config.setStepUndoGranularity(vm_config::StepUndoGranularity::INSTRUCTION);
+  ASSERT_EQ(coalesced.undo_stack_.size(), 1);
+  ASSERT_EQ(coalesced.memory_controller_.ReadWord(4), 55);
+  const auto final_gprs = coalesced.registers_.GetGprValues();
+
+  coalesced.Undo();
+  ASSERT_EQ(coalesced.program_counter_, 0);
+  ASSERT_EQ(coalesced.instructions_retired_, 0);
+  ASSERT_EQ(coalesced.registers_.GetGprValues(), initial_gprs);
+  ASSERT_EQ(coalesced.memory_controller_.ReadWord(4), 0x00550533); // the store had overwritten the add
+
+  coalesced.Redo();
+  ASSERT_EQ(coalesced.program_counter_, 20);
+  ASSERT_EQ(coalesced.instructions_retired_, 32);
+  ASSERT_EQ(coalesced.registers_.GetGprValues(), final_gprs);
+  ASSERT_EQ(coalesced.memory_controller_.ReadWord(4), 55);
+}
+
+TEST(VmTest, BreakpointBitmapTest) {
+  AssembledProgram program;
+  for (int i = 0; i < 200; ++i) {
+    program.text_buffer.push_back(0x00128293); // addi x5, x5, 1
+  }
+
+  RVSSVM vm;
+  vm.LoadProgram(program);
+  ASSERT_FALSE(vm.CheckBreakpoint(0));
+  for (uint64_t address = 256; address < vm.program_size_; address += 4) {
+    vm.AddBreakpoint(address, false);
+  }
+  vm.AddBreakpoint(vm.program_size_, false); // outside the text, rejected
+  vm.AddBreakpoint(258, false);              // misaligned, rejected
+  ASSERT_EQ(vm.breakpoints_.size(), 136);
+  ASSERT_TRUE(vm.CheckBreakpoint(256));
+  ASSERT_TRUE(vm.CheckBreakpoint(796));
+  ASSERT_FALSE(vm.CheckBreakpoint(252));
+  ASSERT_FALSE(vm.CheckBreakpoint(258));
+  ASSERT_FALSE(vm.CheckBreakpoint(vm.program_size_));
+
+  vm.RemoveBreakpoint(256, false);
+  ASSERT_FALSE(vm.CheckBreakpoint(256));
+  ASSERT_EQ(vm.breakpoints_.size(), 135);
+
+  vm.StepN(1000);
+  ASSERT_EQ(vm.program_counter_, 260);
+  ASSERT_EQ(vm.output_status_, "VM_BREAKPOINT_HIT");
+
+  program.text_buffer.resize(100);
+  vm.LoadProgram(program); // only breakpoints inside the new text are kept
+  ASSERT_EQ(vm.breakpoints_.size(), 35);
+  ASSERT_TRUE(vm.CheckBreakpoint(396));
+  ASSERT_FALSE(vm.CheckBreakpoint(400));
+}
+
+TEST(VmTest, Rv5sPipelineTest) {
+  ConfigGuard config_guard;
+  AssembledProgram program;
+  program.text_buffer.push_back(0x00a00293); // addi x5, x0, 10
+  program.text_buffer.push_back(0x00550533); // add x10, x10, x5
+  program.text_buffer.push_back(0xfff28293); // addi x5, x5, -1
+  program.text_buffer.push_back(0xfe029ce3); // bne x5, x0, -8
+  program.text_buffer.push_back(0x00a02223); // sw x10, 4(x0)
+
+  vm_config::config.setInstructionExecutionLimit(1000);
+  RVSSVM reference;
+  RV5SVM pipelined;
+  reference.LoadProgram(program);
+  pipelined.LoadProgram(program);
+  reference.Run();
+  pipelined.Run();
+  ASSERT_EQ(pipelined.instructions_retired_, reference.instructions_retired_);
+  ASSERT_EQ(pipelined.registers_.GetGprValues(), reference.registers_.GetGprValues());
+  ASSERT_EQ(pipelined.memory_controller_.ReadWord(4), 55);
+  // Four cycles to fill, then one per instruction plus two per taken bne.
+  ASSERT_EQ(pipelined.branch_mispredictions_, 9);
+  ASSERT_EQ(pipelined.stall_cycles_, 0);
+  ASSERT_EQ(pipelined.cycle_s_, 4 + 32 + 2 * 9);
+
+  AssembledProgram load_use;
+  load_use.text_buffer.push_back(0x00003303); // ld x6, 0(x0)
+  load_use.text_buffer.push_back(0x006303b3); // add x7, x6, x6
+  RV5SVM forwarded;
+  forwarded.LoadProgram(load_use);
+  forwarded.Run();
+  ASSERT_EQ(forwarded.stall_cycles_, 1);
+  ASSERT_EQ(forwarded.registers_.ReadGpr(7), 2 * 0x006303b300003303ULL);
+
+  // Writes to x0 are neither forwarded nor waited for.
+  AssembledProgram zero_rd;
+  zero_rd.text_buffer.push_back(0x00500013); // addi x0, x0, 5
+  zero_rd.text_buffer.push_back(0x000003b3); // add x7, x0, x0
+  zero_rd.text_buffer.push_back(0x00003003); // ld x0, 0(x0)
+  zero_rd.text_buffer.push_back(0x00000433); // add x8, x0, x0
+  RV5SVM zero_forwarded;
+  zero_forwarded.registers_.WriteGpr(7, 1);
+  zero_forwarded.registers_.WriteGpr(8, 1);
+  zero_forwarded.LoadProgram(zero_rd);
+  zero_forwarded.Run();
+  ASSERT_EQ(zero_forwarded.registers_.ReadGpr(7), 0);
+  ASSERT_EQ(zero_forwarded.registers_.ReadGpr(8), 0);
+  ASSERT_EQ(zero_forwarded.stall_cycles_, 0);
+
+  vm_config::config.setForwarding(false);
+  RV5SVM stalled;
+  stalled.LoadProgram(load_use);
+  stalled.Run();
+  vm_config::config.setForwarding(true);
+  ASSERT_EQ(stalled.stall_cycles_, 2);
+  ASSERT_EQ(stalled.registers_.ReadGpr(7), forwarded.registers_.ReadGpr(7));
+
+  // Undo walks back one cycle at a time.
+  RV5SVM stepped;
+  stepped.LoadProgram(load_use);
+  for (int i = 0; i < 4; ++i) {
+    stepped.Step();
+  }
+  ASSERT_EQ(stepped.stall_cycles_, 1);
+  ASSERT_TRUE(stepped.latches_.mem_wb.valid);
+  stepped.Undo();
+  ASSERT_EQ(stepped.cycle_s_, 3);
+  ASSERT_FALSE(stepped.latches_.mem_wb.valid);
+  stepped.Redo();
+  ASSERT_EQ(stepped.cycle_s_, 4);
+  ASSERT_TRUE(stepped.latches_.mem_wb.valid);
+
+  // Counters past 32 bits come back whole on Undo.
+  RV5SVM wide;
+  wide.LoadProgram(load_use);
+  wide.cycle_s_ = 7000000000ULL;
+  wide.instructions_retired_ = 5000000000ULL;
+  wide.stall_cycles_ = 4300000000ULL;
+  wide.branch_predictions_ = 4400000000ULL;
+  wide.branch_mispredictions_ = 4500000000ULL;
+  wide.Step();
+  ASSERT_EQ(wide.cycle_s_, 7000000001ULL);
+  wide.Undo();
+  ASSERT_EQ(wide.cycle_s_, 7000000000ULL);
+  ASSERT_EQ(wide.instructions_retired_, 5000000000ULL);
+  ASSERT_EQ(wide.stall_cycles_, 4300000000ULL);
+  ASSERT_EQ(wide.branch_predictions_, 4400000000ULL);
+  ASSERT_EQ(wide.branch_mispredictions_, 4500000000ULL);
+}
+
+TEST(VmTest, Rv5sStatisticsKeepFflagsTest) {
+  ConfigGuard config_guard;
+  // cpi/ipc are host float divisions, their inexact flag must not reach the guest.
+  AssembledProgram program;
+  program.text_buffer.push_back(0x00700293); // addi x5, x0, 7
+  program.text_buffer.push_back(0x00300313); // addi x6, x0, 3
+  program.text_buffer.push_back(0x006283b3); // add x7, x5, x6
+
+  vm_config::config.setRunStepDelay(0);
+  RV5SVM run;
+  run.LoadProgram(program);
+  run.Run();
+  RV5SVM debug_run;
+  debug_run.LoadProgram(program);
+  debug_run.DebugRun();
+  ASSERT_EQ(run.registers_.ReadGpr(7), 10);
+  ASSERT_EQ(debug_run.registers_.ReadGpr(7), 10);
+  ASSERT_EQ(run.registers_.ReadCsr(0x001), 0);
+  ASSERT_EQ(debug_run.registers_.ReadCsr(0x001), 0);
+}
+
+TEST(VmTest, BranchPredictionTest) {
+  ConfigGuard config_guard;
+  AssembledProgram program;
+  program.text_buffer.push_back(0x00a00293); // addi x5, x0, 10
+  program.text_buffer.push_back(0x00550533); // add x10, x10, x5
+  program.text_buffer.push_back(0xfff28293); // addi x5, x5, -1
+  program.text_buffer.push_back(0xfe029ce3); // bne x5, x0, -8
+  program.text_buffer.push_back(0x00a02223); // sw x10, 4(x0)
+
+  vm_config::config.setInstructionExecutionLimit(1000);
+  vm_config::config.setBranchPredictorType(vm_config::BranchPredictorType::BTFN);
+  RV5SVM pipelined;
+  pipelined.LoadProgram(program);
+  pipelined.Run();
+  ASSERT_EQ(pipelined.memory_controller_.ReadWord(4), 55);
+  // Only the loop exit goes against backward-taken.
+  ASSERT_EQ(pipelined.branch_predictions_, 10);
+  ASSERT_EQ(pipelined.branch_mispredictions_, 1);
+  ASSERT_EQ(pipelined.cycle_s_, 4 + 32 + 2 * 1);
+
+  RVSSVM without_predictor;
+  without_predictor.LoadProgram(program);
+  ASSERT_EQ(without_predictor.branch_predictor_, nullptr);
+
+  vm_config::config.setBranchPredictorSingleStage(true);
+  RVSSThreadedVM predictor_only;
+  predictor_only.LoadProgram(program);
+  predictor_only.Run();
+  ASSERT_EQ(predictor_only.memory_controller_.ReadWord(4), 55);
+  ASSERT_EQ(predictor_only.branch_predictions_, 10);
+  ASSERT_EQ(predictor_only.branch_mispredictions_, 1);
+}
+
+TEST(VmTest, CacheTimingTest) {
+  ConfigGuard config_guard;
+  AssembledProgram program;
+  program.text_buffer.push_back(0x00a00293); // addi x5, x0, 10
+  program.text_buffer.push_back(0x00550533); // add x10, x10, x5
+  program.text_buffer.push_back(0xfff28293); // addi x5, x5, -1
+  program.text_buffer.push_back(0xfe029ce3); // bne x5, x0, -8
+  program.text_buffer.push_back(0x00a02223); // sw x10, 4(x0)
+
+  vm_config::CacheSettings cache;
+  cache.enabled = true;
+  vm_config::config.setInstructionCache(cache);
+  vm_config::config.setDataCache(cache);
+  vm_config::config.setInstructionExecutionLimit(1000);
+
+  // The whole text sits in one line: one cold fetch miss, and one miss for the store.
+  RVSSThreadedVM single;
+  single.LoadProgram(program);
+  single.Run();
+  ASSERT_EQ(single.memory_controller_.ReadWord(4), 55);
+  ASSERT_EQ(single.memory_controller_.GetInstructionCache()->GetStats().accesses, 32);
+  ASSERT_EQ(single.memory_controller_.GetInstructionCache()->GetStats().misses, 1);
+  ASSERT_EQ(single.memory_controller_.GetDataCache()->GetStats().misses, 1);
+  ASSERT_EQ(single.cycle_s_, 32 + 2 * cache.miss_penalty);
+
+  RVSSVM stepped;
+  stepped.LoadProgram(program);
+  stepped.Step();
+  ASSERT_EQ(stepped.cycle_s_, 1 + cache.miss_penalty);
+  stepped.Undo();
+  ASSERT_EQ(stepped.cycle_s_, 0);
+  stepped.Redo();
+  ASSERT_EQ(stepped.cycle_s_, 1 + cache.miss_penalty);
+
+  RV5SVM pipelined;
+  pipelined.LoadProgram(program);
+  pipelined.Run();
+  ASSERT_EQ(pipelined.memory_controller_.ReadWord(4), 55);
+  ASSERT_EQ(pipelined.cycle_s_, 4 + 32 + 18 + 2 * cache.miss_penalty);
+
+}
+
+TEST(VmTest, NonBlockingCacheTest) {
+  ConfigGuard config_guard;
+  AssembledProgram program;
+  program.text_buffer.push_back(0x00002283); // lw x5, 0(x0)
+  program.text_buffer.push_back(0x04002303); // lw x6, 64(x0)
+  program.text_buffer.push_back(0x08002383); // lw x7, 128(x0)
+  program.text_buffer.push_back(0x00628433); // add x8, x5, x6
+
+  vm_config::CacheSettings cache;
+  cache.enabled = true;
+  vm_config::config.setDataCache(cache);
+  vm_config::config.setInstructionExecutionLimit(1000);
+  auto cycles = [&program](uint64_t mshrs) {
+    vm_config::config.setCacheMshrs(mshrs);
+    RV5SVM pipelined;
+    pipelined.LoadProgram(program);
+    pipelined.Run();
+    EXPECT_EQ(pipelined.registers_.ReadGpr(8), 0x00002283); // x6 loads the zeros past the text
+    return pipelined.cycle_s_;
+  };
+  const unsigned int blocking = cycles(0);
+  const unsigned int one_mshr = cycles(1);
+  const unsigned int four_mshrs = cycles(4);
+  // Blocking, each miss freezes the pipeline. With one MSHR, each load after the first waits
+  // for the one before it to arrive. With four, the misses overlap and only the add waits, in ID.
+  ASSERT_EQ(blocking, 4 + 4 + 3 * cache.miss_penalty);
+  ASSERT_EQ(one_mshr, 4 + 4 + 2 * cache.miss_penalty);
+  ASSERT_EQ(four_mshrs, 4 + 4 + cache.miss_penalty);
+
+}